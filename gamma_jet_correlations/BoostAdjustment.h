@@ -0,0 +1,53 @@
+// eta-boosting adjustment for p-Pb, to convert from the p-Pb center of mass frame to the lab frame, of the clusters selected by
+// GammaJet.cc and histogramcombiner/purity_fit.cc, so that both select the same clusters (|eta - boost_adj| < Cluster_Eta_max)
+// WARNING: the adjustment is only made for the files listed here (13d, 13e, 17g6a1 in the same direction, 13f reversed). If you
+// want to use any other pPb samples, you need to add them manually
+// Author: Ivan Chernyshev
+
+#ifndef BOOSTADJUSTMENT_H
+#define BOOSTADJUSTMENT_H
+
+#include <string>
+
+inline double boost_adjustment(const std::string& filename){
+    // 13d and 13e, and 17g6a1 (same direction as 13d and 13e)
+    const char* forward[] = {
+        "/project/projectdirs/alice/NTuples/pPb/13d/13d.root",
+        "/project/projectdirs/alice/NTuples/pPb/13e/13e.root",
+        "/project/projectdirs/alice/NTuples/pPb/13d/13d_Mixing/13d_0GeVTrack_paired.root",
+        "/project/projectdirs/alice/NTuples/pPb/13e/13e_Mixing/13e_0GeVTrack_paired.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat1_ptmin12.0_Nevent_500000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat2_ptmin12.0_Nevent_500000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat3_ptmin12.0_Nevent_500000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat4_ptmin12.0_Nevent_500000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat5_ptmin12.0_Nevent_500000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat1_ptmin12.0_Nevent_300000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat2_ptmin12.0_Nevent_300000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat3_ptmin12.0_Nevent_300000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat4_ptmin12.0_Nevent_300000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat5_ptmin12.0_Nevent_300000.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat1.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat2.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat3.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat4.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat5.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat2_4L_allruns_ptmin15.0.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat3_4L_allruns_ptmin15.0.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat4_4L_allruns_ptmin15.0.root",
+        "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat5_4L_allruns_ptmin15.0.root",
+    };
+    // 13f (reversed)
+    const char* backward[] = {
+        "/project/projectdirs/alice/NTuples/pPb/13f/13f.root",
+        "/project/projectdirs/alice/NTuples/pPb/13f/13f_Mixing/13f_0GeVTrack_paired.root",
+    };
+    for (size_t i = 0; i < sizeof(forward)/sizeof(*forward); i++) {
+        if (filename == forward[i]) return -0.465;
+    }
+    for (size_t i = 0; i < sizeof(backward)/sizeof(*backward); i++) {
+        if (filename == backward[i]) return 0.465;
+    }
+    return 0;
+}
+
+#endif // BOOSTADJUSTMENT_H
@@ -0,0 +1,275 @@
+// Periodic checkpoints of the event loops of GammaJet.cc and mixed_cluster_jet.cc, so that a job killed on a preemptible queue
+// resumes where it stopped instead of starting over:
+//   --checkpoint <file>              write checkpoints to <file>, and resume from it if it exists
+//   --checkpoint-events <N>          every N events (default: only by time)
+//   --checkpoint-minutes <T>         every T minutes (default 10)
+// A checkpoint is a ROOT file with every registered histogram (contents, sums of weights squared and statistics, copied back
+// exactly) and a TObjString "checkpoint" holding the loop position and the registered counters (N_SR, N_BR, ...):
+//     fingerprint <hash of the arguments and configuration>   a checkpoint is only resumed by the same job
+//     file <index of the input file>
+//     entry <first entry of that file not yet processed>
+//     counter <name> <value>
+// It is written to <file>.tmp and renamed over <file>, so a job killed while writing leaves the previous checkpoint intact,
+// and removed once the outputs are written. The resumed job writes the same outputs as an uninterrupted one
+// Author: Ivan Chernyshev
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TObjString.h>
+#include <TDirectory.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "../general_tools/HistogramAlgebra.h"
+
+enum CheckpointCounterType {CHECKPOINT_INT, CHECKPOINT_FLOAT, CHECKPOINT_DOUBLE, CHECKPOINT_LONG64, CHECKPOINT_BOOL};
+
+struct CheckpointCounter {
+    std::string name;
+    CheckpointCounterType type;
+    void* value;
+};
+
+struct Checkpoint {
+    std::string path;               // "" if checkpoints are off
+    Long64_t every_events;          // 0: not by number of events
+    double every_minutes;
+    unsigned long long fingerprint;
+    std::vector<std::string> histogram_names;
+    std::vector<TH1*> histograms;
+    std::vector<CheckpointCounter> counters;
+    
+    Long64_t events_since;          // since the last checkpoint
+    time_t last_time;
+};
+
+// 64-bit FNV-1a, continued from hash
+inline unsigned long long checkpoint_hash(const std::string& s, unsigned long long hash){
+    for (size_t i = 0; i < s.size(); i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211ULL;
+    }
+    // Separate the fields, so that "ab" "c" and "a" "bc" differ
+    hash ^= 0xff;
+    return hash*1099511628211ULL;
+}
+
+inline Checkpoint checkpoint_none(){
+    Checkpoint checkpoint;
+    checkpoint.path = "";
+    checkpoint.every_events = 0;
+    checkpoint.every_minutes = 10;
+    checkpoint.fingerprint = 14695981039346656037ULL;
+    checkpoint.events_since = 0;
+    checkpoint.last_time = time(NULL);
+    return checkpoint;
+}
+
+// Parse the checkpoint option at argv[iarg], moving iarg to its last argument; false if argv[iarg] is not a checkpoint option
+inline bool checkpoint_option(Checkpoint& checkpoint, int& iarg, int argc, char *argv[]){
+    if (strcmp(argv[iarg], "--checkpoint") != 0 && strcmp(argv[iarg], "--checkpoint-events") != 0 && strcmp(argv[iarg], "--checkpoint-minutes") != 0) return false;
+    if (iarg + 1 >= argc) {
+        fprintf(stderr, "%s:%d: %s needs a value\n", __FILE__, __LINE__, argv[iarg]);
+        exit(EXIT_FAILURE);
+    }
+    const char* option = argv[iarg];
+    const char* value = argv[++iarg];
+    if (strcmp(option, "--checkpoint") == 0) checkpoint.path = value;
+    else if (strcmp(option, "--checkpoint-events") == 0) checkpoint.every_events = atoll(value);
+    else checkpoint.every_minutes = atof(value);
+    if (checkpoint.every_events < 0 || not(checkpoint.every_minutes > 0)) {
+        fprintf(stderr, "%s:%d: invalid checkpoint interval %s %s\n", __FILE__, __LINE__, option, value);
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+// Add an argument, or the contents of a file (e.g. the configuration), to what a resumed job must share with the checkpoint
+inline void checkpoint_fingerprint(Checkpoint& checkpoint, const std::string& text){
+    checkpoint.fingerprint = checkpoint_hash(text, checkpoint.fingerprint);
+}
+
+inline void checkpoint_fingerprint_file(Checkpoint& checkpoint, const char* filename){
+    std::ifstream file(filename);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    checkpoint_fingerprint(checkpoint, contents.str());
+}
+
+// Register the state that the event loop accumulates; names must be unique
+inline void checkpoint_histogram(Checkpoint& checkpoint, const std::string& name, TH1* hist){
+    checkpoint.histogram_names.push_back(name);
+    checkpoint.histograms.push_back(hist);
+}
+
+inline void checkpoint_counter(Checkpoint& checkpoint, const std::string& name, CheckpointCounterType type, void* value){
+    CheckpointCounter counter = {name, type, value};
+    checkpoint.counters.push_back(counter);
+}
+
+inline void checkpoint_counter(Checkpoint& checkpoint, const std::string& name, int* value){ checkpoint_counter(checkpoint, name, CHECKPOINT_INT, value); }
+inline void checkpoint_counter(Checkpoint& checkpoint, const std::string& name, float* value){ checkpoint_counter(checkpoint, name, CHECKPOINT_FLOAT, value); }
+inline void checkpoint_counter(Checkpoint& checkpoint, const std::string& name, double* value){ checkpoint_counter(checkpoint, name, CHECKPOINT_DOUBLE, value); }
+inline void checkpoint_counter(Checkpoint& checkpoint, const std::string& name, Long64_t* value){ checkpoint_counter(checkpoint, name, CHECKPOINT_LONG64, value); }
+inline void checkpoint_counter(Checkpoint& checkpoint, const std::string& name, bool* value){ checkpoint_counter(checkpoint, name, CHECKPOINT_BOOL, value); }
+
+// Every counter type converts to double and back exactly (Long64_t up to 2^53)
+inline double checkpoint_counter_value(const CheckpointCounter& counter){
+    if (counter.type == CHECKPOINT_INT) return *(int*)counter.value;
+    if (counter.type == CHECKPOINT_FLOAT) return *(float*)counter.value;
+    if (counter.type == CHECKPOINT_DOUBLE) return *(double*)counter.value;
+    if (counter.type == CHECKPOINT_LONG64) return *(Long64_t*)counter.value;
+    return *(bool*)counter.value ? 1 : 0;
+}
+
+inline void checkpoint_set_counter(const CheckpointCounter& counter, double value){
+    if (counter.type == CHECKPOINT_INT) *(int*)counter.value = (int)value;
+    else if (counter.type == CHECKPOINT_FLOAT) *(float*)counter.value = (float)value;
+    else if (counter.type == CHECKPOINT_DOUBLE) *(double*)counter.value = value;
+    else if (counter.type == CHECKPOINT_LONG64) *(Long64_t*)counter.value = (Long64_t)value;
+    else *(bool*)counter.value = value != 0;
+}
+
+// hist = saved, bin arrays and statistics included, leaving the name, title, axis labels and directory of hist alone
+inline void checkpoint_copy_histogram(TH1* hist, const TH1* saved){
+    hist_check_compatible(hist, saved);
+    const int ncells = hist->GetNcells();
+    std::copy(hist_content(saved), hist_content(saved) + ncells, hist_content(hist));
+    if (hist_sumw2(saved) != NULL) std::copy(hist_sumw2(saved), hist_sumw2(saved) + ncells, hist_sumw2_result(hist));
+    double stats[TH1::kNstat];
+    saved->GetStats(stats);
+    hist->PutStats(stats);
+    hist->SetEntries(saved->GetEntries());
+}
+
+// Once per event, before processing it: whether a checkpoint is due
+inline bool checkpoint_due(Checkpoint& checkpoint){
+    if (checkpoint.path.empty()) return false;
+    checkpoint.events_since++;
+    if (checkpoint.every_events > 0 && checkpoint.events_since >= checkpoint.every_events) return true;
+    // The clock is only read every 1000 events
+    return checkpoint.events_since % 1000 == 0 && difftime(time(NULL), checkpoint.last_time) >= 60*checkpoint.every_minutes;
+}
+
+// Write the registered state; file and entry are the position of the next event to process
+inline void checkpoint_write(Checkpoint& checkpoint, long file, Long64_t entry){
+    std::ostringstream text;
+    text.precision(17);
+    text << "fingerprint " << checkpoint.fingerprint << "\n";
+    text << "file " << file << "\n";
+    text << "entry " << entry << "\n";
+    for (size_t i = 0; i < checkpoint.counters.size(); i++)
+        text << "counter " << checkpoint.counters[i].name << " " << checkpoint_counter_value(checkpoint.counters[i]) << "\n";
+    
+    TDirectory* previous = gDirectory;
+    const std::string temporary = checkpoint.path + ".tmp";
+    TFile* fout = TFile::Open(temporary.c_str(), "RECREATE");
+    if (fout == NULL || fout->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot create the checkpoint %s\n", __FILE__, __LINE__, temporary.c_str());
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < checkpoint.histograms.size(); i++)
+        checkpoint.histograms[i]->Write(checkpoint.histogram_names[i].c_str());
+    TObjString state(text.str().c_str());
+    state.Write("checkpoint");
+    fout->Close();
+    delete fout;
+    if (previous != NULL) previous->cd();
+    
+    if (rename(temporary.c_str(), checkpoint.path.c_str()) != 0) {
+        perror("rename");
+        exit(EXIT_FAILURE);
+    }
+    std::cout << " Checkpoint written at file " << file << ", entry " << entry << std::endl;
+    checkpoint.events_since = 0;
+    checkpoint.last_time = time(NULL);
+}
+
+// Restore the registered state from an existing checkpoint of the same job; false (file 0, entry 0) if there is none
+inline bool checkpoint_resume(Checkpoint& checkpoint, long& file, Long64_t& entry){
+    file = 0;
+    entry = 0;
+    if (checkpoint.path.empty() || access(checkpoint.path.c_str(), F_OK) != 0) return false;
+    
+    TDirectory* previous = gDirectory;
+    TFile* fin = TFile::Open(checkpoint.path.c_str(), "READ");
+    if (fin == NULL || fin->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot read the checkpoint %s\n", __FILE__, __LINE__, checkpoint.path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    TObjString* state = dynamic_cast<TObjString*>(fin->Get("checkpoint"));
+    if (state == NULL) {
+        fprintf(stderr, "%s:%d: %s is not a checkpoint\n", __FILE__, __LINE__, checkpoint.path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    std::istringstream text(state->GetString().Data());
+    delete state;
+    std::string line;
+    size_t ncounter = 0;
+    while (std::getline(text, line)) {
+        std::istringstream field(line);
+        std::string kind;
+        field >> kind;
+        if (kind == "fingerprint") {
+            unsigned long long fingerprint = 0;
+            field >> fingerprint;
+            if (fingerprint != checkpoint.fingerprint) {
+                fprintf(stderr, "%s:%d: %s was written with other arguments or another configuration; remove it to start over\n", __FILE__, __LINE__, checkpoint.path.c_str());
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (kind == "file") field >> file;
+        else if (kind == "entry") field >> entry;
+        else if (kind == "counter") {
+            std::string name;
+            double value = 0;
+            field >> name >> value;
+            for (size_t i = 0; i < checkpoint.counters.size(); i++) {
+                if (checkpoint.counters[i].name != name) continue;
+                checkpoint_set_counter(checkpoint.counters[i], value);
+                ncounter++;
+            }
+        }
+    }
+    if (ncounter != checkpoint.counters.size()) {
+        fprintf(stderr, "%s:%d: %s does not hold every counter\n", __FILE__, __LINE__, checkpoint.path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < checkpoint.histograms.size(); i++) {
+        TH1* saved = dynamic_cast<TH1*>(fin->Get(checkpoint.histogram_names[i].c_str()));
+        if (saved == NULL) {
+            fprintf(stderr, "%s:%d: %s has no histogram %s\n", __FILE__, __LINE__, checkpoint.path.c_str(), checkpoint.histogram_names[i].c_str());
+            exit(EXIT_FAILURE);
+        }
+        checkpoint_copy_histogram(checkpoint.histograms[i], saved);
+        delete saved;
+    }
+    fin->Close();
+    delete fin;
+    if (previous != NULL) previous->cd();
+    
+    std::cout << " Resuming from the checkpoint " << checkpoint.path << " at file " << file << ", entry " << entry << std::endl;
+    checkpoint.last_time = time(NULL);
+    return true;
+}
+
+// The outputs are written: the checkpoint is not needed any more
+inline void checkpoint_remove(const Checkpoint& checkpoint){
+    if (!checkpoint.path.empty()) remove(checkpoint.path.c_str());
+}
+
+#endif // CHECKPOINT_H
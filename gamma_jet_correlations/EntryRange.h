@@ -0,0 +1,90 @@
+// Range of TTree entries processed by one job of GammaJet.cc or mixed_cluster_jet.cc, so that one sample can be split over a job array
+// The entries are numbered globally over the input files, in command-line order (the first entry of the second file comes right
+// after the last entry of the first one), and the range is given either explicitly or as a shard of the whole sample:
+//   --first-entry <first> --last-entry <last>    entries first to last, both included (either one may be left out)
+//   --shard <i>/<N>                               the i-th of N equal consecutive parts (i = 0, ..., N - 1), e.g. --shard ${SLURM_ARRAY_TASK_ID}/100
+// The outputs of a range get _SHARD_<i>_of_<N> or _ENTRIES_<first>_to_<last> in their names, so the jobs of an array do not
+// overwrite each other; run them with --unnormalized, and add the outputs up with merge_outputs
+// Author: Ivan Chernyshev
+
+#ifndef ENTRYRANGE_H
+#define ENTRYRANGE_H
+
+#include <TROOT.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+struct EntryRange {
+    Long64_t first;     // first global entry
+    Long64_t last;      // last global entry (included); -1: up to the last entry
+    long shard;
+    long nshard;        // 0 if the range is not a shard
+};
+
+inline EntryRange entry_range_all(){
+    EntryRange range = {0, -1, 0, 0};
+    return range;
+}
+
+// Whether any range option was given, i.e. whether the job only processes part of the sample
+inline bool entry_range_partial(const EntryRange& range){
+    return range.nshard > 0 || range.first > 0 || range.last >= 0;
+}
+
+// Parse the range option at argv[iarg], moving iarg to its last argument; false if argv[iarg] is not a range option
+inline bool entry_range_option(EntryRange& range, int& iarg, int argc, char *argv[]){
+    if (strcmp(argv[iarg], "--first-entry") != 0 && strcmp(argv[iarg], "--last-entry") != 0 && strcmp(argv[iarg], "--shard") != 0) return false;
+    if (iarg + 1 >= argc) {
+        fprintf(stderr, "%s:%d: %s needs a value\n", __FILE__, __LINE__, argv[iarg]);
+        exit(EXIT_FAILURE);
+    }
+    const char* option = argv[iarg];
+    const char* value = argv[++iarg];
+    if (strcmp(option, "--shard") == 0) {
+        if (sscanf(value, "%ld/%ld", &range.shard, &range.nshard) != 2 || range.nshard < 1 || range.shard < 0 || range.shard >= range.nshard) {
+            fprintf(stderr, "%s:%d: --shard needs <i>/<N> with 0 <= i < N, not %s\n", __FILE__, __LINE__, value);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (strcmp(option, "--first-entry") == 0) range.first = atoll(value);
+    else range.last = atoll(value);
+    if (range.nshard > 0 && (range.first > 0 || range.last >= 0)) {
+        fprintf(stderr, "%s:%d: --shard cannot be combined with --first-entry/--last-entry\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
+    if (range.first < 0 || (range.last >= 0 && range.last < range.first)) {
+        fprintf(stderr, "%s:%d: invalid entry range %lld to %lld\n", __FILE__, __LINE__, range.first, range.last);
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+// Turn a shard, or an open-ended range, into explicit entries, once the total number of entries of the sample is known
+inline void entry_range_resolve(EntryRange& range, Long64_t nentries){
+    if (range.nshard > 0) {
+        range.first = nentries*range.shard/range.nshard;
+        range.last = nentries*(range.shard + 1)/range.nshard - 1;
+    }
+    else if (range.last < 0 || range.last >= nentries) {
+        range.last = nentries - 1;
+    }
+}
+
+// The local entries [begin, end) of a file whose nentries entries start at the global entry offset; begin == end if none
+inline void entry_range_local(const EntryRange& range, Long64_t offset, Long64_t nentries, Long64_t& begin, Long64_t& end){
+    begin = std::min(std::max(range.first - offset, Long64_t(0)), nentries);
+    end = std::max(std::min(range.last + 1 - offset, nentries), begin);
+}
+
+// The output name tag of the range: "" for the whole sample
+inline std::string entry_range_tag(const EntryRange& range){
+    if (range.nshard > 0) return Form("_SHARD_%ld_of_%ld", range.shard, range.nshard);
+    if (!entry_range_partial(range)) return "";
+    return Form("_ENTRIES_%lld_to_%lld", range.first, range.last);
+}
+
+#endif // ENTRYRANGE_H
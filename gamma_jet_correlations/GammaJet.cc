@@ -1,5 +1,20 @@
 /**
    This program produces gamma-jet correlations of inputted data with resepect to dPhi, XobsPb (the Bjorken-x sensitive observable), Multiplicity, p_TD, and several other variables
+ With --unnormalized, the histograms are written as raw weighted counts with the normalization recorded next to them (see NormalizationMetadata.h),
+ so that the outputs of jobs run on parts of the data can be added up and normalized once by merge_outputs
+ With --shard <i>/<N> or --first-entry/--last-entry, only part of the events of the input files is correlated (see EntryRange.h)
+ With --write-weights <file>, only the background weights (hweight after the weight pass of each input file) are computed and written
+ to <file>; jobs on parts of the same input files given --weights <file> read them instead of each redoing the weight pass over every event
+ With --checkpoint <file>, the state of the event loop is saved periodically and a restarted job resumes from it (see Checkpoint.h)
+ With --batch, no graphics objects are created: instead of drawing hSR_dPhi every 10000 events, the event rate, read rate and time
+ left are printed every 10 seconds. With --snapshot <file>, the histograms filled so far are written to <file> every minute
+ With photon_idvar: DNN_local, the DNN score of each cluster is recomputed from the cell energies around its maximum cell by the network
+ of the file given by DNN_local_weights (see general_tools/ShowerNet.h), instead of being taken from cluster_s_nphoton. Likewise,
+ lambda_0_local and Emax_over_Ecluster_local recompute lambda0^2 and Emax from the cells of each cluster (see general_tools/ShowerShape.h),
+ and EcrossoverE_local: 1 takes the Ecross of the spiky-cluster cut from those cells instead of cluster_e_cross; only the clusters passing
+ the pT and eta cuts are recomputed
+ With Cluster_isolation_determinant: track_cone, the isolation is recomputed from the tracks of the event, in a cone of Isolation_cone_radius
+ with the tracks passing Isolation_track_mask (see general_tools/IsolationGrid.h), instead of being taken from the R = 0.4 cluster_iso_* values
  Note: there is currently a bug with many of the Monte-Carlo files, which I haven't fixed yet because I have not been using Monte-Carlo for a while
  Author: Ivan Chernyshev, February 2019
 */
@@ -13,36 +28,211 @@
 #include <TCanvas.h>
 #include <TStyle.h>
 #include <TH2D.h>
-#include <THStack.h>
 #include <TProfile.h>
+#include <TNamed.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <TGraphAsymmErrors.h>
 
 #define NTRACK_MAX (1U << 15)
 
 #include <vector>
 #include <math.h>
-#include <set>
+#include <ctime>
+#include "NormalizationMetadata.h"
+#include "EntryRange.h"
+#include "Checkpoint.h"
+#include "BoostAdjustment.h"
+#include "../general_tools/TruthIndex.h"
+#include "../general_tools/ShowerNet.h"
+#include "../general_tools/ShowerShape.h"
+#include "../general_tools/IsolationGrid.h"
 
 const int MAX_INPUT_LENGTH = 200;
 
 // Energy of lead, in GeV
 const double EPb = 1560;
 
-enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_04_02, CLUSTER_FRIXIONE_ITS_04_02};
-enum photon_IDVARS {LAMBDA_0, DNN, EMAX_OVER_ECLUSTER};
+enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_04_02, CLUSTER_FRIXIONE_ITS_04_02, TRACK_CONE};
+enum photon_IDVARS {LAMBDA_0, DNN, EMAX_OVER_ECLUSTER, DNN_LOCAL, LAMBDA_0_LOCAL, EMAX_OVER_ECLUSTER_LOCAL};
 
 // Function to calculate the bin width of a TH1 graph
 double calculatebinwidth(int numofbins, double binmin, double binmax){
     return (binmax - binmin)/numofbins;
 }
 
+// Number of entries of the _tree_event of a file (directly in the file or in AliAnalysisTaskNTGJ), for the global entry numbering
+Long64_t event_tree_entries(const std::string& filestring){
+    TFile *file = TFile::Open((TString)filestring);
+    if (file == NULL) {
+        fprintf(stderr, "%s:%d: cannot open %s\n", __FILE__, __LINE__, filestring.c_str());
+        exit(EXIT_FAILURE);
+    }
+    TTree *_tree_event = dynamic_cast<TTree *> (file->Get("_tree_event"));
+    if (_tree_event == NULL && dynamic_cast<TDirectoryFile *> (file->Get("AliAnalysisTaskNTGJ")) != NULL) {
+        _tree_event = dynamic_cast<TTree *> (dynamic_cast<TDirectoryFile *> (file->Get("AliAnalysisTaskNTGJ"))->Get("_tree_event"));
+    }
+    if (_tree_event == NULL) {
+        fprintf(stderr, "%s:%d: %s has no _tree_event\n", __FILE__, __LINE__, filestring.c_str());
+        exit(EXIT_FAILURE);
+    }
+    const Long64_t nentries = _tree_event->GetEntries();
+    file->Close();
+    delete file;
+    return nentries;
+}
+
+// Batch-mode progress of the main loop over one file: rates since the loop over the file started, and the time left for the file
+void report_progress(size_t ifile, size_t nfile, Long64_t ievent, Long64_t first_event, Long64_t last_event, double seconds, double bytes){
+    const double rate = seconds > 0 ? (ievent - first_event)/seconds : 0;
+    const long eta = rate > 0 ? long((last_event - ievent)/rate) : -1;
+    std::cout << Form(" file %lu/%lu, event %lld of %lld: %.0f events/s, %.1f MB/s, ", ifile + 1, nfile, ievent, last_event, rate, seconds > 0 ? bytes/(1e6*seconds) : 0.0);
+    if (eta >= 0) std::cout << Form("%ldh%02ldm%02lds left in this file", eta/3600, (eta/60)%60, eta%60) << std::endl;
+    else std::cout << "time left unknown" << std::endl;
+}
+
+// Write the histograms filled so far to a file that a viewer (e.g. a TBrowser) can open while the job runs
+// Written to <path>.tmp and renamed, so the viewer never opens a half-written snapshot
+void write_snapshot(const std::string& path, const std::vector<TH1*>& histograms){
+    TDirectory* previous = gDirectory;
+    const std::string temporary = path + ".tmp";
+    TFile* fsnapshot = TFile::Open(temporary.c_str(), "RECREATE");
+    if (fsnapshot == NULL || fsnapshot->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot create the snapshot %s\n", __FILE__, __LINE__, temporary.c_str());
+        return;
+    }
+    for (size_t ihist = 0; ihist < histograms.size(); ihist++) histograms[ihist]->Write(histograms[ihist]->GetName());
+    fsnapshot->Close();
+    delete fsnapshot;
+    if (previous != NULL) previous->cd();
+    if (rename(temporary.c_str(), path.c_str()) != 0) perror("rename");
+}
+
+// Indices of the clusters passing the pT and eta cuts, the only ones whose shower shape is recomputed
+void kinematic_clusters(std::vector<int>& selected, ULong64_t ncluster, const Float_t* cluster_pt, const Float_t* cluster_eta, double pt_min, double pt_max, double eta_max, double boost_adj){
+    selected.clear();
+    for (ULong64_t n = 0; n < ncluster; n++) {
+        if (cluster_pt[n] > pt_min && cluster_pt[n] < pt_max && TMath::Abs(cluster_eta[n] - boost_adj) < eta_max) selected.push_back(n);
+    }
+}
+
+// The input files and configuration that the background weights are computed for; a --weights file is only read by jobs with the same
+std::string weights_description(const std::vector<std::string>& input_files){
+    std::stringstream description;
+    for (size_t iarg = 0; iarg < input_files.size(); iarg++) description << input_files[iarg] << std::endl;
+    std::ifstream config("GammaJet_config.yaml");
+    if (config) description << config.rdbuf();
+    return description.str();
+}
+
+// Write the background weights of a --write-weights job, hweight_<i> for the i-th input file, with the description they were computed for
+void write_weights(const std::string& path, const std::vector<TH1D*>& weights, const std::string& description){
+    TDirectory* previous = gDirectory;
+    TFile* fweights = TFile::Open(path.c_str(), "RECREATE");
+    if (fweights == NULL || fweights->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    for (size_t iarg = 0; iarg < weights.size(); iarg++) weights[iarg]->Write(Form("hweight_%lu", iarg));
+    TNamed("weights_description", description.c_str()).Write("weights_description");
+    fweights->Close();
+    delete fweights;
+    if (previous != NULL) previous->cd();
+}
+
+// Read the background weights of nfile input files written by write_weights, detached from the file
+std::vector<TH1D*> read_weights(const std::string& path, size_t nfile, const std::string& description){
+    TDirectory* previous = gDirectory;
+    TFile* fweights = TFile::Open(path.c_str(), "READ");
+    if (fweights == NULL || fweights->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot open %s\n", __FILE__, __LINE__, path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    TNamed* stored = dynamic_cast<TNamed*>(fweights->Get("weights_description"));
+    if (stored == NULL || description != stored->GetTitle()) {
+        fprintf(stderr, "%s:%d: %s was not written by --write-weights with the same input files and GammaJet_config.yaml\n", __FILE__, __LINE__, path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    std::vector<TH1D*> weights;
+    for (size_t iarg = 0; iarg < nfile; iarg++) {
+        TH1D* hist = dynamic_cast<TH1D*>(fweights->Get(Form("hweight_%lu", iarg)));
+        if (hist == NULL) {
+            fprintf(stderr, "%s:%d: %s has no hweight_%lu\n", __FILE__, __LINE__, path.c_str(), iarg);
+            exit(EXIT_FAILURE);
+        }
+        hist->SetDirectory(0);
+        weights.push_back(hist);
+    }
+    fweights->Close();
+    delete fweights;
+    if (previous != NULL) previous->cd();
+    return weights;
+}
+
 int main(int argc, char *argv[])
 {
   if (argc < 2) {
+    fprintf(stderr, "Syntax is [--unnormalized] [--batch] [--snapshot <file>] [--shard <i>/<N> | --first-entry <entry> --last-entry <entry>] [--checkpoint <file> [--checkpoint-events <N>] [--checkpoint-minutes <T>]] [--write-weights <file> | --weights <file>] [input ROOT files] ...\n");
     exit(EXIT_FAILURE);
   }
+    
+    // Options start with --, everything else is an input file
+    bool unnormalized = false;
+    EntryRange entry_range = entry_range_all();
+    Checkpoint checkpoint = checkpoint_none();
+    bool batch = false;
+    std::string snapshot_file = "";
+    std::string write_weights_file = "";
+    std::string weights_file = "";
+    std::vector<std::string> input_files;
+    for (int iarg = 1; iarg < argc; iarg++) {
+        // Batch mode, the snapshots and the checkpoint interval may change between restarts; every other argument must stay the same
+        if (strcmp(argv[iarg], "--batch") == 0) {
+            batch = true;
+            continue;
+        }
+        if (strcmp(argv[iarg], "--snapshot") == 0 && iarg + 1 < argc) {
+            snapshot_file = argv[++iarg];
+            continue;
+        }
+        if (checkpoint_option(checkpoint, iarg, argc, argv)) continue;
+        checkpoint_fingerprint(checkpoint, argv[iarg]);
+        if (entry_range_option(entry_range, iarg, argc, argv)) {
+            checkpoint_fingerprint(checkpoint, argv[iarg]);
+            continue;
+        }
+        if (strcmp(argv[iarg], "--write-weights") == 0 && iarg + 1 < argc) {
+            write_weights_file = argv[++iarg];
+            continue;
+        }
+        if (strcmp(argv[iarg], "--weights") == 0 && iarg + 1 < argc) {
+            weights_file = argv[++iarg];
+            checkpoint_fingerprint(checkpoint, argv[iarg]);
+            continue;
+        }
+        if (strcmp(argv[iarg], "--unnormalized") == 0) {
+            unnormalized = true;
+        }
+        else if (strncmp(argv[iarg], "--", 2) == 0) {
+            fprintf(stderr, "%s:%d: unrecognized option %s\n", __FILE__, __LINE__, argv[iarg]);
+            exit(EXIT_FAILURE);
+        }
+        else {
+            input_files.push_back(argv[iarg]);
+        }
+    }
+    if (input_files.empty()) {
+        fprintf(stderr, "%s:%d: no input files\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
+    // The weights are those of every entry of the input files, computed in one pass that is not checkpointed
+    if (!write_weights_file.empty() && (!weights_file.empty() || entry_range_partial(entry_range) || !checkpoint.path.empty())) {
+        fprintf(stderr, "%s:%d: --write-weights cannot be combined with --weights, an entry range or --checkpoint\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
+    // Raw counts are added up before the normalization, so every histogram needs its sum of weights squared
+    if (unnormalized) TH1::SetDefaultSumw2(kTRUE);
 
     // Read configuration file for various variables used for cutting
     FILE* config = fopen("GammaJet_config.yaml", "r"); //Config file to be read
@@ -71,6 +261,7 @@ int main(int argc, char *argv[])
     double Cluster_locmaxima_max = 2.0;
     double Cluster_distobadchannel = 2.0;
     double EcrossoverE_min = 0.05;
+    bool EcrossoverE_local = false; // Ecross of the spiky-cluster cut recomputed from the cells (see general_tools/ShowerShape.h)
     
     // The bounds for the events to fal/ into the isolation and nonisolation areas
     double iso_max = 1.0;
@@ -87,7 +278,12 @@ int main(int argc, char *argv[])
     
     // Which variable should be used to determine whether a cluster should fall into iso, noniso, or neither
     isolationDet determiner = CLUSTER_ISO_ITS_04;
+    // Cone and tracks of the track_cone isolation
+    double isolation_cone_radius = 0.4;
+    unsigned int isolation_track_mask = 16;
+    double isolation_track_pt_min = 0.15;
     photon_IDVARS photon_identifier = LAMBDA_0; // Which variable should be used to determine which shower shape variable (DNN, Lambda0, Emax/Ecluster) should be used
+    std::string shower_net_weights = "shower_net.txt"; // Network of the DNN_local photon selection
     
     // Truth cuts
     int rightpdgcode = 22;
@@ -218,6 +414,10 @@ int main(int argc, char *argv[])
             EcrossoverE_min = atof(value);
             std::cout << "EcrossoverE_min is " << EcrossoverE_min << std::endl;
         }
+        else if (strcmp(key, "EcrossoverE_local") == 0) {
+            EcrossoverE_local = atoi(value) != 0;
+            std::cout << "EcrossoverE_local is " << EcrossoverE_local << std::endl;
+        }
         else if (strcmp(key, "iso_max") == 0) {
             iso_max = atof(value);
             std::cout << "iso_max is " << iso_max << std::endl;
@@ -259,11 +459,27 @@ int main(int argc, char *argv[])
                 photon_identifier = EMAX_OVER_ECLUSTER;
                 std::cout << "#frac{E_{max}}{E_{cluster}} will determine photon selection" << std::endl;
             }
+            else if (strcmp(value, "DNN_local") == 0){
+                photon_identifier = DNN_LOCAL;
+                std::cout << "Deep Neural Net, recomputed from the cell energies, will determine photon selection" << std::endl;
+            }
+            else if (strcmp(value, "lambda_0_local") == 0){
+                photon_identifier = LAMBDA_0_LOCAL;
+                std::cout << "lambda_0, recomputed from the cell energies, will determine photon selection" << std::endl;
+            }
+            else if (strcmp(value, "Emax_over_Ecluster_local") == 0){
+                photon_identifier = EMAX_OVER_ECLUSTER_LOCAL;
+                std::cout << "#frac{E_{max}}{E_{cluster}}, recomputed from the cell energies, will determine photon selection" << std::endl;
+            }
             else {
-                std::cout << "ERROR: Photon selection determinant in configuration file must be \"lambda_0\", \"DNN\", or \"Emax_over_Ecluster\"" << std::endl << "Aborting the program" << std::endl;
+                std::cout << "ERROR: Photon selection determinant in configuration file must be \"lambda_0\", \"DNN\", \"Emax_over_Ecluster\", \"DNN_local\", \"lambda_0_local\", or \"Emax_over_Ecluster_local\"" << std::endl << "Aborting the program" << std::endl;
                 exit(EXIT_FAILURE);
             }
         }
+        else if (strcmp(key, "DNN_local_weights") == 0) {
+            shower_net_weights = value;
+            std::cout << "DNN_local network file: " << shower_net_weights << std::endl;
+        }
         else if (strcmp(key, "Cluster_isolation_determinant") == 0) {
             if (strcmp(value, "cluster_iso_tpc_04") == 0){
                 determiner = CLUSTER_ISO_TPC_04;
@@ -281,11 +497,27 @@ int main(int argc, char *argv[])
                 determiner = CLUSTER_FRIXIONE_ITS_04_02;
                 std::cout << "cluster_frixione_its_04_02 will determine the isolation and non-isolation placement" << std::endl;
             }
+            else if (strcmp(value, "track_cone") == 0){
+                determiner = TRACK_CONE;
+                std::cout << "track_cone will determine the isolation and non-isolation placement" << std::endl;
+            }
             else {
-                std::cout << "ERROR: Cluster_isolation_determinant in configuration file must be \"cluster_iso_tpc_04\", \"cluster_iso_its_04\", \"cluster_frixione_tpc_04_02\", or \"cluster_frixione_its_04_02\"" << std::endl << "Aborting the program" << std::endl;
+                std::cout << "ERROR: Cluster_isolation_determinant in configuration file must be \"cluster_iso_tpc_04\", \"cluster_iso_its_04\", \"cluster_frixione_tpc_04_02\", \"cluster_frixione_its_04_02\", or \"track_cone\"" << std::endl << "Aborting the program" << std::endl;
                 exit(EXIT_FAILURE);
             }
         }
+        else if (strcmp(key, "Isolation_cone_radius") == 0) {
+            isolation_cone_radius = atof(value);
+            std::cout << "Isolation_cone_radius: " << isolation_cone_radius << std::endl;
+        }
+        else if (strcmp(key, "Isolation_track_mask") == 0) {
+            isolation_track_mask = strtoul(value, NULL, 0);
+            std::cout << "Isolation_track_mask: " << isolation_track_mask << std::endl;
+        }
+        else if (strcmp(key, "Isolation_track_pt_min") == 0) {
+            isolation_track_pt_min = atof(value);
+            std::cout << "Isolation_track_pt_min: " << isolation_track_pt_min << std::endl;
+        }
         else if (strcmp(key, "pdg_code") == 0) {
             rightpdgcode = atoi(value);
             std::cout << "Right pdg_code: " << rightpdgcode << std::endl;
@@ -303,6 +535,32 @@ int main(int argc, char *argv[])
         }
     }
     fclose(config);
+    checkpoint_fingerprint_file(checkpoint, "GammaJet_config.yaml");
+    // The background weights of every input file, from a --write-weights job on the same input files and configuration
+    std::vector<TH1D*> stored_weights;
+    if (!weights_file.empty()) {
+        stored_weights = read_weights(weights_file, input_files.size(), weights_description(input_files));
+        checkpoint_fingerprint_file(checkpoint, weights_file.c_str());
+    }
+    // The network of DNN_local, read once; a resumed job must use the same one
+    ShowerNet shower_net;
+    const EMCalGeometry emcal = emcal_geometry();
+    ShowerNetWork shower_net_work;
+    // The cells of the clusters passing the pT and eta cuts, for lambda_0_local, Emax_over_Ecluster_local and EcrossoverE_local
+    const bool recompute_shower_shape = photon_identifier == LAMBDA_0_LOCAL || photon_identifier == EMAX_OVER_ECLUSTER_LOCAL || EcrossoverE_local;
+    std::vector<int> shower_shape_clusters;
+    const ShowerShapeParameters shower_shape_cuts = shower_shape_parameters();
+    ShowerShapeWork shower_shape_scratch = shower_shape_work();
+    // The tracks of each event sorted for the track_cone isolation, over the |eta| < 0.9 of the tracks
+    IsolationGrid isolation_tracks = isolation_grid(0.9, 0.05, isolation_track_pt_min, &isolation_track_mask, 1);
+    if (determiner == TRACK_CONE && !(isolation_cone_radius > 0 && isolation_cone_radius < TMath::Pi())) {
+        std::cout << "ERROR: Isolation_cone_radius must be between 0 and pi" << std::endl << "Aborting the program" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (photon_identifier == DNN_LOCAL) {
+        shower_net = shower_net_read(shower_net_weights.c_str());
+        checkpoint_fingerprint_file(checkpoint, shower_net_weights.c_str());
+    }
     /**
      End config-file reading mechanism
      */
@@ -316,7 +574,9 @@ int main(int argc, char *argv[])
   std::cout << "minimum pt jet " << jet_pT_min<< std::endl;
 
   dummyv[0] = strdup("main");
-  TApplication application("", &dummyc, dummyv);    
+  // The live drawing needs an application and a canvas; batch mode creates no graphics objects at all
+  TApplication* application = NULL;
+  if (!batch) application = new TApplication("", &dummyc, dummyv);
   std::cout <<" Number of arguments " << argc << std::endl; 
 
     // These are all of the histograms that are produced by this program
@@ -586,7 +846,9 @@ int main(int argc, char *argv[])
   h_Xj_truth.SetTitle("; X_{j}^{true} ; counts");
 
     
-  TCanvas* canvas = new TCanvas();
+  TCanvas* canvas = NULL;
+  if (!batch) canvas = new TCanvas();
+  h_truth.SetLineColor(2);
   Float_t N_SR = 0; //float because it might be weighted in MC
   Float_t N_BR = 0;
   Float_t N_eventpassed = 0;
@@ -601,29 +863,53 @@ int main(int argc, char *argv[])
     int num_bkg_XobsPb = 0;
  
   Bool_t isRealData = true;
-  for (int iarg = 1; iarg < argc; iarg++) { // Loop over files
-      std::string filestring = (std::string)argv[iarg];
-    std::cout << "Opening: " << (TString)argv[iarg] << std::endl;
-    TFile *file = TFile::Open((TString)argv[iarg]);
-    
-    // eta-boosting adjustment for p-Pb (to convert from p-Pb center of mass frame to the lab frame)
-    // WARNING: boosting adjustment is only made for the 13d.root, 13e.root, 13f.root, 13d_0GeVTrack_paired.root, 13e_0GeVTrack_paired.root, and 13f_0GeVTrack_paired.root
-      // If you want to use any other pPb samples, you need to add them manually.
-    double boost_adj = 0;
+    // With --write-weights, hweight after the weight pass of each file
+    std::vector<TH1D*> file_weights;
+    // Entries of every file, capped by Num_events, numbered globally in the order of the files; only needed to split the sample
+    std::vector<Long64_t> file_entries(input_files.size(), 0);
+    if (entry_range_partial(entry_range)) {
+        Long64_t total_entries = 0;
+        for (size_t iarg = 0; iarg < input_files.size(); iarg++) {
+            file_entries[iarg] = event_tree_entries(input_files[iarg]);
+            if (nevents > 0) file_entries[iarg] = std::min(file_entries[iarg], Long64_t(nevents));
+            total_entries += file_entries[iarg];
+        }
+        entry_range_resolve(entry_range, total_entries);
+        std::cout << " Correlating the entries " << entry_range.first << " to " << entry_range.last << " of " << total_entries << std::endl;
+    }
+    Long64_t file_offset = 0;
     
-    // 13d and 13e
-    if((filestring == "/project/projectdirs/alice/NTuples/pPb/13d/13d.root") || (filestring == "/project/projectdirs/alice/NTuples/pPb/13e/13e.root") || (filestring == "/project/projectdirs/alice/NTuples/pPb/13d/13d_Mixing/13d_0GeVTrack_paired.root") || (filestring == "/project/projectdirs/alice/NTuples/pPb/13e/13e_Mixing/13e_0GeVTrack_paired.root")) {
-        boost_adj = -0.465;
+    // Everything the event loops accumulate: every histogram (all declared above, in gROOT) and the counters
+    TIter next_histogram(gROOT->GetList());
+    while (TObject* object = next_histogram()) {
+        TH1* hist = dynamic_cast<TH1*>(object);
+        if (hist != NULL) checkpoint_histogram(checkpoint, hist->GetName(), hist);
     }
-      // 17g6a1 (same direction as 13d and 13e)
-      if( (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat1_ptmin12.0_Nevent_500000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat2_ptmin12.0_Nevent_500000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat3_ptmin12.0_Nevent_500000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat4_ptmin12.0_Nevent_500000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat5_ptmin12.0_Nevent_500000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat1_ptmin12.0_Nevent_300000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat2_ptmin12.0_Nevent_300000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat3_ptmin12.0_Nevent_300000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat4_ptmin12.0_Nevent_300000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat5_ptmin12.0_Nevent_300000.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat1.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat2.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat3.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat4.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/17g6a1_pthat5.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat2_4L_allruns_ptmin15.0.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat3_4L_allruns_ptmin15.0.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat4_4L_allruns_ptmin15.0.root") || (filestring == "/project/projectdirs/alice/NTuples/MC/17g6a1/Skimmed_17g6a1_pthat5_4L_allruns_ptmin15.0.root")) {
-          boost_adj = -0.465;
+    checkpoint_counter(checkpoint, "N_SR", &N_SR);
+    checkpoint_counter(checkpoint, "N_BR", &N_BR);
+    checkpoint_counter(checkpoint, "N_eventpassed", &N_eventpassed);
+    checkpoint_counter(checkpoint, "N_truth", &N_truth);
+    checkpoint_counter(checkpoint, "num_sig_dPhi", &num_sig_dPhi);
+    checkpoint_counter(checkpoint, "num_bkg_dPhi", &num_bkg_dPhi);
+    checkpoint_counter(checkpoint, "num_sig_XobsPb", &num_sig_XobsPb);
+    checkpoint_counter(checkpoint, "num_bkg_XobsPb", &num_bkg_XobsPb);
+    long resume_file;
+    Long64_t resume_entry;
+    const bool resumed = checkpoint_resume(checkpoint, resume_file, resume_entry);
+  for (size_t iarg = 0; iarg < input_files.size(); iarg++) { // Loop over files
+      // Files before the checkpoint are already in the restored histograms
+      if (resumed && long(iarg) < resume_file) {
+          file_offset += file_entries[iarg];
+          continue;
       }
-      
-    // 13f (reversed)
-    if((filestring == "/project/projectdirs/alice/NTuples/pPb/13f/13f.root") || (filestring == "/project/projectdirs/alice/NTuples/pPb/13f/13f_Mixing/13f_0GeVTrack_paired.root")) {
-        boost_adj = 0.465;
-    }
+      // The checkpoint was written in the main loop of this file, after its background weights were computed
+      const bool resuming_file = resumed && long(iarg) == resume_file;
+      std::string filestring = input_files[iarg];
+    std::cout << "Opening: " << (TString)filestring << std::endl;
+    TFile *file = TFile::Open((TString)filestring);
+    
+    // eta-boosting adjustment for p-Pb (to convert from p-Pb center of mass frame to the lab frame), see BoostAdjustment.h
+    double boost_adj = boost_adjustment(filestring);
       std::cout << "\nBoost adjustment is " << boost_adj << " in eta\n";
     
     if (file == NULL) {
@@ -694,6 +980,8 @@ int main(int argc, char *argv[])
     UShort_t  cluster_cell_id_max[NTRACK_MAX];
     Float_t cluster_lambda_square[NTRACK_MAX][2];
     Float_t cell_e[17664];
+    Float_t cluster_s_nphoton_local[NTRACK_MAX]; // DNN_local score
+    std::vector<ShowerShape> cluster_shower_shape(NTRACK_MAX); // lambda_0_local, Emax_over_Ecluster_local and EcrossoverE_local
 
     //Jets reco 
     UInt_t njet_ak04its;
@@ -733,6 +1021,8 @@ int main(int argc, char *argv[])
     short mc_truth_first_parent_pdg_code[NTRACK_MAX];
     char mc_truth_charge[NTRACK_MAX];
     UChar_t mc_truth_status[NTRACK_MAX];
+    // Truth classes of the particles and truth matches of the clusters, rebuilt every event
+    TruthIndex truth = truth_index(NTRACK_MAX, rightpdgcode, rightparentpdgcode);
         
     Float_t mc_truth_first_parent_e[NTRACK_MAX];
     Float_t mc_truth_first_parent_pt[NTRACK_MAX];
@@ -829,26 +1119,63 @@ int main(int argc, char *argv[])
  
     std::cout<<" About to start looping over events to get weights" << std::endl;
 
-    if( not(nevents>0)){ // Get the number events
-      nevents = _tree_event->GetEntries();
+    // Get the number events of this file: every entry, or the first Num_events
+    Long64_t nevents_file = _tree_event->GetEntries();
+    if (nevents > 0) nevents_file = std::min(nevents_file, Long64_t(nevents));
+    
+    // The entries of this file inside the entry range; the background weights still use every entry, as in a single job (unless they
+    // are read with --weights)
+    Long64_t first_event = 0;
+    Long64_t last_event = nevents_file;
+    if (entry_range_partial(entry_range)) {
+        entry_range_local(entry_range, file_offset, nevents_file, first_event, last_event);
+        std::cout << " Correlating the entries " << first_event << " to " << last_event - 1 << " of this file" << std::endl;
+    }
+    file_offset += nevents_file;
+    if (resuming_file) first_event = std::max(first_event, resume_entry);
+
+    // hweight as a single job has it after the weight pass of this file
+    if (!weights_file.empty()) checkpoint_copy_histogram(&hweight, stored_weights[iarg]);
+    if(isRealData && !resuming_file && !weights_file.empty()){
+        // The weights are read, so only the event histograms of the weight pass are filled, for the entries of this job, reading only
+        // the branches they need
+        const char* event_branches[] = {"primary_vertex", "is_pileup_from_spd_5_08", "ue_estimate_its_const", "ue_estimate_tpc_const"};
+        std::vector<TBranch*> branches;
+        for (size_t ibranch = 0; ibranch < 4; ibranch++) branches.push_back(_tree_event->GetBranch(event_branches[ibranch]));
+        for(Long64_t ievent = first_event; ievent < last_event ; ievent++){
+            for (size_t ibranch = 0; ibranch < branches.size(); ibranch++) branches[ibranch]->GetEntry(ievent);
+            if(not( TMath::Abs(primary_vertex[2])<primary_vertex_max)) continue; //vertex z position cut
+            if(not (primary_vertex[2]!=0.00 )) continue; //removes default of vertex z = 0
+            if(is_pileup_from_spd_5_08) continue; //removes pileup
+            h_zvertex.Fill(primary_vertex[2]);
+            h_evt_rhoITS.Fill(ue_estimate_its_const);
+            h_evt_rhoTPC.Fill(ue_estimate_tpc_const);
+        }
     }
-
-   
       // Loop for real data (not Monte-Carlo), to fill the hweight and hBR histograms
-    if(isRealData){
-      for(Long64_t ievent = 0; ievent < nevents ; ievent++){ // Loop over events
+    else if(isRealData && !resuming_file){
+      for(Long64_t ievent = 0; ievent < nevents_file ; ievent++){ // Loop over events
 	    if (ievent % 100000 == 0) std::cout << " event " << ievent << std::endl;
 
             _tree_event->GetEntry(ievent);
             if(not( TMath::Abs(primary_vertex[2])<primary_vertex_max)) continue; //vertex z position cut
             if(not (primary_vertex[2]!=0.00 )) continue; //removes default of vertex z = 0
             if(is_pileup_from_spd_5_08) continue; //removes pileup
+            if (photon_identifier == DNN_LOCAL) shower_net_event(shower_net, emcal, ncluster, cell_e, cluster_cell_id_max, cluster_e, cluster_s_nphoton_local, shower_net_work);
+            if (recompute_shower_shape) {
+                kinematic_clusters(shower_shape_clusters, ncluster, cluster_pt, cluster_eta, clus_pT_min, clus_pT_max, Cluster_Eta_max, boost_adj);
+                shower_shape_event(emcal, shower_shape_cuts, cell_e, shower_shape_clusters.size(), shower_shape_clusters.data(), cluster_cell_id_max, cluster_ncell, &cluster_shower_shape[0], shower_shape_scratch);
+            }
+            if (determiner == TRACK_CONE) isolation_grid_build(isolation_tracks, ntrack, track_pt, track_eta, track_phi, track_quality);
 
 
+            // The event histograms only count the entries of this job, so that the jobs of an entry range add up to a single one
+            if (ievent >= first_event && ievent < last_event) {
             h_zvertex.Fill(primary_vertex[2]);
             //fill UE: 
 	    h_evt_rhoITS.Fill(ue_estimate_its_const);
             h_evt_rhoTPC.Fill(ue_estimate_tpc_const);
+            }
 
 
 
@@ -871,9 +1198,11 @@ int main(int argc, char *argv[])
                 if( not(cluster_pt[n]<clus_pT_max)) continue;
                 if( not(TMath::Abs(cluster_eta[n]-boost_adj)<Cluster_Eta_max)) continue; //select eta of photons
                 if( not(cluster_ncell[n]>Cluster_ncell_min)) continue;   //removes clusters with 1 or 2 cells
-                if( not(cluster_e_cross[n]/cluster_e[n]>EcrossoverE_min)) continue; //removes "spiky" clusters
+                if( not((EcrossoverE_local ? cluster_shower_shape[n].e_cross : cluster_e_cross[n])/cluster_e[n]>EcrossoverE_min)) continue; //removes "spiky" clusters
                 if( not(cluster_nlocal_maxima[n]<= Cluster_locmaxima_max)) continue; //require to have at most 2 local maxima.
                 if( not(cluster_distance_to_bad_channel[n]>=Cluster_distobadchannel)) continue;
+                // The track cone is only summed for the clusters that passed the other cuts
+                if (determiner == TRACK_CONE) isolation = isolation_grid_cone(isolation_tracks, 0, cluster_eta[n], cluster_phi[n], isolation_cone_radius) - ue_estimate_its_const*isolation_cone_radius*isolation_cone_radius*TMath::Pi();
                 if( not(isolation < iso_max)) continue;
 
                 Bool_t inSignalRegion;
@@ -881,16 +1210,18 @@ int main(int argc, char *argv[])
                 
                 // Select the shower shape cut variable, and apply it
                 //std::cout << "SIG icluster " << n << " has  lambda0 " << cluster_lambda_square[n][0] << std::endl;
-                if (photon_identifier == DNN) {
-                    inSignalRegion = ((cluster_s_nphoton[n][1] > SIG_DNN_min) and (cluster_s_nphoton[n][1]<SIG_DNN_max));
-                    inBkgRegion    = ((cluster_s_nphoton[n][1]>BKG_DNN_min) and (cluster_s_nphoton[n][1]<BKG_DNN_max));
+                if (photon_identifier == DNN || photon_identifier == DNN_LOCAL) {
+                    const float dnn = photon_identifier == DNN_LOCAL ? cluster_s_nphoton_local[n] : cluster_s_nphoton[n][1];
+                    inSignalRegion = ((dnn > SIG_DNN_min) and (dnn<SIG_DNN_max));
+                    inBkgRegion    = ((dnn>BKG_DNN_min) and (dnn<BKG_DNN_max));
                 }
-                else if (photon_identifier == LAMBDA_0) {
-                    inSignalRegion = ((cluster_lambda_square[n][0]>SIG_lambda_min) and (cluster_lambda_square[n][0]<SIG_lambda_max));
-                    inBkgRegion    = ((cluster_lambda_square[n][0]>BKG_lambda_min) and (cluster_lambda_square[n][0]<BKG_lambda_max));
+                else if (photon_identifier == LAMBDA_0 || photon_identifier == LAMBDA_0_LOCAL) {
+                    const float lambda0 = photon_identifier == LAMBDA_0_LOCAL ? cluster_shower_shape[n].lambda0_square : cluster_lambda_square[n][0];
+                    inSignalRegion = ((lambda0>SIG_lambda_min) and (lambda0<SIG_lambda_max));
+                    inBkgRegion    = ((lambda0>BKG_lambda_min) and (lambda0<BKG_lambda_max));
                 }
                 else {
-                    float eratio = cluster_e_max[n]/cluster_e[n];
+                    float eratio = (photon_identifier == EMAX_OVER_ECLUSTER_LOCAL ? cluster_shower_shape[n].e_max : cluster_e_max[n])/cluster_e[n];
                     inSignalRegion = (( eratio > SIG_Emax_over_Ecluster_min) and (eratio < SIG_Emax_over_Ecluster_max));
                     inBkgRegion    = ((eratio > BKG_Emax_over_Ecluster_min) and (eratio < BKG_Emax_over_Ecluster_max));
                 }
@@ -907,6 +1238,15 @@ int main(int argc, char *argv[])
 	std::cout << " Weights " << std::endl;
         for(int i=0 ; i< hweight.GetNbinsX() ; i++) std::cout <<" i" << i << " weight= " << hweight.GetBinContent(i) << std::endl;
     }//end loop over events to get weights for background region
+    if (!write_weights_file.empty()) {
+        // Weights only: keep those of this file and skip the correlations
+        TH1D* weights = (TH1D*)hweight.Clone(Form("hweight_%lu", iarg));
+        weights->SetDirectory(0);
+        file_weights.push_back(weights);
+        file->Close();
+        delete file;
+        continue;
+    }
     
       // Create cutflow histograms
     std::cout<<" About to start looping over events" << std::endl;
@@ -939,8 +1279,26 @@ int main(int argc, char *argv[])
     h_jetcutflow.GetXaxis()->SetBinLabel(4, "In Signal Region");
     h_jetcutflow.GetXaxis()->SetBinLabel(5, "In Background Region");
       
+    // Progress reports (batch mode) and snapshots, with the clock read every 1000 events
+    const time_t loop_start = time(NULL);
+    const double loop_bytes = file->GetBytesRead();
+    time_t last_report = loop_start;
+    time_t last_snapshot = loop_start;
+    
       // Main loop
-    for(Long64_t ievent = 0; ievent < nevents ; ievent++){ // Loop over events
+    for(Long64_t ievent = first_event; ievent < last_event ; ievent++){ // Loop over events
+      if (checkpoint_due(checkpoint)) checkpoint_write(checkpoint, iarg, ievent);
+      if ((batch || !snapshot_file.empty()) && (ievent - first_event) % 1000 == 0) {
+          const time_t now = time(NULL);
+          if (batch && difftime(now, last_report) >= 10) {
+              report_progress(iarg, input_files.size(), ievent, first_event, last_event, difftime(now, loop_start), file->GetBytesRead() - loop_bytes);
+              last_report = now;
+          }
+          if (!snapshot_file.empty() && difftime(now, last_snapshot) >= 60) {
+              write_snapshot(snapshot_file, checkpoint.histograms);
+              last_snapshot = now;
+          }
+      }
       if(ievent%2) continue;
       _tree_event->GetEntry(ievent);
       h_evtcutflow.Fill(0);
@@ -957,6 +1315,14 @@ int main(int argc, char *argv[])
       h_evtcutflow.Fill(4);
 
       N_eventpassed +=1;
+      truth_index_build(truth, nmc_truth, mc_truth_pdg_code, mc_truth_first_parent_pdg_code, mc_truth_status);
+      truth_index_match_clusters(truth, TRUTH_SELECTED, ncluster, cluster_mc_truth_index);
+      if (photon_identifier == DNN_LOCAL) shower_net_event(shower_net, emcal, ncluster, cell_e, cluster_cell_id_max, cluster_e, cluster_s_nphoton_local, shower_net_work);
+      if (recompute_shower_shape) {
+          kinematic_clusters(shower_shape_clusters, ncluster, cluster_pt, cluster_eta, clus_pT_min, clus_pT_max, Cluster_Eta_max, boost_adj);
+          shower_shape_event(emcal, shower_shape_cuts, cell_e, shower_shape_clusters.size(), shower_shape_clusters.data(), cluster_cell_id_max, cluster_ncell, &cluster_shower_shape[0], shower_shape_scratch);
+      }
+      if (determiner == TRACK_CONE) isolation_grid_build(isolation_tracks, ntrack, track_pt, track_eta, track_phi, track_quality);
 
         /**
             Weights are used for Monte-Carlo simulations in order to make sure that the right amount of points from each pT bin is included
@@ -1103,14 +1469,16 @@ int main(int argc, char *argv[])
           // Photon Identification
           Bool_t inSignalRegion;
           Bool_t inBkgRegion;
-          float eratio = cluster_e_max[n]/cluster_e[n];
-          if (photon_identifier == DNN) {
-              inSignalRegion = ((cluster_s_nphoton[n][1] > SIG_DNN_min) and (cluster_s_nphoton[n][1]<SIG_DNN_max));
-              inBkgRegion    = ((cluster_s_nphoton[n][1]>BKG_DNN_min) and (cluster_s_nphoton[n][1]<BKG_DNN_max));
+          float eratio = (photon_identifier == EMAX_OVER_ECLUSTER_LOCAL ? cluster_shower_shape[n].e_max : cluster_e_max[n])/cluster_e[n];
+          const float lambda0 = photon_identifier == LAMBDA_0_LOCAL ? cluster_shower_shape[n].lambda0_square : cluster_lambda_square[n][0];
+          const float dnn = photon_identifier == DNN_LOCAL ? cluster_s_nphoton_local[n] : cluster_s_nphoton[n][1];
+          if (photon_identifier == DNN || photon_identifier == DNN_LOCAL) {
+              inSignalRegion = ((dnn > SIG_DNN_min) and (dnn<SIG_DNN_max));
+              inBkgRegion    = ((dnn>BKG_DNN_min) and (dnn<BKG_DNN_max));
           }
-          else if (photon_identifier == LAMBDA_0) {
-              inSignalRegion = ((cluster_lambda_square[n][0]>SIG_lambda_min) and (cluster_lambda_square[n][0]<SIG_lambda_max));
-              inBkgRegion    = ((cluster_lambda_square[n][0]>BKG_lambda_min) and (cluster_lambda_square[n][0]<BKG_lambda_max));
+          else if (photon_identifier == LAMBDA_0 || photon_identifier == LAMBDA_0_LOCAL) {
+              inSignalRegion = ((lambda0>SIG_lambda_min) and (lambda0<SIG_lambda_max));
+              inBkgRegion    = ((lambda0>BKG_lambda_min) and (lambda0<BKG_lambda_max));
           }
           else {
               inSignalRegion = ((eratio > SIG_Emax_over_Ecluster_min) and (eratio < SIG_Emax_over_Ecluster_max));
@@ -1126,7 +1494,7 @@ int main(int argc, char *argv[])
         h_cutflow.Fill(2);
         if( not(cluster_ncell[n]>Cluster_ncell_min)) continue;   //removes clusters with 1 or 2 cells
         h_cutflow.Fill(3);
-	if( not(cluster_e_cross[n]/cluster_e[n]>EcrossoverE_min)) continue; //removes "spiky" clusters
+	if( not((EcrossoverE_local ? cluster_shower_shape[n].e_cross : cluster_e_cross[n])/cluster_e[n]>EcrossoverE_min)) continue; //removes "spiky" clusters
         h_cutflow.Fill(4);
         if( not(cluster_nlocal_maxima[n]< Cluster_locmaxima_max)) continue; //require to have at most 2 local maxima.
         h_cutflow.Fill(5);
@@ -1134,14 +1502,16 @@ int main(int argc, char *argv[])
         h_cutflow.Fill(6);
 	h_clusterphi.Fill(cluster_phi[n], weight);
         h_clustereta.Fill(cluster_eta[n], weight);
+        // The track cone is only summed for the clusters that passed the other cuts
+        if (determiner == TRACK_CONE) isolation = isolation_grid_cone(isolation_tracks, 0, cluster_eta[n], cluster_phi[n], isolation_cone_radius) - ue_estimate_its_const*isolation_cone_radius*isolation_cone_radius*TMath::Pi();
         if( not(isolation < 2.0)) continue;
         h_cutflow.Fill(7);
 	if( not(isolation < iso_max)) continue;
         h_clusterphi_iso.Fill(cluster_phi[n], weight);
         h_clustereta_iso.Fill(cluster_eta[n], weight);
         h_cutflow.Fill(8);
-    h_lambda_0.Fill(cluster_lambda_square[n][0]);
-    h_DNN.Fill(cluster_s_nphoton[n][1]);
+    h_lambda_0.Fill(lambda0);
+    h_DNN.Fill(dnn);
           h_EmaxOverEcluster.Fill(eratio);
     if (inSignalRegion)
         h_cutflow.Fill(9);
@@ -1154,18 +1524,13 @@ int main(int argc, char *argv[])
         Float_t truth_eta = -999.0;
         Float_t truth_phi = -999.0;
 
-	for(int counter = 0 ; counter<32; counter++){
-	  unsigned short index = cluster_mc_truth_index[n][counter];                   
-          if(isTruePhoton) break;
-          if(index==65535) continue;
-          if(mc_truth_pdg_code[index]!=rightpdgcode) continue;
-          if(mc_truth_first_parent_pdg_code[index]!=rightparentpdgcode) continue;
-          if( not (mc_truth_status[index] >0)) continue;        
+	const int truth_match = truth.cluster_truth[n]; // first truth particle of the right pdg codes
+	if(truth_match>=0){
           isTruePhoton = true;
-          truth_pt     = mc_truth_pt[index];
-          truth_phi    =  mc_truth_phi[index];
-          truth_eta    =  mc_truth_eta[index];
-	}//end loop over indices
+          truth_pt     = mc_truth_pt[truth_match];
+          truth_phi    =  mc_truth_phi[truth_match];
+          truth_eta    =  mc_truth_eta[truth_match];
+	}
         //if (not isTruePhoton){ std::cout << " photon is not true " << std::endl;} 
 	// if((not isRealData) and (not isTruePhoton) and weight!=1.0 ) continue; //17g samples don't have weight FIX ME: of course this cut only works for GJ and not JJ
 	
@@ -1344,26 +1709,24 @@ int main(int argc, char *argv[])
          h_jetpt_truth.Fill(jet_truth_ak04_pt[ijet], weight);
       }
     
-      std::set<int> temp; //to store truth indices associated with reco jets
       for (ULong64_t ijet = 0; ijet < njet_ak04its; ijet++) { 
 	if(not (jet_ak04its_pt_raw[ijet]>jet_pT_min)) continue;
 	if(not (TMath::Abs(jet_ak04its_eta_raw[ijet])  <Jet_Eta_max ) ) continue;
 	h_jetpt_reco.Fill(jet_ak04its_pt_raw[ijet], weight);
-	temp.insert(jet_ak04its_truth_index_z_reco[ijet][0]);
-      } //end loop over reco jets
-      for(auto& index: temp){
-	if(index>0){
+	// each truth jet associated with reco jets once
+	const int index = jet_ak04its_truth_index_z_reco[ijet][0];
+	if(index>0 && truth_index_first_jet(truth, index)){
 	  if(not(TMath::Abs(jet_truth_ak04_eta[index])<Jet_Eta_max)) continue;
           h_jetpt_truthreco.Fill(jet_truth_ak04_pt[index],weight);
 	}
-      }//end loop over indices of reco jets
+      } //end loop over reco jets
 
         // Monte-Carlo only: loop over truth mc particles
         // Warning: Boosting is not adjusted for here, due to lack of need last time used (6/1/2019)
       for (ULong64_t nmc = 0; nmc < nmc_truth; nmc++) {
         //if(not(mc_truth_pt[nmc]>clus_pT_min)) continue;
 	//if(not(mc_truth_pt[nmc]<clus_pT_max)) continue;
-	if(mc_truth_pdg_code[nmc]==rightpdgcode && int(mc_truth_status[nmc])>0 &&  mc_truth_first_parent_pdg_code[nmc]==rightparentpdgcode){
+	if(truth_index_is(truth, TRUTH_SELECTED, nmc)){
 	  //std::cout << mc_truth_pt[nmc] << "phi " << mc_truth_phi[nmc] << " eta " << mc_truth_eta[nmc] << 
 	  //  " code: " << mc_truth_pdg_code[nmc] << " status " << int(mc_truth_status[nmc]) << " parentpdg " << mc_truth_first_parent_pdg_code[nmc] << std::endl;    
 	  h_truth.Fill(mc_truth_pt[nmc],weight);
@@ -1385,15 +1748,7 @@ int main(int argc, char *argv[])
 	}
       }//end loop over mc particles
 
-     // Create the file label, to be used within the filenames, to represent the source file
-     
-
-      h_truth.SetLineColor(2);
-      THStack* hs = new THStack("hs","stack histo for plotting");
-      hs->Add(&h_reco);
-      hs->Add(&h_truth);
-
-      if (ievent % 10000 == 0) {
+      if (!batch && ievent % 10000 == 0) {
 	//SR_Xj.Draw("e1x0nostack");
         hSR_dPhi.Draw("e1x0nostack");
 	std::cout << ievent << " " << _tree_event->GetEntries() << std::endl;
@@ -1402,6 +1757,11 @@ int main(int argc, char *argv[])
 
      }//end loop over events
   } // end loop over files
+    if (!write_weights_file.empty()) {
+        write_weights(write_weights_file, file_weights, weights_description(input_files));
+        std::cout << " Background weights of " << file_weights.size() << " files written to " << write_weights_file << std::endl;
+        return EXIT_SUCCESS;
+    }
     std::cout << " Numbers of events passing selection " << N_eventpassed << std::endl;
     std::cout << " Number of clusters in signal region " << N_SR << std::endl;
     std::cout << " Number of clusters in background region " << N_BR << std::endl;
@@ -1409,8 +1769,8 @@ int main(int argc, char *argv[])
     
     // Create the output file and its name
     std::string opened_files = "";
-    for (int iarg = 1; iarg < argc; iarg++) {
-        std::string filepath = argv[iarg];
+    for (size_t iarg = 0; iarg < input_files.size(); iarg++) {
+        std::string filepath = input_files[iarg];
         opened_files += "_" + filepath.substr(filepath.find_last_of("/")+1, filepath.find_last_of(".")-filepath.find_last_of("/")-1);
     }
     
@@ -1418,14 +1778,24 @@ int main(int argc, char *argv[])
     if (photon_identifier == DNN) {
         photonselectionvar = "DNN";
     }
+    else if (photon_identifier == DNN_LOCAL) {
+        photonselectionvar = "DNNlocal";
+    }
     else if (photon_identifier == LAMBDA_0) {
         photonselectionvar = "Lambda0";
     }
+    else if (photon_identifier == LAMBDA_0_LOCAL) {
+        photonselectionvar = "Lambda0local";
+    }
+    else if (photon_identifier == EMAX_OVER_ECLUSTER_LOCAL) {
+        photonselectionvar = "EmaxOverEclusterlocal";
+    }
     else {
         photonselectionvar = "EmaxOverEcluster";
     }
     // Note: there are multiple filenames here, because the filename always includes the names of all of the datafiles used to create the correlations, but for Monte Carlo the resulting name becomes too long for the machine to handle
-    TFile* fout = new TFile(Form("GammaJet_config_clusptmin%2.1f_clusptmax%2.1f_JETPTMIN_%2.1f_DATANAME_%s_PHOTONSELECT_%s.root", clus_pT_min, clus_pT_max, jet_pT_min, opened_files.c_str(), photonselectionvar.c_str()),"RECREATE");
+    // Unnormalized outputs are marked, so that they are not mistaken for final results, and the outputs of an entry range carry it
+    TFile* fout = new TFile(Form("GammaJet_config_clusptmin%2.1f_clusptmax%2.1f_JETPTMIN_%2.1f_DATANAME_%s_PHOTONSELECT_%s%s%s.root", clus_pT_min, clus_pT_max, jet_pT_min, opened_files.c_str(), photonselectionvar.c_str(), entry_range_tag(entry_range).c_str(), unnormalized ? "_UNNORMALIZED" : ""),"RECREATE");
     //TFile* fout = new TFile(Form("GammaJet_config_clusptmin%2.1f_clusptmax%2.1f_JETPTMIN_%2.1f_DATANAME_MC17g6a1_PHOTONSELECT_%s.root", clus_pT_min, clus_pT_max, jet_pT_min, photonselectionvar.c_str()),"RECREATE");
     //TFile* fout = new TFile(Form("GammaJet_config_clusptmin%2.1f_clusptmax%2.1f_JETPTMIN_%2.1f_DATANAME_MCdijet_PHOTONSELECT_%s.root", clus_pT_min, clus_pT_max, jet_pT_min, photonselectionvar.c_str()),"RECREATE");
     //TFile* fout = new TFile(Form("GammaJet_config_clusptmin%2.1f_clusptmax%2.1f_JETPTMIN_%2.1f_DATANAME_MCgammajet_PHOTONSELECT_%s.root", clus_pT_min, clus_pT_max, jet_pT_min, photonselectionvar.c_str()),"RECREATE");
@@ -1442,63 +1812,68 @@ int main(int argc, char *argv[])
     h_weights.Write("h_weights");
 
 
-    ///Histogram-weighting
-    hSR_njet.Scale(1.0/(N_SR*hSR_njet_binwidth));
-    hBR_njet.Scale(1.0/(N_BR*hBR_njet_binwidth));
-
-    hSR_Xj.Scale(1.0/(N_SR*hSR_Xj_binwidth));
-    hBR_Xj.Scale(1.0/(N_BR*hBR_Xj_binwidth));
-    hSR_dPhi.Scale(1.0/(N_SR*hSR_dPhi_binwidth));
-    hBR_dPhi.Scale(1.0/(N_BR*hBR_dPhi_binwidth));
-    hSR_dEta.Scale(1.0/(N_SR*hSR_dEta_binwidth));
-    hBR_dEta.Scale(1.0/(N_BR*hBR_dEta_binwidth));
-
-    hSR_AvgEta.Scale(1.0/(N_SR*hSR_AvgEta_binwidth));
-    hBR_AvgEta.Scale(1.0/(N_BR*hBR_AvgEta_binwidth));
-
-    hSR_jetpt.Scale(1.0/(N_SR*hSR_jetpt_binwidth));
-    hBR_jetpt.Scale(1.0/(N_BR*hBR_jetpt_binwidth));
-    hSR_jeteta.Scale(1.0/(N_SR*hSR_jeteta_binwidth));
-    hBR_jeteta.Scale(1.0/(N_BR*hBR_jeteta_binwidth));
-    hSR_jetphi.Scale(1.0/(N_SR*hSR_jetphi_binwidth));
-    hBR_jetphi.Scale(1.0/(N_BR*hBR_jetphi_binwidth));
-
-
-    hSR_jetpt_truth.Scale(1.0/(N_SR*hSR_jetpt_truth_binwidth));
-    hBR_jetpt_truth.Scale(1.0/(N_BR*hBR_jetpt_truth_binwidth));
-    hSR_jeteta_truth.Scale(1.0/(N_SR*hSR_jeteta_truth_binwidth));
-    hBR_jeteta_truth.Scale(1.0/(N_BR*hBR_jeteta_truth_binwidth));
-    hSR_jetphi_truth.Scale(1.0/(N_SR*hSR_jetphi_truth_binwidth));
-    hBR_jetphi_truth.Scale(1.0/(N_BR*hBR_jetphi_truth_binwidth));
-
-
-    hSR_Xj_truth.Scale(1.0/(N_SR*hSR_Xj_truth_binwidth));
-    hBR_Xj_truth.Scale(1.0/(N_BR*hBR_Xj_truth_binwidth));
-    hSR_dPhi_truth.Scale(1.0/(N_SR*hSR_dPhi_truth_binwidth));
-    hBR_dPhi_truth.Scale(1.0/(N_BR*hBR_dPhi_truth_binwidth));
-    hSR_dEta_truth.Scale(1.0/(N_SR*hSR_dEta_truth_binwidth));
-    hBR_dEta_truth.Scale(1.0/(N_BR*hBR_dEta_truth_binwidth));
-    hSR_AvgEta_truth.Scale(1.0/(N_SR*hSR_AvgEta_truth_binwidth));
-    hBR_AvgEta_truth.Scale(1.0/(N_BR*hBR_AvgEta_truth_binwidth));
-
-
-    hSR_pTD.Scale(1.0/(N_SR*hSR_pTD_binwidth));
-    hBR_pTD.Scale(1.0/(N_BR*hBR_pTD_binwidth));
-    hSR_Multiplicity.Scale(1.0/(N_SR*hSR_Multiplicity_binwidth));
-    hBR_Multiplicity.Scale(1.0/(N_BR*hBR_Multiplicity_binwidth));
-    hSR_jetwidth.Scale(1.0/(N_SR*hSR_jetwidth_binwidth));
-    hBR_jetwidth.Scale(1.0/(N_BR*hBR_jetwidth_binwidth));
+    ///Histogram-weighting (deferred to merge_outputs if unnormalized)
+    NormalizationMetadata normalization = normalization_metadata(unnormalized);
+    normalization_set_counter(normalization, "N_SR", N_SR);
+    normalization_set_counter(normalization, "N_BR", N_BR);
+    normalization_set_counter(normalization, "N_eventpassed", N_eventpassed);
+    normalization_set_counter(normalization, "N_truth", N_truth);
+    normalization_scale(normalization, hSR_njet, "sig_njet", "N_SR", hSR_njet_binwidth);
+    normalization_scale(normalization, hBR_njet, "bkg_njet", "N_BR", hBR_njet_binwidth);
+
+    normalization_scale(normalization, hSR_Xj, "sig_Xj", "N_SR", hSR_Xj_binwidth);
+    normalization_scale(normalization, hBR_Xj, "bkg_Xj", "N_BR", hBR_Xj_binwidth);
+    normalization_scale(normalization, hSR_dPhi, "sig_dPhi", "N_SR", hSR_dPhi_binwidth);
+    normalization_scale(normalization, hBR_dPhi, "bkg_dPhi", "N_BR", hBR_dPhi_binwidth);
+    normalization_scale(normalization, hSR_dEta, "sig_dEta", "N_SR", hSR_dEta_binwidth);
+    normalization_scale(normalization, hBR_dEta, "bkg_dEta", "N_BR", hBR_dEta_binwidth);
+
+    normalization_scale(normalization, hSR_AvgEta, "sig_AvgEta", "N_SR", hSR_AvgEta_binwidth);
+    normalization_scale(normalization, hBR_AvgEta, "bkg_AvgEta", "N_BR", hBR_AvgEta_binwidth);
+
+    normalization_scale(normalization, hSR_jetpt, "sig_jetpt", "N_SR", hSR_jetpt_binwidth);
+    normalization_scale(normalization, hBR_jetpt, "bkg_jetpt", "N_BR", hBR_jetpt_binwidth);
+    normalization_scale(normalization, hSR_jeteta, "sig_jeteta", "N_SR", hSR_jeteta_binwidth);
+    normalization_scale(normalization, hBR_jeteta, "bkg_jeteta", "N_BR", hBR_jeteta_binwidth);
+    normalization_scale(normalization, hSR_jetphi, "sig_jetphi", "N_SR", hSR_jetphi_binwidth);
+    normalization_scale(normalization, hBR_jetphi, "bkg_jetphi", "N_BR", hBR_jetphi_binwidth);
+
+
+    normalization_scale(normalization, hSR_jetpt_truth, "sig_jetpt_truth", "N_SR", hSR_jetpt_truth_binwidth);
+    normalization_scale(normalization, hBR_jetpt_truth, "bkg_jetpt_truth", "N_BR", hBR_jetpt_truth_binwidth);
+    normalization_scale(normalization, hSR_jeteta_truth, "sig_jeteta_truth", "N_SR", hSR_jeteta_truth_binwidth);
+    normalization_scale(normalization, hBR_jeteta_truth, "bkg_jeteta_truth", "N_BR", hBR_jeteta_truth_binwidth);
+    normalization_scale(normalization, hSR_jetphi_truth, "sig_jetphi_truth", "N_SR", hSR_jetphi_truth_binwidth);
+    normalization_scale(normalization, hBR_jetphi_truth, "bkg_jetphi_truth", "N_BR", hBR_jetphi_truth_binwidth);
+
+
+    normalization_scale(normalization, hSR_Xj_truth, "sig_Xj_truth", "N_SR", hSR_Xj_truth_binwidth);
+    normalization_scale(normalization, hBR_Xj_truth, "bkg_Xj_truth", "N_BR", hBR_Xj_truth_binwidth);
+    normalization_scale(normalization, hSR_dPhi_truth, "sig_dPhi_truth", "N_SR", hSR_dPhi_truth_binwidth);
+    normalization_scale(normalization, hBR_dPhi_truth, "bkg_dPhi_truth", "N_BR", hBR_dPhi_truth_binwidth);
+    normalization_scale(normalization, hSR_dEta_truth, "sig_dEta_truth", "N_SR", hSR_dEta_truth_binwidth);
+    normalization_scale(normalization, hBR_dEta_truth, "bkg_dEta_truth", "N_BR", hBR_dEta_truth_binwidth);
+    normalization_scale(normalization, hSR_AvgEta_truth, "sig_AvgEta_truth", "N_SR", hSR_AvgEta_truth_binwidth);
+    normalization_scale(normalization, hBR_AvgEta_truth, "bkg_AvgEta_truth", "N_BR", hBR_AvgEta_truth_binwidth);
+
+
+    normalization_scale(normalization, hSR_pTD, "sig_pTD", "N_SR", hSR_pTD_binwidth);
+    normalization_scale(normalization, hBR_pTD, "bkg_pTD", "N_BR", hBR_pTD_binwidth);
+    normalization_scale(normalization, hSR_Multiplicity, "sig_Multiplicity", "N_SR", hSR_Multiplicity_binwidth);
+    normalization_scale(normalization, hBR_Multiplicity, "bkg_Multiplicity", "N_BR", hBR_Multiplicity_binwidth);
+    normalization_scale(normalization, hSR_jetwidth, "sig_jetwidth", "N_SR", hSR_jetwidth_binwidth);
+    normalization_scale(normalization, hBR_jetwidth, "bkg_jetwidth", "N_BR", hBR_jetwidth_binwidth);
 
     
-    hSR_clustereta.Scale(1.0/(N_SR*hSR_clustereta_binwidth));
-    hBR_clustereta.Scale(1.0/(N_BR*hBR_clustereta_binwidth));
-    hSR_clusterphi.Scale(1.0/(N_SR*hSR_clusterphi_binwidth));
-    hBR_clusterphi.Scale(1.0/(N_BR*hBR_clusterphi_binwidth));
+    normalization_scale(normalization, hSR_clustereta, "sig_clustereta", "N_SR", hSR_clustereta_binwidth);
+    normalization_scale(normalization, hBR_clustereta, "bkg_clustereta", "N_BR", hBR_clustereta_binwidth);
+    normalization_scale(normalization, hSR_clusterphi, "sig_clusterphi", "N_SR", hSR_clusterphi_binwidth);
+    normalization_scale(normalization, hBR_clusterphi, "bkg_clusterphi", "N_BR", hBR_clusterphi_binwidth);
 
-    hSR_XobsPb.Scale(1.0/(N_SR*hSR_XobsPb_binwidth));
-    hBR_XobsPb.Scale(1.0/(N_BR*hBR_XobsPb_binwidth));
-    hSR_XobsPb_truth.Scale(1.0/(N_SR*hSR_XobsPb_truth_binwidth));
-    hBR_XobsPb_truth.Scale(1.0/(N_BR*hBR_XobsPb_truth_binwidth));
+    normalization_scale(normalization, hSR_XobsPb, "sig_XobsPb", "N_SR", hSR_XobsPb_binwidth);
+    normalization_scale(normalization, hBR_XobsPb, "bkg_XobsPb", "N_BR", hBR_XobsPb_binwidth);
+    normalization_scale(normalization, hSR_XobsPb_truth, "sig_XobsPb_truth", "N_SR", hSR_XobsPb_truth_binwidth);
+    normalization_scale(normalization, hBR_XobsPb_truth, "bkg_XobsPb_truth", "N_BR", hBR_XobsPb_truth_binwidth);
 
 
 
@@ -1513,11 +1888,11 @@ int main(int argc, char *argv[])
 
     std::cout << "N_truth: " << N_truth << std::endl;
 
-    h_dPhi_truth.Scale(1.0/(N_truth*h_dPhi_truth_binwidth));
-    h_Xj_truth.Scale(1.0/(N_truth*h_Xj_truth_binwidth));
-    h_XobsPb_truth.Scale(1.0/(N_truth*h_XobsPb_truth_binwidth));
-    h_pTD_truth.Scale(1.0/(N_truth*h_pTD_truth_binwidth));
-    h_Multiplicity_truth.Scale(1.0/(N_truth*h_Multiplicity_truth_binwidth));
+    normalization_scale(normalization, h_dPhi_truth, "h_dPhi_truth", "N_truth", h_dPhi_truth_binwidth);
+    normalization_scale(normalization, h_Xj_truth, "h_Xj_truth", "N_truth", h_Xj_truth_binwidth);
+    normalization_scale(normalization, h_XobsPb_truth, "h_XobsPb_truth", "N_truth", h_XobsPb_truth_binwidth);
+    normalization_scale(normalization, h_pTD_truth, "h_pTD_truth", "N_truth", h_pTD_truth_binwidth);
+    normalization_scale(normalization, h_Multiplicity_truth, "h_Multiplicity_truth", "N_truth", h_Multiplicity_truth_binwidth);
     
     // Write out all histograms
     h_evtcutflow.Write("EventCutFlow");
@@ -1611,13 +1986,17 @@ int main(int argc, char *argv[])
 
     h_clusterphi.Write("h_clusterphi");
     h_clusterphi_iso.Write("h_clusterphi_iso");
-    h_clusterphi_iso.Divide(&h_clusterphi);
-    h_clusterphi_iso.Write("h_clusterphi_isoratio");
+    if (normalization_ratio(normalization, "h_clusterphi_isoratio", "h_clusterphi_iso", "h_clusterphi")) {
+        h_clusterphi_iso.Divide(&h_clusterphi);
+        h_clusterphi_iso.Write("h_clusterphi_isoratio");
+    }
 
     h_clustereta.Write("h_clustereta");
     h_clustereta_iso.Write("h_clustereta_iso");
-    h_clustereta_iso.Divide(&h_clustereta);
-    h_clustereta_iso.Write("h_clustereta_isoratio");
+    if (normalization_ratio(normalization, "h_clustereta_isoratio", "h_clustereta_iso", "h_clustereta")) {
+        h_clustereta_iso.Divide(&h_clustereta);
+        h_clustereta_iso.Write("h_clustereta_isoratio");
+    }
 
     //MC truth
     if (not isRealData) {
@@ -1636,12 +2015,17 @@ int main(int argc, char *argv[])
     h_trackphi.Write("h_trackphi");
     h_jetphi.Write("h_jetphi");
    
-    TH1D* jet_eff = (TH1D*)h_jetpt_truthreco.Clone();
-    jet_eff->Divide(&h_jetpt_truth);
-    jet_eff->Write("jetefficiency");
+    // Its inputs are only written for Monte-Carlo; for real data there is no truth and the efficiency stays empty, also once merged
+    if (isRealData || normalization_ratio(normalization, "jetefficiency", "h_jetpt_truthreco", "h_jetpt_truth")) {
+        TH1D* jet_eff = (TH1D*)h_jetpt_truthreco.Clone();
+        jet_eff->Divide(&h_jetpt_truth);
+        jet_eff->Write("jetefficiency");
+    }
+    normalization_write(normalization);
  
     std::cout << " ending " << std::endl;
     fout->Close();
+    checkpoint_remove(checkpoint);
   //end of arguments
   return EXIT_SUCCESS;
 }
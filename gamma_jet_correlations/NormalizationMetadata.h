@@ -0,0 +1,148 @@
+// Normalization of the GammaJet.cc and mixed_cluster_jet.cc outputs, which may be deferred to merge_outputs.cc
+// Normally every correlation histogram is scaled by 1/(counter*bin width) (counter: N_SR, N_BR or N_truth) before it is written,
+// and outputs of split jobs cannot simply be added. With --unnormalized, the histograms are written as raw weighted counts (with
+// Sumw2), ratios are not written, and the output gets two more objects describing how to normalize it once merged:
+// - "normalization", a TObjString with one line per counter and per deferred operation:
+//     counter <counter name>                                     bin i of h_counters holds the i-th counter
+//     scale <histogram> <counter name> <bin width>               histogram/(counter*bin width)
+//     ratio <histogram> <numerator histogram> <denominator histogram>   numerator/denominator (TH1::Divide), after the scaling
+// - "h_counters", a TH1D of the counters (N_SR, N_BR, N_eventpassed, ...), which add up like the histograms
+// Author: Ivan Chernyshev
+
+#ifndef NORMALIZATIONMETADATA_H
+#define NORMALIZATIONMETADATA_H
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TH1D.h>
+#include <TObjString.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+
+struct NormalizationScale {
+    std::string histogram;
+    std::string counter;
+    double binwidth;
+};
+
+struct NormalizationRatio {
+    std::string histogram;
+    std::string numerator;
+    std::string denominator;
+};
+
+// The normalization of one output, applied right away or, if unnormalized, recorded for merge_outputs
+struct NormalizationMetadata {
+    bool unnormalized;
+    std::vector<std::string> counter_names;
+    std::map<std::string, double> counters;
+    std::vector<NormalizationScale> scales;
+    std::vector<NormalizationRatio> ratios;
+};
+
+inline NormalizationMetadata normalization_metadata(bool unnormalized){
+    NormalizationMetadata metadata;
+    metadata.unnormalized = unnormalized;
+    return metadata;
+}
+
+inline void normalization_set_counter(NormalizationMetadata& metadata, const std::string& name, double value){
+    if (metadata.counters.count(name) == 0) metadata.counter_names.push_back(name);
+    metadata.counters[name] = value;
+}
+
+// hist (written as histogram) /= counter*binwidth now, or once merged if unnormalized; the counter must have been set
+inline void normalization_scale(NormalizationMetadata& metadata, TH1& hist, const std::string& histogram, const std::string& counter, double binwidth){
+    if (metadata.counters.count(counter) == 0) {
+        fprintf(stderr, "%s:%d: normalization counter %s of %s was never set\n", __FILE__, __LINE__, counter.c_str(), histogram.c_str());
+        exit(EXIT_FAILURE);
+    }
+    if (metadata.unnormalized) {
+        NormalizationScale scale = {histogram, counter, binwidth};
+        metadata.scales.push_back(scale);
+        return;
+    }
+    hist.Scale(1.0/(metadata.counters[counter]*binwidth));
+}
+
+// Record that histogram = numerator/denominator, to be computed once merged; returns false if unnormalized, i.e. if the caller
+// should not write the ratio itself
+inline bool normalization_ratio(NormalizationMetadata& metadata, const std::string& histogram, const std::string& numerator, const std::string& denominator){
+    if (!metadata.unnormalized) return true;
+    NormalizationRatio ratio = {histogram, numerator, denominator};
+    metadata.ratios.push_back(ratio);
+    return false;
+}
+
+// Write "normalization" and "h_counters" to the current directory, if unnormalized
+inline void normalization_write(const NormalizationMetadata& metadata){
+    if (!metadata.unnormalized) return;
+    std::ostringstream text;
+    text.precision(17);
+    for (size_t i = 0; i < metadata.counter_names.size(); i++) text << "counter " << metadata.counter_names[i] << "\n";
+    for (size_t i = 0; i < metadata.scales.size(); i++) text << "scale " << metadata.scales[i].histogram << " " << metadata.scales[i].counter << " " << metadata.scales[i].binwidth << "\n";
+    for (size_t i = 0; i < metadata.ratios.size(); i++) text << "ratio " << metadata.ratios[i].histogram << " " << metadata.ratios[i].numerator << " " << metadata.ratios[i].denominator << "\n";
+    TObjString description(text.str().c_str());
+    description.Write("normalization");
+
+    const int ncounter = metadata.counter_names.size();
+    TH1D h_counters("h_counters", "normalization counters (see the normalization object)", ncounter, 0.5, ncounter + 0.5);
+    h_counters.SetDirectory(0);
+    for (int i = 0; i < ncounter; i++) {
+        h_counters.GetXaxis()->SetBinLabel(i + 1, metadata.counter_names[i].c_str());
+        h_counters.SetBinContent(i + 1, metadata.counters.find(metadata.counter_names[i])->second);
+    }
+    h_counters.Write("h_counters");
+}
+
+// Read the normalization of an unnormalized output (counters left at 0); false if the file is a normalized output
+inline bool normalization_read(TFile* file, NormalizationMetadata& metadata){
+    TObjString* description = dynamic_cast<TObjString*>(file->Get("normalization"));
+    if (description == NULL) return false;
+    metadata = normalization_metadata(true);
+    std::istringstream text(description->GetString().Data());
+    std::string line;
+    while (std::getline(text, line)) {
+        std::istringstream field(line);
+        std::string kind;
+        field >> kind;
+        if (kind == "counter") {
+            std::string name;
+            field >> name;
+            normalization_set_counter(metadata, name, 0);
+        }
+        else if (kind == "scale") {
+            NormalizationScale scale;
+            field >> scale.histogram >> scale.counter >> scale.binwidth;
+            metadata.scales.push_back(scale);
+        }
+        else if (kind == "ratio") {
+            NormalizationRatio ratio;
+            field >> ratio.histogram >> ratio.numerator >> ratio.denominator;
+            metadata.ratios.push_back(ratio);
+        }
+        if (!kind.empty() && field.fail()) {
+            fprintf(stderr, "%s:%d: %s: cannot parse normalization line \"%s\"\n", __FILE__, __LINE__, file->GetName(), line.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+    delete description;
+    return true;
+}
+
+// The description text of a normalization, to check that merged outputs were made with the same configuration
+inline std::string normalization_description(TFile* file){
+    TObjString* description = dynamic_cast<TObjString*>(file->Get("normalization"));
+    if (description == NULL) return "";
+    const std::string text = description->GetString().Data();
+    delete description;
+    return text;
+}
+
+#endif // NORMALIZATIONMETADATA_H
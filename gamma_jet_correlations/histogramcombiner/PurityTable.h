@@ -0,0 +1,140 @@
+// Machine-readable purity tables, as written by purity_fit.cc and read by purity_finder.cc and background_purity_subtraction.C
+//
+// One line per (data type, shower-shape variable, cluster pT interval), # starts a comment:
+// <data type (pp, pPb)> <shower-shape variable (lambda_0, DNN, Emax_over_Ecluster)> <cluster pT min> <cluster pT max> <purity> <purity uncertainty>
+// Purities are fractions (0.472, not 47.2%), as taken by background_purity_subtraction
+// Author: Ivan Chernyshev
+
+#ifndef PURITYTABLE_H
+#define PURITYTABLE_H
+
+#include <TH1.h>
+#include <TMath.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Purity of one cluster pT interval
+struct PurityEntry {
+    std::string datatype;
+    std::string idvar;
+    double cluspT_min;
+    double cluspT_max;
+    double purity;
+    double deltapurity;
+};
+
+inline bool purity_entry_less(const PurityEntry& a, const PurityEntry& b){
+    if (a.datatype != b.datatype) return a.datatype < b.datatype;
+    if (a.idvar != b.idvar) return a.idvar < b.idvar;
+    return a.cluspT_min < b.cluspT_min;
+}
+
+// Read a purity table, or exit if it cannot be read
+inline std::vector<PurityEntry> read_purity_table(const char* filename){
+    FILE* table = fopen(filename, "r");
+    if (table == NULL) {
+        fprintf(stderr, "%s:%d: cannot open purity table %s\n", __FILE__, __LINE__, filename);
+        exit(EXIT_FAILURE);
+    }
+    
+    std::vector<PurityEntry> entries;
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), table) != NULL) {
+        line_number++;
+        char datatype[256];
+        char idvar[256];
+        PurityEntry entry;
+        const char* first = line + strspn(line, " \t");
+        if (*first == '#' || *first == '\n' || *first == '\r' || *first == '\0') continue;
+        if (sscanf(line, "%255s %255s %lf %lf %lf %lf", datatype, idvar, &entry.cluspT_min, &entry.cluspT_max, &entry.purity, &entry.deltapurity) != 6) {
+            fprintf(stderr, "%s:%d: %s line %d: expected <data type> <shower-shape variable> <cluster pT min> <cluster pT max> <purity> <purity uncertainty>\n", __FILE__, __LINE__, filename, line_number);
+            exit(EXIT_FAILURE);
+        }
+        entry.datatype = datatype;
+        entry.idvar = idvar;
+        entries.push_back(entry);
+    }
+    fclose(table);
+    std::sort(entries.begin(), entries.end(), purity_entry_less);
+    
+    return entries;
+}
+
+// Write a purity table; written to a temporary file first and renamed, so readers never see a partial table
+inline void write_purity_table(const char* filename, std::vector<PurityEntry> entries, const char* comment = NULL){
+    const std::string tmp_filename = std::string(filename) + ".tmp";
+    FILE* table = fopen(tmp_filename.c_str(), "w");
+    if (table == NULL) {
+        fprintf(stderr, "%s:%d: cannot create purity table %s\n", __FILE__, __LINE__, tmp_filename.c_str());
+        exit(EXIT_FAILURE);
+    }
+    std::sort(entries.begin(), entries.end(), purity_entry_less);
+    if (comment != NULL) fprintf(table, "# %s\n", comment);
+    fprintf(table, "# datatype idvar cluspT_min cluspT_max purity purity_uncertainty\n");
+    for (size_t i = 0; i < entries.size(); i++) {
+        fprintf(table, "%s %s %g %g %.6g %.6g\n", entries[i].datatype.c_str(), entries[i].idvar.c_str(), entries[i].cluspT_min, entries[i].cluspT_max, entries[i].purity, entries[i].deltapurity);
+    }
+    if (fclose(table) != 0 || rename(tmp_filename.c_str(), filename) != 0) {
+        fprintf(stderr, "%s:%d: cannot write purity table %s\n", __FILE__, __LINE__, filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// The entries of one data type and shower-shape variable, in cluster pT order
+inline std::vector<PurityEntry> purity_intervals(const std::vector<PurityEntry>& table, const std::string& datatype, const std::string& idvar){
+    std::vector<PurityEntry> intervals;
+    for (size_t i = 0; i < table.size(); i++) {
+        if (table[i].datatype == datatype && table[i].idvar == idvar) intervals.push_back(table[i]);
+    }
+    std::sort(intervals.begin(), intervals.end(), purity_entry_less);
+    return intervals;
+}
+
+// Number of clusters of cluspT_hist in the bins whose centers are in [low, high), so that adjacent intervals do not share a bin
+inline double cluster_count(TH1* cluspT_hist, double low, double high){
+    double count = 0;
+    for (int i = 1; i <= cluspT_hist->GetNbinsX(); i++) {
+        const double center = cluspT_hist->GetBinCenter(i);
+        if (center >= low && center < high) count += cluspT_hist->GetBinContent(i);
+    }
+    return count;
+}
+
+// Purity over the cluster pT range [minval, maxval]: the average of the purities of the intervals overlapping it, weighted by
+// the number of clusters of cluspT_hist (e.g. TOT_clusterpt) in each overlap; the uncertainties are added in quadrature with
+// the same weights. Returns false if the table does not cover the range
+inline bool weighted_purity(const std::vector<PurityEntry>& table, const std::string& datatype, const std::string& idvar, TH1* cluspT_hist, double minval, double maxval, double& purity, double& deltapurity){
+    const std::vector<PurityEntry> intervals = purity_intervals(table, datatype, idvar);
+    if (intervals.empty() || minval < intervals.front().cluspT_min || maxval > intervals.back().cluspT_max || minval >= maxval) return false;
+    
+    double total_purity = 0;
+    double total_delta_purity = 0;
+    double covered = minval;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        const double low = std::max(minval, intervals[i].cluspT_min);
+        const double high = std::min(maxval, intervals[i].cluspT_max);
+        if (high <= low) continue;
+        // The intervals must be contiguous over the range
+        if (low > covered) return false;
+        covered = high;
+        const double num_in_interval = cluster_count(cluspT_hist, low, high);
+        total_purity += num_in_interval*intervals[i].purity;
+        total_delta_purity += (num_in_interval*intervals[i].deltapurity)*(num_in_interval*intervals[i].deltapurity);
+    }
+    if (covered < maxval) return false;
+    
+    const double num_total = cluster_count(cluspT_hist, minval, maxval);
+    if (num_total <= 0) return false;
+    purity = total_purity/num_total;
+    deltapurity = TMath::Sqrt(total_delta_purity)/num_total;
+    
+    return true;
+}
+
+#endif // PURITYTABLE_H
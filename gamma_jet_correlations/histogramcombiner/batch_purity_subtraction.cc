@@ -0,0 +1,255 @@
+// This program is the compiled batch version of background_purity_subtraction.C: it runs the (hSR-hBR*(1-p))/p subtraction
+// for every file and histogram listed in a manifest, in one process, instead of one ROOT interpreter call per histogram
+// (as autorun.C and autorun_main_mixed_compare.C do)
+// Each input file is opened once, all of its histograms are processed, and the output file is written once; independent
+// input files are processed in parallel by forked worker processes
+//
+// Manifest format: one job per line, blank lines and lines starting with # are ignored
+// <input ROOT file> <output ROOT file> <purity> <purity uncertainty> <signal>:<background>:<result> [<signal>:<background>:<result> ...]
+// Example (the 17q Lambda0 part of autorun.C):
+// GammaJet_config_..._17q_PHOTONSELECT_Lambda0.root GammaJet_config_..._17q_PHOTONSELECT_Lambda0.root 0.499892 0.0108913 sig_dPhi:bkg_dPhi:hadj_dPhi sig_Xj:bkg_Xj:hadj_Xj
+//
+// As with the macro, the output file receives the results and a copy of every object of the input file, so the output may be the
+// input file itself; several lines may name the same input file (e.g. with different purities) and/or the same output file,
+// a result replaces an input object of the same name
+// Author: Ivan Chernyshev
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TH1.h>
+#include <TROOT.h>
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../../general_tools/HistogramAlgebra.h"
+
+// One signal/background pair to subtract, and the name of the result
+struct SubtractionPair {
+    std::string signal;
+    std::string background;
+    std::string result;
+};
+
+// One line of the manifest
+struct SubtractionJob {
+    std::string input;
+    std::string output;
+    double purity;
+    double deltapurity;
+    std::vector<SubtractionPair> pairs;
+};
+
+// All jobs reading one input file, processed by one worker
+struct InputGroup {
+    std::string input;
+    std::vector<SubtractionJob> jobs;
+};
+
+// Parse the manifest, and group the jobs by input file, in order of first appearance
+std::vector<InputGroup> read_manifest(const char* filename){
+    // - reads the manifest from the standard input, e.g. from a pipeline step (see pipeline.cc)
+    FILE* manifest = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (manifest == NULL) {
+        fprintf(stderr, "%s:%d: cannot open manifest %s\n", __FILE__, __LINE__, filename);
+        exit(EXIT_FAILURE);
+    }
+    
+    std::vector<InputGroup> groups;
+    std::map<std::string, size_t> group_index;
+    // Every output file must be written by a single worker
+    std::map<std::string, std::string> output_input;
+    char line[16384];
+    int line_number = 0;
+    
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        line_number++;
+        std::vector<std::string> field;
+        for (char* token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n")) {
+            field.push_back(token);
+        }
+        if (field.empty() || field[0][0] == '#') continue;
+        if (field.size() < 5) {
+            fprintf(stderr, "%s:%d: %s line %d: expected <input> <output> <purity> <purity uncertainty> <signal>:<background>:<result> ...\n", __FILE__, __LINE__, filename, line_number);
+            exit(EXIT_FAILURE);
+        }
+    
+        SubtractionJob job;
+        job.input = field[0];
+        job.output = field[1];
+        char* end;
+        job.purity = strtod(field[2].c_str(), &end);
+        if (*end != '\0' || job.purity == 0) {
+            fprintf(stderr, "%s:%d: %s line %d: invalid purity %s\n", __FILE__, __LINE__, filename, line_number, field[2].c_str());
+            exit(EXIT_FAILURE);
+        }
+        job.deltapurity = strtod(field[3].c_str(), &end);
+        if (*end != '\0') {
+            fprintf(stderr, "%s:%d: %s line %d: invalid purity uncertainty %s\n", __FILE__, __LINE__, filename, line_number, field[3].c_str());
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 4; i < field.size(); i++) {
+            const size_t colon1 = field[i].find(':');
+            const size_t colon2 = colon1 == std::string::npos ? std::string::npos : field[i].find(':', colon1 + 1);
+            if (colon2 == std::string::npos || colon1 == 0 || colon2 == colon1 + 1 || colon2 + 1 == field[i].size()) {
+                fprintf(stderr, "%s:%d: %s line %d: expected <signal>:<background>:<result>, got %s\n", __FILE__, __LINE__, filename, line_number, field[i].c_str());
+                exit(EXIT_FAILURE);
+            }
+            SubtractionPair pair;
+            pair.signal = field[i].substr(0, colon1);
+            pair.background = field[i].substr(colon1 + 1, colon2 - colon1 - 1);
+            pair.result = field[i].substr(colon2 + 1);
+            job.pairs.push_back(pair);
+        }
+    
+        if (output_input.count(job.output) > 0 && output_input[job.output] != job.input) {
+            fprintf(stderr, "%s:%d: %s line %d: output %s is already written from input %s\n", __FILE__, __LINE__, filename, line_number, job.output.c_str(), output_input[job.output].c_str());
+            exit(EXIT_FAILURE);
+        }
+        output_input[job.output] = job.input;
+    
+        if (group_index.count(job.input) == 0) {
+            group_index[job.input] = groups.size();
+            groups.push_back(InputGroup());
+            groups.back().input = job.input;
+        }
+        groups[group_index[job.input]].jobs.push_back(job);
+    }
+    if (manifest != stdin) fclose(manifest);
+    
+    return groups;
+}
+
+// Process all jobs of one input file; returns the number of failed histogram pairs
+int process_group(const InputGroup& group){
+    // Read every object of the input into memory (the latest cycle of each name), so that the input can be closed before an
+    // output of the same name is recreated
+    TFile* fdata = TFile::Open(group.input.c_str(), "READ");
+    if (fdata == NULL || fdata->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot open %s\n", __FILE__, __LINE__, group.input.c_str());
+        return 1;
+    }
+    std::vector<std::string> object_names;
+    std::map<std::string, TObject*> objects;
+    TIter next(fdata->GetListOfKeys());
+    while (TKey* key = dynamic_cast<TKey*>(next())) {
+        if (objects.count(key->GetName()) > 0) continue;
+        TObject* object = key->ReadObj();
+        TH1* hist = dynamic_cast<TH1*>(object);
+        if (hist != NULL) hist->SetDirectory(0);
+        object_names.push_back(key->GetName());
+        objects[key->GetName()] = object;
+    }
+    fdata->Close();
+    delete fdata;
+    
+    // Results per output file, in manifest order
+    int nfailed = 0;
+    std::vector<std::string> outputs;
+    std::map<std::string, std::map<std::string, TH1*> > results;
+    for (size_t i = 0; i < group.jobs.size(); i++) {
+        const SubtractionJob& job = group.jobs[i];
+        if (results.count(job.output) == 0) outputs.push_back(job.output);
+        std::map<std::string, TH1*>& output_results = results[job.output];
+        for (size_t j = 0; j < job.pairs.size(); j++) {
+            const SubtractionPair& pair = job.pairs[j];
+            TH1* signal = objects.count(pair.signal) > 0 ? dynamic_cast<TH1*>(objects[pair.signal]) : NULL;
+            TH1* background = objects.count(pair.background) > 0 ? dynamic_cast<TH1*>(objects[pair.background]) : NULL;
+            if (signal == NULL || background == NULL) {
+                fprintf(stderr, "%s:%d: %s: could not find histogram %s\n", __FILE__, __LINE__, group.input.c_str(), (signal == NULL ? pair.signal : pair.background).c_str());
+                nfailed++;
+                continue;
+            }
+            TH1* result = dynamic_cast<TH1*>(signal->Clone(pair.result.c_str()));
+            hist_purity_subtract(result, signal, background, job.purity, job.deltapurity);
+            if (output_results.count(pair.result) > 0) delete output_results[pair.result];
+            output_results[pair.result] = result;
+        }
+    }
+    
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const std::map<std::string, TH1*>& output_results = results[outputs[i]];
+        TFile* fout = TFile::Open(outputs[i].c_str(), "RECREATE");
+        if (fout == NULL || fout->IsZombie()) {
+            fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, outputs[i].c_str());
+            nfailed++;
+            continue;
+        }
+        for (std::map<std::string, TH1*>::const_iterator result = output_results.begin(); result != output_results.end(); result++) {
+            result->second->Write(result->first.c_str());
+        }
+        for (size_t j = 0; j < object_names.size(); j++) {
+            if (output_results.count(object_names[j]) > 0) continue;
+            objects[object_names[j]]->Write(object_names[j].c_str());
+        }
+        fout->Close();
+        delete fout;
+        std::cout << group.input << " -> " << outputs[i] << ": " << output_results.size() << " subtracted histograms" << std::endl;
+    }
+    
+    return nfailed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Syntax is [manifest, or - for the standard input] [number of parallel workers (default: number of CPUs)]\n");
+        fprintf(stderr, "Each manifest line: <input ROOT file> <output ROOT file> <purity> <purity uncertainty> <signal>:<background>:<result> ...\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    const std::vector<InputGroup> groups = read_manifest(argv[1]);
+    long nworker = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworker < 1) nworker = 1;
+    
+    // Histograms must not attach to whatever file is open in the worker
+    TH1::AddDirectory(kFALSE);
+    
+    // One forked worker per input file, at most nworker at a time; the parent never opens a ROOT file, so the children start clean
+    std::map<pid_t, size_t> running;
+    int nfailed_group = 0;
+    size_t next_group = 0;
+    while (next_group < groups.size() || !running.empty()) {
+        if (next_group < groups.size() && (long)running.size() < nworker) {
+            if (nworker == 1) {
+                if (process_group(groups[next_group]) != 0) nfailed_group++;
+                next_group++;
+                continue;
+            }
+            const pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                _exit(process_group(groups[next_group]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            running[pid] = next_group;
+            next_group++;
+            continue;
+        }
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            exit(EXIT_FAILURE);
+        }
+        if (running.count(pid) == 0) continue;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "%s:%d: processing %s failed\n", __FILE__, __LINE__, groups[running[pid]].input.c_str());
+            nfailed_group++;
+        }
+        running.erase(pid);
+    }
+    
+    std::cout << groups.size() - nfailed_group << " of " << groups.size() << " input files processed" << std::endl;
+    
+    return nfailed_group == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
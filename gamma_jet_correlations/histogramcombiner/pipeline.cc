@@ -0,0 +1,645 @@
+// This program runs the post-processing chain (GammaJet output -> background_purity_subtraction -> ratiofinder -> rootresultcombiner
+// -> plot_comparisons / truthseparator) from a pipeline file that declares, for each step, its command, input files, parameters and
+// output files, instead of rerunning every macro by hand whenever one input changes
+// Steps depend on the steps that write their inputs; a step is rerun only if the hash of its command, parameters and the contents of
+// its inputs differs from the one recorded after its last successful run, or if one of its outputs is missing or was changed since.
+// A rerun step whose outputs come out identical does not make its dependent steps stale. Independent steps run in parallel
+//
+// Pipeline format: blank lines and lines starting with # are ignored, a step runs until the next step: line
+// set: <name> = <value>                 a variable for all following steps, written ${name} in any field below
+// step: <name>
+//     command: <shell command>         run with /bin/sh -c in the current directory
+//     param: <name> = <value>          a parameter of this step (e.g. a purity), also usable as ${name}
+//     input: <file>                    the whole content of the file is hashed
+//     input_lines: <file> <field> ...  only the lines of the file whose first fields are the given ones are hashed, e.g.
+//                                      input_lines: purity_table.txt pPb lambda_0 16 for one cluster pT interval of a purity table
+//     output: <file>
+// (see postprocessing.pipeline); outputs must be new files: a step cannot rewrite one of its inputs in place as autorun.C does
+//
+// The hashes are kept in <pipeline file>.cache, rewritten after every step so that an interrupted run keeps the finished steps
+// Author: Ivan Chernyshev
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// 64-bit FNV-1a
+const unsigned long long fnv_offset = 14695981039346656037ULL;
+const unsigned long long fnv_prime = 1099511628211ULL;
+
+unsigned long long fnv1a(const void* data, size_t size, unsigned long long hash = fnv_offset){
+    const unsigned char* byte = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= byte[i];
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+// Hash a string including its length, so that consecutive fields cannot run into each other
+unsigned long long fnv1a_field(const std::string& s, unsigned long long hash){
+    const unsigned long long size = s.size();
+    hash = fnv1a(&size, sizeof(size), hash);
+    return fnv1a(s.data(), s.size(), hash);
+}
+
+// Hashed lines of a file: the first fields of the lines to hash
+struct LineSelection {
+    std::string file;
+    std::vector<std::string> fields;
+};
+
+// One step of the pipeline
+struct Step {
+    std::string name;
+    std::string command;
+    std::vector<std::pair<std::string, std::string> > params;
+    std::vector<std::string> inputs;
+    std::vector<LineSelection> input_lines;
+    std::vector<std::string> outputs;
+    std::vector<size_t> dependencies;
+    int line_number;
+};
+
+// Content hash of a file, valid while its size, modification time and inode are unchanged
+struct FileHash {
+    unsigned long long hash;
+    long long size;
+    long long mtime_ns;
+    long long inode;
+};
+
+// The hash of a step's command, parameters and inputs at its last successful run, and the hashes of its outputs
+struct StepRecord {
+    unsigned long long key;
+    std::map<std::string, unsigned long long> outputs;
+};
+
+std::map<std::string, FileHash> file_hashes;
+std::map<std::string, StepRecord> step_records;
+
+std::string strip(const std::string& s){
+    const size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return "";
+    const size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string> split_whitespace(const std::string& s){
+    std::vector<std::string> field;
+    size_t start = s.find_first_not_of(" \t");
+    while (start != std::string::npos) {
+        const size_t end = s.find_first_of(" \t", start);
+        field.push_back(s.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        start = end == std::string::npos ? std::string::npos : s.find_first_not_of(" \t", end);
+    }
+    return field;
+}
+
+// Replace every ${name} of s, with the step's parameters taking precedence over the set: variables
+std::string substitute(const std::string& s, const std::map<std::string, std::string>& variables, const char* filename, int line_number){
+    std::string result;
+    size_t start = 0;
+    while (true) {
+        const size_t open = s.find("${", start);
+        if (open == std::string::npos) break;
+        const size_t close = s.find('}', open);
+        if (close == std::string::npos) {
+            fprintf(stderr, "%s:%d: %s line %d: unterminated ${ in %s\n", __FILE__, __LINE__, filename, line_number, s.c_str());
+            exit(EXIT_FAILURE);
+        }
+        const std::string name = s.substr(open + 2, close - open - 2);
+        std::map<std::string, std::string>::const_iterator value = variables.find(name);
+        if (value == variables.end()) {
+            fprintf(stderr, "%s:%d: %s line %d: undefined variable ${%s}\n", __FILE__, __LINE__, filename, line_number, name.c_str());
+            exit(EXIT_FAILURE);
+        }
+        result += s.substr(start, open - start) + value->second;
+        start = close + 1;
+    }
+    return result + s.substr(start);
+}
+
+// Split "<name> = <value>"
+void parse_assignment(const std::string& s, std::string& name, std::string& value, const char* filename, int line_number){
+    const size_t equal = s.find('=');
+    if (equal == std::string::npos || strip(s.substr(0, equal)).empty()) {
+        fprintf(stderr, "%s:%d: %s line %d: expected <name> = <value>, got %s\n", __FILE__, __LINE__, filename, line_number, s.c_str());
+        exit(EXIT_FAILURE);
+    }
+    name = strip(s.substr(0, equal));
+    value = strip(s.substr(equal + 1));
+}
+
+// Substitute the variables of every field of a step, once all of its parameters are known
+void finish_step(Step& step, const std::map<std::string, std::string>& globals, const std::vector<std::pair<int, std::pair<std::string, std::string> > >& fields, const char* filename){
+    std::map<std::string, std::string> variables = globals;
+    for (size_t i = 0; i < step.params.size(); i++) variables[step.params[i].first] = step.params[i].second;
+    
+    for (size_t i = 0; i < fields.size(); i++) {
+        const int line_number = fields[i].first;
+        const std::string& key = fields[i].second.first;
+        const std::string value = substitute(fields[i].second.second, variables, filename, line_number);
+        if (key == "command") {
+            if (!step.command.empty()) {
+                fprintf(stderr, "%s:%d: %s line %d: step %s has more than one command\n", __FILE__, __LINE__, filename, line_number, step.name.c_str());
+                exit(EXIT_FAILURE);
+            }
+            step.command = value;
+        }
+        else if (key == "input") {
+            step.inputs.push_back(value);
+        }
+        else if (key == "input_lines") {
+            std::vector<std::string> field = split_whitespace(value);
+            if (field.size() < 2) {
+                fprintf(stderr, "%s:%d: %s line %d: expected input_lines: <file> <field> ...\n", __FILE__, __LINE__, filename, line_number);
+                exit(EXIT_FAILURE);
+            }
+            LineSelection selection;
+            selection.file = field[0];
+            selection.fields.assign(field.begin() + 1, field.end());
+            step.input_lines.push_back(selection);
+        }
+        else if (key == "output") {
+            step.outputs.push_back(value);
+        }
+    }
+    if (step.command.empty()) {
+        fprintf(stderr, "%s:%d: %s line %d: step %s has no command\n", __FILE__, __LINE__, filename, step.line_number, step.name.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Parse the pipeline file, and find the dependencies of every step
+std::vector<Step> read_pipeline(const char* filename){
+    FILE* pipeline = fopen(filename, "r");
+    if (pipeline == NULL) {
+        fprintf(stderr, "%s:%d: cannot open pipeline %s\n", __FILE__, __LINE__, filename);
+        exit(EXIT_FAILURE);
+    }
+    
+    std::vector<Step> steps;
+    std::map<std::string, std::string> globals;
+    // Fields of the current step, substituted when the step is complete since a param: may follow its first use
+    std::vector<std::pair<int, std::pair<std::string, std::string> > > fields;
+    char line[16384];
+    int line_number = 0;
+    
+    while (fgets(line, sizeof(line), pipeline) != NULL) {
+        line_number++;
+        const std::string stripped = strip(line);
+        if (stripped.empty() || stripped[0] == '#') continue;
+        const size_t colon = stripped.find(':');
+        if (colon == std::string::npos) {
+            fprintf(stderr, "%s:%d: %s line %d: expected <key>: <value>\n", __FILE__, __LINE__, filename, line_number);
+            exit(EXIT_FAILURE);
+        }
+        const std::string key = strip(stripped.substr(0, colon));
+        const std::string value = strip(stripped.substr(colon + 1));
+    
+        if (key == "set") {
+            std::string name, setting;
+            parse_assignment(value, name, setting, filename, line_number);
+            globals[name] = substitute(setting, globals, filename, line_number);
+        }
+        else if (key == "step") {
+            if (!steps.empty()) finish_step(steps.back(), globals, fields, filename);
+            fields.clear();
+            for (size_t i = 0; i < steps.size(); i++) {
+                if (steps[i].name == value) {
+                    fprintf(stderr, "%s:%d: %s line %d: step %s is already defined on line %d\n", __FILE__, __LINE__, filename, line_number, value.c_str(), steps[i].line_number);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            Step step;
+            step.name = value;
+            step.line_number = line_number;
+            steps.push_back(step);
+        }
+        else if (key == "command" || key == "param" || key == "input" || key == "input_lines" || key == "output") {
+            if (steps.empty()) {
+                fprintf(stderr, "%s:%d: %s line %d: %s: outside of a step\n", __FILE__, __LINE__, filename, line_number, key.c_str());
+                exit(EXIT_FAILURE);
+            }
+            if (key == "param") {
+                std::string name, setting;
+                parse_assignment(value, name, setting, filename, line_number);
+                steps.back().params.push_back(std::make_pair(name, substitute(setting, globals, filename, line_number)));
+            }
+            else {
+                fields.push_back(std::make_pair(line_number, std::make_pair(key, value)));
+            }
+        }
+        else {
+            fprintf(stderr, "%s:%d: %s line %d: unknown key %s\n", __FILE__, __LINE__, filename, line_number, key.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(pipeline);
+    if (!steps.empty()) finish_step(steps.back(), globals, fields, filename);
+    
+    // Every file is written by at most one step, and never by a step that also reads it
+    std::map<std::string, size_t> writer;
+    for (size_t i = 0; i < steps.size(); i++) {
+        for (size_t j = 0; j < steps[i].outputs.size(); j++) {
+            const std::string& output = steps[i].outputs[j];
+            if (writer.count(output) > 0) {
+                fprintf(stderr, "%s:%d: %s: %s is an output of both step %s and step %s\n", __FILE__, __LINE__, filename, output.c_str(), steps[writer[output]].name.c_str(), steps[i].name.c_str());
+                exit(EXIT_FAILURE);
+            }
+            writer[output] = i;
+        }
+    }
+    for (size_t i = 0; i < steps.size(); i++) {
+        std::set<size_t> dependencies;
+        std::vector<std::string> read = steps[i].inputs;
+        for (size_t j = 0; j < steps[i].input_lines.size(); j++) read.push_back(steps[i].input_lines[j].file);
+        for (size_t j = 0; j < read.size(); j++) {
+            if (writer.count(read[j]) == 0) continue;
+            if (writer[read[j]] == i) {
+                fprintf(stderr, "%s:%d: %s: step %s reads its own output %s; write the result to a new file\n", __FILE__, __LINE__, filename, steps[i].name.c_str(), read[j].c_str());
+                exit(EXIT_FAILURE);
+            }
+            dependencies.insert(writer[read[j]]);
+        }
+        steps[i].dependencies.assign(dependencies.begin(), dependencies.end());
+    }
+    
+    // Reject cycles, by removing steps without remaining dependencies until none is left
+    std::vector<size_t> nremaining(steps.size());
+    std::vector<std::vector<size_t> > dependents(steps.size());
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < steps.size(); i++) {
+        nremaining[i] = steps[i].dependencies.size();
+        for (size_t j = 0; j < steps[i].dependencies.size(); j++) dependents[steps[i].dependencies[j]].push_back(i);
+        if (nremaining[i] == 0) ready.push_back(i);
+    }
+    size_t nordered = 0;
+    while (!ready.empty()) {
+        const size_t i = ready.back();
+        ready.pop_back();
+        nordered++;
+        for (size_t j = 0; j < dependents[i].size(); j++) {
+            if (--nremaining[dependents[i][j]] == 0) ready.push_back(dependents[i][j]);
+        }
+    }
+    if (nordered != steps.size()) {
+        for (size_t i = 0; i < steps.size(); i++) {
+            if (nremaining[i] > 0) fprintf(stderr, "%s:%d: %s: step %s is part of a dependency cycle\n", __FILE__, __LINE__, filename, steps[i].name.c_str());
+        }
+        exit(EXIT_FAILURE);
+    }
+    
+    return steps;
+}
+
+// Read the hashes of the last run; a missing cache means that every step is stale
+void read_cache(const std::string& filename){
+    FILE* cache = fopen(filename.c_str(), "r");
+    if (cache == NULL) return;
+    
+    char line[16384];
+    char name[16384];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), cache) != NULL) {
+        line_number++;
+        if (line[0] == '#') continue;
+        line[strcspn(line, "\r\n")] = '\0';
+        FileHash file;
+        unsigned long long hash;
+        int nread = 0;
+        if (sscanf(line, "file %llx %lld %lld %lld %n", &file.hash, &file.size, &file.mtime_ns, &file.inode, &nread) == 4 && nread > 0) {
+            file_hashes[line + nread] = file;
+        }
+        else if (sscanf(line, "step %llx %16383s", &hash, name) == 2) {
+            step_records[name].key = hash;
+        }
+        else if (sscanf(line, "output %16383s %llx %n", name, &hash, &nread) == 2 && nread > 0) {
+            step_records[name].outputs[line + nread] = hash;
+        }
+        else {
+            // An unreadable cache only costs a rerun
+            fprintf(stderr, "%s:%d: %s line %d: ignoring the cache\n", __FILE__, __LINE__, filename.c_str(), line_number);
+            file_hashes.clear();
+            step_records.clear();
+            break;
+        }
+    }
+    fclose(cache);
+}
+
+// Write the cache to a temporary file first and rename it, so that an interrupted run never leaves a partial cache
+void write_cache(const std::string& filename){
+    const std::string tmp_filename = filename + ".tmp";
+    FILE* cache = fopen(tmp_filename.c_str(), "w");
+    if (cache == NULL) {
+        fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, tmp_filename.c_str());
+        exit(EXIT_FAILURE);
+    }
+    fprintf(cache, "# pipeline cache: file <hash> <size> <mtime> <inode> <path>, step <key> <name>, output <step> <hash> <path>\n");
+    for (std::map<std::string, FileHash>::const_iterator file = file_hashes.begin(); file != file_hashes.end(); file++) {
+        fprintf(cache, "file %016llx %lld %lld %lld %s\n", file->second.hash, file->second.size, file->second.mtime_ns, file->second.inode, file->first.c_str());
+    }
+    for (std::map<std::string, StepRecord>::const_iterator record = step_records.begin(); record != step_records.end(); record++) {
+        fprintf(cache, "step %016llx %s\n", record->second.key, record->first.c_str());
+        for (std::map<std::string, unsigned long long>::const_iterator output = record->second.outputs.begin(); output != record->second.outputs.end(); output++) {
+            fprintf(cache, "output %s %016llx %s\n", record->first.c_str(), output->second, output->first.c_str());
+        }
+    }
+    if (fclose(cache) != 0 || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        fprintf(stderr, "%s:%d: cannot write %s\n", __FILE__, __LINE__, filename.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Content hash of a file, reusing the cached hash while the file is unchanged on disk; false if the file cannot be read
+bool hash_file(const std::string& filename, unsigned long long& hash){
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return false;
+#ifdef __APPLE__
+    const long long mtime_ns = (long long)info.st_mtimespec.tv_sec*1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+    const long long mtime_ns = (long long)info.st_mtim.tv_sec*1000000000LL + info.st_mtim.tv_nsec;
+#endif
+    std::map<std::string, FileHash>::const_iterator cached = file_hashes.find(filename);
+    if (cached != file_hashes.end() && cached->second.size == (long long)info.st_size && cached->second.mtime_ns == mtime_ns && cached->second.inode == (long long)info.st_ino) {
+        hash = cached->second.hash;
+        return true;
+    }
+    
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL) return false;
+    std::vector<char> buffer(1 << 20);
+    hash = fnv_offset;
+    size_t nread;
+    while ((nread = fread(&buffer[0], 1, buffer.size(), file)) > 0) hash = fnv1a(&buffer[0], nread, hash);
+    const bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) return false;
+    
+    FileHash entry;
+    entry.hash = hash;
+    entry.size = info.st_size;
+    entry.mtime_ns = mtime_ns;
+    entry.inode = info.st_ino;
+    file_hashes[filename] = entry;
+    return true;
+}
+
+// Hash of the lines of a file whose first fields are the selected ones; false if the file cannot be read or no line matches
+bool hash_lines(const LineSelection& selection, unsigned long long& hash){
+    FILE* file = fopen(selection.file.c_str(), "r");
+    if (file == NULL) return false;
+    hash = fnv_offset;
+    int nmatch = 0;
+    char line[16384];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        const std::vector<std::string> field = split_whitespace(strip(line));
+        if (field.size() < selection.fields.size() || field[0][0] == '#') continue;
+        bool match = true;
+        for (size_t i = 0; i < selection.fields.size() && match; i++) match = field[i] == selection.fields[i];
+        if (!match) continue;
+        // Whitespace changes do not count
+        for (size_t i = 0; i < field.size(); i++) hash = fnv1a_field(field[i], hash);
+        nmatch++;
+    }
+    fclose(file);
+    return nmatch > 0;
+}
+
+// The hash of a step's command, parameters and inputs; false if an input cannot be read
+bool step_key(const Step& step, unsigned long long& key){
+    key = fnv1a_field(step.command, fnv_offset);
+    for (size_t i = 0; i < step.params.size(); i++) {
+        key = fnv1a_field(step.params[i].first, key);
+        key = fnv1a_field(step.params[i].second, key);
+    }
+    for (size_t i = 0; i < step.inputs.size(); i++) {
+        unsigned long long hash;
+        if (!hash_file(step.inputs[i], hash)) {
+            fprintf(stderr, "%s:%d: step %s: cannot read input %s\n", __FILE__, __LINE__, step.name.c_str(), step.inputs[i].c_str());
+            return false;
+        }
+        key = fnv1a_field(step.inputs[i], key);
+        key = fnv1a(&hash, sizeof(hash), key);
+    }
+    for (size_t i = 0; i < step.input_lines.size(); i++) {
+        unsigned long long hash;
+        if (!hash_lines(step.input_lines[i], hash)) {
+            fprintf(stderr, "%s:%d: step %s: no line of %s starts with the selected fields\n", __FILE__, __LINE__, step.name.c_str(), step.input_lines[i].file.c_str());
+            return false;
+        }
+        key = fnv1a_field(step.input_lines[i].file, key);
+        for (size_t j = 0; j < step.input_lines[i].fields.size(); j++) key = fnv1a_field(step.input_lines[i].fields[j], key);
+        key = fnv1a(&hash, sizeof(hash), key);
+    }
+    for (size_t i = 0; i < step.outputs.size(); i++) key = fnv1a_field(step.outputs[i], key);
+    return true;
+}
+
+// Whether the outputs of a step are those recorded after its last run with this key
+bool up_to_date(const Step& step, unsigned long long key){
+    std::map<std::string, StepRecord>::const_iterator record = step_records.find(step.name);
+    if (record == step_records.end() || record->second.key != key || record->second.outputs.size() != step.outputs.size()) return false;
+    for (size_t i = 0; i < step.outputs.size(); i++) {
+        std::map<std::string, unsigned long long>::const_iterator output = record->second.outputs.find(step.outputs[i]);
+        unsigned long long hash;
+        if (output == record->second.outputs.end() || !hash_file(step.outputs[i], hash) || hash != output->second) return false;
+    }
+    return true;
+}
+
+enum StepState {PENDING, RUNNING, DONE, FAILED, SKIPPED};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Syntax is [pipeline file] [-j number of parallel steps (default: number of CPUs)] [-n (only list the stale steps)] [-f (rerun every step)] [steps or output files to bring up to date (default: all)]\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    const char* filename = argv[1];
+    long nworker = sysconf(_SC_NPROCESSORS_ONLN);
+    bool dry_run = false;
+    bool force = false;
+    std::vector<std::string> targets;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) nworker = atol(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0) dry_run = true;
+        else if (strcmp(argv[i], "-f") == 0) force = true;
+        else targets.push_back(argv[i]);
+    }
+    if (nworker < 1) nworker = 1;
+    
+    const std::vector<Step> steps = read_pipeline(filename);
+    const std::string cache_filename = std::string(filename) + ".cache";
+    read_cache(cache_filename);
+    
+    // Only the targets and the steps they depend on
+    std::vector<bool> selected(steps.size(), targets.empty());
+    std::vector<size_t> to_select;
+    for (size_t i = 0; i < targets.size(); i++) {
+        bool found = false;
+        for (size_t j = 0; j < steps.size(); j++) {
+            bool match = steps[j].name == targets[i];
+            for (size_t k = 0; k < steps[j].outputs.size(); k++) match = match || steps[j].outputs[k] == targets[i];
+            if (match) {
+                to_select.push_back(j);
+                found = true;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "%s:%d: %s is neither a step nor an output of %s\n", __FILE__, __LINE__, targets[i].c_str(), filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+    while (!to_select.empty()) {
+        const size_t i = to_select.back();
+        to_select.pop_back();
+        if (selected[i]) continue;
+        selected[i] = true;
+        to_select.insert(to_select.end(), steps[i].dependencies.begin(), steps[i].dependencies.end());
+    }
+    
+    // Start every step whose dependencies are done, at most nworker at a time, and wait for one to finish when none can start
+    std::vector<StepState> state(steps.size(), PENDING);
+    std::vector<unsigned long long> key(steps.size(), 0);
+    // In a dry run, the steps that would run; their dependents would run too, as their inputs are not known yet
+    std::vector<bool> would_run(steps.size(), false);
+    std::map<pid_t, size_t> running;
+    int nrun = 0;
+    int nuptodate = 0;
+    int nfailed = 0;
+    while (true) {
+        bool progress = false;
+        for (size_t i = 0; i < steps.size(); i++) {
+            if (!selected[i] || state[i] != PENDING) continue;
+            bool waiting = false;
+            bool dependency_failed = false;
+            bool dependency_would_run = false;
+            for (size_t j = 0; j < steps[i].dependencies.size(); j++) {
+                const StepState dependency = state[steps[i].dependencies[j]];
+                if (dependency == FAILED || dependency == SKIPPED) dependency_failed = true;
+                else if (dependency != DONE) waiting = true;
+                dependency_would_run = dependency_would_run || would_run[steps[i].dependencies[j]];
+            }
+            if (dependency_failed) {
+                std::cout << "[" << steps[i].name << "] skipped, a step it depends on failed" << std::endl;
+                state[i] = SKIPPED;
+                progress = true;
+                continue;
+            }
+            if (waiting) continue;
+    
+            if (dry_run) {
+                if (dependency_would_run || force || !step_key(steps[i], key[i]) || !up_to_date(steps[i], key[i])) {
+                    std::cout << "[" << steps[i].name << "] would run: " << steps[i].command << std::endl;
+                    would_run[i] = true;
+                    nrun++;
+                }
+                else {
+                    nuptodate++;
+                }
+                state[i] = DONE;
+                progress = true;
+                continue;
+            }
+    
+            if (!step_key(steps[i], key[i])) {
+                state[i] = FAILED;
+                nfailed++;
+                progress = true;
+                continue;
+            }
+            if (!force && up_to_date(steps[i], key[i])) {
+                std::cout << "[" << steps[i].name << "] up to date" << std::endl;
+                state[i] = DONE;
+                nuptodate++;
+                progress = true;
+                continue;
+            }
+            if ((long)running.size() >= nworker) continue;
+    
+            // Forget the old record first, so that a failed or interrupted run leaves the step stale
+            step_records.erase(steps[i].name);
+            write_cache(cache_filename);
+            std::cout << "[" << steps[i].name << "] running: " << steps[i].command << std::endl;
+            const pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                execl("/bin/sh", "sh", "-c", steps[i].command.c_str(), (char*)NULL);
+                perror("execl");
+                _exit(127);
+            }
+            running[pid] = i;
+            state[i] = RUNNING;
+            progress = true;
+        }
+        if (progress) continue;
+        if (running.empty()) break;
+    
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("wait");
+            exit(EXIT_FAILURE);
+        }
+        if (running.count(pid) == 0) continue;
+        const size_t i = running[pid];
+        running.erase(pid);
+        nrun++;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "%s:%d: step %s failed\n", __FILE__, __LINE__, steps[i].name.c_str());
+            state[i] = FAILED;
+            nfailed++;
+            continue;
+        }
+        StepRecord record;
+        record.key = key[i];
+        bool outputs_written = true;
+        for (size_t j = 0; j < steps[i].outputs.size(); j++) {
+            unsigned long long hash;
+            if (!hash_file(steps[i].outputs[j], hash)) {
+                fprintf(stderr, "%s:%d: step %s did not write its output %s\n", __FILE__, __LINE__, steps[i].name.c_str(), steps[i].outputs[j].c_str());
+                outputs_written = false;
+                continue;
+            }
+            record.outputs[steps[i].outputs[j]] = hash;
+        }
+        if (!outputs_written) {
+            state[i] = FAILED;
+            nfailed++;
+            continue;
+        }
+        step_records[steps[i].name] = record;
+        write_cache(cache_filename);
+        std::cout << "[" << steps[i].name << "] done" << std::endl;
+        state[i] = DONE;
+    }
+    
+    int nskipped = 0;
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (state[i] == SKIPPED) nskipped++;
+    }
+    if (dry_run) {
+        std::cout << nrun << " steps would run, " << nuptodate << " are up to date" << std::endl;
+        return EXIT_SUCCESS;
+    }
+    std::cout << nrun << " steps run, " << nuptodate << " up to date, " << nfailed << " failed, " << nskipped << " skipped" << std::endl;
+    
+    return nfailed == 0 && nskipped == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,359 @@
+// This program is the compiled batch version of CompareHistograms.py, as called by loopovervariables.cc, loopoverratios.cc and
+// comparehistsforallvars.sh: for every page listed in a manifest, it superimposes the histogram of the same name from each ROOT
+// file of an input list, with the ATLAS style, and writes <output dir>/<histogram><tag>_Comparison.pdf along with the percent
+// difference of the second file with respect to the first, <histogram><tag>_Ratio.pdf
+// Each input list is opened once for all of its pages, and pages are spread over forked worker processes
+//
+// Manifest format: fields separated by |, any number of lines per input list, blank lines and lines starting with # are ignored
+// <input list> | <histograms, comma separated> | <tag> | <legend title> | <x axis label> | <y axis label> | <y minimum> | <y maximum> [| <output dir>]
+// corresponding to CompareHistograms.py -i <input list> --hists <histograms> -t <tag> -m <legend title> -x ... -y ... -z <y minimum> -a <y maximum>
+// (e.g. comparehistsforallvars.manifest); the input lists have the usual format, <ROOT file name>, <label for legend> on each row
+//
+// Compile with the ATLAS style:
+// g++ -O2 -std=c++11 $(root-config --cflags) plot_comparisons.cc ../../general_tools/atlasstyle-00-03-05/AtlasStyle.C
+//     ../../general_tools/atlasstyle-00-03-05/AtlasUtils.C -o plot_comparisons $(root-config --libs)
+// Author: Ivan Chernyshev
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TROOT.h>
+#include <TCanvas.h>
+#include <TStyle.h>
+#include <TGraphErrors.h>
+#include <TMultiGraph.h>
+#include <TLine.h>
+#include <TList.h>
+#include <TAxis.h>
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../../general_tools/atlasstyle-00-03-05/AtlasStyle.h"
+#include "../../general_tools/atlasstyle-00-03-05/AtlasUtils.h"
+
+// Same marker colors and styles as CompareHistograms.py, one per input file
+const int num_of_styles = 6;
+const int graph_colors[num_of_styles] = {1, 2, 4, 7, 9, 8};
+const int graph_styles[num_of_styles] = {20, 21, 24, 26, 27, 32};
+
+// One comparison page (and its ratio page)
+struct ComparisonPage {
+    std::string histogram;
+    std::string tag;
+    std::string legend_title;
+    std::string xaxis_label;
+    std::string yaxis_label;
+    double yminimum;
+    double ymaximum;
+    std::string output_dir;
+};
+
+// The pages of one input list; a worker renders a contiguous chunk of them
+struct InputListPages {
+    std::string input_list;
+    std::vector<ComparisonPage> pages;
+};
+
+// A unit of work for a worker process: pages [first, last) of an input list
+struct PageChunk {
+    size_t list;
+    size_t first;
+    size_t last;
+};
+
+// Strip the leading and trailing whitespace
+std::string strip(const std::string& s){
+    const size_t first = s.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// Split s at every separator, stripping each field
+std::vector<std::string> split(const std::string& s, char separator){
+    std::vector<std::string> field;
+    size_t start = 0;
+    for (size_t end = s.find(separator); end != std::string::npos; end = s.find(separator, start)) {
+        field.push_back(strip(s.substr(start, end - start)));
+        start = end + 1;
+    }
+    field.push_back(strip(s.substr(start)));
+    return field;
+}
+
+// Parse the manifest, and group the pages by input list, in order of first appearance
+std::vector<InputListPages> read_manifest(const char* filename){
+    // - reads the manifest from the standard input, e.g. from a pipeline step (see pipeline.cc)
+    FILE* manifest = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (manifest == NULL) {
+        fprintf(stderr, "%s:%d: cannot open manifest %s\n", __FILE__, __LINE__, filename);
+        exit(EXIT_FAILURE);
+    }
+    
+    std::vector<InputListPages> lists;
+    std::map<std::string, size_t> list_index;
+    char line[16384];
+    int line_number = 0;
+    
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        line_number++;
+        const std::string stripped = strip(line);
+        if (stripped.empty() || stripped[0] == '#') continue;
+        const std::vector<std::string> field = split(stripped, '|');
+        if (field.size() < 8 || field.size() > 9) {
+            fprintf(stderr, "%s:%d: %s line %d: expected <input list> | <histograms> | <tag> | <legend title> | <x axis label> | <y axis label> | <y minimum> | <y maximum> [| <output dir>]\n", __FILE__, __LINE__, filename, line_number);
+            exit(EXIT_FAILURE);
+        }
+    
+        ComparisonPage page;
+        page.tag = field[2];
+        page.legend_title = field[3];
+        page.xaxis_label = field[4];
+        page.yaxis_label = field[5];
+        char* end;
+        page.yminimum = strtod(field[6].c_str(), &end);
+        if (*end != '\0') {
+            fprintf(stderr, "%s:%d: %s line %d: invalid y minimum %s\n", __FILE__, __LINE__, filename, line_number, field[6].c_str());
+            exit(EXIT_FAILURE);
+        }
+        page.ymaximum = strtod(field[7].c_str(), &end);
+        if (*end != '\0') {
+            fprintf(stderr, "%s:%d: %s line %d: invalid y maximum %s\n", __FILE__, __LINE__, filename, line_number, field[7].c_str());
+            exit(EXIT_FAILURE);
+        }
+        page.output_dir = field.size() > 8 && !field[8].empty() ? field[8] : ".";
+    
+        if (list_index.count(field[0]) == 0) {
+            list_index[field[0]] = lists.size();
+            lists.push_back(InputListPages());
+            lists.back().input_list = field[0];
+        }
+        const std::vector<std::string> histograms = split(field[1], ',');
+        for (size_t i = 0; i < histograms.size(); i++) {
+            if (histograms[i].empty()) continue;
+            page.histogram = histograms[i];
+            lists[list_index[field[0]]].pages.push_back(page);
+        }
+    }
+    if (manifest != stdin) fclose(manifest);
+    
+    return lists;
+}
+
+// Percent difference (num/den - 1)*100 point by point, as DivideGraphs of CompareHistograms.py
+TGraphErrors* percent_difference(TGraphErrors* den, TGraphErrors* num){
+    TGraphErrors* ratio = new TGraphErrors();
+    for (int i = 0; i < den->GetN() && i < num->GetN(); i++) {
+        double x, y1, y2;
+        num->GetPoint(i, x, y2);
+        den->GetPoint(i, x, y1);
+        if (y1 != 0) {
+            ratio->SetPoint(ratio->GetN(), x, (y2/y1 - 1)*100);
+        }
+    }
+    return ratio;
+}
+
+// Render pages [first, last) of an input list; returns the number of pages that could not be made
+int render_pages(const InputListPages& list, size_t first, size_t last){
+    // Open every file of the input list once
+    FILE* inlist = fopen(list.input_list.c_str(), "r");
+    if (inlist == NULL) {
+        fprintf(stderr, "%s:%d: cannot open input list %s\n", __FILE__, __LINE__, list.input_list.c_str());
+        return last - first;
+    }
+    std::vector<TFile*> files;
+    std::vector<std::string> labels;
+    char line[4096];
+    while (fgets(line, sizeof(line), inlist) != NULL) {
+        if (line[0] == '#' || strip(line).empty()) continue;
+        const std::vector<std::string> field = split(line, ',');
+        TFile* file = TFile::Open(field[0].c_str(), "READ");
+        if (file == NULL || file->IsZombie()) {
+            fprintf(stderr, "%s:%d: %s: skipping missing file %s\n", __FILE__, __LINE__, list.input_list.c_str(), field[0].c_str());
+            continue;
+        }
+        files.push_back(file);
+        labels.push_back(field.size() > 1 ? field[1] : "");
+    }
+    fclose(inlist);
+    
+    TCanvas canvas("canvas", "", 800, 600);
+    int nfailed = 0;
+    
+    for (size_t p = first; p < last; p++) {
+        const ComparisonPage& page = list.pages[p];
+        mkdir(page.output_dir.c_str(), 0755);
+    
+        // One graph per file that has the histogram
+        std::vector<TGraphErrors*> graphs;
+        std::vector<std::string> graph_labels;
+        for (size_t i = 0; i < files.size(); i++) {
+            TObject* object = files[i]->Get(page.histogram.c_str());
+            TGraphErrors* graph = NULL;
+            if (TH1* hist = dynamic_cast<TH1*>(object)) {
+                graph = new TGraphErrors(hist);
+            }
+            else {
+                graph = dynamic_cast<TGraphErrors*>(object);
+            }
+            if (graph == NULL) {
+                fprintf(stderr, "%s:%d: skipping missing histogram %s in %s\n", __FILE__, __LINE__, page.histogram.c_str(), files[i]->GetName());
+                continue;
+            }
+            const int style = graphs.size() % num_of_styles;
+            graph->SetLineColor(graph_colors[style]);
+            graph->SetMarkerColor(graph_colors[style]);
+            graph->SetMarkerStyle(graph_styles[style]);
+            graph->SetMarkerSize(1);
+            graph->SetLineWidth(2);
+            graphs.push_back(graph);
+            graph_labels.push_back(labels[i]);
+        }
+        if (graphs.empty()) {
+            fprintf(stderr, "%s:%d: %s: no file has histogram %s, skipping the page\n", __FILE__, __LINE__, list.input_list.c_str(), page.histogram.c_str());
+            nfailed++;
+            continue;
+        }
+    
+        canvas.cd();
+        canvas.Clear();
+        TMultiGraph* multi = new TMultiGraph();
+        for (size_t i = 0; i < graphs.size(); i++) {
+            multi->Add(graphs[i]);
+        }
+        multi->Draw("ALP");
+        gStyle->SetErrorX(0.0001);
+        multi->SetMaximum(1.02*multi->GetHistogram()->GetMaximum());
+        multi->GetXaxis()->SetTitle(page.xaxis_label.c_str());
+        multi->GetYaxis()->SetTitle(page.yaxis_label.c_str());
+        multi->GetXaxis()->SetTitleSize(0.04);
+        multi->GetXaxis()->SetTitleOffset(1.6);
+        multi->GetYaxis()->SetRangeUser(page.yminimum, page.ymaximum);
+        multi->GetXaxis()->SetNdivisions(10);
+    
+        // Legend, as the Legend class of Legend.py: title, then one line sample and label per file
+        const double legend_x = 0.6;
+        const double legend_y = 0.96;
+        const double step_y = 0.05;
+        const double line_length = 0.015;
+        myText(legend_x, legend_y, 1, Form("#font[62]{#scale[0.9]{%s}}", page.legend_title.c_str()));
+        for (size_t i = 0; i < graphs.size(); i++) {
+            TLine line_sample;
+            line_sample.SetLineColor(graphs[i]->GetLineColor());
+            line_sample.SetLineWidth(graphs[i]->GetLineWidth() + 1);
+            line_sample.DrawLineNDC(legend_x + 0.02 - line_length, legend_y - 0.05 - i*step_y, legend_x + 0.02 + line_length, legend_y - 0.05 - i*step_y);
+            myText(legend_x + 0.05, legend_y - i*step_y - 0.065, 1, Form("#scale[0.7]{%s}", graph_labels[i].c_str()));
+        }
+        myText(0.2, 0.9, 1, "#font[62]{#scale[0.9]{15 GeV < p_{T_{trigger}} < 30 GeV}}");
+        myText(0.2, 0.80, 1, "#font[62]{#scale[0.9]{p_{T}^{jet} > 10 GeV ; R=0.4}}");
+    
+        const std::string page_name = page.output_dir + "/" + page.histogram + page.tag;
+        canvas.SaveAs((page_name + "_Comparison.pdf").c_str());
+    
+        // Percent difference of the second file with respect to the first
+        if (graphs.size() > 1) {
+            canvas.Clear();
+            TGraphErrors* ratio = percent_difference(graphs[0], graphs[1]);
+            ratio->Draw("ALP");
+            canvas.SaveAs((page_name + "_Ratio.pdf").c_str());
+            delete ratio;
+        }
+    
+        canvas.Clear();
+        delete multi;
+    }
+    
+    for (size_t i = 0; i < files.size(); i++) {
+        files[i]->Close();
+        delete files[i];
+    }
+    
+    return nfailed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Syntax is [manifest, or - for the standard input] [number of parallel workers (default: number of CPUs)]\n");
+        fprintf(stderr, "Each manifest line: <input list> | <histograms> | <tag> | <legend title> | <x axis label> | <y axis label> | <y minimum> | <y maximum> [| <output dir>]\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    const std::vector<InputListPages> lists = read_manifest(argv[1]);
+    long nworker = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworker < 1) nworker = 1;
+    
+    gROOT->SetBatch(kTRUE);
+    TH1::AddDirectory(kFALSE);
+    SetAtlasStyle();
+    
+    // Split the pages of each input list into as many chunks as there are workers per input list, so that a few input lists with
+    // many pages still use all workers (each chunk opens the input files once)
+    size_t npage = 0;
+    for (size_t i = 0; i < lists.size(); i++) {
+        npage += lists[i].pages.size();
+    }
+    std::vector<PageChunk> chunks;
+    for (size_t i = 0; i < lists.size(); i++) {
+        const size_t nchunk = std::max<size_t>(1, nworker/lists.size());
+        const size_t chunk_size = (lists[i].pages.size() + nchunk - 1)/nchunk;
+        for (size_t first = 0; first < lists[i].pages.size(); first += chunk_size) {
+            PageChunk chunk;
+            chunk.list = i;
+            chunk.first = first;
+            chunk.last = std::min(first + chunk_size, lists[i].pages.size());
+            chunks.push_back(chunk);
+        }
+    }
+    
+    // At most nworker forked workers at a time; the parent never opens a ROOT file
+    std::map<pid_t, size_t> running;
+    int nfailed_chunk = 0;
+    size_t next_chunk = 0;
+    while (next_chunk < chunks.size() || !running.empty()) {
+        if (next_chunk < chunks.size() && (long)running.size() < nworker) {
+            const PageChunk& chunk = chunks[next_chunk];
+            if (nworker == 1) {
+                if (render_pages(lists[chunk.list], chunk.first, chunk.last) != 0) nfailed_chunk++;
+                next_chunk++;
+                continue;
+            }
+            const pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                _exit(render_pages(lists[chunk.list], chunk.first, chunk.last) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            running[pid] = next_chunk;
+            next_chunk++;
+            continue;
+        }
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            exit(EXIT_FAILURE);
+        }
+        if (running.count(pid) == 0) continue;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "%s:%d: some pages of %s could not be made\n", __FILE__, __LINE__, lists[chunks[running[pid]].list].input_list.c_str());
+            nfailed_chunk++;
+        }
+        running.erase(pid);
+    }
+    
+    std::cout << npage << " pages from " << lists.size() << " input lists, " << nfailed_chunk << " of " << chunks.size() << " chunks with missing pages" << std::endl;
+    
+    return nfailed_chunk == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
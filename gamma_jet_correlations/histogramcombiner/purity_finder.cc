@@ -1,5 +1,6 @@
-\// This program outputs the purity of a given data set, in the form of a ROOT output file
+// This program outputs the purity of a given data set, in the form of a ROOT output file
 // Requires that the data posesses a TOT_clusterpt histogram, which contains a distribution of all of the purities of the data sample, and that the data's cluster pT is between 12.5 and 40 GeV
+// The purities per cluster pT interval come from a purity table (see PurityTable.h, e.g. written by purity_fit.cc), or by default from the analysis note values below; the result is a fraction, as taken by background_purity_subtraction
 // Author: Ivan Chernyshev; Date: 10/16/2018
 
 #include <TH1.h>
@@ -7,6 +8,8 @@
 #include <TMath.h>
 #include <iostream>
 
+#include "PurityTable.h"
+
 const int num_of_datatypes = 2;
 const int num_of_id_vars = 2;
 //enum photon_IDVARS {LAMBDA_0, DNN, EMAX_OVER_ECLUSTER};
@@ -53,33 +56,29 @@ void SetCut(TH1* h, double min, double max){
     return;
 }
 
-// Integration function, based on the Integrate.cc function
-double integrate(std::string filename, std::string histname, double minval, double maxval) {
-    TFile* inputfile = new TFile(filename.c_str(), "READ");
-    if (inputfile == NULL){
-        std::cout << "Error: file " << filename << " not found" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    
-    // Get histogram
-    TH1* histogram = 0;
-    inputfile->GetObject(histname.c_str(), histogram);
-    if (histogram == NULL){
-        std::cout << "Error: histogram " << histname << " not found" << std::endl;
-        exit(EXIT_FAILURE);
+// The purity table of the analysis note values above, in the format of PurityTable.h (fractions rather than percent)
+std::vector<PurityEntry> builtin_purity_table(){
+    std::vector<PurityEntry> table;
+    for (int i = 0; i < num_of_datatypes; i++) {
+        for (int j = 0; j < num_of_id_vars; j++) {
+            for (int k = 0; k < num_of_pt_intervals; k++) {
+                PurityEntry entry;
+                entry.datatype = datatype_identifiers[i];
+                entry.idvar = Idvar_identifiers[j];
+                entry.cluspT_min = cluspT_intervals[k];
+                entry.cluspT_max = cluspT_intervals[k + 1];
+                entry.purity = purities[i][j][k]/100;
+                entry.deltapurity = purityerrors[i][j][k]/100;
+                table.push_back(entry);
+            }
+        }
     }
-    
-    //Get the minimum and maximum indices and integrate
-    double integral_result = histogram->Integral(histogram->FindBin(minval), histogram->FindBin(maxval));
-    std::cout << "Integral of Histogram " << histname << " from file " << filename << " from " << minval << " to " << maxval << ": " << integral_result << std::endl;
-    
-    
-    return(integral_result);
+    return table;
 }
 
 int main(int argc, char *argv[]) {
     if(argc < 6) {
-        std::cout << "Error: syntax is ./Integrate [ROOT filename] [Cluster pT min] [Cluster pT max] [Type of data (pp or pPb)] [Shower-shape selection variable]" << std::endl;
+        std::cout << "Error: syntax is ./purity_finder [ROOT filename] [Cluster pT min] [Cluster pT max] [Type of data (pp or pPb)] [Shower-shape selection variable] [purity table (optional, e.g. from purity_fit; default: analysis note values)]" << std::endl;
         exit(EXIT_FAILURE);
     }
     
@@ -99,49 +98,32 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
     
-    // Set the data type used
-    std::string name_of_datatype = (std::string)argv[4];
-    int datatype_index = -1;
-    for (int i = 0; i < num_of_datatypes; i++) {
-        if(name_of_datatype == datatype_identifiers[i]) {
-            datatype_index = i;
-            break;
-        }
-    }
-    if (datatype_index == -1) {
-        std::cout << "ERROR: Data type selection variable must be: \""  << datatype_identifiers[0] << "\", or \"" << datatype_identifiers[1] << std::endl;
-        exit(EXIT_FAILURE);
-    }
+    // Get the purities per cluster pT interval, from the purity table if one is given
+    const std::vector<PurityEntry> table = argc > 6 ? read_purity_table(argv[6]) : builtin_purity_table();
     
-    // Set the variable specifying the shower-shape variable used
+    // Set the data type and the shower-shape variable used
+    std::string name_of_datatype = (std::string)argv[4];
     std::string name_of_showershapevar = (std::string)argv[5];
-    int showershape_index = -1;
-    for (int i = 0; i < num_of_id_vars; i++) {
-        if(name_of_showershapevar == Idvar_identifiers[i]) {
-            showershape_index = i;
-            break;
+    const std::vector<PurityEntry> intervals = purity_intervals(table, name_of_datatype, name_of_showershapevar);
+    if (intervals.empty()) {
+        std::cout << "ERROR: no purities for data type \"" << name_of_datatype << "\" and shower-shape selection variable \"" << name_of_showershapevar << "\"; available:";
+        for (size_t i = 0; i < table.size(); i++) {
+            if (i == 0 || table[i].datatype != table[i - 1].datatype || table[i].idvar != table[i - 1].idvar) std::cout << " " << table[i].datatype << "/" << table[i].idvar;
         }
-    }
-    if (showershape_index == -1) {
-        std::cout << "ERROR: Shower shape selection variable must be: \"" << Idvar_identifiers[0] << "\" or \"" << Idvar_identifiers[2] << std::endl;
+        std::cout << std::endl;
         exit(EXIT_FAILURE);
     }
-        
-    // Caluculate the purity and its uncertainty
-    double total_purity = 0;
-    double total_delta_purity = 0;
+    
     double minval = atof(argv[2]);
     double maxval = atof(argv[3]);
     
-    int i = 1;
-    
     // Quit the program if the minimum cluster pT submitted is smaller than the minimum of the pT intervals or larger than the maximum of the pT intervals
-    if (minval < cluspT_intervals[0]) {
-        std::cout << "ERROR: minimum cluster p_{T} value must be at least " << cluspT_intervals[0] << " GeV" << std::endl;
+    if (minval < intervals.front().cluspT_min) {
+        std::cout << "ERROR: minimum cluster p_{T} value must be at least " << intervals.front().cluspT_min << " GeV" << std::endl;
         exit(EXIT_FAILURE);
     }
-    if (maxval > cluspT_intervals[num_of_pt_intervals]) {
-        std::cout << "ERROR: maximum cluster p_{T} value must be at most " << cluspT_intervals[num_of_pt_intervals] << " GeV" << std::endl;
+    if (maxval > intervals.back().cluspT_max) {
+        std::cout << "ERROR: maximum cluster p_{T} value must be at most " << intervals.back().cluspT_max << " GeV" << std::endl;
         exit(EXIT_FAILURE);
     }
     // A failsafe, in case submitted min pt is not smaller than submitted max pt
@@ -150,44 +132,17 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
     
-    // Iterate over all pT intervals that at least partially overlap with the specified datarange, adding up purities and purity uncertainties (latter is added in quadrature)
-    while(minval > cluspT_intervals[i])
-        i++;
-    
-    if (cluspT_intervals[i] < maxval) {
-        double num_in_interval = integrate(filename, "TOT_clusterpt", minval, cluspT_intervals[i]);
-        total_purity += (num_in_interval*purities[datatype_index][showershape_index][i-1]);
-        total_delta_purity += (num_in_interval*purityerrors[datatype_index][showershape_index][i-1])*(num_in_interval*purityerrors[datatype_index][showershape_index][i-1]);
-        i++;
-        
-        while(cluspT_intervals[i] < maxval) {
-            num_in_interval = integrate(filename, "TOT_clusterpt", cluspT_intervals[i - 1], cluspT_intervals[i]);
-            total_purity += (num_in_interval*purities[datatype_index][showershape_index][i-1]);
-            total_delta_purity += (num_in_interval*purityerrors[datatype_index][showershape_index][i-1])*(num_in_interval*purityerrors[datatype_index][showershape_index][i-1]);
-            i++;
-        }
-        num_in_interval = integrate(filename, "TOT_clusterpt", cluspT_intervals[i - 1], maxval);
-        total_purity += (num_in_interval*purities[datatype_index][showershape_index][i-1]);
-        total_delta_purity += (num_in_interval*purityerrors[datatype_index][showershape_index][i-1])*(num_in_interval*purityerrors[datatype_index][showershape_index][i-1]);
-        i++;
-    }
-    else {
-        double num_in_interval = integrate(filename, "TOT_clusterpt", minval, maxval);
-        total_purity += (num_in_interval*purities[datatype_index][showershape_index][i-1]);
-        total_delta_purity += (num_in_interval*purityerrors[datatype_index][showershape_index][i-1])*(num_in_interval*purityerrors[datatype_index][showershape_index][i-1]);
-        i++;
+    // Average the purities of all pT intervals that at least partially overlap with the specified datarange, weighted by the number of clusters (uncertainties are added in quadrature)
+    double total_purity = 0;
+    double total_delta_purity = 0;
+    if (!weighted_purity(table, name_of_datatype, name_of_showershapevar, cluspT_hist, minval, maxval, total_purity, total_delta_purity)) {
+        std::cout << "ERROR: the purity table does not cover the cluster pT range " << minval << " to " << maxval << " without gaps, or there are no clusters in it" << std::endl;
+        exit(EXIT_FAILURE);
     }
     
-    // Now, normalize the total purity and the error (and take a square root of the latter before doing so, because we're adding in quadrature)
-    total_delta_purity = TMath::Sqrt(total_delta_purity);
-    double num_total = integrate(filename, "TOT_clusterpt", minval, maxval);
-    total_purity = total_purity/num_total;
-    total_delta_purity = total_delta_purity/num_total;
-    
     // Now print out the results
     std::cout << "Resultant purity for dataset " << filename << " with " << name_of_datatype << " data processed by the " << name_of_showershapevar << " shower-shape cut over cluster pT range " << minval << " to " << maxval << " is: " << total_purity << " +/- " << total_delta_purity << std::endl;
     
     std::cout << "ending" << std::endl;
     return(EXIT_SUCCESS);
 }
-
@@ -0,0 +1,495 @@
+// This program measures the photon purity of the isolated clusters of a data set by shower-shape template fits, and writes it to a
+// purity table (see PurityTable.h) read by purity_finder.cc and background_purity_subtraction.C
+//
+// For every shower-shape variable (lambda_0, DNN, Emax_over_Ecluster) and cluster pT interval, the distribution of the isolated
+// data clusters is fitted (TFractionFitter) with
+// - a signal template: isolated clusters matched to a true prompt photon in the Monte-Carlo (e.g. 17g6a1), as unweighted counts,
+//   the cross section per trial weights of the pT-hat bins being given to the fit per bin (TFractionFitter::SetWeight)
+// - a background template: anti-isolated data clusters (noniso_min < isolation < noniso_max)
+// The purity is the fitted signal yield over the number of data clusters inside the signal region of the variable
+// (SIG_<variable>_min, SIG_<variable>_max), as selected by GammaJet.cc
+//
+// Cuts are read from GammaJet_config.yaml in the current directory, with the same keys and defaults as GammaJet.cc. The data and
+// Monte-Carlo NTuples are read once for all variables and intervals; the fits run in parallel in forked worker processes
+// The templates, the data and the fit results are also written to <purity table>.root for inspection
+// Author: Ivan Chernyshev
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TDirectoryFile.h>
+#include <TH1D.h>
+#include <TMath.h>
+#include <TROOT.h>
+#include <TObjArray.h>
+#include <TFractionFitter.h>
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "PurityTable.h"
+#include "../BoostAdjustment.h"
+
+#define NTRACK_MAX (1U << 15)
+
+const int MAX_INPUT_LENGTH = 200;
+
+enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_04_02, CLUSTER_FRIXIONE_ITS_04_02};
+
+// Shower-shape variables, named as the photon_idvar values of GammaJet_config.yaml, with their template binning
+const int num_of_id_vars = 3;
+const std::string Idvar_identifiers[num_of_id_vars] = {"lambda_0", "DNN", "Emax_over_Ecluster"};
+const std::string Idvar_titles[num_of_id_vars] = {"#lambda_{0}^{2}", "DNN", "#frac{E_{max}}{E_{cluster}}"};
+const int idvar_bins[num_of_id_vars] = {80, 40, 40};
+const double idvar_min[num_of_id_vars] = {0.0, 0.0, 0.0};
+const double idvar_max[num_of_id_vars] = {2.0, 1.0, 1.0};
+
+// Cluster pT intervals, as in purity_finder.cc
+const int num_of_pt_intervals = 8;
+const double cluspT_intervals[num_of_pt_intervals + 1] = {12.5, 13.5, 14.0, 16.0, 18.0, 20.0, 25.0, 30.0, 40.0};
+
+// Cuts, from GammaJet_config.yaml
+struct PurityCuts {
+    double primary_vertex_max;
+    double Cluster_Eta_max;
+    double Cluster_ncell_min;
+    double Cluster_locmaxima_max;
+    double Cluster_distobadchannel;
+    double EcrossoverE_min;
+    double iso_max;
+    double noniso_min;
+    double noniso_max;
+    double SIG_min[num_of_id_vars];
+    double SIG_max[num_of_id_vars];
+    isolationDet determiner;
+    int rightpdgcode;
+    int rightparentpdgcode;
+};
+
+// Data, signal template and background template of every variable and pT interval
+struct PurityHistograms {
+    TH1D* data[num_of_id_vars][num_of_pt_intervals];
+    TH1D* signal[num_of_id_vars][num_of_pt_intervals];         // counts, as TFractionFitter takes them
+    TH1D* signal_weighted[num_of_id_vars][num_of_pt_intervals];// sum of the cross section per trial weights
+    TH1D* background[num_of_id_vars][num_of_pt_intervals];
+};
+
+// Result of one template fit
+struct PurityFitResult {
+    double status;
+    double purity;
+    double deltapurity;
+    double signal_fraction;
+    double delta_signal_fraction;
+};
+
+PurityCuts read_config(const char* filename){
+    // Same defaults as GammaJet.cc
+    PurityCuts cuts;
+    cuts.primary_vertex_max = 10.0;
+    cuts.Cluster_Eta_max = 0.67;
+    cuts.Cluster_ncell_min = 2;
+    cuts.Cluster_locmaxima_max = 2.0;
+    cuts.Cluster_distobadchannel = 2.0;
+    cuts.EcrossoverE_min = 0.05;
+    cuts.iso_max = 1.0;
+    cuts.noniso_min = 2.0;
+    cuts.noniso_max = 10.0;
+    cuts.SIG_min[0] = 0.0;
+    cuts.SIG_max[0] = 0.4;
+    cuts.SIG_min[1] = 0.55;
+    cuts.SIG_max[1] = 0.85;
+    cuts.SIG_min[2] = 0.0;
+    cuts.SIG_max[2] = 0.5;
+    cuts.determiner = CLUSTER_ISO_ITS_04;
+    cuts.rightpdgcode = 22;
+    cuts.rightparentpdgcode = 22;
+    
+    FILE* config = fopen(filename, "r");
+    if (config == NULL) {
+        std::cout << "no config, using the default cuts" << std::endl;
+        return cuts;
+    }
+    char line[MAX_INPUT_LENGTH];
+    while (fgets(line, MAX_INPUT_LENGTH, config) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        char key[MAX_INPUT_LENGTH];
+        char dummy[MAX_INPUT_LENGTH];
+        char value[MAX_INPUT_LENGTH];
+        key[0] = '\0';
+        value[0] = '\0';
+        sscanf(line, "%[^:]:%[ \t]%100[^\n]", key, dummy, value);
+    
+        if (strcmp(key, "primary_vertex_max") == 0) cuts.primary_vertex_max = atof(value);
+        else if (strcmp(key, "Cluster_Eta_max") == 0) cuts.Cluster_Eta_max = atof(value);
+        else if (strcmp(key, "Cluster_ncell_min") == 0) cuts.Cluster_ncell_min = atof(value);
+        else if (strcmp(key, "Cluster_locmaxima_max") == 0) cuts.Cluster_locmaxima_max = atof(value);
+        else if (strcmp(key, "Cluster_distobadchannel") == 0) cuts.Cluster_distobadchannel = atof(value);
+        else if (strcmp(key, "EcrossoverE_min") == 0) cuts.EcrossoverE_min = atof(value);
+        else if (strcmp(key, "iso_max") == 0) cuts.iso_max = atof(value);
+        else if (strcmp(key, "noniso_min") == 0) cuts.noniso_min = atof(value);
+        else if (strcmp(key, "noniso_max") == 0) cuts.noniso_max = atof(value);
+        else if (strcmp(key, "SIG_lambda_min") == 0) cuts.SIG_min[0] = atof(value);
+        else if (strcmp(key, "SIG_lambda_max") == 0) cuts.SIG_max[0] = atof(value);
+        else if (strcmp(key, "SIG_DNN_min") == 0) cuts.SIG_min[1] = atof(value);
+        else if (strcmp(key, "SIG_DNN_max") == 0) cuts.SIG_max[1] = atof(value);
+        else if (strcmp(key, "SIG_Emax_over_Ecluster_min") == 0) cuts.SIG_min[2] = atof(value);
+        else if (strcmp(key, "SIG_Emax_over_Ecluster_max") == 0) cuts.SIG_max[2] = atof(value);
+        else if (strcmp(key, "pdg_code") == 0) cuts.rightpdgcode = atoi(value);
+        else if (strcmp(key, "parent_pdg_code") == 0) cuts.rightparentpdgcode = atoi(value);
+        else if (strcmp(key, "Cluster_isolation_determinant") == 0) {
+            if (strcmp(value, "cluster_iso_tpc_04") == 0) cuts.determiner = CLUSTER_ISO_TPC_04;
+            else if (strcmp(value, "cluster_iso_its_04") == 0) cuts.determiner = CLUSTER_ISO_ITS_04;
+            else if (strcmp(value, "cluster_frixione_tpc_04_02") == 0) cuts.determiner = CLUSTER_FRIXIONE_TPC_04_02;
+            else if (strcmp(value, "cluster_frixione_its_04_02") == 0) cuts.determiner = CLUSTER_FRIXIONE_ITS_04_02;
+            else {
+                std::cout << "ERROR: Cluster_isolation_determinant in configuration file must be \"cluster_iso_tpc_04\", \"cluster_iso_its_04\", \"cluster_frixione_tpc_04_02\", or \"cluster_frixione_its_04_02\"" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    fclose(config);
+    
+    return cuts;
+}
+
+// Split a comma-separated list of file names
+std::vector<std::string> parse_filenames(const char* list){
+    std::vector<std::string> filenames;
+    std::string s = list;
+    size_t start = 0;
+    for (size_t end = s.find(','); ; end = s.find(',', start)) {
+        const std::string filename = s.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (!filename.empty()) filenames.push_back(filename);
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    return filenames;
+}
+
+// Fill the data and background (is_mc false) or signal (is_mc true) histograms from the NTuples
+void fill_histograms(const std::vector<std::string>& filenames, bool is_mc, const PurityCuts& cuts, PurityHistograms& hists){
+    for (size_t ifile = 0; ifile < filenames.size(); ifile++) {
+        std::cout << "Opening: " << filenames[ifile] << std::endl;
+        TFile* file = TFile::Open(filenames[ifile].c_str());
+        if (file == NULL) {
+            std::cout << " fail; could not open file" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        TTree* _tree_event = dynamic_cast<TTree *> (file->Get("_tree_event"));
+        if (_tree_event == NULL) {
+            TDirectoryFile* directory = dynamic_cast<TDirectoryFile *> (file->Get("AliAnalysisTaskNTGJ"));
+            if (directory != NULL) _tree_event = dynamic_cast<TTree *> (directory->Get("_tree_event"));
+        }
+        if (_tree_event == NULL) {
+            std::cout << " fail; could not find _tree_event " << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        // eta-boosting adjustment for p-Pb, as in GammaJet.cc
+        const double boost_adj = boost_adjustment(filenames[ifile]);
+        std::cout << "Boost adjustment is " << boost_adj << " in eta" << std::endl;
+    
+        Double_t primary_vertex[3];
+        Bool_t is_pileup_from_spd_5_08;
+        Float_t ue_estimate_its_const;
+        UInt_t ncluster;
+        Float_t cluster_e[NTRACK_MAX];
+        Float_t cluster_e_cross[NTRACK_MAX];
+        Float_t cluster_e_max[NTRACK_MAX];
+        Float_t cluster_pt[NTRACK_MAX];
+        Float_t cluster_eta[NTRACK_MAX];
+        Float_t cluster_iso_tpc_04[NTRACK_MAX];
+        Float_t cluster_iso_its_04[NTRACK_MAX];
+        Float_t cluster_iso_its_04_ue[NTRACK_MAX];
+        Float_t cluster_frixione_tpc_04_02[NTRACK_MAX];
+        Float_t cluster_frixione_its_04_02[NTRACK_MAX];
+        Float_t cluster_s_nphoton[NTRACK_MAX][4];
+        UChar_t cluster_nlocal_maxima[NTRACK_MAX];
+        Float_t cluster_distance_to_bad_channel[NTRACK_MAX];
+        Int_t cluster_ncell[NTRACK_MAX];
+        Float_t cluster_lambda_square[NTRACK_MAX][2];
+        unsigned short cluster_mc_truth_index[NTRACK_MAX][32];
+        short mc_truth_pdg_code[NTRACK_MAX];
+        short mc_truth_first_parent_pdg_code[NTRACK_MAX];
+        UChar_t mc_truth_status[NTRACK_MAX];
+        Float_t eg_cross_section = 0;
+        Int_t eg_ntrial = 0;
+    
+        // Only read the branches used here
+        _tree_event->SetBranchStatus("*", 0);
+        const char* branches[] = {"primary_vertex", "is_pileup_from_spd_5_08", "ue_estimate_its_const", "ncluster", "cluster_e", "cluster_e_cross", "cluster_e_max", "cluster_pt", "cluster_eta", "cluster_iso_tpc_04", "cluster_iso_its_04", "cluster_iso_its_04_ue", "cluster_frixione_tpc_04_02", "cluster_frixione_its_04_02", "cluster_s_nphoton", "cluster_nlocal_maxima", "cluster_distance_to_bad_channel", "cluster_ncell", "cluster_lambda_square"};
+        for (size_t i = 0; i < sizeof(branches)/sizeof(*branches); i++) {
+            _tree_event->SetBranchStatus(branches[i], 1);
+        }
+        _tree_event->SetBranchAddress("primary_vertex", primary_vertex);
+        _tree_event->SetBranchAddress("is_pileup_from_spd_5_08", &is_pileup_from_spd_5_08);
+        _tree_event->SetBranchAddress("ue_estimate_its_const", &ue_estimate_its_const);
+        _tree_event->SetBranchAddress("ncluster", &ncluster);
+        _tree_event->SetBranchAddress("cluster_e", cluster_e);
+        _tree_event->SetBranchAddress("cluster_e_cross", cluster_e_cross);
+        _tree_event->SetBranchAddress("cluster_e_max", cluster_e_max);
+        _tree_event->SetBranchAddress("cluster_pt", cluster_pt);
+        _tree_event->SetBranchAddress("cluster_eta", cluster_eta);
+        _tree_event->SetBranchAddress("cluster_iso_tpc_04", cluster_iso_tpc_04);
+        _tree_event->SetBranchAddress("cluster_iso_its_04", cluster_iso_its_04);
+        _tree_event->SetBranchAddress("cluster_iso_its_04_ue", cluster_iso_its_04_ue);
+        _tree_event->SetBranchAddress("cluster_frixione_tpc_04_02", cluster_frixione_tpc_04_02);
+        _tree_event->SetBranchAddress("cluster_frixione_its_04_02", cluster_frixione_its_04_02);
+        _tree_event->SetBranchAddress("cluster_s_nphoton", cluster_s_nphoton);
+        _tree_event->SetBranchAddress("cluster_nlocal_maxima", cluster_nlocal_maxima);
+        _tree_event->SetBranchAddress("cluster_distance_to_bad_channel", cluster_distance_to_bad_channel);
+        _tree_event->SetBranchAddress("cluster_ncell", cluster_ncell);
+        _tree_event->SetBranchAddress("cluster_lambda_square", cluster_lambda_square);
+        if (is_mc) {
+            const char* mc_branches[] = {"cluster_mc_truth_index", "mc_truth_pdg_code", "mc_truth_first_parent_pdg_code", "mc_truth_status", "eg_cross_section", "eg_ntrial"};
+            for (size_t i = 0; i < sizeof(mc_branches)/sizeof(*mc_branches); i++) {
+                _tree_event->SetBranchStatus(mc_branches[i], 1);
+            }
+            _tree_event->SetBranchAddress("cluster_mc_truth_index", cluster_mc_truth_index);
+            _tree_event->SetBranchAddress("mc_truth_pdg_code", mc_truth_pdg_code);
+            _tree_event->SetBranchAddress("mc_truth_first_parent_pdg_code", mc_truth_first_parent_pdg_code);
+            _tree_event->SetBranchAddress("mc_truth_status", mc_truth_status);
+            _tree_event->SetBranchAddress("eg_cross_section", &eg_cross_section);
+            _tree_event->SetBranchAddress("eg_ntrial", &eg_ntrial);
+        }
+    
+        const Long64_t nevents = _tree_event->GetEntries();
+        for (Long64_t ievent = 0; ievent < nevents; ievent++) {
+            if (ievent % 100000 == 0) std::cout << " event " << ievent << " of " << nevents << std::endl;
+            _tree_event->GetEntry(ievent);
+            if (not(TMath::Abs(primary_vertex[2]) < cuts.primary_vertex_max)) continue; //vertex z position cut
+            if (not(primary_vertex[2] != 0.00)) continue; //removes default of vertex z = 0
+            if (is_pileup_from_spd_5_08) continue; //removes pileup
+    
+            // pT-hat bins of the Monte-Carlo are combined with their cross section per trial
+            const double weight = (is_mc && eg_ntrial > 0) ? eg_cross_section/eg_ntrial : 1.0;
+    
+            for (ULong64_t n = 0; n < ncluster; n++) {
+                if (not(cluster_pt[n] > cluspT_intervals[0] && cluster_pt[n] < cluspT_intervals[num_of_pt_intervals])) continue;
+                if (not(TMath::Abs(cluster_eta[n] - boost_adj) < cuts.Cluster_Eta_max)) continue; //select eta of photons
+                if (not(cluster_ncell[n] > cuts.Cluster_ncell_min)) continue; //removes clusters with 1 or 2 cells
+                if (not(cluster_e_cross[n]/cluster_e[n] > cuts.EcrossoverE_min)) continue; //removes "spiky" clusters
+                if (not(cluster_nlocal_maxima[n] <= cuts.Cluster_locmaxima_max)) continue; //require to have at most 2 local maxima
+                if (not(cluster_distance_to_bad_channel[n] >= cuts.Cluster_distobadchannel)) continue;
+    
+                double isolation;
+                if (cuts.determiner == CLUSTER_ISO_TPC_04) isolation = cluster_iso_tpc_04[n] + cluster_iso_its_04_ue[n];
+                else if (cuts.determiner == CLUSTER_ISO_ITS_04) isolation = cluster_iso_its_04[n] + cluster_iso_its_04_ue[n];
+                else if (cuts.determiner == CLUSTER_FRIXIONE_TPC_04_02) isolation = cluster_frixione_tpc_04_02[n] + cluster_iso_its_04_ue[n];
+                else isolation = cluster_frixione_its_04_02[n] + cluster_iso_its_04_ue[n];
+                isolation = isolation - ue_estimate_its_const*0.4*0.4*TMath::Pi(); //Use rhoxA subtraction
+    
+                const bool isolated = isolation < cuts.iso_max;
+                const bool antiisolated = isolation > cuts.noniso_min && isolation < cuts.noniso_max;
+                if (!isolated && (is_mc || !antiisolated)) continue;
+    
+                if (is_mc) {
+                    Bool_t isTruePhoton = false;
+                    for (int counter = 0; counter < 32 && !isTruePhoton; counter++) {
+                        unsigned short index = cluster_mc_truth_index[n][counter];
+                        if (index == 65535) continue;
+                        if (mc_truth_pdg_code[index] != cuts.rightpdgcode) continue;
+                        if (mc_truth_first_parent_pdg_code[index] != cuts.rightparentpdgcode) continue;
+                        if (not(mc_truth_status[index] > 0)) continue;
+                        isTruePhoton = true;
+                    }
+                    if (!isTruePhoton) continue;
+                }
+    
+                const int ipt = TMath::BinarySearch(num_of_pt_intervals + 1, cluspT_intervals, (double)cluster_pt[n]);
+                const double idvar_value[num_of_id_vars] = {cluster_lambda_square[n][0], cluster_s_nphoton[n][1], cluster_e_max[n]/cluster_e[n]};
+                for (int ivar = 0; ivar < num_of_id_vars; ivar++) {
+                    if (is_mc) {
+                        hists.signal[ivar][ipt]->Fill(idvar_value[ivar]);
+                        hists.signal_weighted[ivar][ipt]->Fill(idvar_value[ivar], weight);
+                    }
+                    else if (isolated) hists.data[ivar][ipt]->Fill(idvar_value[ivar]);
+                    else hists.background[ivar][ipt]->Fill(idvar_value[ivar]);
+                }
+            }
+        }
+        file->Close();
+    }
+}
+
+// Fit the data with the signal and background templates, and get the purity inside the signal region [sig_min, sig_max]
+// The signal template is fitted as counts with the mean Monte-Carlo weight of each bin, signal_weighted/signal
+PurityFitResult fit_purity(TH1D* data, TH1D* signal, TH1D* signal_weighted, TH1D* background, double sig_min, double sig_max){
+    PurityFitResult result = {-1, 0, 0, 0, 0};
+    if (data->Integral() <= 0 || signal->Integral() <= 0 || background->Integral() <= 0) return result;
+    
+    TH1D* signal_weight = (TH1D*)signal_weighted->Clone("signal_weight");
+    for (int bin = 1; bin <= signal->GetNbinsX(); bin++) {
+        const double count = signal->GetBinContent(bin);
+        signal_weight->SetBinContent(bin, count > 0 ? signal_weighted->GetBinContent(bin)/count : 1);
+    }
+    TObjArray templates(2);
+    templates.Add(signal);
+    templates.Add(background);
+    TFractionFitter fitter(data, &templates, "Q");
+    fitter.SetWeight(0, signal_weight);
+    fitter.Constrain(0, 0.0, 1.0);
+    fitter.Constrain(1, 0.0, 1.0);
+    result.status = fitter.Fit();
+    if (result.status != 0) return result;
+    fitter.GetResult(0, result.signal_fraction, result.delta_signal_fraction);
+    
+    // Fitted signal yield in the signal region, over the data in the signal region; the edges are bin edges, so the bin starting at
+    // sig_max is outside it, as with SetCut
+    const int bin_min = data->FindBin(sig_min);
+    const int bin_max = data->FindBin(sig_max) - 1;
+    const double data_SR = data->Integral(bin_min, bin_max);
+    const double signal_SR_fraction = signal_weighted->Integral(bin_min, bin_max)/signal_weighted->Integral();
+    if (data_SR <= 0) {
+        result.status = -1;
+        return result;
+    }
+    const double scale = data->Integral()*signal_SR_fraction/data_SR;
+    result.purity = result.signal_fraction*scale;
+    result.deltapurity = result.delta_signal_fraction*scale;
+    
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 5) {
+        fprintf(stderr, "Syntax is [data ROOT files, comma-separated] [Monte-Carlo ROOT files for the signal templates, comma-separated] [Type of data (pp or pPb)] [purity table to write] [number of parallel fits (default: number of CPUs)]\n");
+        fprintf(stderr, "Entries of the purity table for other types of data are kept\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    const std::vector<std::string> data_filenames = parse_filenames(argv[1]);
+    const std::vector<std::string> mc_filenames = parse_filenames(argv[2]);
+    const std::string datatype = argv[3];
+    const std::string table_filename = argv[4];
+    long nworker = argc > 5 ? atol(argv[5]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworker < 1) nworker = 1;
+    
+    const PurityCuts cuts = read_config("GammaJet_config.yaml");
+    TH1::AddDirectory(kFALSE);
+    
+    PurityHistograms hists;
+    for (int ivar = 0; ivar < num_of_id_vars; ivar++) {
+        for (int ipt = 0; ipt < num_of_pt_intervals; ipt++) {
+            const char* name = Form("%s_%2.1f_%2.1f", Idvar_identifiers[ivar].c_str(), cluspT_intervals[ipt], cluspT_intervals[ipt + 1]);
+            const char* title = Form("%2.1f GeV < p_{T}^{cluster} < %2.1f GeV; %s; counts", cluspT_intervals[ipt], cluspT_intervals[ipt + 1], Idvar_titles[ivar].c_str());
+            hists.data[ivar][ipt] = new TH1D(Form("data_%s", name), title, idvar_bins[ivar], idvar_min[ivar], idvar_max[ivar]);
+            hists.signal[ivar][ipt] = new TH1D(Form("signal_template_%s", name), title, idvar_bins[ivar], idvar_min[ivar], idvar_max[ivar]);
+            hists.signal_weighted[ivar][ipt] = new TH1D(Form("signal_template_weighted_%s", name), title, idvar_bins[ivar], idvar_min[ivar], idvar_max[ivar]);
+            hists.background[ivar][ipt] = new TH1D(Form("background_template_%s", name), title, idvar_bins[ivar], idvar_min[ivar], idvar_max[ivar]);
+            hists.data[ivar][ipt]->Sumw2();
+            hists.signal[ivar][ipt]->Sumw2();
+            hists.signal_weighted[ivar][ipt]->Sumw2();
+            hists.background[ivar][ipt]->Sumw2();
+        }
+    }
+    
+    // One pass over the data and one over the Monte-Carlo fill all templates
+    fill_histograms(data_filenames, false, cuts, hists);
+    fill_histograms(mc_filenames, true, cuts, hists);
+    
+    // The fits, at most nworker at a time in forked workers, each returning its result through a pipe
+    const int njob = num_of_id_vars*num_of_pt_intervals;
+    std::vector<PurityFitResult> results(njob);
+    std::map<pid_t, std::pair<int, int> > running;
+    int next_job = 0;
+    while (next_job < njob || !running.empty()) {
+        if (next_job < njob && (long)running.size() < nworker) {
+            const int ivar = next_job/num_of_pt_intervals;
+            const int ipt = next_job%num_of_pt_intervals;
+            int result_pipe[2];
+            if (pipe(result_pipe) != 0) {
+                perror("pipe");
+                exit(EXIT_FAILURE);
+            }
+            const pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                close(result_pipe[0]);
+                const PurityFitResult result = fit_purity(hists.data[ivar][ipt], hists.signal[ivar][ipt], hists.signal_weighted[ivar][ipt], hists.background[ivar][ipt], cuts.SIG_min[ivar], cuts.SIG_max[ivar]);
+                const bool written = write(result_pipe[1], &result, sizeof(result)) == (ssize_t)sizeof(result);
+                close(result_pipe[1]);
+                _exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            close(result_pipe[1]);
+            running[pid] = std::make_pair(next_job, result_pipe[0]);
+            next_job++;
+            continue;
+        }
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            exit(EXIT_FAILURE);
+        }
+        if (running.count(pid) == 0) continue;
+        const int job = running[pid].first;
+        const int result_fd = running[pid].second;
+        PurityFitResult result = {-1, 0, 0, 0, 0};
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS || read(result_fd, &result, sizeof(result)) != (ssize_t)sizeof(result)) {
+            result.status = -1;
+        }
+        close(result_fd);
+        results[job] = result;
+        running.erase(pid);
+    }
+    
+    // Keep the entries of the other data types of an existing table
+    std::vector<PurityEntry> entries;
+    if (access(table_filename.c_str(), R_OK) == 0) {
+        const std::vector<PurityEntry> previous = read_purity_table(table_filename.c_str());
+        for (size_t i = 0; i < previous.size(); i++) {
+            if (previous[i].datatype != datatype) entries.push_back(previous[i]);
+        }
+    }
+    
+    TFile* fout = new TFile(Form("%s.root", table_filename.c_str()), "RECREATE");
+    TH1D* h_purity[num_of_id_vars];
+    int nfailed = 0;
+    for (int ivar = 0; ivar < num_of_id_vars; ivar++) {
+        h_purity[ivar] = new TH1D(Form("purity_%s", Idvar_identifiers[ivar].c_str()), Form("%s purity; p_{T}^{cluster} (GeV); purity", Idvar_identifiers[ivar].c_str()), num_of_pt_intervals, cluspT_intervals);
+        for (int ipt = 0; ipt < num_of_pt_intervals; ipt++) {
+            const PurityFitResult& result = results[ivar*num_of_pt_intervals + ipt];
+            std::cout << datatype << " " << Idvar_identifiers[ivar] << " " << cluspT_intervals[ipt] << " - " << cluspT_intervals[ipt + 1] << " GeV: ";
+            hists.data[ivar][ipt]->Write();
+            hists.signal[ivar][ipt]->Write();
+            hists.signal_weighted[ivar][ipt]->Write();
+            hists.background[ivar][ipt]->Write();
+            if (result.status != 0) {
+                std::cout << "fit failed, not in the table" << std::endl;
+                nfailed++;
+                continue;
+            }
+            std::cout << "signal fraction " << result.signal_fraction << " +/- " << result.delta_signal_fraction << ", purity " << result.purity << " +/- " << result.deltapurity << std::endl;
+            PurityEntry entry;
+            entry.datatype = datatype;
+            entry.idvar = Idvar_identifiers[ivar];
+            entry.cluspT_min = cluspT_intervals[ipt];
+            entry.cluspT_max = cluspT_intervals[ipt + 1];
+            entry.purity = result.purity;
+            entry.deltapurity = result.deltapurity;
+            entries.push_back(entry);
+            h_purity[ivar]->SetBinContent(ipt + 1, result.purity);
+            h_purity[ivar]->SetBinError(ipt + 1, result.deltapurity);
+        }
+        h_purity[ivar]->Write();
+    }
+    fout->Close();
+    
+    write_purity_table(table_filename.c_str(), entries, "written by purity_fit (shower-shape template fits)");
+    std::cout << "Purity table written to " << table_filename << ", " << njob - nfailed << " of " << njob << " fits succeeded" << std::endl;
+    
+    return nfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,219 @@
+// This program merges the --unnormalized outputs of GammaJet.cc or mixed_cluster_jet.cc jobs run on parts of a sample: every
+// histogram is added up over the inputs, and the normalization recorded in the inputs (see NormalizationMetadata.h) is applied
+// once, with the added-up counters (N_SR, N_BR, ...), so that the output is the one a single job over the whole sample would write
+// With --unnormalized, the sums are written without normalizing, together with the normalization, to be merged again later (e.g.
+// hundreds of batch outputs merged in groups, then the group outputs merged into the final result)
+//
+// Histograms are added one at a time (one sum and the histogram being added in memory, whatever the number of inputs), and the
+// histogram names are spread over forked worker processes, each writing a part file that is merged into the output at the end
+// Author: Ivan Chernyshev
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TH1.h>
+#include <TROOT.h>
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "NormalizationMetadata.h"
+#include "../general_tools/ParallelMerge.h"
+
+// One object of the output: the sum of an input object, or a ratio of two sums
+struct MergeTask {
+    std::string name;
+    bool is_ratio;
+    NormalizationRatio ratio;
+};
+
+// The sum of a histogram over all inputs, normalized unless unnormalized; NULL if an input does not have it
+TH1* merged_histogram(const std::vector<TFile*>& files, const std::string& name, const NormalizationMetadata& metadata, const std::map<std::string, const NormalizationScale*>& scales, bool unnormalized){
+    TH1* sum = NULL;
+    for (size_t i = 0; i < files.size(); i++) {
+        TH1* hist = dynamic_cast<TH1*>(read_object(files[i], name));
+        if (hist == NULL) {
+            fprintf(stderr, "%s:%d: %s has no histogram %s\n", __FILE__, __LINE__, files[i]->GetName(), name.c_str());
+            delete sum;
+            return NULL;
+        }
+        if (sum == NULL) {
+            sum = hist;
+            continue;
+        }
+        sum->Add(hist);
+        delete hist;
+    }
+    std::map<std::string, const NormalizationScale*>::const_iterator scale = scales.find(name);
+    if (!unnormalized && scale != scales.end()) {
+        const double counter = metadata.counters.find(scale->second->counter)->second;
+        sum->Scale(1.0/(counter*scale->second->binwidth));
+    }
+    return sum;
+}
+
+// Merge the given objects of all inputs into output; returns the number of failed objects
+int merge_tasks(const std::vector<std::string>& inputs, const std::vector<MergeTask>& tasks, const std::string& output, bool unnormalized){
+    std::vector<TFile*> files = open_inputs(inputs);
+    if (files.empty()) return 1;
+    
+    // Add up the counters of every input
+    NormalizationMetadata metadata;
+    normalization_read(files[0], metadata);
+    for (size_t i = 0; i < files.size(); i++) {
+        TH1* h_counters = dynamic_cast<TH1*>(read_object(files[i], "h_counters"));
+        if (h_counters == NULL || h_counters->GetNbinsX() != (int)metadata.counter_names.size()) {
+            fprintf(stderr, "%s:%d: %s has no valid h_counters histogram\n", __FILE__, __LINE__, inputs[i].c_str());
+            return 1;
+        }
+        for (size_t j = 0; j < metadata.counter_names.size(); j++) metadata.counters[metadata.counter_names[j]] += h_counters->GetBinContent(j + 1);
+        delete h_counters;
+    }
+    std::map<std::string, const NormalizationScale*> scales;
+    for (size_t i = 0; i < metadata.scales.size(); i++) scales[metadata.scales[i].histogram] = &metadata.scales[i];
+    
+    TFile* fout = TFile::Open(output.c_str(), "RECREATE");
+    if (fout == NULL || fout->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, output.c_str());
+        return 1;
+    }
+    int nfailed = 0;
+    for (size_t k = 0; k < tasks.size(); k++) {
+        const MergeTask& task = tasks[k];
+        if (task.is_ratio) {
+            // numerator/denominator of the normalized sums, as the ratio would have been computed by a single job
+            TH1* numerator = merged_histogram(files, task.ratio.numerator, metadata, scales, false);
+            TH1* denominator = merged_histogram(files, task.ratio.denominator, metadata, scales, false);
+            if (numerator == NULL || denominator == NULL) {
+                nfailed++;
+            }
+            else {
+                numerator->Divide(denominator);
+                fout->cd();
+                numerator->Write(task.name.c_str());
+            }
+            delete numerator;
+            delete denominator;
+            continue;
+        }
+        TObject* first = read_object(files[0], task.name);
+        if (dynamic_cast<TH1*>(first) == NULL) {
+            // Not a histogram (e.g. the normalization itself): copied from the first input
+            fout->cd();
+            if (first != NULL) first->Write(task.name.c_str());
+            delete first;
+            continue;
+        }
+        delete first;
+        TH1* sum = merged_histogram(files, task.name, metadata, scales, unnormalized);
+        if (sum == NULL) {
+            nfailed++;
+            continue;
+        }
+        fout->cd();
+        sum->Write(task.name.c_str());
+        delete sum;
+    }
+    fout->Close();
+    delete fout;
+    close_inputs(files);
+    
+    return nfailed;
+}
+
+int main(int argc, char *argv[]) {
+    long nworker = sysconf(_SC_NPROCESSORS_ONLN);
+    bool unnormalized = false;
+    int first_arg = 1;
+    while (first_arg < argc && (strncmp(argv[first_arg], "--", 2) == 0 || strcmp(argv[first_arg], "-j") == 0)) {
+        if (strcmp(argv[first_arg], "-j") == 0 && first_arg + 1 < argc) {
+            nworker = atol(argv[first_arg + 1]);
+            first_arg += 2;
+        }
+        else if (strcmp(argv[first_arg], "--unnormalized") == 0) {
+            unnormalized = true;
+            first_arg++;
+        }
+        else {
+            fprintf(stderr, "%s:%d: unrecognized option %s\n", __FILE__, __LINE__, argv[first_arg]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - first_arg < 2) {
+        fprintf(stderr, "Syntax is [-j number of parallel workers (default: number of CPUs)] [--unnormalized (keep the sums unnormalized)] [output ROOT file] [input ROOT file written with --unnormalized] [input ROOT file written with --unnormalized] ...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nworker < 1) nworker = 1;
+    const std::string output = argv[first_arg];
+    const std::vector<std::string> inputs(argv + first_arg + 1, argv + argc);
+    
+    // Histograms must not attach to whatever file is open
+    TH1::AddDirectory(kFALSE);
+    
+    // The inputs must all be unnormalized outputs of the same configuration; the objects of the output are those of the first
+    // input, each ratio following its numerator
+    std::vector<MergeTask> tasks;
+    {
+        std::vector<TFile*> files = open_inputs(inputs);
+        if (files.empty()) exit(EXIT_FAILURE);
+        NormalizationMetadata metadata;
+        if (!normalization_read(files[0], metadata)) {
+            fprintf(stderr, "%s:%d: %s is already normalized (it was not written with --unnormalized)\n", __FILE__, __LINE__, inputs[0].c_str());
+            exit(EXIT_FAILURE);
+        }
+        const std::string description = normalization_description(files[0]);
+        for (size_t i = 1; i < files.size(); i++) {
+            if (normalization_description(files[i]) != description) {
+                fprintf(stderr, "%s:%d: %s was not made with the same histograms and counters as %s\n", __FILE__, __LINE__, inputs[i].c_str(), inputs[0].c_str());
+                exit(EXIT_FAILURE);
+            }
+        }
+    
+        std::set<std::string> seen;
+        TIter next(files[0]->GetListOfKeys());
+        while (TKey* key = dynamic_cast<TKey*>(next())) {
+            const std::string name = key->GetName();
+            if (!seen.insert(name).second) continue;
+            // The normalization is only kept in unnormalized merges; h_counters is added up there like any histogram
+            if (!unnormalized && (name == "normalization" || name == "h_counters")) continue;
+            MergeTask task;
+            task.name = name;
+            task.is_ratio = false;
+            tasks.push_back(task);
+            for (size_t j = 0; j < metadata.ratios.size() && !unnormalized; j++) {
+                if (metadata.ratios[j].numerator != name) continue;
+                MergeTask ratio_task;
+                ratio_task.name = metadata.ratios[j].histogram;
+                ratio_task.is_ratio = true;
+                ratio_task.ratio = metadata.ratios[j];
+                tasks.push_back(ratio_task);
+            }
+        }
+        close_inputs(files);
+    }
+    if ((long)tasks.size() < nworker) nworker = tasks.size() > 0 ? tasks.size() : 1;
+    
+    if (nworker == 1) {
+        const int nfailed = merge_tasks(inputs, tasks, output, unnormalized);
+        std::cout << tasks.size() - nfailed << " of " << tasks.size() << " objects merged from " << inputs.size() << " inputs into " << output << std::endl;
+        return nfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    // Worker w merges the objects w, w + nworker, ... into <output>.part<w>, merged into the output in task order
+    const int nfailed_worker = merge_run_workers(nworker, output, [&](long w, const std::string& part) {
+        std::vector<MergeTask> worker_tasks;
+        for (size_t k = w; k < tasks.size(); k += nworker) worker_tasks.push_back(tasks[k]);
+        return merge_tasks(inputs, worker_tasks, part, unnormalized);
+    });
+    std::vector<std::string> names;
+    for (size_t k = 0; k < tasks.size(); k++) names.push_back(tasks[k].name);
+    const size_t nmerged = merge_parts(nworker, names, output);
+    std::cout << nmerged << " of " << tasks.size() << " objects merged from " << inputs.size() << " inputs into " << output << std::endl;
+    
+    return nfailed_worker == 0 && nmerged == tasks.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
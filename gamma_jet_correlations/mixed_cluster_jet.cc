@@ -1,5 +1,18 @@
 /*
   This code is a variation of Fernando's Skeleton_Mix_Correlations.cc code, this time for events
+  With --adaptive, a mixing class stops taking more than a minimum number of partners per trigger once its mixed dPhi and Xj
+  distributions reach the requested relative precision, as a bin-content weighted mean over their bins. Convergence is decided
+  per job, so the shards of an --adaptive run do not add up exactly to a single run over the whole sample
+  With --same-event, the clusters selected for mixing are also paired with the jets of their own event, so the same-event
+  and mixed-event correlations come out of one read of the triggered sample with identical selections
+  The event, cluster and jet cuts are GammaJet's, read from GammaJet_config.yaml with its keys and defaults: the p-Pb boost
+  adjustment of the cluster eta, photon_idvar with its signal and background windows (including the _local variants),
+  Cluster_isolation_determinant (including track_cone) with the rho x A subtraction, and Jet_Eta_max for the triggered and the
+  mixed jets. The cluster and jet pT cuts are the bins given on the command line instead of clus_pT_min/max and jet_pT_min
+  With --unnormalized, the histograms are written as raw counts with their normalization recorded (see NormalizationMetadata.h), so
+  that jobs run on parts of the triggered sample can be added up and normalized once by merge_outputs
+  With --shard <i>/<N> or --first-entry/--last-entry, only part of the triggered events is correlated (see EntryRange.h)
+  With --checkpoint <file>, the state of the event loop is saved periodically and a restarted job resumes from it (see Checkpoint.h)
 */
 // Author: Ivan Chernyshev; Creator of template code: Fernando Torales-Acosta
 
@@ -18,10 +31,19 @@
 #include <iostream>
 #include <fstream>
 #include "H5Cpp.h"
+#include "../general_tools/HDF5Storage.h" // chunk cache sizing for the mixing pool
+#include "NormalizationMetadata.h"
+#include "EntryRange.h"
+#include "Checkpoint.h"
+#include "BoostAdjustment.h"
+#include "../general_tools/ShowerNet.h"
+#include "../general_tools/ShowerShape.h"
+#include "../general_tools/IsolationGrid.h"
 
 #define NTRACK_MAX (1U << 14)
 
 #include <vector>
+#include <algorithm>
 #include <math.h>
 
 // Energy of lead, in GeV
@@ -29,7 +51,8 @@ const double EPb = 1560;
 
 const int MAX_INPUT_LENGTH = 200;
 
-enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_04_02, CLUSTER_FRIXIONE_ITS_04_02};
+enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_04_02, CLUSTER_FRIXIONE_ITS_04_02, TRACK_CONE};
+enum photon_IDVARS {LAMBDA_0, DNN, EMAX_OVER_ECLUSTER, DNN_LOCAL, LAMBDA_0_LOCAL, EMAX_OVER_ECLUSTER_LOCAL};
 
 using namespace H5;
 
@@ -37,13 +60,552 @@ double calculatebinwidth(int numofbins, double binmin, double binmax){
     return (binmax - binmin)/numofbins;
 }
 
+// Parses a comma-separated command-line list, e.g. "0,20,40", into its numbers. A single number is a list of length one
+std::vector<double> parse_list(const char *arg){
+    std::vector<double> values;
+    for (const char *v = arg; *v != '\0';) {
+        char *end;
+        double value = strtod(v, &end);
+        if (end == v) {
+            fprintf(stderr, "%s:%d: cannot parse \"%s\" as a comma-separated list of numbers\n", __FILE__, __LINE__, arg);
+            exit(EXIT_FAILURE);
+        }
+        values.push_back(value);
+        v = end;
+        if (*v == ',') v++;
+    }
+    return values;
+}
+
+// Event, cluster and jet cuts of GammaJet.cc, from GammaJet_config.yaml
+struct GammaJetCuts {
+    double primary_vertex_max;
+    double Cluster_Eta_max;
+    double Jet_Eta_max;
+    double Cluster_ncell_min;
+    double Cluster_locmaxima_max;
+    double Cluster_distobadchannel;
+    double EcrossoverE_min;
+    bool EcrossoverE_local;
+    double iso_max;
+    double SIG_DNN_min;
+    double SIG_DNN_max;
+    double BKG_DNN_min;
+    double BKG_DNN_max;
+    double SIG_lambda_min;
+    double SIG_lambda_max;
+    double BKG_lambda_min;
+    double BKG_lambda_max;
+    double SIG_Emax_over_Ecluster_min;
+    double SIG_Emax_over_Ecluster_max;
+    double BKG_Emax_over_Ecluster_min;
+    double BKG_Emax_over_Ecluster_max;
+    isolationDet determiner;
+    double isolation_cone_radius;
+    unsigned int isolation_track_mask;
+    double isolation_track_pt_min;
+    photon_IDVARS photon_identifier;
+    std::string shower_net_weights;
+};
+
+GammaJetCuts read_gammajet_config(const char* filename){
+    // Same defaults as GammaJet.cc
+    GammaJetCuts cuts;
+    cuts.primary_vertex_max = 10.0;
+    cuts.Cluster_Eta_max = 0.67;
+    cuts.Jet_Eta_max = 0.5;
+    cuts.Cluster_ncell_min = 2;
+    cuts.Cluster_locmaxima_max = 2.0;
+    cuts.Cluster_distobadchannel = 2.0;
+    cuts.EcrossoverE_min = 0.05;
+    cuts.EcrossoverE_local = false;
+    cuts.iso_max = 1.0;
+    cuts.SIG_DNN_min = 0.55;
+    cuts.SIG_DNN_max = 0.85;
+    cuts.BKG_DNN_min = 0.0;
+    cuts.BKG_DNN_max = 0.3;
+    cuts.SIG_lambda_min = 0.0;
+    cuts.SIG_lambda_max = 0.4;
+    cuts.BKG_lambda_min = 0.5;
+    cuts.BKG_lambda_max = 2.0;
+    cuts.SIG_Emax_over_Ecluster_min = 0.0;
+    cuts.SIG_Emax_over_Ecluster_max = 0.5;
+    cuts.BKG_Emax_over_Ecluster_min = 0.5;
+    cuts.BKG_Emax_over_Ecluster_max = 1.0;
+    cuts.determiner = CLUSTER_ISO_ITS_04;
+    cuts.isolation_cone_radius = 0.4;
+    cuts.isolation_track_mask = 16;
+    cuts.isolation_track_pt_min = 0.15;
+    cuts.photon_identifier = LAMBDA_0;
+    cuts.shower_net_weights = "shower_net.txt";
+    
+    FILE* config = fopen(filename, "r");
+    if (config == NULL) {
+        std::cout << "no " << filename << ", using GammaJet's default cuts" << std::endl;
+        return cuts;
+    }
+    char line[MAX_INPUT_LENGTH];
+    while (fgets(line, MAX_INPUT_LENGTH, config) != NULL) {
+        if (line[0] == '#') continue;
+        
+        char key[MAX_INPUT_LENGTH];
+        char dummy[MAX_INPUT_LENGTH];
+        char value[MAX_INPUT_LENGTH];
+        key[0] = '\0';
+        value[0] = '\0';
+        sscanf(line, "%[^:]:%[ \t]%100[^\n]", key, dummy, value);
+        
+        // The keys of GammaJet_config.yaml that only GammaJet uses are skipped
+        if (strcmp(key, "primary_vertex_max") == 0) cuts.primary_vertex_max = atof(value);
+        else if (strcmp(key, "Cluster_Eta_max") == 0) cuts.Cluster_Eta_max = atof(value);
+        else if (strcmp(key, "Jet_Eta_max") == 0) cuts.Jet_Eta_max = atof(value);
+        else if (strcmp(key, "Cluster_ncell_min") == 0) cuts.Cluster_ncell_min = atof(value);
+        else if (strcmp(key, "Cluster_locmaxima_max") == 0) cuts.Cluster_locmaxima_max = atof(value);
+        else if (strcmp(key, "Cluster_distobadchannel") == 0) cuts.Cluster_distobadchannel = atof(value);
+        else if (strcmp(key, "EcrossoverE_min") == 0) cuts.EcrossoverE_min = atof(value);
+        else if (strcmp(key, "EcrossoverE_local") == 0) cuts.EcrossoverE_local = atoi(value) != 0;
+        else if (strcmp(key, "iso_max") == 0) cuts.iso_max = atof(value);
+        else if (strcmp(key, "SIG_DNN_min") == 0) cuts.SIG_DNN_min = atof(value);
+        else if (strcmp(key, "SIG_DNN_max") == 0) cuts.SIG_DNN_max = atof(value);
+        else if (strcmp(key, "BKG_DNN_min") == 0) cuts.BKG_DNN_min = atof(value);
+        else if (strcmp(key, "BKG_DNN_max") == 0) cuts.BKG_DNN_max = atof(value);
+        else if (strcmp(key, "SIG_lambda_min") == 0) cuts.SIG_lambda_min = atof(value);
+        else if (strcmp(key, "SIG_lambda_max") == 0) cuts.SIG_lambda_max = atof(value);
+        else if (strcmp(key, "BKG_lambda_min") == 0) cuts.BKG_lambda_min = atof(value);
+        else if (strcmp(key, "BKG_lambda_max") == 0) cuts.BKG_lambda_max = atof(value);
+        else if (strcmp(key, "SIG_Emax_over_Ecluster_min") == 0) cuts.SIG_Emax_over_Ecluster_min = atof(value);
+        else if (strcmp(key, "SIG_Emax_over_Ecluster_max") == 0) cuts.SIG_Emax_over_Ecluster_max = atof(value);
+        else if (strcmp(key, "BKG_Emax_over_Ecluster_min") == 0) cuts.BKG_Emax_over_Ecluster_min = atof(value);
+        else if (strcmp(key, "BKG_Emax_over_Ecluster_max") == 0) cuts.BKG_Emax_over_Ecluster_max = atof(value);
+        else if (strcmp(key, "Isolation_cone_radius") == 0) cuts.isolation_cone_radius = atof(value);
+        else if (strcmp(key, "Isolation_track_mask") == 0) cuts.isolation_track_mask = strtoul(value, NULL, 0);
+        else if (strcmp(key, "Isolation_track_pt_min") == 0) cuts.isolation_track_pt_min = atof(value);
+        else if (strcmp(key, "DNN_local_weights") == 0) cuts.shower_net_weights = value;
+        else if (strcmp(key, "photon_idvar") == 0) {
+            if (strcmp(value, "lambda_0") == 0) cuts.photon_identifier = LAMBDA_0;
+            else if (strcmp(value, "DNN") == 0) cuts.photon_identifier = DNN;
+            else if (strcmp(value, "Emax_over_Ecluster") == 0) cuts.photon_identifier = EMAX_OVER_ECLUSTER;
+            else if (strcmp(value, "DNN_local") == 0) cuts.photon_identifier = DNN_LOCAL;
+            else if (strcmp(value, "lambda_0_local") == 0) cuts.photon_identifier = LAMBDA_0_LOCAL;
+            else if (strcmp(value, "Emax_over_Ecluster_local") == 0) cuts.photon_identifier = EMAX_OVER_ECLUSTER_LOCAL;
+            else {
+                std::cout << "ERROR: Photon selection determinant in configuration file must be \"lambda_0\", \"DNN\", \"Emax_over_Ecluster\", \"DNN_local\", \"lambda_0_local\", or \"Emax_over_Ecluster_local\"" << std::endl << "Aborting the program" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(key, "Cluster_isolation_determinant") == 0) {
+            if (strcmp(value, "cluster_iso_tpc_04") == 0) cuts.determiner = CLUSTER_ISO_TPC_04;
+            else if (strcmp(value, "cluster_iso_its_04") == 0) cuts.determiner = CLUSTER_ISO_ITS_04;
+            else if (strcmp(value, "cluster_frixione_tpc_04_02") == 0) cuts.determiner = CLUSTER_FRIXIONE_TPC_04_02;
+            else if (strcmp(value, "cluster_frixione_its_04_02") == 0) cuts.determiner = CLUSTER_FRIXIONE_ITS_04_02;
+            else if (strcmp(value, "track_cone") == 0) cuts.determiner = TRACK_CONE;
+            else {
+                std::cout << "ERROR: Cluster_isolation_determinant in configuration file must be \"cluster_iso_tpc_04\", \"cluster_iso_its_04\", \"cluster_frixione_tpc_04_02\", \"cluster_frixione_its_04_02\", or \"track_cone\"" << std::endl << "Aborting the program" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    fclose(config);
+    if (cuts.determiner == TRACK_CONE && !(cuts.isolation_cone_radius > 0 && cuts.isolation_cone_radius < TMath::Pi())) {
+        std::cout << "ERROR: Isolation_cone_radius must be between 0 and pi" << std::endl << "Aborting the program" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    
+    return cuts;
+}
+
+// A cluster of the triggered event that passed all cuts except the cluster pT bin, selected once per event
+struct SelectedCluster {
+    double pT;
+    double phi;
+    double eta;
+    bool inSignalRegion;
+};
+
+// A jet that passed the NaN and eta cuts, selected once per triggered event (same-event) or per mixed event
+struct SelectedJet {
+    double pT;
+    double phi;
+    double eta;
+    double pTD;
+    double multiplicity;
+};
+
+// All histograms and trigger counts belonging to one (mixing window, cluster pT bin, minimum jet pT) combination
+// Every combination is written to its own output file, exactly as a separate job with the same arguments would have
+// Same-event sets have no mixing window, and count each trigger once instead of once per mixing partner
+struct CorrelationHistogramSet {
+    bool same_event;
+    size_t mix_start;
+    size_t mix_end;
+    double cluspTmin;
+    double cluspTmax;
+    double jetpTmin;
+    
+    int N_SR;
+    int N_BR;
+    NormalizationMetadata normalization;
+    
+    // Adaptive mixing: once converged, each trigger only takes the minimum number of partners
+    bool converged;
+    int npartners_event;
+    int npartners_planned;
+    TH1D* h_npartners;
+    
+    TH1D* SIGcluster_pt_dist;
+    TH1D* SIGjet_pt_dist;
+    TH1D* SIGpt_diff_dist;
+    TH1D* SIGdPhi;
+    TH1D* SIGclusterPhi;
+    TH1D* SIGjetPhi;
+    TH1D* SIGdEta;
+    TH1D* SIGclusterEta;
+    TH1D* SIGjetEta;
+    TH1D* SIGXj;
+    TH1D* SIGpTD;
+    TH1D* SIGMultiplicity;
+    TH1D* SIGXobsPb;
+    
+    TH1D* BKGcluster_pt_dist;
+    TH1D* BKGjet_pt_dist;
+    TH1D* BKGpt_diff_dist;
+    TH1D* BKGdPhi;
+    TH1D* BKGclusterPhi;
+    TH1D* BKGjetPhi;
+    TH1D* BKGdEta;
+    TH1D* BKGclusterEta;
+    TH1D* BKGjetEta;
+    TH1D* BKGXj;
+    TH1D* BKGpTD;
+    TH1D* BKGMultiplicity;
+    TH1D* BKGXobsPb;
+    
+    TH1D* z_Vertices_individual;
+    TH1D* z_Vertices_hdf5;
+    TH1D* z_Vertices;
+    TH1D* Multiplicity_individual;
+    TH1D* Multiplicity_hdf5;
+    TH1D* Multiplicity;
+};
+
+// The signal and background correlation histograms of a set, in output order
+std::vector<TH1D*> correlation_histograms(const CorrelationHistogramSet &set){
+    TH1D* histograms[] = {
+        set.SIGcluster_pt_dist, set.SIGjet_pt_dist, set.SIGpt_diff_dist, set.SIGdPhi, set.SIGclusterPhi, set.SIGjetPhi,
+        set.SIGdEta, set.SIGclusterEta, set.SIGjetEta, set.SIGXj, set.SIGpTD, set.SIGMultiplicity, set.SIGXobsPb,
+        set.BKGcluster_pt_dist, set.BKGjet_pt_dist, set.BKGpt_diff_dist, set.BKGdPhi, set.BKGclusterPhi, set.BKGjetPhi,
+        set.BKGdEta, set.BKGclusterEta, set.BKGjetEta, set.BKGXj, set.BKGpTD, set.BKGMultiplicity, set.BKGXobsPb
+    };
+    return std::vector<TH1D*>(histograms, histograms + sizeof(histograms)/sizeof(histograms[0]));
+}
+
+// Declare the histograms of one combination
+void create_histograms(CorrelationHistogramSet &set){
+    double cluspTmin = set.cluspTmin;
+    double cluspTmax = set.cluspTmax;
+    
+    set.N_SR = 0;
+    set.N_BR = 0;
+    set.normalization = normalization_metadata(false);
+    set.converged = false;
+    set.npartners_event = 0;
+    set.npartners_planned = 0;
+    
+    set.SIGcluster_pt_dist = new TH1D("sig_Cluster_pT", "Signal Cluster p_{T} distribution; cluster p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 5, cluspTmin, cluspTmax);
+    set.SIGjet_pt_dist = new TH1D("sig_Jet_pT", "Signal Jet p_{T} distribution; jet p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 25, 5, 30);
+    set.SIGpt_diff_dist = new TH1D("sig_clusjet_pT_diff", "Signal p_{T}^{cluster}-p_{T}^{jet} distribution; #Delta p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 20, 0, 20);
+    
+    set.SIGdPhi = new TH1D("sig_dPhi", "Signal #Delta #phi distribution; #Delta #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 7, 0, TMath::Pi());
+    set.SIGclusterPhi = new TH1D("sig_clusterPhi", "Signal #phi_{cluster} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
+    set.SIGjetPhi = new TH1D("sig_jetPhi", "Signal #phi_{jet} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
+    
+    set.SIGdEta = new TH1D("sig_dEta", "Signal #Delta #eta distribution; #Delta #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 40, -2.4, 2.4);
+    set.SIGclusterEta = new TH1D("sig_clusterEta", "#Signal eta_{cluster} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
+    set.SIGjetEta = new TH1D("sig_jetEta", "Signal #eta_{jet} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
+    
+    set.SIGXj = new TH1D("sig_Xj", "Signal Xj distribution; Xj; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0,2.0);
+    set.SIGpTD = new TH1D("sig_pTD", "Signal Jet pTD distribution; p_{T}D (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 5, 0.0,1.0);
+    set.SIGMultiplicity = new TH1D("sig_Multiplicity", "Signal Jet Multiplicity; Multiplicity; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0 , 20.0);
+    set.SIGXobsPb = new TH1D("sig_XobsPb", "x_{pPb}^{obs} distribution: signal region; x_{pPb}^{obs}; #frac{d #sigma}{dx^{obs}_{pPb}}", 5, 0.004, 0.024);
+    
+    set.BKGcluster_pt_dist = new TH1D("bkg_Cluster_pT", "Background Cluster p_{T} distribution; cluster p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 7, cluspTmin, cluspTmax);
+    set.BKGjet_pt_dist = new TH1D("bkg_Jet_pT", "Background Jet p_{T} distribution; jet p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 25, 5, 30);
+    set.BKGpt_diff_dist = new TH1D("bkg_clusjet_pT_diff", "Background p_{T}^{cluster}-p_{T}^{jet} distribution; #Delta p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 20, 0, 20);
+    
+    set.BKGdPhi = new TH1D("bkg_dPhi", "Background #Delta #phi distribution; #Delta #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 7, 0, TMath::Pi());
+    set.BKGclusterPhi = new TH1D("bkg_clusterPhi", "Background #phi_{cluster} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
+    set.BKGjetPhi = new TH1D("bkg_jetPhi", "Background #phi_{jet} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
+    
+    set.BKGdEta = new TH1D("bkg_dEta", "Background #Delta #eta distribution; #Delta #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 40, -2.4, 2.4);
+    set.BKGclusterEta = new TH1D("bkg_clusterEta", "Background #eta_{cluster} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
+    set.BKGjetEta = new TH1D("bkg_jetEta", "Background #eta_{jet} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
+    
+    set.BKGXj = new TH1D("bkg_Xj", "Background Xj distribution; Xj; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0,2.0);
+    set.BKGpTD = new TH1D("bkg_pTD", "Background Jet pTD distribution; p_{T}D (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 5, 0.0,1.0);
+    set.BKGMultiplicity = new TH1D("bkg_Multiplicity", "Background Jet Multiplicity distribution; Multiplicity; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0 , 20.0);
+    set.BKGXobsPb = new TH1D("bkg_XobsPb", "x_{pPb}^{obs} distribution: background region; x_{pPb}^{obs}; #frac{d #sigma}{dx^{obs}_{pPb}}", 5, 0.004, 0.024);
+    
+    set.z_Vertices_individual = new TH1D("z_Vertices_individual", "Z-vertex (ROOT)", 50, 0, 25);
+    set.z_Vertices_hdf5 = new TH1D("z_Vertices_hdf5", "Z-vertex (hdf5)", 50, 0, 25);
+    set.z_Vertices = new TH1D("z_Vertices", "Z-vertex difference distribution", 50, 0, 25);
+    
+    set.Multiplicity_individual = new TH1D("mult_Vertices_individual", "Multiplicity (ROOT)", 427, 0, 1281);
+    set.Multiplicity_hdf5 = new TH1D("mult_Vertices_hdf5", "Multiplicity (hdf5)", 427, 0, 1281);
+    set.Multiplicity = new TH1D("mult_Vertices", "Multiplicity differnce distribution", 1281, 0, 1281);
+    
+    std::vector<TH1D*> histograms = correlation_histograms(set);
+    TH1D* vertex_histograms[] = {
+        set.z_Vertices_individual, set.z_Vertices_hdf5, set.z_Vertices,
+        set.Multiplicity_individual, set.Multiplicity_hdf5, set.Multiplicity
+    };
+    histograms.insert(histograms.end(), vertex_histograms, vertex_histograms + 6);
+    for (TH1D* h : histograms) h->Sumw2();
+    
+    // Number of mixing partners actually paired with each trigger; N_SR and N_BR count one trigger per partner, or each trigger
+    // once with --adaptive, its pairs weighted by 1/N_partners
+    set.h_npartners = new TH1D("h_npartners", "Mixing partners used per trigger; N_{partners}; N_{#gamma}", 301, -0.5, 300.5);
+}
+
+// Relative statistical error of the filled bins of a histogram, averaged with the bin contents as weights (sum of the errors over
+// sum of the contents), so that sparse tail bins count for as little as they hold; 1 if nothing is filled yet
+double weighted_relative_error(TH1D* h){
+    double sum_error = 0;
+    double sum_content = 0;
+    for (int ibin = 1; ibin <= h->GetNbinsX(); ibin++) {
+        double content = h->GetBinContent(ibin);
+        if (content <= 0) continue;
+        sum_error += h->GetBinError(ibin);
+        sum_content += content;
+    }
+    return sum_content > 0 ? sum_error/sum_content : 1;
+}
+
+// A mixing class has converged when the signal and background dPhi and Xj distributions all reach the requested precision
+void update_convergence(CorrelationHistogramSet &set, double precision){
+    if (set.converged) return;
+    TH1D* key_histograms[] = {set.SIGdPhi, set.SIGXj, set.BKGdPhi, set.BKGXj};
+    for (TH1D* h : key_histograms)
+        if (weighted_relative_error(h) >= precision) return;
+    set.converged = true;
+    std::cout << "Mixing converged for window " << set.mix_start << " to " << set.mix_end << ", cluster pT " << set.cluspTmin << " to " << set.cluspTmax << ", minimum jet pT " << set.jetpTmin << " after " << set.N_SR << " signal and " << set.N_BR << " background triggers" << std::endl;
+}
+
+// Register everything the event loop accumulates in a set with the checkpoint, under <prefix>_<name>
+void checkpoint_set(Checkpoint &checkpoint, CorrelationHistogramSet &set, const std::string &prefix){
+    std::vector<TH1D*> histograms = correlation_histograms(set);
+    TH1D* other_histograms[] = {
+        set.z_Vertices_individual, set.z_Vertices_hdf5, set.z_Vertices,
+        set.Multiplicity_individual, set.Multiplicity_hdf5, set.Multiplicity, set.h_npartners
+    };
+    histograms.insert(histograms.end(), other_histograms, other_histograms + 7);
+    for (size_t ihist = 0; ihist < histograms.size(); ihist++)
+        checkpoint_histogram(checkpoint, prefix + "_" + histograms[ihist]->GetName(), histograms[ihist]);
+    checkpoint_counter(checkpoint, prefix + "_N_SR", &set.N_SR);
+    checkpoint_counter(checkpoint, prefix + "_N_BR", &set.N_BR);
+    checkpoint_counter(checkpoint, prefix + "_converged", &set.converged);
+}
+
+// Fill one cluster-jet pair into the signal or background histograms of a combination, with the given weight
+// The vertex comparison histograms compare the triggered event with its mixing partner, so they are left empty for same-event sets
+void fill_pair(CorrelationHistogramSet &set, const SelectedCluster &cluster, const SelectedJet &jet, float event_zvertex, float event_multiplicity, double primary_vertex_z, float multiplicity_sum, double weight){
+    double cluspT = cluster.pT;
+    double clusphi = cluster.phi;
+    double cluseta = cluster.eta;
+    double jet_pT = jet.pT;
+    double jet_phi = jet.phi;
+    double jet_eta = jet.eta;
+    
+    double dphinum = clusphi-jet_phi;
+    while(dphinum < -TMath::Pi()) dphinum += 2*TMath::Pi();
+    while(dphinum > TMath::Pi()) dphinum -= 2*TMath::Pi();
+    
+    if(cluster.inSignalRegion) {
+        set.SIGcluster_pt_dist->Fill(cluspT, weight);
+        set.SIGjet_pt_dist->Fill(jet_pT, weight);
+        set.SIGpt_diff_dist->Fill(TMath::Abs(cluspT-jet_pT), weight);
+        
+        set.SIGdPhi->Fill(TMath::Abs(dphinum), weight);
+        if(not(dphinum > TMath::Pi()/2)) return;
+        set.SIGclusterPhi->Fill(clusphi, weight);
+        set.SIGjetPhi->Fill(jet_phi, weight);
+        
+        set.SIGdEta->Fill(jet_eta-cluseta, weight);
+        set.SIGclusterEta->Fill(cluseta, weight);
+        set.SIGjetEta->Fill(jet_eta, weight);
+        
+        set.SIGXj->Fill(jet_pT/cluspT, weight);
+        set.SIGpTD->Fill(jet.pTD, weight);
+        set.SIGMultiplicity->Fill(jet.multiplicity, weight);
+        set.SIGXobsPb->Fill(((cluspT*TMath::Exp(-cluseta))+(jet_pT*TMath::Exp(-jet_eta)))/(2*EPb), weight);
+        
+        if (set.same_event) return;
+        set.z_Vertices->Fill(TMath::Abs(event_zvertex - primary_vertex_z), weight);
+        set.z_Vertices_individual->Fill(primary_vertex_z, weight);
+        set.z_Vertices_hdf5->Fill(event_zvertex, weight);
+        
+        set.Multiplicity->Fill(TMath::Abs(event_multiplicity - multiplicity_sum), weight);
+        set.Multiplicity_individual->Fill(multiplicity_sum, weight);
+        set.Multiplicity_hdf5->Fill(event_multiplicity, weight);
+    }
+    else {
+        set.BKGcluster_pt_dist->Fill(cluspT, weight);
+        set.BKGjet_pt_dist->Fill(jet_pT, weight);
+        set.BKGpt_diff_dist->Fill(TMath::Abs(cluspT-jet_pT), weight);
+        
+        set.BKGdPhi->Fill(TMath::Abs(dphinum), weight);
+        if(not(dphinum > TMath::Pi()/2)) return;
+        set.BKGclusterPhi->Fill(clusphi, weight);
+        set.BKGjetPhi->Fill(jet_phi, weight);
+        
+        set.BKGdEta->Fill(jet_eta-cluseta, weight);
+        set.BKGclusterEta->Fill(cluseta, weight);
+        set.BKGjetEta->Fill(jet_eta, weight);
+        
+        set.BKGXj->Fill(jet_pT/cluspT, weight);
+        set.BKGpTD->Fill(jet.pTD, weight);
+        set.BKGMultiplicity->Fill(jet.multiplicity, weight);
+        set.BKGXobsPb->Fill(((cluspT*TMath::Exp(-cluseta))+(jet_pT*TMath::Exp(-jet_eta)))/(2*EPb), weight);
+    }
+}
+
+// Normalize the histograms of one combination by its trigger counts and bin widths, or record the normalization if unnormalized
+void normalize_histograms(CorrelationHistogramSet &set, bool unnormalized){
+    double cluspTmin = set.cluspTmin;
+    double cluspTmax = set.cluspTmax;
+    set.normalization = normalization_metadata(unnormalized);
+    normalization_set_counter(set.normalization, "N_SR", set.N_SR);
+    normalization_set_counter(set.normalization, "N_BR", set.N_BR);
+    
+    normalization_scale(set.normalization, *set.SIGcluster_pt_dist, set.SIGcluster_pt_dist->GetName(), "N_SR", calculatebinwidth(5, cluspTmin, cluspTmax));
+    normalization_scale(set.normalization, *set.SIGjet_pt_dist, set.SIGjet_pt_dist->GetName(), "N_SR", calculatebinwidth(25, 5, 30));
+    normalization_scale(set.normalization, *set.SIGpt_diff_dist, set.SIGpt_diff_dist->GetName(), "N_SR", calculatebinwidth(25, 0, 20));
+    
+    normalization_scale(set.normalization, *set.SIGdPhi, set.SIGdPhi->GetName(), "N_SR", calculatebinwidth(7, 0, TMath::Pi()));
+    normalization_scale(set.normalization, *set.SIGclusterPhi, set.SIGclusterPhi->GetName(), "N_SR", calculatebinwidth(14, -TMath::Pi(), TMath::Pi()));
+    normalization_scale(set.normalization, *set.SIGjetPhi, set.SIGjetPhi->GetName(), "N_SR", calculatebinwidth(14, -TMath::Pi(), TMath::Pi()));
+    
+    normalization_scale(set.normalization, *set.SIGdEta, set.SIGdEta->GetName(), "N_SR", calculatebinwidth(40, -2.4, 2.4));
+    normalization_scale(set.normalization, *set.SIGclusterEta, set.SIGclusterEta->GetName(), "N_SR", calculatebinwidth(20, -1.2, 1.2));
+    normalization_scale(set.normalization, *set.SIGjetEta, set.SIGjetEta->GetName(), "N_SR", calculatebinwidth(20, -1.2, 1.2));
+    
+    normalization_scale(set.normalization, *set.SIGXj, set.SIGXj->GetName(), "N_SR", calculatebinwidth(10, 0.0,2.0));
+    normalization_scale(set.normalization, *set.SIGpTD, set.SIGpTD->GetName(), "N_SR", calculatebinwidth(5, 0.0,1.0));
+    normalization_scale(set.normalization, *set.SIGMultiplicity, set.SIGMultiplicity->GetName(), "N_SR", calculatebinwidth(10, 0.0 , 20.0));
+    normalization_scale(set.normalization, *set.SIGXobsPb, set.SIGXobsPb->GetName(), "N_SR", calculatebinwidth(5, 0.004, 0.024));
+    
+    normalization_scale(set.normalization, *set.BKGcluster_pt_dist, set.BKGcluster_pt_dist->GetName(), "N_BR", calculatebinwidth(7, cluspTmin, cluspTmax));
+    normalization_scale(set.normalization, *set.BKGjet_pt_dist, set.BKGjet_pt_dist->GetName(), "N_BR", calculatebinwidth(25, 5, 30));
+    normalization_scale(set.normalization, *set.BKGpt_diff_dist, set.BKGpt_diff_dist->GetName(), "N_BR", calculatebinwidth(20, 0, 20));
+    
+    normalization_scale(set.normalization, *set.BKGdPhi, set.BKGdPhi->GetName(), "N_BR", calculatebinwidth(7, 0, TMath::Pi()));
+    normalization_scale(set.normalization, *set.BKGclusterPhi, set.BKGclusterPhi->GetName(), "N_BR", calculatebinwidth(14, -TMath::Pi(), TMath::Pi()));
+    normalization_scale(set.normalization, *set.BKGjetPhi, set.BKGjetPhi->GetName(), "N_BR", calculatebinwidth(14, -TMath::Pi(), TMath::Pi()));
+    
+    normalization_scale(set.normalization, *set.BKGdEta, set.BKGdEta->GetName(), "N_BR", calculatebinwidth(40, -2.4, 2.4));
+    normalization_scale(set.normalization, *set.BKGclusterEta, set.BKGclusterEta->GetName(), "N_BR", calculatebinwidth(20, -1.2, 1.2));
+    normalization_scale(set.normalization, *set.BKGjetEta, set.BKGjetEta->GetName(), "N_BR", calculatebinwidth(20, -1.2, 1.2));
+    
+    normalization_scale(set.normalization, *set.BKGXj, set.BKGXj->GetName(), "N_BR", calculatebinwidth(10, 0.0,2.0));
+    normalization_scale(set.normalization, *set.BKGpTD, set.BKGpTD->GetName(), "N_BR", calculatebinwidth(5, 0.0,1.0));
+    normalization_scale(set.normalization, *set.BKGMultiplicity, set.BKGMultiplicity->GetName(), "N_BR", calculatebinwidth(10, 0.0 , 20.0));
+    normalization_scale(set.normalization, *set.BKGXobsPb, set.BKGXobsPb->GetName(), "N_BR", calculatebinwidth(5, 0.004, 0.024));
+    
+    std::vector<TH1D*> correlations = correlation_histograms(set);
+    for (size_t ihist = 0; ihist < correlations.size(); ihist++)
+        correlations[ihist]->SetMinimum(0);
+}
+
+// Write the normalized histograms of one combination, with the trigger counts, to the combination's own output files
+// Unnormalized outputs get _UNNORMALIZED before .root, and the normalization to apply once merged
+// Mixed-event sets keep the original New_ names; same-event sets have no mixing window and are prefixed Same_
+// The rawname of an entry range ends with its tag (see EntryRange.h), which the trigger count files get as well
+void write_histograms(CorrelationHistogramSet &set, const std::string &rawname, const std::string &range_tag, int GeV_Track_Skim){
+    size_t mix_start = set.mix_start;
+    size_t mix_end = set.mix_end;
+    double cluspTmin = set.cluspTmin;
+    double cluspTmax = set.cluspTmax;
+    double jetpTmin = set.jetpTmin;
+    int N_SR = set.N_SR;
+    int N_BR = set.N_BR;
+    
+    //very particular about file names to ease scripting
+    TString outname;
+    TString ntriggername;
+    if (set.same_event) {
+        outname = Form("Same_%s_%luGeVTracks_Correlation_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f%s.root",rawname.data(),GeV_Track_Skim, cluspTmin, cluspTmax, jetpTmin, set.normalization.unnormalized ? "_UNNORMALIZED" : "");
+        ntriggername = Form("Ntriggercount_Same_%luGeVTracks_Correlation_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f%s.txt", GeV_Track_Skim, cluspTmin, cluspTmax, jetpTmin, range_tag.c_str());
+    }
+    else {
+        outname = Form("New_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f%s.root",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin, set.normalization.unnormalized ? "_UNNORMALIZED" : "");
+        ntriggername = Form("Ntriggercount_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f%s.txt", GeV_Track_Skim, mix_start, mix_end, cluspTmin, cluspTmax, jetpTmin, range_tag.c_str());
+    }
+    TFile* fout = new TFile(outname,"RECREATE");
+    std::cout<< "Created datafile: " << outname << std::endl;
+    
+    std::vector<TH1D*> correlations = correlation_histograms(set);
+    for (size_t ihist = 0; ihist < correlations.size(); ihist++)
+        correlations[ihist]->Write();
+    
+    if (not set.same_event) {
+        set.z_Vertices->Write();
+        set.Multiplicity->Write();
+        set.z_Vertices_individual->Write();
+        set.z_Vertices_hdf5->Write();
+        set.Multiplicity_individual->Write();
+        set.Multiplicity_hdf5->Write();
+        set.h_npartners->Write();
+    }
+    normalization_write(set.normalization);
+    
+    fout->Close();
+    
+    std::cout << " ending; num of signal triggers is " << N_SR << " background " << N_BR << std::endl;
+    
+    // Write out number of triggers to a text-file, for permanence
+    std::ofstream outfile_ntrigger;
+    outfile_ntrigger.open(ntriggername);
+    outfile_ntrigger << "num of signal triggers is " << N_SR << " background " << N_BR << std::endl;
+    outfile_ntrigger.close();
+}
+
+// Write the same-event over mixed-event ratio of every normalized correlation histogram, under the same histogram names
+void write_ratio(const CorrelationHistogramSet &same, const CorrelationHistogramSet &mixed, const std::string &rawname, int GeV_Track_Skim){
+    TString outname = Form("Ratio_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.root",rawname.data(),GeV_Track_Skim,mixed.mix_start,mixed.mix_end, mixed.cluspTmin, mixed.cluspTmax, mixed.jetpTmin);
+    TFile* fout = new TFile(outname,"RECREATE");
+    std::cout<< "Created datafile: " << outname << std::endl;
+    
+    std::vector<TH1D*> numerators = correlation_histograms(same);
+    std::vector<TH1D*> denominators = correlation_histograms(mixed);
+    for (size_t ihist = 0; ihist < numerators.size(); ihist++) {
+        TH1D* ratio = (TH1D*)numerators[ihist]->Clone(numerators[ihist]->GetName());
+        ratio->Divide(denominators[ihist]);
+        ratio->SetTitle(Form("%s: same/mixed", numerators[ihist]->GetTitle()));
+        ratio->Write();
+        delete ratio;
+    }
+    fout->Close();
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 9) {
-        fprintf(stderr,"Batch Syntax is [Gamma-Triggered Paired Root], [Min-Bias HDF5] [Mix Start] [Mix End] [Track Skim GeV] [Min cluster pT] [Max cluster pT] [Min jet pT]");
+        fprintf(stderr,"Batch Syntax is [Gamma-Triggered Paired Root], [Min-Bias HDF5] [Mix Start] [Mix End] [Track Skim GeV] [Min cluster pT] [Max cluster pT] [Min jet pT] [--same-event] [--ratio] [--adaptive <precision> [min partners]] [--unnormalized] [--shard <i>/<N> | --first-entry <entry> --last-entry <entry>] [--checkpoint <file> [--checkpoint-events <N>] [--checkpoint-minutes <T>]]\n");
+        fprintf(stderr,"[Mix Start]/[Mix End], [Min cluster pT]/[Max cluster pT] and [Min jet pT] may be comma-separated lists (e.g. 0,20 19,39), to produce every combination in one pass\n");
+        fprintf(stderr,"--same-event also pairs the clusters with the jets of their own event; --ratio implies --same-event and writes same/mixed\n");
+        fprintf(stderr,"--unnormalized writes raw counts, to be added up and normalized by merge_outputs\n");
+        fprintf(stderr,"--shard i/N (0 <= i < N) correlates only the i-th of N equal parts of the triggered events, --first-entry/--last-entry an explicit range of them\n");
+        fprintf(stderr,"--checkpoint saves the state of the event loop to a file every 10 minutes (or as set), and resumes from it when the job is restarted\n");
+        fprintf(stderr,"--adaptive stops taking more than [min partners] (default 1) partners per trigger once the content-weighted relative error of the mixed dPhi and Xj bins is below <precision>; convergence is decided per job, so --adaptive shards do not add up exactly to a single run\n");
         exit(EXIT_FAILURE);
     }
     
+    // Every argument but the checkpoint options must stay the same between restarts of a checkpointed job
+    Checkpoint checkpoint = checkpoint_none();
+    for (int iarg = 1; iarg < argc; iarg++) {
+        if (checkpoint_option(checkpoint, iarg, argc, argv)) continue;
+        checkpoint_fingerprint(checkpoint, argv[iarg]);
+    }
+    
     int dummyc = 1;
     char **dummyv = new char *[1];
     
@@ -56,130 +618,115 @@ int main(int argc, char *argv[])
     TString hdf5_file = (TString)argv[2];
     fprintf(stderr,hdf5_file);
     
-    size_t mix_start = atoi(argv[3]);
-    size_t mix_end = atoi(argv[4]);
+    // Mixing windows are paired element by element: window i mixes with partners [mix_starts[i], mix_ends[i]]
+    std::vector<double> mix_starts = parse_list(argv[3]);
+    std::vector<double> mix_ends = parse_list(argv[4]);
+    if (mix_starts.size() != mix_ends.size()) {
+        fprintf(stderr, "%s:%d: [Mix Start] and [Mix End] must have the same number of entries\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
     
     int GeV_Track_Skim = atoi(argv[5]);
-    std::cout<<"mix start is "<<mix_start<<std::endl;
-    std::cout<<"mix end is "<<mix_end<<std::endl;
     fprintf(stderr,"Using %iGeV Track Skimmed from batch Script \n",GeV_Track_Skim);
     
-    double cluspTmin = atof(argv[6]);
-    double cluspTmax = atof(argv[7]);
-    std::cout<< "Cluster pT min: " << cluspTmin << "; max: " << cluspTmax << std::endl;
+    // Cluster pT bins are paired the same way: bin i is [cluspTmins[i], cluspTmaxs[i]]
+    std::vector<double> cluspTmins = parse_list(argv[6]);
+    std::vector<double> cluspTmaxs = parse_list(argv[7]);
+    if (cluspTmins.size() != cluspTmaxs.size()) {
+        fprintf(stderr, "%s:%d: [Min cluster pT] and [Max cluster pT] must have the same number of entries\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
     
-    double jetpTmin = atof(argv[8]);
-    std::cout << "Minimum jet pT: " << jetpTmin << std::endl;
+    std::vector<double> jetpTmins = parse_list(argv[8]);
+    
+    bool do_same_event = false;
+    bool do_ratio = false;
+    double adaptive_precision = 0;
+    int adaptive_min_partners = 1;
+    bool unnormalized = false;
+    EntryRange entry_range = entry_range_all();
+    for (int iarg = 9; iarg < argc; iarg++) {
+        if (entry_range_option(entry_range, iarg, argc, argv)) continue;
+        if (checkpoint_option(checkpoint, iarg, argc, argv)) continue;
+        if (strcmp(argv[iarg], "--same-event") == 0) do_same_event = true;
+        else if (strcmp(argv[iarg], "--ratio") == 0) {
+            do_same_event = true;
+            do_ratio = true;
+        }
+        else if (strcmp(argv[iarg], "--unnormalized") == 0) unnormalized = true;
+        else if (strcmp(argv[iarg], "--adaptive") == 0 && iarg + 1 < argc) {
+            adaptive_precision = atof(argv[++iarg]);
+            if (iarg + 1 < argc && isdigit(argv[iarg + 1][0])) adaptive_min_partners = atoi(argv[++iarg]);
+            if (not(adaptive_precision > 0) || adaptive_min_partners < 1) {
+                fprintf(stderr, "%s:%d: --adaptive needs a positive precision and at least 1 partner\n", __FILE__, __LINE__);
+                exit(EXIT_FAILURE);
+            }
+            fprintf(stderr, "Adaptive mixing: relative precision %f, at least %i partners per trigger\n", adaptive_precision, adaptive_min_partners);
+        }
+        else {
+            fprintf(stderr, "%s:%d: unrecognized option %s\n", __FILE__, __LINE__, argv[iarg]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    // The same/mixed ratio needs the normalized histograms
+    if (do_ratio && unnormalized) {
+        fprintf(stderr, "%s:%d: --ratio needs normalized histograms; merge the --unnormalized outputs with merge_outputs and divide them\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
     
     size_t nmix = 300;
     fprintf(stderr,"Number of Mixed Events: %i \n",nmix);
     
-    // Declare histograms
-    TH1D* SIGcluster_pt_dist = new TH1D("sig_Cluster_pT", "Signal Cluster p_{T} distribution; cluster p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 5, cluspTmin, cluspTmax);
-    TH1D* SIGjet_pt_dist = new TH1D("sig_Jet_pT", "Signal Jet p_{T} distribution; jet p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 25, 5, 30);
-    TH1D* SIGpt_diff_dist = new TH1D("sig_clusjet_pT_diff", "Signal p_{T}^{cluster}-p_{T}^{jet} distribution; #Delta p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 20, 0, 20);
-    double SIGcluster_pt_dist_binwidth = calculatebinwidth(5, cluspTmin, cluspTmax);
-    double SIGjet_pt_dist_binwidth = calculatebinwidth(25, 5, 30);
-    double SIGpt_diff_dist_binwidth = calculatebinwidth(25, 0, 20);
-    SIGcluster_pt_dist->Sumw2();
-    SIGjet_pt_dist->Sumw2();
-    SIGpt_diff_dist->Sumw2();
-    
-    TH1D* SIGdPhi = new TH1D("sig_dPhi", "Signal #Delta #phi distribution; #Delta #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 7, 0, TMath::Pi());
-    TH1D* SIGclusterPhi = new TH1D("sig_clusterPhi", "Signal #phi_{cluster} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
-    TH1D* SIGjetPhi = new TH1D("sig_jetPhi", "Signal #phi_{jet} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
-    double SIGdPhi_binwidth = calculatebinwidth(7, 0, TMath::Pi());
-    double SIGclusterPhi_binwidth = calculatebinwidth(14, -TMath::Pi(), TMath::Pi());
-    double SIGjetPhi_binwidth = calculatebinwidth(14, -TMath::Pi(), TMath::Pi());
-    SIGdPhi->Sumw2();
-    SIGclusterPhi->Sumw2();
-    SIGjetPhi->Sumw2();
-    
-    TH1D* SIGdEta = new TH1D("sig_dEta", "Signal #Delta #eta distribution; #Delta #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 40, -2.4, 2.4);
-    TH1D* SIGclusterEta = new TH1D("sig_clusterEta", "#Signal eta_{cluster} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
-    TH1D* SIGjetEta = new TH1D("sig_jetEta", "Signal #eta_{jet} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
-    double SIGdEta_binwidth = calculatebinwidth(40, -2.4, 2.4);
-    double SIGclusterEta_binwidth = calculatebinwidth(20, -1.2, 1.2);
-    double SIGjetEta_binwidth = calculatebinwidth(20, -1.2, 1.2);
-    SIGdEta->Sumw2();
-    SIGclusterEta->Sumw2();
-    SIGjetEta->Sumw2();
-    
-    TH1D* SIGXj = new TH1D("sig_Xj", "Signal Xj distribution; Xj; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0,2.0);
-    TH1D* SIGpTD = new TH1D("sig_pTD", "Signal Jet pTD distribution; p_{T}D (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 5, 0.0,1.0);
-    TH1D* SIGMultiplicity = new TH1D("sig_Multiplicity", "Signal Jet Multiplicity; Multiplicity; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0 , 20.0);
-    TH1D* SIGXobsPb = new TH1D("sig_XobsPb", "x_{pPb}^{obs} distribution: signal region; x_{pPb}^{obs}; #frac{d #sigma}{dx^{obs}_{pPb}}", 5, 0.004, 0.024);
-    double SIGXj_binwidth = calculatebinwidth(10, 0.0,2.0);
-    double SIGpTD_binwidth = calculatebinwidth(5, 0.0,1.0);
-    double SIGMultiplicity_binwidth = calculatebinwidth(10, 0.0 , 20.0);
-    double SIGXobsPb_binwidth = calculatebinwidth(5, 0.004, 0.024);
-    SIGXj->Sumw2();
-    SIGpTD->Sumw2();
-    SIGMultiplicity->Sumw2();
-    SIGXobsPb->Sumw2();
-    
-    TH1D* BKGcluster_pt_dist = new TH1D("bkg_Cluster_pT", "Background Cluster p_{T} distribution; cluster p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 7, cluspTmin, cluspTmax);
-    TH1D* BKGjet_pt_dist = new TH1D("bkg_Jet_pT", "Background Jet p_{T} distribution; jet p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 25, 5, 30);
-    TH1D* BKGpt_diff_dist = new TH1D("bkg_clusjet_pT_diff", "Background p_{T}^{cluster}-p_{T}^{jet} distribution; #Delta p_{T} (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 20, 0, 20);
-    double BKGcluster_pt_dist_binwidth = calculatebinwidth(7, cluspTmin, cluspTmax);
-    double BKGjet_pt_dist_binwidth = calculatebinwidth(25, 5, 30);
-    double BKGpt_diff_dist_binwidth = calculatebinwidth(20, 0, 20);
-    BKGcluster_pt_dist->Sumw2();
-    BKGjet_pt_dist->Sumw2();
-    BKGpt_diff_dist->Sumw2();
-    
-    TH1D* BKGdPhi = new TH1D("bkg_dPhi", "Background #Delta #phi distribution; #Delta #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 7, 0, TMath::Pi());
-    TH1D* BKGclusterPhi = new TH1D("bkg_clusterPhi", "Background #phi_{cluster} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
-    TH1D* BKGjetPhi = new TH1D("bkg_jetPhi", "Background #phi_{jet} distribution; #phi (rads); #frac{dN}{N_{#gamma}*N_{minbias}}", 14, -TMath::Pi(), TMath::Pi());
-    double BKGdPhi_binwidth = calculatebinwidth(7, 0, TMath::Pi());
-    double BKGclusterPhi_binwidth = calculatebinwidth(14, -TMath::Pi(), TMath::Pi());
-    double BKGjetPhi_binwidth = calculatebinwidth(14, -TMath::Pi(), TMath::Pi());
-    BKGdPhi->Sumw2();
-    BKGclusterPhi->Sumw2();
-    BKGjetPhi->Sumw2();
-    
-    TH1D* BKGdEta = new TH1D("bkg_dEta", "Background #Delta #eta distribution; #Delta #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 40, -2.4, 2.4);
-    TH1D* BKGclusterEta = new TH1D("bkg_clusterEta", "Background #eta_{cluster} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
-    TH1D* BKGjetEta = new TH1D("bkg_jetEta", "Background #eta_{jet} distribution; #eta; #frac{dN}{N_{#gamma}*N_{minbias}}", 20, -1.2, 1.2);
-    double BKGdEta_binwidth = calculatebinwidth(40, -2.4, 2.4);
-    double BKGclusterEta_binwidth = calculatebinwidth(20, -1.2, 1.2);
-    double BKGjetEta_binwidth = calculatebinwidth(20, -1.2, 1.2);
-    BKGdEta->Sumw2();
-    BKGclusterEta->Sumw2();
-    BKGjetEta->Sumw2();
-    
-    TH1D* BKGXj = new TH1D("bkg_Xj", "Background Xj distribution; Xj; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0,2.0);
-    TH1D* BKGpTD = new TH1D("bkg_pTD", "Background Jet pTD distribution; p_{T}D (GeV); #frac{dN}{N_{#gamma}*N_{minbias}}", 5, 0.0,1.0);
-    TH1D* BKGMultiplicity = new TH1D("bkg_Multiplicity", "Background Jet Multiplicity distribution; Multiplicity; #frac{dN}{N_{#gamma}*N_{minbias}}", 10, 0.0 , 20.0);
-    TH1D* BKGXobsPb = new TH1D("bkg_XobsPb", "x_{pPb}^{obs} distribution: background region; x_{pPb}^{obs}; #frac{d #sigma}{dx^{obs}_{pPb}}", 5, 0.004, 0.024);
-    double BKGXj_binwidth = calculatebinwidth(10, 0.0,2.0);
-    double BKGpTD_binwidth = calculatebinwidth(5, 0.0,1.0);
-    double BKGMultiplicity_binwidth = calculatebinwidth(10, 0.0 , 20.0);
-    double BKGXobsPb_binwidth = calculatebinwidth(5, 0.004, 0.024);
-    BKGXj->Sumw2();
-    BKGpTD->Sumw2();
-    BKGMultiplicity->Sumw2();
-    BKGXobsPb->Sumw2();
-    
-    TH1D* z_Vertices_individual = new TH1D("z_Vertices_individual", "Z-vertex (ROOT)", 50, 0, 25);
-    TH1D* z_Vertices_hdf5 = new TH1D("z_Vertices_hdf5", "Z-vertex (hdf5)", 50, 0, 25);
-    TH1D* z_Vertices = new TH1D("z_Vertices", "Z-vertex difference distribution", 50, 0, 25);
-    double z_Vertices_individual_binwidth = calculatebinwidth(50, 0, 25);
-    double z_Vertices_hdf5_binwidth = calculatebinwidth(50, 0, 25);
-    double z_Vertices_binwidth = calculatebinwidth(50, 0, 25);
-    z_Vertices_individual->Sumw2();
-    z_Vertices_hdf5->Sumw2();
-    z_Vertices->Sumw2();
-    
-    TH1D* Multiplicity_individual = new TH1D("mult_Vertices_individual", "Multiplicity (ROOT)", 427, 0, 1281);
-    TH1D* Multiplicity_hdf5 = new TH1D("mult_Vertices_hdf5", "Multiplicity (hdf5)", 427, 0, 1281);
-    TH1D* Multiplicity = new TH1D("mult_Vertices", "Multiplicity differnce distribution", 1281, 0, 1281);
-    double Multiplicity_individual_binwidth = calculatebinwidth(50, 0, 25);
-    double Multiplicity_hdf5_binwidth = calculatebinwidth(50, 0, 25);
-    double Multiplicity_binwidth = calculatebinwidth(50, 0, 25);
-    Multiplicity_individual->Sumw2();
-    Multiplicity_hdf5->Sumw2();
-    Multiplicity->Sumw2();
+    // Histograms are owned by their combination and written to per-combination files, so keep them out of gDirectory
+    TH1::AddDirectory(kFALSE);
+    
+    // Declare one set of histograms per (mixing window, cluster pT bin, minimum jet pT) combination
+    std::vector<CorrelationHistogramSet> histogram_sets;
+    size_t mix_first = nmix;
+    size_t mix_last = 0;
+    for (size_t iwindow = 0; iwindow < mix_starts.size(); iwindow++) {
+        for (size_t ibin = 0; ibin < cluspTmins.size(); ibin++) {
+            for (size_t ijetpT = 0; ijetpT < jetpTmins.size(); ijetpT++) {
+                CorrelationHistogramSet set;
+                set.same_event = false;
+                set.mix_start = size_t(mix_starts[iwindow]);
+                set.mix_end = size_t(mix_ends[iwindow]);
+                set.cluspTmin = cluspTmins[ibin];
+                set.cluspTmax = cluspTmaxs[ibin];
+                set.jetpTmin = jetpTmins[ijetpT];
+                if (set.mix_end >= nmix || set.mix_start > set.mix_end) {
+                    fprintf(stderr, "%s:%d: mixing window %lu to %lu must lie within 0 to %lu\n", __FILE__, __LINE__, set.mix_start, set.mix_end, nmix - 1);
+                    exit(EXIT_FAILURE);
+                }
+                create_histograms(set);
+                histogram_sets.push_back(set);
+                
+                mix_first = std::min(mix_first, set.mix_start);
+                mix_last = std::max(mix_last, set.mix_end);
+                std::cout << "mix start is " << set.mix_start << ", mix end is " << set.mix_end << "; Cluster pT min: " << set.cluspTmin << "; max: " << set.cluspTmax << "; Minimum jet pT: " << set.jetpTmin << std::endl;
+            }
+        }
+    }
+    
+    // Same-event sets: one per (cluster pT bin, minimum jet pT), shared by all mixing windows
+    std::vector<CorrelationHistogramSet> same_event_sets;
+    if (do_same_event) {
+        for (size_t ibin = 0; ibin < cluspTmins.size(); ibin++) {
+            for (size_t ijetpT = 0; ijetpT < jetpTmins.size(); ijetpT++) {
+                CorrelationHistogramSet set;
+                set.same_event = true;
+                set.mix_start = 0;
+                set.mix_end = 0;
+                set.cluspTmin = cluspTmins[ibin];
+                set.cluspTmax = cluspTmaxs[ibin];
+                set.jetpTmin = jetpTmins[ijetpT];
+                create_histograms(set);
+                same_event_sets.push_back(set);
+            }
+        }
+    }
+    std::cout << histogram_sets.size() << " mixed-event and " << same_event_sets.size() << " same-event combinations will be filled in one pass" << std::endl;
     
     //Config File ---------------------------------------------------------------------------
     
@@ -197,7 +744,6 @@ int main(int argc, char *argv[])
     double noniso_min = 0;
     double noniso_max = 0;
     double deta_max = 0;
-    isolationDet determiner = CLUSTER_ISO_ITS_04;
     int n_eta_bins = 0;
     int n_phi_bins = 0;
     
@@ -326,27 +872,8 @@ int main(int argc, char *argv[])
             std::cout << "}\n";
         }
         
-        else if (strcmp(key, "Cluster_isolation_determinant") == 0) {
-            if (strcmp(value, "cluster_iso_tpc_04") == 0){
-                determiner = CLUSTER_ISO_TPC_04;
-                std::cout << "Isolation Variable: cluster_iso_tpc_04" << std::endl; }
-            
-            else if (strcmp(value, "cluster_iso_its_04") == 0){
-                determiner = CLUSTER_ISO_ITS_04;
-                std::cout << "Isolation Variable: cluster_iso_its_04" << std::endl; }
-            
-            else if (strcmp(value, "cluster_frixione_tpc_04_02") == 0){
-                determiner = CLUSTER_FRIXIONE_TPC_04_02;
-                std::cout << "Isolation Variable: cluster_frixione_tpc_04_02" << std::endl; }
-            
-            else if (strcmp(value, "cluster_frixione_its_04_02") == 0){
-                determiner = CLUSTER_FRIXIONE_ITS_04_02;
-                std::cout << "Isolation Variable: cluster_frixione_its_04_02" << std::endl; }
-            
-            else {
-                std::cout << "ERROR: Cluster_isolation_determinant in configuration file must be \"cluster_iso_tpc_04\", \"cluster_iso_its_04\", \"cluster_frixione_tpc_04_02\", or \"cluster_frixione_its_04_02\"" << std::endl << "Aborting the program" << std::endl;
-                exit(EXIT_FAILURE); }
-        }
+        else if (strcmp(key, "Cluster_isolation_determinant") == 0)
+            std::cout << "Cluster_isolation_determinant is taken from GammaJet_config.yaml, ignoring the one of Corr_config.yaml" << std::endl;
         
         else std::cout << "WARNING: Unrecognized keyvariable " << key << std::endl;
         
@@ -354,6 +881,26 @@ int main(int argc, char *argv[])
     //end Config Loop
     
     fclose(config);
+    checkpoint_fingerprint_file(checkpoint, "Corr_config.yaml");
+    
+    // The event, cluster and jet selection of GammaJet, shared by the same-event and mixed-event sets
+    const GammaJetCuts cuts = read_gammajet_config("GammaJet_config.yaml");
+    checkpoint_fingerprint_file(checkpoint, "GammaJet_config.yaml");
+    ShowerNet shower_net;
+    const EMCalGeometry emcal = emcal_geometry();
+    ShowerNetWork shower_net_work;
+    if (cuts.photon_identifier == DNN_LOCAL) {
+        shower_net = shower_net_read(cuts.shower_net_weights.c_str());
+        checkpoint_fingerprint_file(checkpoint, cuts.shower_net_weights.c_str());
+    }
+    // The cells of the clusters passing the eta cut and inside the cluster pT bins, for the _local shower shapes and EcrossoverE_local
+    const bool recompute_shower_shape = cuts.photon_identifier == LAMBDA_0_LOCAL || cuts.photon_identifier == EMAX_OVER_ECLUSTER_LOCAL || cuts.EcrossoverE_local;
+    std::vector<int> shower_shape_clusters;
+    const ShowerShapeParameters shower_shape_cuts = shower_shape_parameters();
+    ShowerShapeWork shower_shape_scratch = shower_shape_work();
+    IsolationGrid isolation_tracks = isolation_grid(0.9, 0.05, cuts.isolation_track_pt_min, &cuts.isolation_track_mask, 1);
+    const double cluspT_lowest = *std::min_element(cluspTmins.begin(), cluspTmins.end());
+    const double cluspT_highest = *std::max_element(cluspTmaxs.begin(), cluspTmaxs.end());
     
     for (int i = 0; i <= nztbins; i++)
         std::cout << "zt bound: " << ztbins[i] << std::endl;
@@ -361,11 +908,6 @@ int main(int argc, char *argv[])
         std::cout << "pt bound: " << ptbins[i] << std::endl;
     
     
-    //HISTOGRAMS
-    TCanvas canvas("canvas", "");
-    
-    //TH2D* Signal_pT_Dist = new TH2D("Signal_pT_Dist","Cluster Pt Spectrum For Isolation (its_04) bins 0.55 < DNN < 0.85",59,0.5,30,59,0.5,30);
-    //For this example, fill with pt and energy
     
     //ROOT --------------------------------------------------------------------------------------
     
@@ -385,12 +927,16 @@ int main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
     }
+    // eta-boosting adjustment for p-Pb, as in GammaJet.cc
+    const double boost_adj = boost_adjustment((std::string)root_file);
+    std::cout << "Boost adjustment is " << boost_adj << " in eta" << std::endl;
     
     //variables
     UInt_t nevent;
     std::vector<Double_t> primary_vertex(3, NAN);
     Bool_t is_pileup_from_spd_5_08;
     std::vector<Float_t> multiplicity_v0(64, NAN);//64 channels for v0 detector, to be summed
+    Float_t ue_estimate_its_const;
     
     UInt_t ntrack;
     Float_t track_e[NTRACK_MAX];
@@ -402,6 +948,7 @@ int main(int argc, char *argv[])
     UInt_t ncluster;
     Float_t cluster_e[NTRACK_MAX];
     Float_t cluster_e_cross[NTRACK_MAX];
+    Float_t cluster_e_max[NTRACK_MAX];
     Float_t cluster_pt[NTRACK_MAX];
     Float_t cluster_eta[NTRACK_MAX];
     Float_t cluster_phi[NTRACK_MAX];
@@ -411,6 +958,7 @@ int main(int argc, char *argv[])
     Float_t cluster_frixione_its_04_02[NTRACK_MAX];
     Float_t cluster_iso_its_04_ue[NTRACK_MAX];
     Float_t cluster_s_nphoton[NTRACK_MAX][4];
+    Float_t cluster_s_nphoton_local[NTRACK_MAX]; // DNN_local score
     UChar_t cluster_nlocal_maxima[NTRACK_MAX];
     Float_t cluster_distance_to_bad_channel[NTRACK_MAX];
     
@@ -419,18 +967,22 @@ int main(int argc, char *argv[])
     UShort_t  cluster_cell_id_max[NTRACK_MAX];
     Float_t cluster_lambda_square[NTRACK_MAX][2];
     Float_t cell_e[17664];
+    std::vector<ShowerShape> cluster_shower_shape(NTRACK_MAX); // lambda_0_local, Emax_over_Ecluster_local and EcrossoverE_local
     
     //Jets
     UInt_t njet_ak04its;
     Float_t jet_ak04its_pt_raw[NTRACK_MAX];
     Float_t jet_ak04its_eta_raw[NTRACK_MAX];
     Float_t jet_ak04its_phi[NTRACK_MAX];
+    Float_t jet_ak04its_ptd_raw[NTRACK_MAX];
+    UShort_t jet_ak04its_multiplicity[NTRACK_MAX];
     
     Long64_t mix_events[300];
     
     _tree_event->SetBranchAddress("primary_vertex", &primary_vertex[0]);
     _tree_event->SetBranchAddress("is_pileup_from_spd_5_08", &is_pileup_from_spd_5_08);
     _tree_event->SetBranchAddress("multiplicity_v0", &multiplicity_v0[0]);
+    _tree_event->SetBranchAddress("ue_estimate_its_const", &ue_estimate_its_const);
     
     _tree_event->SetBranchAddress("ntrack", &ntrack);
     _tree_event->SetBranchAddress("track_e", track_e);
@@ -442,6 +994,7 @@ int main(int argc, char *argv[])
     _tree_event->SetBranchAddress("ncluster", &ncluster);
     _tree_event->SetBranchAddress("cluster_e", cluster_e);
     _tree_event->SetBranchAddress("cluster_e_cross", cluster_e_cross);
+    _tree_event->SetBranchAddress("cluster_e_max", cluster_e_max);
     _tree_event->SetBranchAddress("cluster_pt", cluster_pt); // here
     _tree_event->SetBranchAddress("cluster_eta", cluster_eta);
     _tree_event->SetBranchAddress("cluster_phi", cluster_phi);
@@ -465,6 +1018,10 @@ int main(int argc, char *argv[])
     _tree_event->SetBranchAddress("jet_ak04its_pt_raw", jet_ak04its_pt_raw);
     _tree_event->SetBranchAddress("jet_ak04its_eta_raw", jet_ak04its_eta_raw);
     _tree_event->SetBranchAddress("jet_ak04its_phi", jet_ak04its_phi);
+    if (do_same_event) {
+        _tree_event->SetBranchAddress("jet_ak04its_ptd_raw", jet_ak04its_ptd_raw);
+        _tree_event->SetBranchAddress("jet_ak04its_multiplicity_raw", jet_ak04its_multiplicity);
+    }
     
     _tree_event->SetBranchAddress("mixed_events", mix_events);
     
@@ -476,7 +1033,7 @@ int main(int argc, char *argv[])
     //open hdf5: Define size of data from file, explicitly allocate memory in hdf5 space and array size
     const H5std_string event_ds_name( "event" );
     H5File h5_file( hdf5_file_name, H5F_ACC_RDONLY ); //hdf5_file_name from argv[2]
-    DataSet event_dataset = h5_file.openDataSet( event_ds_name );
+    DataSet event_dataset = hdf5_open_dataset_cached( h5_file, event_ds_name.c_str() ); //chunk cache sized to the dataset
     DataSpace event_dataspace = event_dataset.getSpace();
     //Load the dimensions of dataset from file, to be used in array/hyperslab
     const int event_ndims = event_dataspace.getSimpleExtentNdims();
@@ -523,7 +1080,7 @@ int main(int argc, char *argv[])
     // Get jet
     const H5std_string jet_ds_name( "jet" );
     H5File h5_file_jet( hdf5_file_name, H5F_ACC_RDONLY ); //hdf5_file_name from argv[2]
-    DataSet jet_dataset = h5_file_jet.openDataSet( jet_ds_name );
+    DataSet jet_dataset = hdf5_open_dataset_cached( h5_file_jet, jet_ds_name.c_str() ); //chunk cache sized to the dataset
     DataSpace jet_dataspace = jet_dataset.getSpace();
     
     //Load the dimensions of dataset from file, to be used in array/hyperslab
@@ -570,398 +1127,282 @@ int main(int argc, char *argv[])
     jet_dataset.read( jet_data_out, PredType::NATIVE_FLOAT, jet_memspace, jet_dataspace );
     fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, "jet dataset read into array: OK");
     
+    
     //MONEY MAKING LOOP
     Long64_t nentries = _tree_event->GetEntries();
-    
-    int N_SR = 0;
-    int N_BR = 0;
-    
-    for(Long64_t ievent = 0; ievent < nentries ; ievent++){
+    entry_range_resolve(entry_range, nentries);
+    Long64_t first_entry;
+    Long64_t last_entry;
+    entry_range_local(entry_range, 0, nentries, first_entry, last_entry);
+    if (entry_range_partial(entry_range))
+        std::cout << " Correlating the entries " << first_entry << " to " << last_entry - 1 << std::endl;
+    
+    for (size_t iset = 0; iset < histogram_sets.size(); iset++)
+        checkpoint_set(checkpoint, histogram_sets[iset], Form("mixed%lu", iset));
+    for (size_t iset = 0; iset < same_event_sets.size(); iset++)
+        checkpoint_set(checkpoint, same_event_sets[iset], Form("same%lu", iset));
+    // Triggered events that reach the mixing, which set the cadence of the convergence checks
+    Long64_t ntriggered = 0;
+    checkpoint_counter(checkpoint, "ntriggered", &ntriggered);
+    long resume_file;
+    Long64_t resume_entry;
+    if (checkpoint_resume(checkpoint, resume_file, resume_entry))
+        first_entry = std::max(first_entry, resume_entry);
+    
+    std::vector<SelectedCluster> selected_clusters;
+    std::vector<SelectedJet> same_jets;
+    std::vector<SelectedJet> mixed_jets;
+    
+    for(Long64_t ievent = first_entry; ievent < last_entry ; ievent++){
+        if (checkpoint_due(checkpoint)) checkpoint_write(checkpoint, 0, ievent);
         _tree_event->GetEntry(ievent);
-        if(not( TMath::Abs(primary_vertex[2])<10)) continue; //vertex z position cut
+        if(not( TMath::Abs(primary_vertex[2])<cuts.primary_vertex_max)) continue; //vertex z position cut
         if(not (primary_vertex[2]!=0.00 )) continue; //removes default of vertex z = 0
         if(is_pileup_from_spd_5_08) continue; //removes pileup
-
-        //Cuts/Variables from the ROOT file go here
-        for (Long64_t imix = mix_start; imix < mix_end+1; imix++){
+        
+        // The cluster selection does not depend on the mixed event, so it is done once per triggered event, with GammaJet's cuts
+        if (cuts.photon_identifier == DNN_LOCAL) shower_net_event(shower_net, emcal, ncluster, cell_e, cluster_cell_id_max, cluster_e, cluster_s_nphoton_local, shower_net_work);
+        if (recompute_shower_shape) {
+            shower_shape_clusters.clear();
+            for (ULong64_t n = 0; n < ncluster; n++) {
+                if (cluster_pt[n] > cluspT_lowest && cluster_pt[n] < cluspT_highest && TMath::Abs(cluster_eta[n] - boost_adj) < cuts.Cluster_Eta_max) shower_shape_clusters.push_back(n);
+            }
+            shower_shape_event(emcal, shower_shape_cuts, cell_e, shower_shape_clusters.size(), shower_shape_clusters.data(), cluster_cell_id_max, cluster_ncell, &cluster_shower_shape[0], shower_shape_scratch);
+        }
+        if (cuts.determiner == TRACK_CONE) isolation_grid_build(isolation_tracks, ntrack, track_pt, track_eta, track_phi, track_quality);
+        
+        selected_clusters.clear();
+        for(Long64_t icluster = 0; icluster < ncluster; icluster++) {
+            // The cluster pT bin is applied per combination, when the pairs are routed
+            if( not(cluster_pt[icluster] > cluspT_lowest && cluster_pt[icluster] < cluspT_highest)) {continue;}
+            if( not(TMath::Abs(cluster_eta[icluster]-boost_adj)<cuts.Cluster_Eta_max)) {continue;} //select eta of photons
+            if( not(cluster_ncell[icluster]>cuts.Cluster_ncell_min)) {continue;}   //removes clusters with 1 or 2 cells
+            if( not((cuts.EcrossoverE_local ? cluster_shower_shape[icluster].e_cross : cluster_e_cross[icluster])/cluster_e[icluster]>cuts.EcrossoverE_min)) {continue;} //removes "spiky" clusters
+            if( not(cluster_nlocal_maxima[icluster]<cuts.Cluster_locmaxima_max)) {continue;} //local maxima cut, as in GammaJet's correlation loop
+            if( not(cluster_distance_to_bad_channel[icluster]>=cuts.Cluster_distobadchannel)) {continue;}
+            
+            double isolation;
+            // UE subtraction; choose isolation variable
+            if (cuts.determiner == TRACK_CONE) isolation = isolation_grid_cone(isolation_tracks, 0, cluster_eta[icluster], cluster_phi[icluster], cuts.isolation_cone_radius) - ue_estimate_its_const*cuts.isolation_cone_radius*cuts.isolation_cone_radius*TMath::Pi();
+            else {
+                if (cuts.determiner == CLUSTER_ISO_TPC_04) isolation = cluster_iso_tpc_04[icluster] + cluster_iso_its_04_ue[icluster];
+                else if (cuts.determiner == CLUSTER_ISO_ITS_04) isolation = cluster_iso_its_04[icluster] + cluster_iso_its_04_ue[icluster];
+                else if (cuts.determiner == CLUSTER_FRIXIONE_TPC_04_02) isolation = cluster_frixione_tpc_04_02[icluster] + cluster_iso_its_04_ue[icluster];
+                else isolation = cluster_frixione_its_04_02[icluster] + cluster_iso_its_04_ue[icluster];
+                isolation = isolation - ue_estimate_its_const*0.4*0.4*TMath::Pi(); //Use rhoxA subtraction
+            }
+            if( not(isolation < cuts.iso_max)) continue;
+            
+            // Photon Identification, with the signal region taking precedence as in GammaJet
+            bool inSignalRegion;
+            bool inBkgRegion;
+            if (cuts.photon_identifier == DNN || cuts.photon_identifier == DNN_LOCAL) {
+                const float dnn = cuts.photon_identifier == DNN_LOCAL ? cluster_s_nphoton_local[icluster] : cluster_s_nphoton[icluster][1];
+                inSignalRegion = dnn > cuts.SIG_DNN_min && dnn < cuts.SIG_DNN_max;
+                inBkgRegion = dnn > cuts.BKG_DNN_min && dnn < cuts.BKG_DNN_max;
+            }
+            else if (cuts.photon_identifier == LAMBDA_0 || cuts.photon_identifier == LAMBDA_0_LOCAL) {
+                const float lambda0 = cuts.photon_identifier == LAMBDA_0_LOCAL ? cluster_shower_shape[icluster].lambda0_square : cluster_lambda_square[icluster][0];
+                inSignalRegion = lambda0 > cuts.SIG_lambda_min && lambda0 < cuts.SIG_lambda_max;
+                inBkgRegion = lambda0 > cuts.BKG_lambda_min && lambda0 < cuts.BKG_lambda_max;
+            }
+            else {
+                const float eratio = (cuts.photon_identifier == EMAX_OVER_ECLUSTER_LOCAL ? cluster_shower_shape[icluster].e_max : cluster_e_max[icluster])/cluster_e[icluster];
+                inSignalRegion = eratio > cuts.SIG_Emax_over_Ecluster_min && eratio < cuts.SIG_Emax_over_Ecluster_max;
+                inBkgRegion = eratio > cuts.BKG_Emax_over_Ecluster_min && eratio < cuts.BKG_Emax_over_Ecluster_max;
+            }
+            if (not(inSignalRegion || inBkgRegion)) {continue;}
+            
+            SelectedCluster cluster;
+            cluster.inSignalRegion = inSignalRegion;
+            cluster.pT = cluster_pt[icluster];
+            cluster.phi = cluster_phi[icluster];
+            cluster.eta = cluster_eta[icluster];
+            while(cluster.phi >= TMath::Pi()) cluster.phi -= (2*TMath::Pi());
+            while(cluster.phi <= -TMath::Pi()) cluster.phi += (2*TMath::Pi());
+            selected_clusters.push_back(cluster);
+        }
+        // Nothing to pair: skip the HDF5 reads of the mixing partners altogether
+        if (selected_clusters.empty()) continue;
+        
+        float multiplicity_sum = 0;
+        for (int k = 0; k < 64; k++)  multiplicity_sum += multiplicity_v0[k];
+        
+        // Same-event pairs: the jets of the triggered event itself, with the same jet selection as the mixed jets
+        if (do_same_event) {
+            same_jets.clear();
+            for(Long64_t ijet = 0; ijet < njet_ak04its; ijet++){
+                SelectedJet jet;
+                jet.pT = jet_ak04its_pt_raw[ijet];
+                jet.eta = jet_ak04its_eta_raw[ijet];
+                jet.phi = jet_ak04its_phi[ijet];
+                jet.pTD = jet_ak04its_ptd_raw[ijet];
+                jet.multiplicity = jet_ak04its_multiplicity[ijet];
+                if (not(TMath::Abs(jet.eta) < cuts.Jet_Eta_max)) {continue;}
+                
+                while(jet.phi >= TMath::Pi()) jet.phi -= (2*TMath::Pi());
+                while(jet.phi <= -TMath::Pi()) jet.phi += (2*TMath::Pi());
+                same_jets.push_back(jet);
+            }
+            
+            for (size_t iset = 0; iset < same_event_sets.size(); iset++) {
+                CorrelationHistogramSet &set = same_event_sets[iset];
+                for (size_t icluster = 0; icluster < selected_clusters.size(); icluster++) {
+                    const SelectedCluster &cluster = selected_clusters[icluster];
+                    if(not(cluster.pT > set.cluspTmin)) {continue;}
+                    if(not(cluster.pT < set.cluspTmax)) {continue;}
+                    
+                    if (cluster.inSignalRegion) set.N_SR++;
+                    else set.N_BR++;
+                    
+                    for (size_t ijet = 0; ijet < same_jets.size(); ijet++) {
+                        if(not(same_jets[ijet].pT > set.jetpTmin)) {continue;}
+                        fill_pair(set, cluster, same_jets[ijet], primary_vertex[2], multiplicity_sum, primary_vertex[2], multiplicity_sum, 1);
+                    }
+                }
+            }
+        }
+        
+        // Adaptive mixing: check the key distributions every 1000 triggered events
+        ntriggered++;
+        if (adaptive_precision > 0 && ntriggered % 1000 == 0) {
+            for (size_t iset = 0; iset < histogram_sets.size(); iset++)
+                update_convergence(histogram_sets[iset], adaptive_precision);
+        }
+        for (size_t iset = 0; iset < histogram_sets.size(); iset++)
+            histogram_sets[iset].npartners_event = 0;
+        
+        // With --adaptive, a trigger mixed before convergence takes every partner of the window, and one mixed after it only the
+        // minimum: its pairs are weighted by 1/N_partners and the trigger counted once, so that every trigger weighs the same
+        if (adaptive_precision > 0) {
+            for (size_t iset = 0; iset < histogram_sets.size(); iset++) {
+                CorrelationHistogramSet &set = histogram_sets[iset];
+                set.npartners_planned = 0;
+                for (size_t imix = set.mix_start; imix <= set.mix_end; imix++) {
+                    if (set.converged && set.npartners_planned >= adaptive_min_partners) break;
+                    if (mix_events[imix] < 9999999) set.npartners_planned++;
+                }
+                if (set.npartners_planned == 0) continue;
+                for (size_t icluster = 0; icluster < selected_clusters.size(); icluster++) {
+                    const SelectedCluster &cluster = selected_clusters[icluster];
+                    if(not(cluster.pT > set.cluspTmin)) {continue;}
+                    if(not(cluster.pT < set.cluspTmax)) {continue;}
+                    if (cluster.inSignalRegion) set.N_SR++;
+                    else set.N_BR++;
+                }
+            }
+        }
+        
+        // Each mixing partner is read once, and shared by every combination whose window contains it
+        for (Long64_t imix = mix_first; imix < mix_last+1; imix++){
+            // Stop reading partners once no combination needs any more of them for this trigger
+            bool partners_needed = false;
+            for (size_t iset = 0; iset < histogram_sets.size(); iset++) {
+                const CorrelationHistogramSet &set = histogram_sets[iset];
+                if (size_t(imix) > set.mix_end) continue;
+                if (set.converged && set.npartners_event >= adaptive_min_partners) continue;
+                partners_needed = true;
+                break;
+            }
+            if (not partners_needed) break;
+            
             Long64_t mix_event = mix_events[imix];
             //fprintf(stderr,"\n %s:%d: Mixed event = %lu",__FILE__,__LINE__,mix_event);
             
             //if (mix_event == ievent) continue; //not needed for gamma-MB pairing: Different Triggers
             if(mix_event >= 9999999) continue;
+            
+            //adjust offset for next mixed event
+            event_offset[0]=mix_event;
             event_dataspace.selectHyperslab( H5S_SELECT_SET, event_count, event_offset );
             event_dataset.read( event_data_out, PredType::NATIVE_FLOAT, event_memspace, event_dataspace );
             
-            //adjust offset for next mixed event
             jet_offset[0]=mix_event;
             jet_dataspace.selectHyperslab( H5S_SELECT_SET, jet_count, jet_offset );
             jet_dataset.read( jet_data_out, PredType::NATIVE_FLOAT, jet_memspace, jet_dataspace );
             
-            double cluspT = -9000;
-            double jet_pT = -9000;
-            double clusphi = -9000;
-            double jet_phi = -9000;
-            double cluseta = -9000;
-            double jet_eta = -9000;
-            double jet_pTD = -9000;
-            double jet_multiplicity = -9000;
-            for(Long64_t icluster = 0; icluster < ncluster; icluster++) {
-                double isolation;
-                // UE subtraction; choose isolation variable
-                if (determiner == CLUSTER_ISO_TPC_04) isolation = cluster_iso_tpc_04[icluster] + cluster_iso_its_04_ue[icluster];
-                else if (determiner == CLUSTER_ISO_ITS_04) isolation = cluster_iso_its_04[icluster] + cluster_iso_its_04_ue[icluster];
-                else if (determiner == CLUSTER_FRIXIONE_TPC_04_02) isolation = cluster_frixione_tpc_04_02[icluster] + cluster_iso_its_04_ue[icluster];
-                else isolation = cluster_frixione_its_04_02[icluster] + cluster_iso_its_04_ue[icluster];
-                
-                if(not(cluster_pt[icluster] > cluspTmin)) {continue;}
-                if(not(cluster_pt[icluster] < cluspTmax)) {continue;}
-                if( not(TMath::Abs(cluster_eta[icluster])<0.67)) {continue;} //select eta of photons
-                if( not(cluster_ncell[icluster]>2)) {continue;}   //removes clusters with 1 or 2 cells
-                if( not(cluster_e_cross[icluster]/cluster_e[icluster]>0.03)) {continue;} //removes "spiky" clusters
-                if( not(cluster_nlocal_maxima[icluster]<= 2)) {continue;} //require to have at most 2 local maxima.
-                if( not(cluster_distance_to_bad_channel[icluster]>=2.0)) {continue;}
-                if( not(isolation < 1)) continue;
+            // Jets are padded with NaN up to njet_max in the HDF5 file
+            mixed_jets.clear();
+            for(Long64_t ijet = 0; ijet < njet_max; ijet++){
+                if(TMath::IsNaN(jet_data_out[0][ijet][0])) continue;
+                SelectedJet jet;
+                jet.pT = jet_data_out[0][ijet][0];
+                jet.eta = jet_data_out[0][ijet][1];
+                jet.phi = jet_data_out[0][ijet][2];
+                jet.pTD = jet_data_out[0][ijet][3];
+                jet.multiplicity = jet_data_out[0][ijet][4];
+                if (not(TMath::Abs(jet.eta) < cuts.Jet_Eta_max)) {continue;}
                 
-                cluspT = cluster_pt[icluster];
-                clusphi = cluster_phi[icluster];
-                cluseta = cluster_eta[icluster];
-                
-                while(clusphi >= TMath::Pi()) clusphi -= (2*TMath::Pi());
-                while(clusphi <= -TMath::Pi()) clusphi += (2*TMath::Pi());
-                
-               // After cluster cuts, increment number of triggers and loop over jets
-                if((cluster_lambda_square[icluster][0] > 0.05) && (cluster_lambda_square[icluster][0] < 0.3)) {
-                    N_SR++;
-                }
-                else if((cluster_lambda_square[icluster][0] > 0.4) && (cluster_lambda_square[icluster][0] < 1.0)) {
-                    N_BR++;
-                }
-                else {continue;}
+                while(jet.phi >= TMath::Pi()) jet.phi -= (2*TMath::Pi());
+                while(jet.phi <= -TMath::Pi()) jet.phi += (2*TMath::Pi());
+                mixed_jets.push_back(jet);
+            }
+            
+            // Route every cluster-jet pair to the combinations it belongs to
+            for (size_t iset = 0; iset < histogram_sets.size(); iset++) {
+                CorrelationHistogramSet &set = histogram_sets[iset];
+                if (size_t(imix) < set.mix_start || size_t(imix) > set.mix_end) continue;
+                if (set.converged && set.npartners_event >= adaptive_min_partners) continue;
+                set.npartners_event++;
+                const double weight = adaptive_precision > 0 ? 1.0/set.npartners_planned : 1;
                 
-                for(Long64_t ijet = 0; ijet < njet_ak04its; ijet++){
-                    if(TMath::IsNaN(jet_data_out[0][ijet][0])) continue;
-                    if(not(jet_data_out[0][ijet][0] > jetpTmin)) {continue;}
-                    //std::cout << "icluster " << icluster << " has  lambda0 " << cluster_lambda_square[icluster][0] << std::endl;
-                    // After the jet cuts, fill histograms
-                    jet_pT = jet_data_out[0][ijet][0];
-                    jet_phi = jet_data_out[0][ijet][2];
-                    jet_eta = jet_data_out[0][ijet][1];
-                    jet_pTD = jet_data_out[0][ijet][3];
-                    jet_multiplicity = jet_data_out[0][ijet][4];
-                    if (not(TMath::Abs(jet_eta) < 0.5)) {continue;}
-                    
-                    //std::cout << "icluster " << icluster << " ijet " << ijet << " passed all jet cuts " << std::endl;
-                    
-                    while(jet_phi >= TMath::Pi()) jet_phi -= (2*TMath::Pi());
-                    while(jet_phi <= -TMath::Pi()) jet_phi += (2*TMath::Pi());
+                for (size_t icluster = 0; icluster < selected_clusters.size(); icluster++) {
+                    const SelectedCluster &cluster = selected_clusters[icluster];
+                    if(not(cluster.pT > set.cluspTmin)) {continue;}
+                    if(not(cluster.pT < set.cluspTmax)) {continue;}
                     
-                    
-                    if((cluster_lambda_square[icluster][0] > 0.05) && (cluster_lambda_square[icluster][0] < 0.3)) {
-                        //std::cout << "SIG icluster " << icluster << " has  lambda0 " << cluster_lambda_square[icluster][0] << std::endl;
-                        SIGcluster_pt_dist->Fill(cluspT);
-                        SIGjet_pt_dist->Fill(jet_pT);
-                        SIGpt_diff_dist->Fill(TMath::Abs(cluspT-jet_pT));
-                        
-                        double dphinum = clusphi-jet_phi;
-                        while(dphinum < -TMath::Pi()) dphinum += 2*TMath::Pi();
-                        while(dphinum > TMath::Pi()) dphinum -= 2*TMath::Pi();
-                        SIGdPhi->Fill(TMath::Abs(dphinum));
-                        if(not(dphinum > TMath::Pi()/2)) continue;
-                        SIGclusterPhi->Fill(clusphi);
-                        SIGjetPhi->Fill(jet_phi);
-                        
-                        SIGdEta->Fill(jet_eta-cluseta);
-                        SIGclusterEta->Fill(cluseta);
-                        SIGjetEta->Fill(jet_eta);
-                        
-                        SIGXj->Fill(jet_pT/cluspT);
-                        SIGpTD->Fill(jet_pTD);
-                        SIGMultiplicity->Fill(jet_multiplicity);
-                        SIGXobsPb->Fill(((cluspT*TMath::Exp(-cluseta))+(jet_pT*TMath::Exp(-jet_eta)))/(2*EPb));
-                        
-                        z_Vertices->Fill(TMath::Abs(event_data_out[0][0] - primary_vertex[2]));
-                        z_Vertices_individual->Fill(primary_vertex[2]);
-                        z_Vertices_hdf5->Fill(event_data_out[0][0]);
-                        
-                        float multiplicity_sum = 0;
-                        for (int k = 0; k < 64; k++)  multiplicity_sum += multiplicity_v0[k];
-                        //std::cout << "Multiplicity difference " << TMath::Abs(event_data_out[0][1] - multiplicity_sum) << std::endl;
-                        Multiplicity->Fill(TMath::Abs(event_data_out[0][1] - multiplicity_sum));
-                        Multiplicity_individual->Fill(multiplicity_sum);
-                        Multiplicity_hdf5->Fill(event_data_out[0][1]);
+                    // After cluster cuts, increment number of triggers (per partner, unless adaptive) and loop over jets
+                    if (adaptive_precision == 0) {
+                        if (cluster.inSignalRegion) set.N_SR++;
+                        else set.N_BR++;
                     }
                     
-                    if((cluster_lambda_square[icluster][0] > 0.4) && (cluster_lambda_square[icluster][0] < 1.0)) {
-                        //std::cout << "BKG icluster " << icluster << " has  lambda0 " << cluster_lambda_square[icluster][0] << std::endl;
-                        BKGcluster_pt_dist->Fill(cluspT);
-                        BKGjet_pt_dist->Fill(jet_pT);
-                        BKGpt_diff_dist->Fill(TMath::Abs(cluspT-jet_pT));
-                        
-                        double dphinum = clusphi-jet_phi;
-                        while(dphinum < -TMath::Pi()) dphinum += 2*TMath::Pi();
-                        while(dphinum > TMath::Pi()) dphinum -= 2*TMath::Pi();
-                        BKGdPhi->Fill(TMath::Abs(dphinum));
-                        if(not(dphinum > TMath::Pi()/2)) continue;
-                        BKGclusterPhi->Fill(clusphi);
-                        BKGjetPhi->Fill(jet_phi);
-                        
-                        BKGdEta->Fill(jet_eta-cluseta);
-                        BKGclusterEta->Fill(cluseta);
-                        BKGjetEta->Fill(jet_eta);
-                        
-                        BKGXj->Fill(jet_pT/cluspT);
-                        BKGpTD->Fill(jet_pTD);
-                        BKGMultiplicity->Fill(jet_multiplicity);
-                        BKGXobsPb->Fill(((cluspT*TMath::Exp(-cluseta))+(jet_pT*TMath::Exp(-jet_eta)))/(2*EPb));
-                        
+                    for (size_t ijet = 0; ijet < mixed_jets.size(); ijet++) {
+                        if(not(mixed_jets[ijet].pT > set.jetpTmin)) {continue;}
+                        fill_pair(set, cluster, mixed_jets[ijet], event_data_out[0][0], event_data_out[0][1], primary_vertex[2], multiplicity_sum, weight);
                     }
-                    //else {
-                        //std::cout << "icluster " << icluster << " has  lambda0 " << cluster_lambda_square[icluster][0] << std::endl;
-                    //}
                 }
             }
-            
         }//end loop over mixed events
+        
+        // Record how many partners each trigger was actually mixed with
+        for (size_t iset = 0; iset < histogram_sets.size(); iset++) {
+            CorrelationHistogramSet &set = histogram_sets[iset];
+            for (size_t icluster = 0; icluster < selected_clusters.size(); icluster++) {
+                if(not(selected_clusters[icluster].pT > set.cluspTmin)) {continue;}
+                if(not(selected_clusters[icluster].pT < set.cluspTmax)) {continue;}
+                set.h_npartners->Fill(set.npartners_event);
+            }
+        }
         if(ievent % 10000 == 0)
             std::cout << "Event " << ievent << std::endl;
     } //end loop over events
     
-    //very particular about file names to ease scripting
-    // Write to fout
-    
+    // Write one output per combination
     std::string rawname = ((std::string)root_file).substr(((std::string)root_file).find_last_of("/")+1, ((std::string)root_file).find_last_of(".")-((std::string)root_file).find_last_of("/")-1);
-    //std::string rawname = std::string(argv[1]);
-    TFile* fout = new TFile(Form("New_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.root",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin),"RECREATE");
-    std::cout<< "Created datafile: " << Form("New_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.root",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin) << std::endl;
-    // Normalize
-    SIGcluster_pt_dist->Scale(1.0/(N_SR*SIGcluster_pt_dist_binwidth));
-    SIGjet_pt_dist->Scale(1.0/(N_SR*SIGjet_pt_dist_binwidth));
-    SIGpt_diff_dist->Scale(1.0/(N_SR*SIGpt_diff_dist_binwidth));
-    
-    SIGdPhi->Scale(1.0/(N_SR*SIGdPhi_binwidth));
-    SIGclusterPhi->Scale(1.0/(N_SR*SIGclusterPhi_binwidth));
-    SIGjetPhi->Scale(1.0/(N_SR*SIGjetPhi_binwidth));
-    
-    SIGdEta->Scale(1.0/(N_SR*SIGdEta_binwidth));
-    SIGclusterEta->Scale(1.0/(N_SR*SIGclusterEta_binwidth));
-    SIGjetEta->Scale(1.0/(N_SR*SIGjetEta_binwidth));
-    
-    SIGXj->Scale(1.0/(N_SR*SIGXj_binwidth));
-    SIGpTD->Scale(1.0/(N_SR*SIGpTD_binwidth));
-    SIGMultiplicity->Scale(1.0/(N_SR*SIGMultiplicity_binwidth));
-    SIGXobsPb->Scale(1.0/(N_SR*SIGXobsPb_binwidth));
-    
-    BKGcluster_pt_dist->Scale(1.0/(N_BR*BKGcluster_pt_dist_binwidth));
-    BKGjet_pt_dist->Scale(1.0/(N_BR*BKGjet_pt_dist_binwidth));
-    BKGpt_diff_dist->Scale(1.0/(N_BR*BKGpt_diff_dist_binwidth));
-    
-    BKGdPhi->Scale(1.0/(N_BR*BKGdPhi_binwidth));
-    BKGclusterPhi->Scale(1.0/(N_BR*BKGclusterPhi_binwidth));
-    BKGjetPhi->Scale(1.0/(N_BR*BKGjetPhi_binwidth));
-    
-    BKGdEta->Scale(1.0/(N_BR*BKGdEta_binwidth));
-    BKGclusterEta->Scale(1.0/(N_BR*BKGclusterEta_binwidth));
-    BKGjetEta->Scale(1.0/(N_BR*BKGjetEta_binwidth));
-    
-    BKGXj->Scale(1.0/(N_BR*BKGXj_binwidth));
-    BKGpTD->Scale(1.0/(N_BR*BKGpTD_binwidth));
-    BKGMultiplicity->Scale(1.0/(N_BR*BKGMultiplicity_binwidth));
-    BKGXobsPb->Scale(1.0/(N_BR*BKGXobsPb_binwidth));
-    
-    // Set minima
-    SIGcluster_pt_dist->SetMinimum(0);
-    SIGjet_pt_dist->SetMinimum(0);
-    SIGpt_diff_dist->SetMinimum(0);
-    
-    SIGdPhi->SetMinimum(0);
-    SIGclusterPhi->SetMinimum(0);
-    SIGjetPhi->SetMinimum(0);
-    
-    SIGdEta->SetMinimum(0);
-    SIGclusterEta->SetMinimum(0);
-    SIGjetEta->SetMinimum(0);
-    
-    SIGXj->SetMinimum(0);
-    SIGpTD->SetMinimum(0);
-    SIGMultiplicity->SetMinimum(0);
-    SIGXobsPb->SetMinimum(0);
-    
-    BKGcluster_pt_dist->SetMinimum(0);
-    BKGjet_pt_dist->SetMinimum(0);
-    BKGpt_diff_dist->SetMinimum(0);
-    
-    BKGdPhi->SetMinimum(0);
-    BKGclusterPhi->SetMinimum(0);
-    BKGjetPhi->SetMinimum(0);
-    
-    BKGdEta->SetMinimum(0);
-    BKGclusterEta->SetMinimum(0);
-    BKGjetEta->SetMinimum(0);
-    
-    BKGXj->SetMinimum(0);
-    BKGpTD->SetMinimum(0);
-    BKGMultiplicity->SetMinimum(0);
-    BKGXobsPb->SetMinimum(0);
-    
-    //Write histograms here
-    
-    SIGcluster_pt_dist->Write();
-    SIGjet_pt_dist->Write();
-    SIGpt_diff_dist->Write();
-    
-    SIGdPhi->Write();
-    SIGclusterPhi->Write();
-    SIGjetPhi->Write();
-    
-    SIGdEta->Write();
-    SIGclusterEta->Write();
-    SIGjetEta->Write();
-    
-    SIGXj->Write();
-    SIGpTD->Write();
-    SIGMultiplicity->Write();
-    SIGXobsPb->Write();
-    
-    BKGcluster_pt_dist->Write();
-    BKGjet_pt_dist->Write();
-    BKGpt_diff_dist->Write();
-    
-    BKGdPhi->Write();
-    BKGclusterPhi->Write();
-    BKGjetPhi->Write();
-    
-    BKGdEta->Write();
-    BKGclusterEta->Write();
-    BKGjetEta->Write();
-    
-    BKGXj->Write();
-    BKGpTD->Write();
-    BKGMultiplicity->Write();
-    BKGXobsPb->Write();
-    
-    z_Vertices->Write();
-    Multiplicity->Write();
-    z_Vertices_individual->Write();
-    z_Vertices_hdf5->Write();
-    Multiplicity_individual->Write();
-    Multiplicity_hdf5->Write();
-    
-    // Commented out due to segfaults
-    /*
-    SIGcluster_pt_dist->Draw();
-    canvas.SaveAs(Form("signal_cluster_pT_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGjet_pt_dist->Draw();
-    canvas.SaveAs(Form("signal_jet_pt_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f._minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGpt_diff_dist->Draw();
-    canvas.SaveAs(Form("signal_pt_diff_differences_individual_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    SIGclusterPhi->Draw();
-    canvas.SaveAs(Form("signal_cluster_phi_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGjetPhi->Draw();
-    canvas.SaveAs(Form("signal_jet_phi_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGdPhi->Draw();
-    canvas.SaveAs(Form("signal_delta_phi_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    SIGdEta->Draw();
-    canvas.SaveAs(Form("signal_delta_eta_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGclusterEta->Draw();
-    canvas.SaveAs(Form("signal_cluster_eta_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGjetEta->Draw();
-    canvas.SaveAs(Form("signal_jet_eta_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    SIGXj->Draw();
-    canvas.SaveAs(Form("signal_Xj_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGpTD->Draw();
-    canvas.SaveAs(Form("signal_pTD_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    SIGMultiplicity->Draw();
-    canvas.SaveAs(Form("signal_multiplicity_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    BKGcluster_pt_dist->Draw();
-    canvas.SaveAs(Form("background_cluster_pT_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGjet_pt_dist->Draw();
-    canvas.SaveAs(Form("background_jet_pt_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGpt_diff_dist->Draw();
-    canvas.SaveAs(Form("background_pt_diff_differences_individual_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    BKGclusterPhi->Draw();
-    canvas.SaveAs(Form("background_cluster_phi_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGjetPhi->Draw();
-    canvas.SaveAs(Form("background_jet_phi_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGdPhi->Draw();
-    canvas.SaveAs(Form("background_delta_phi_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    BKGdEta->Draw();
-    canvas.SaveAs(Form("background_delta_eta_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGclusterEta->Draw();
-    canvas.SaveAs(Form("background_cluster_eta_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGjetEta->Draw();
-    canvas.SaveAs(Form("background_jet_eta_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    BKGXj->Draw();
-    canvas.SaveAs(Form("background_Xj_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGpTD->Draw();
-    canvas.SaveAs(Form("background_pTD_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    BKGMultiplicity->Draw();
-    canvas.SaveAs(Form("background_multiplicity_distribution_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.png",rawname.data(),GeV_Track_Skim,mix_start,mix_end, cluspTmin, cluspTmax, jetpTmin));
-    canvas.Clear();
-    
-    z_Vertices->Draw();
-   
-    std::string filepath = argv[1];
-    std::string opened_files = "_" + filepath.substr(filepath.find_last_of("/")+1, filepath.find_last_of(".")-filepath.find_last_of("/")-1);
-    //std::string rawname = std::string(argv[1]);
-    canvas.SaveAs(Form("z_Vertices_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu.png",opened_files.c_str(),GeV_Track_Skim,mix_start,mix_end));
-    canvas.Clear();
-    Multiplicity->Draw();
-    canvas.SaveAs(Form("Multiplicity_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu.png",opened_files.c_str(),GeV_Track_Skim,mix_start,mix_end));
-    //Signal_pT_Dist->Write();
-    canvas.Clear();
-    z_Vertices_individual->Draw();
-    canvas.SaveAs(Form("z_Vertices_individual_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu.png",opened_files.c_str(),GeV_Track_Skim,mix_start,mix_end));
-    canvas.Clear();
-    z_Vertices_hdf5->Draw();
-    canvas.SaveAs(Form("z_Vertices_hdf5l_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu.png",opened_files.c_str(),GeV_Track_Skim,mix_start,mix_end));
-    canvas.Clear();
-    Multiplicity_individual->Draw();
-    canvas.SaveAs(Form("Multiplicity_individual_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu.png",opened_files.c_str(),GeV_Track_Skim,mix_start,mix_end));
-    canvas.Clear();
-    Multiplicity_hdf5->Draw();
-    canvas.SaveAs(Form("Multiplicity_hdf5_%s_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu.png",opened_files.c_str(),GeV_Track_Skim,mix_start,mix_end));
-    canvas.Clear(); */
-    
-    canvas.Close();
-    
-    fout->Close();
+    const std::string range_tag = entry_range_tag(entry_range);
+    rawname += range_tag;
+    for (size_t iset = 0; iset < histogram_sets.size(); iset++) {
+        normalize_histograms(histogram_sets[iset], unnormalized);
+        write_histograms(histogram_sets[iset], rawname, range_tag, GeV_Track_Skim);
+    }
+    for (size_t iset = 0; iset < same_event_sets.size(); iset++) {
+        normalize_histograms(same_event_sets[iset], unnormalized);
+        write_histograms(same_event_sets[iset], rawname, range_tag, GeV_Track_Skim);
+    }
     
-    std::cout << " ending; num of signal triggers is " << N_SR << " background " << N_BR << std::endl;
+    // Ratio of each mixed-event combination to the same-event set with the same cluster pT bin and minimum jet pT
+    if (do_ratio) {
+        for (size_t iset = 0; iset < histogram_sets.size(); iset++) {
+            const CorrelationHistogramSet &mixed = histogram_sets[iset];
+            for (size_t jset = 0; jset < same_event_sets.size(); jset++) {
+                const CorrelationHistogramSet &same = same_event_sets[jset];
+                if (same.cluspTmin == mixed.cluspTmin && same.cluspTmax == mixed.cluspTmax && same.jetpTmin == mixed.jetpTmin)
+                    write_ratio(same, mixed, rawname, GeV_Track_Skim);
+            }
+        }
+    }
+    checkpoint_remove(checkpoint);
     
-    // Write out number of triggers to a text-file, for permanence
-    std::ofstream outfile_ntrigger;
-    outfile_ntrigger.open(Form("Ntriggercount_%luGeVTracks_Correlation_%1.1lu_to_%1.1lu_cluspT_%1.1f_to_%1.1f_minjetpT_%2.1f.txt", GeV_Track_Skim, mix_start, mix_end, cluspTmin, cluspTmax, jetpTmin));
-    outfile_ntrigger << "num of signal triggers is " << N_SR << " background " << N_BR << std::endl;
-    outfile_ntrigger.close();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,25 @@
+// Helpers shared by the benchmarks of general_tools (*_benchmark.cc, built by the Makefile): the wall time of a run, and the table of
+// the methods compared, with their time and rate
+// Author: Ivan Chernyshev
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstdio>
+
+// Wall time since start, in seconds
+inline double benchmark_seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Header of the method table, rate being the title of the rate column, e.g. "pairs (/s)"
+inline void benchmark_table_header(const char* rate){
+    fprintf(stdout, "%-14s %12s %18s\n", "method", "time (s)", rate);
+}
+
+inline void benchmark_table_row(const char* method, double time, double rate){
+    fprintf(stdout, "%-14s %12.3f %18.4g\n", method, time, rate);
+}
+
+#endif // BENCHMARK_H
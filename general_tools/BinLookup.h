@@ -0,0 +1,68 @@
+// Direct lookup of the bin of a value in variable-width bins (e.g. the Zt_bins and Pt_bins of Corr_config.yaml), for the
+// correlation fills, which otherwise test every bin for every cluster-track pair
+// The range of the bins is cut into uniform cells at least twice as fine as the narrowest bin, and each cell remembers the bin
+// its lower edge falls in, so a lookup is one multiplication and a step over at most a couple of edges
+// The bins are open on both sides, as in the loops: a value exactly on an edge, outside the bins, or NaN has no bin (-1)
+// Author: Ivan Chernyshev
+
+#ifndef BINLOOKUP_H
+#define BINLOOKUP_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+struct BinLookup {
+    int nbins;
+    std::vector<float> edges;       // nbins + 1 edges, kept as float like the configuration arrays so the comparisons do not change
+    double low;
+    double cell_inverse;            // number of cells per unit
+    std::vector<int> cell_bin;      // bin of the lower edge of each cell
+};
+
+inline BinLookup bin_lookup(const float* edges, int nbins){
+    if (nbins < 1) {
+        fprintf(stderr, "%s:%d: a bin lookup needs at least one bin, not %d\n", __FILE__, __LINE__, nbins);
+        exit(EXIT_FAILURE);
+    }
+    BinLookup lookup;
+    lookup.nbins = nbins;
+    lookup.edges.assign(edges, edges + nbins + 1);
+    double min_width = lookup.edges[nbins] - lookup.edges[0];
+    for (int i = 0; i < nbins; i++) {
+        if (!(lookup.edges[i] < lookup.edges[i + 1])) {
+            fprintf(stderr, "%s:%d: the bin edges must increase, but edge %d is %g and edge %d is %g\n", __FILE__, __LINE__,
+                    i, lookup.edges[i], i + 1, lookup.edges[i + 1]);
+            exit(EXIT_FAILURE);
+        }
+        min_width = std::min(min_width, double(lookup.edges[i + 1]) - lookup.edges[i]);
+    }
+    lookup.low = lookup.edges[0];
+    const double range = double(lookup.edges[nbins]) - lookup.low;
+    const int ncell = (int)std::min(4096.0, std::max(double(nbins), std::ceil(2*range/min_width)));
+    lookup.cell_inverse = ncell/range;
+    lookup.cell_bin.resize(ncell);
+    int bin = 0;
+    for (int c = 0; c < ncell; c++) {
+        const double cell_low = lookup.low + c/lookup.cell_inverse;
+        while (bin + 1 < nbins && lookup.edges[bin + 1] <= cell_low) bin++;
+        lookup.cell_bin[c] = bin;
+    }
+    return lookup;
+}
+
+// Bin of x, i.e. the i with edges[i] < x < edges[i + 1]; -1 if there is none
+inline int bin_lookup_find(const BinLookup& lookup, double x){
+    const float* edges = &lookup.edges[0];
+    if (!(x > edges[0] && x < edges[lookup.nbins])) return -1;
+    const int cell = std::min((int)((x - lookup.low)*lookup.cell_inverse), (int)lookup.cell_bin.size() - 1);
+    int bin = lookup.cell_bin[cell];
+    // Rounding of the cell can be off by one either way near the cell edges
+    while (bin > 0 && !(edges[bin] < x)) bin--;
+    while (bin + 1 < lookup.nbins && !(x < edges[bin + 1])) bin++;
+    return (edges[bin] < x && x < edges[bin + 1]) ? bin : -1;
+}
+
+#endif // BINLOOKUP_H
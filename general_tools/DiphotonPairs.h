@@ -0,0 +1,245 @@
+// Diphoton (pi0 candidate) pairing of the EMCal clusters of an event, and event mixing of those pairs, filling a dense
+// pair pT x invariant mass histogram; the pairing behind the hPion THnSparses of old/pi_0, done from the _tree_event cluster arrays
+// The clusters are taken as massless photons of energy cluster_e in the direction (eta, phi), and kept as arrays of E, px, py, pz
+// sorted by decreasing energy. The energies of the partners of a cluster that can pass the pair cuts form an interval
+// (pair pT <= E1 + E2, and |E1 - E2|/(E1 + E2) < asymmetry_max), found by two binary searches, so the pairs outside it are never
+// formed; the mass, pT and opening angle of the rest are computed in a branch-free loop over the arrays, which the compiler vectorizes,
+// and the asymmetry, opening angle and pT cuts applied to them
+// Mixing pairs the clusters of an event with those of the last few events of the same (vz, multiplicity) class
+// Author: Ivan Chernyshev
+
+#ifndef DIPHOTONPAIRS_H
+#define DIPHOTONPAIRS_H
+
+#include <TH2D.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+struct DiphotonClusters {
+    std::vector<double> e;      // by decreasing energy
+    std::vector<double> px;
+    std::vector<double> py;
+    std::vector<double> pz;
+};
+
+struct DiphotonCuts {
+    double pt_min;              // pair pT
+    double pt_max;
+    double asymmetry_max;       // |E1 - E2|/(E1 + E2)
+    double angle_min;           // opening angle, in radians
+};
+
+// Pair counts in npt x nmass uniform bins, without under- or overflow
+struct DiphotonHistogram {
+    int npt;
+    double pt_low;
+    double pt_high;
+    int nmass;
+    double mass_low;
+    double mass_high;
+    std::vector<double> count;  // [ipt*nmass + imass]
+    double npair;
+};
+
+// Mixing classes: nvz x nmult uniform bins of vz and multiplicity, each keeping its last depth events
+struct DiphotonPool {
+    int nvz;
+    double vz_low;
+    double vz_high;
+    int nmult;
+    double mult_low;
+    double mult_high;
+    size_t depth;
+    std::vector<std::deque<DiphotonClusters> > events;
+};
+
+// Scratch arrays of the pair kernel, reused from one cluster to the next
+struct DiphotonScratch {
+    std::vector<double> mass2;
+    std::vector<double> pt2;
+    std::vector<double> asymmetry;
+    std::vector<double> cos_angle;
+};
+
+// Fill clusters with the n clusters of index[] (e.g. those passing the cluster cuts) out of the event arrays
+inline void diphoton_clusters(DiphotonClusters& clusters, const float* e, const float* eta, const float* phi, const int* index, size_t n){
+    std::vector<int> order(index, index + n);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return e[a] > e[b] || (e[a] == e[b] && a < b); });
+    clusters.e.resize(n);
+    clusters.px.resize(n);
+    clusters.py.resize(n);
+    clusters.pz.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        const int k = order[i];
+        // |p| = E, pT = E/cosh(eta)
+        const double pt = e[k]/std::cosh(eta[k]);
+        clusters.e[i] = e[k];
+        clusters.px[i] = pt*std::cos(phi[k]);
+        clusters.py[i] = pt*std::sin(phi[k]);
+        clusters.pz[i] = pt*std::sinh(eta[k]);
+    }
+}
+
+// The positions [begin, end) in clusters of the partners of energy e_other might pair with under the cuts; the bounds are widened
+// by a hair, since the exact cuts are applied to each pair afterwards
+inline void diphoton_partner_range(const DiphotonClusters& clusters, double e_other, const DiphotonCuts& cuts, size_t& begin, size_t& end){
+    const double a = cuts.asymmetry_max;
+    const double e_low = std::max(cuts.pt_min - e_other, a < 1 ? e_other*(1 - a)/(1 + a) : 0.0)*(1 - 1e-9);
+    const double e_high = a < 1 ? e_other*(1 + a)/(1 - a)*(1 + 1e-9) : HUGE_VAL;
+    // Decreasing energies: first position with e <= e_high, first with e < e_low
+    begin = std::lower_bound(clusters.e.begin(), clusters.e.end(), e_high, [](double x, double bound) { return x > bound; }) -
+        clusters.e.begin();
+    end = std::lower_bound(clusters.e.begin(), clusters.e.end(), e_low, [](double x, double bound) { return x >= bound; }) -
+        clusters.e.begin();
+    end = std::max(begin, end);
+}
+
+inline DiphotonHistogram diphoton_histogram(int npt, double pt_low, double pt_high, int nmass, double mass_low, double mass_high){
+    if (npt < 1 || nmass < 1 || !(pt_low < pt_high) || !(mass_low < mass_high)) {
+        fprintf(stderr, "%s:%d: bad pair histogram binning %d [%g, %g) x %d [%g, %g)\n", __FILE__, __LINE__, npt, pt_low, pt_high,
+                nmass, mass_low, mass_high);
+        exit(EXIT_FAILURE);
+    }
+    DiphotonHistogram hist;
+    hist.npt = npt;
+    hist.pt_low = pt_low;
+    hist.pt_high = pt_high;
+    hist.nmass = nmass;
+    hist.mass_low = mass_low;
+    hist.mass_high = mass_high;
+    hist.count.assign((size_t)npt*nmass, 0);
+    hist.npair = 0;
+    return hist;
+}
+
+// Pair the cluster i of a with the clusters [begin, end) of b and count the pairs passing the cuts
+inline void diphoton_pair_kernel(DiphotonHistogram& hist, const DiphotonClusters& a, size_t i, const DiphotonClusters& b, size_t begin,
+                                 size_t end, const DiphotonCuts& cuts, DiphotonScratch& scratch){
+    const size_t n = end - begin;
+    if (n == 0) return;
+    scratch.mass2.resize(n);
+    scratch.pt2.resize(n);
+    scratch.asymmetry.resize(n);
+    scratch.cos_angle.resize(n);
+    const double e = a.e[i];
+    const double px = a.px[i];
+    const double py = a.py[i];
+    const double pz = a.pz[i];
+    const double* e_b = &b.e[begin];
+    const double* px_b = &b.px[begin];
+    const double* py_b = &b.py[begin];
+    const double* pz_b = &b.pz[begin];
+    double* mass2 = &scratch.mass2[0];
+    double* pt2 = &scratch.pt2[0];
+    double* asymmetry = &scratch.asymmetry[0];
+    double* cos_angle = &scratch.cos_angle[0];
+    for (size_t j = 0; j < n; j++) {
+        // Massless photons: m^2 = 2 E1 E2 (1 - cos(angle))
+        cos_angle[j] = (px*px_b[j] + py*py_b[j] + pz*pz_b[j])/(e*e_b[j]);
+        mass2[j] = 2*e*e_b[j]*(1 - cos_angle[j]);
+        pt2[j] = (px + px_b[j])*(px + px_b[j]) + (py + py_b[j])*(py + py_b[j]);
+        asymmetry[j] = std::fabs(e - e_b[j])/(e + e_b[j]);
+    }
+    const double pt_scale = hist.npt/(hist.pt_high - hist.pt_low);
+    const double mass_scale = hist.nmass/(hist.mass_high - hist.mass_low);
+    const double cos_angle_max = std::cos(cuts.angle_min);
+    for (size_t j = 0; j < n; j++) {
+        if (!(asymmetry[j] < cuts.asymmetry_max)) continue;
+        if (!(cos_angle[j] < cos_angle_max)) continue;
+        const double pt = std::sqrt(pt2[j]);
+        if (!(pt > cuts.pt_min && pt < cuts.pt_max)) continue;
+        const double mass = std::sqrt(std::max(mass2[j], 0.0));
+        if (!(pt >= hist.pt_low && pt < hist.pt_high && mass >= hist.mass_low && mass < hist.mass_high)) continue;
+        const int ipt = std::min((int)((pt - hist.pt_low)*pt_scale), hist.npt - 1);
+        const int imass = std::min((int)((mass - hist.mass_low)*mass_scale), hist.nmass - 1);
+        hist.count[(size_t)ipt*hist.nmass + imass]++;
+        hist.npair++;
+    }
+}
+
+// All the pairs of distinct clusters of an event
+inline void diphoton_fill_same(DiphotonHistogram& hist, const DiphotonClusters& clusters, const DiphotonCuts& cuts, DiphotonScratch& scratch){
+    for (size_t i = 0; i + 1 < clusters.e.size(); i++) {
+        // Pair pT <= E1 + E2, and the energies only decrease from here on
+        if ((clusters.e[i] + clusters.e[i + 1])*(1 + 1e-9) < cuts.pt_min) break;
+        size_t begin;
+        size_t end;
+        diphoton_partner_range(clusters, clusters.e[i], cuts, begin, end);
+        // Each pair once: the partners of i come after it
+        begin = std::max(begin, i + 1);
+        if (end <= begin) continue;
+        diphoton_pair_kernel(hist, clusters, i, clusters, begin, end, cuts, scratch);
+    }
+}
+
+// All the pairs of a cluster of one event with a cluster of another
+inline void diphoton_fill_mixed(DiphotonHistogram& hist, const DiphotonClusters& clusters, const DiphotonClusters& other, const DiphotonCuts& cuts,
+                                DiphotonScratch& scratch){
+    for (size_t i = 0; i < clusters.e.size(); i++) {
+        size_t begin;
+        size_t end;
+        diphoton_partner_range(other, clusters.e[i], cuts, begin, end);
+        diphoton_pair_kernel(hist, clusters, i, other, begin, end, cuts, scratch);
+    }
+}
+
+inline DiphotonPool diphoton_pool(int nvz, double vz_low, double vz_high, int nmult, double mult_low, double mult_high, size_t depth){
+    if (nvz < 1 || nmult < 1 || depth < 1 || !(vz_low < vz_high) || !(mult_low < mult_high)) {
+        fprintf(stderr, "%s:%d: bad mixing classes %d [%g, %g) x %d [%g, %g), depth %lu\n", __FILE__, __LINE__, nvz, vz_low, vz_high,
+                nmult, mult_low, mult_high, (unsigned long)depth);
+        exit(EXIT_FAILURE);
+    }
+    DiphotonPool pool;
+    pool.nvz = nvz;
+    pool.vz_low = vz_low;
+    pool.vz_high = vz_high;
+    pool.nmult = nmult;
+    pool.mult_low = mult_low;
+    pool.mult_high = mult_high;
+    pool.depth = depth;
+    pool.events.resize((size_t)nvz*nmult);
+    return pool;
+}
+
+// The mixing class of an event; -1 outside the classes (such events are neither mixed nor kept)
+inline int diphoton_pool_class(const DiphotonPool& pool, double vz, double mult){
+    if (!(vz >= pool.vz_low && vz < pool.vz_high && mult >= pool.mult_low && mult < pool.mult_high)) return -1;
+    const int ivz = std::min((int)((vz - pool.vz_low)/(pool.vz_high - pool.vz_low)*pool.nvz), pool.nvz - 1);
+    const int imult = std::min((int)((mult - pool.mult_low)/(pool.mult_high - pool.mult_low)*pool.nmult), pool.nmult - 1);
+    return ivz*pool.nmult + imult;
+}
+
+// Pair the clusters with those of the events kept in their class, then keep them in place of the oldest; returns the number
+// of events mixed with
+inline size_t diphoton_fill_pool(DiphotonHistogram& hist, DiphotonPool& pool, int iclass, const DiphotonClusters& clusters,
+                                 const DiphotonCuts& cuts, DiphotonScratch& scratch){
+    if (iclass < 0 || clusters.e.empty()) return 0;
+    std::deque<DiphotonClusters>& events = pool.events[iclass];
+    for (size_t k = 0; k < events.size(); k++) diphoton_fill_mixed(hist, clusters, events[k], cuts, scratch);
+    const size_t nmixed = events.size();
+    events.push_back(clusters);
+    if (events.size() > pool.depth) events.pop_front();
+    return nmixed;
+}
+
+// The counts as a TH2D of pair pT (x) and mass (y), with Poisson errors
+inline TH2D* diphoton_histogram_th2d(const DiphotonHistogram& hist, const char* name, const char* title){
+    TH2D* th2d = new TH2D(name, title, hist.npt, hist.pt_low, hist.pt_high, hist.nmass, hist.mass_low, hist.mass_high);
+    th2d->Sumw2();
+    for (int ipt = 0; ipt < hist.npt; ipt++) {
+        for (int imass = 0; imass < hist.nmass; imass++) {
+            const double count = hist.count[(size_t)ipt*hist.nmass + imass];
+            th2d->SetBinContent(ipt + 1, imass + 1, count);
+            th2d->SetBinError(ipt + 1, imass + 1, std::sqrt(count));
+        }
+    }
+    th2d->SetEntries(hist.npair);
+    return th2d;
+}
+
+#endif // DIPHOTONPAIRS_H
@@ -0,0 +1,99 @@
+// Cell geometry table of the EMCal and DCal, for the 17664 cells of the cell_e/cluster_cell_id_max arrays of the ntuples
+// The cells are numbered supermodule by supermodule: 10 full EMCal supermodules (24 x 48 cells in phi x eta), 2 third EMCal ones
+// (8 x 48), 6 two-thirds DCal ones (24 x 32), and 2 third DCal ones (8 x 48). Inside a supermodule, the cells come by 2 x 2 module,
+// phi row after phi row, and within a module eta first, the eta index running backwards (as in AliEMCALGeometry)
+// The (ieta, iphi) indices are those within the supermodule. The (column, row) indices are global, in cell units: the odd supermodules
+// continue the columns of the even ones (column = ieta + 48, and 16 more past the PHOS hole of the two-thirds DCal ones), and the
+// rows run over the supermodule pairs, the DCal a row apart from the EMCal. Neighbours are looked up in those, so they cross
+// supermodule boundaries; the table is built in well under a millisecond, so it is computed rather than read from a file
+// Author: Ivan Chernyshev
+
+#ifndef EMCALGEOMETRY_H
+#define EMCALGEOMETRY_H
+
+#include <vector>
+#include <algorithm>
+
+#define EMCAL_NCELL 17664
+#define EMCAL_NSM 20
+#define EMCAL_NCOLUMN 96
+#define EMCAL_NROW 209
+
+// Order of the 4 neighbours sharing a side with a cell
+enum EMCalNeighbour {EMCAL_COLUMN_DOWN, EMCAL_COLUMN_UP, EMCAL_ROW_DOWN, EMCAL_ROW_UP};
+
+struct EMCalGeometry {
+    int sm_offset[EMCAL_NSM + 1];       // first cell of each supermodule
+    int sm_neta[EMCAL_NSM];
+    int sm_nphi[EMCAL_NSM];
+    int sm_column[EMCAL_NSM];           // global column and row of ieta = iphi = 0
+    int sm_row[EMCAL_NSM];
+    std::vector<unsigned char> sm;      // per cell
+    std::vector<unsigned char> ieta;
+    std::vector<unsigned char> iphi;
+    std::vector<unsigned char> column;
+    std::vector<unsigned char> row;
+    std::vector<unsigned char> sm_edge; // cells to the nearest edge of the supermodule, 0 on the edge
+    std::vector<short> neighbour;       // [cell*4 + EMCalNeighbour], -1 if none
+    std::vector<short> grid;            // [row*EMCAL_NCOLUMN + column], -1 if no cell
+};
+
+inline EMCalGeometry emcal_geometry(){
+    EMCalGeometry geometry;
+    geometry.sm_offset[0] = 0;
+    for (int s = 0; s < EMCAL_NSM; s++) {
+        geometry.sm_nphi[s] = (s < 10 || (s >= 12 && s < 18)) ? 24 : 8;
+        geometry.sm_neta[s] = (s >= 12 && s < 18) ? 32 : 48;
+        geometry.sm_offset[s + 1] = geometry.sm_offset[s] + geometry.sm_nphi[s]*geometry.sm_neta[s];
+        geometry.sm_column[s] = 48*(s % 2) + (geometry.sm_neta[s] == 32 && s % 2 == 1 ? 16 : 0);
+        // EMCal rows 0 to 127, DCal rows from 129
+        geometry.sm_row[s] = s < 12 ? 24*(s/2) : 129 + 24*((s - 12)/2);
+    }
+    geometry.sm.resize(EMCAL_NCELL);
+    geometry.ieta.resize(EMCAL_NCELL);
+    geometry.iphi.resize(EMCAL_NCELL);
+    geometry.column.resize(EMCAL_NCELL);
+    geometry.row.resize(EMCAL_NCELL);
+    geometry.sm_edge.resize(EMCAL_NCELL);
+    geometry.grid.assign(EMCAL_NROW*EMCAL_NCOLUMN, -1);
+    for (int s = 0; s < EMCAL_NSM; s++) {
+        const int neta = geometry.sm_neta[s];
+        const int nphi = geometry.sm_nphi[s];
+        for (int cell = geometry.sm_offset[s]; cell < geometry.sm_offset[s + 1]; cell++) {
+            const int k = cell - geometry.sm_offset[s];
+            const int eta = 2*(k/(2*nphi)) + 1 - k % 2;
+            const int phi = (k/2) % nphi;
+            geometry.sm[cell] = s;
+            geometry.ieta[cell] = eta;
+            geometry.iphi[cell] = phi;
+            geometry.column[cell] = geometry.sm_column[s] + eta;
+            geometry.row[cell] = geometry.sm_row[s] + phi;
+            geometry.sm_edge[cell] = std::min(std::min(eta, neta - 1 - eta), std::min(phi, nphi - 1 - phi));
+            geometry.grid[geometry.row[cell]*EMCAL_NCOLUMN + geometry.column[cell]] = cell;
+        }
+    }
+    geometry.neighbour.resize(4*EMCAL_NCELL);
+    for (int cell = 0; cell < EMCAL_NCELL; cell++) {
+        const int column = geometry.column[cell];
+        const int row = geometry.row[cell];
+        geometry.neighbour[4*cell + EMCAL_COLUMN_DOWN] = column > 0 ? geometry.grid[row*EMCAL_NCOLUMN + column - 1] : -1;
+        geometry.neighbour[4*cell + EMCAL_COLUMN_UP] = column + 1 < EMCAL_NCOLUMN ? geometry.grid[row*EMCAL_NCOLUMN + column + 1] : -1;
+        geometry.neighbour[4*cell + EMCAL_ROW_DOWN] = row > 0 ? geometry.grid[(row - 1)*EMCAL_NCOLUMN + column] : -1;
+        geometry.neighbour[4*cell + EMCAL_ROW_UP] = row + 1 < EMCAL_NROW ? geometry.grid[(row + 1)*EMCAL_NCOLUMN + column] : -1;
+    }
+    return geometry;
+}
+
+// The cell at (ieta, iphi) of supermodule sm; -1 outside the supermodule
+inline int emcal_cell(const EMCalGeometry& geometry, int sm, int ieta, int iphi){
+    if (sm < 0 || sm >= EMCAL_NSM || ieta < 0 || ieta >= geometry.sm_neta[sm] || iphi < 0 || iphi >= geometry.sm_nphi[sm]) return -1;
+    return geometry.sm_offset[sm] + 2*((ieta/2)*geometry.sm_nphi[sm] + iphi) + 1 - ieta % 2;
+}
+
+// The cell at global (column, row); -1 if there is none
+inline int emcal_cell_at(const EMCalGeometry& geometry, int column, int row){
+    if (column < 0 || column >= EMCAL_NCOLUMN || row < 0 || row >= EMCAL_NROW) return -1;
+    return geometry.grid[row*EMCAL_NCOLUMN + column];
+}
+
+#endif // EMCALGEOMETRY_H
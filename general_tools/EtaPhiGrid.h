@@ -0,0 +1,97 @@
+// Fixed eta-phi cell grid, to match points (e.g. tracks projected to the EMCal) against a set of other points (e.g. clusters)
+// within a box window |delta eta| < window_eta and |delta phi| < window_phi, as the charged-particle vetoes do
+// The cells are the size of the window, so a match can only lie in the query's cell or its 8 neighbours. Only the occupied cells
+// are stored, as the points sorted by cell, so building is O(n log n) in the number of points whatever their spread, and a query
+// costs three binary searches and the points of at most 9 cells instead of a loop over every point
+// Differences are taken as they are (float minus float, no wrapping of phi around 2 pi), so matches are exactly those of the loops
+// for finite coordinates; points and queries with a NaN, infinite or absurdly large eta or phi have no cell and never match
+// Author: Ivan Chernyshev
+
+#ifndef ETAPHIGRID_H
+#define ETAPHIGRID_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+struct EtaPhiGridPoint {
+    int ieta;
+    int iphi;
+    float eta;
+    float phi;
+    int index;      // position of the point in the input
+};
+
+struct EtaPhiGrid {
+    double window_eta;
+    double window_phi;
+    double cell_eta;
+    double cell_phi;
+    std::vector<EtaPhiGridPoint> points;    // sorted by (ieta, iphi, index)
+};
+
+inline bool operator<(const EtaPhiGridPoint& a, const EtaPhiGridPoint& b){
+    if (a.ieta != b.ieta) return a.ieta < b.ieta;
+    if (a.iphi != b.iphi) return a.iphi < b.iphi;
+    return a.index < b.index;
+}
+
+// Cell of coordinate x into i; false when x has none (NaN, infinite, or a cell number beyond the range of an int)
+inline bool eta_phi_grid_cell(double x, double cell, int& i){
+    const double c = std::floor(x/cell);
+    if (!(std::fabs(c) < 1e9)) return false;
+    i = (int)c;
+    return true;
+}
+
+// The cells are made a hair wider than the window, so that rounding can never put a match two cells away
+inline EtaPhiGrid eta_phi_grid(double window_eta, double window_phi){
+    EtaPhiGrid grid;
+    grid.window_eta = window_eta;
+    grid.window_phi = window_phi;
+    grid.cell_eta = window_eta*(1 + 1e-6);
+    grid.cell_phi = window_phi*(1 + 1e-6);
+    return grid;
+}
+
+// Fill the grid with n points, whose eta and phi are stride floats apart (e.g. the rows of an HDF5 hyperslab:
+// eta_phi_grid_build(grid, &cluster_data_out[0][0][2], &cluster_data_out[0][0][3], 5, ncluster)); the memory is reused from
+// one build to the next. Points without a cell are left out
+inline void eta_phi_grid_build(EtaPhiGrid& grid, const float* eta, const float* phi, size_t stride, size_t n){
+    grid.points.resize(n);
+    size_t npoint = 0;
+    for (size_t i = 0; i < n; i++) {
+        EtaPhiGridPoint& point = grid.points[npoint];
+        point.eta = eta[i*stride];
+        point.phi = phi[i*stride];
+        if (!eta_phi_grid_cell(point.eta, grid.cell_eta, point.ieta) || !eta_phi_grid_cell(point.phi, grid.cell_phi, point.iphi)) continue;
+        point.index = (int)i;
+        npoint++;
+    }
+    grid.points.resize(npoint);
+    std::sort(grid.points.begin(), grid.points.end());
+}
+
+// Index (in the input) of the first point within the window of (eta, phi); -1 if there is none
+inline int eta_phi_grid_match(const EtaPhiGrid& grid, float eta, float phi){
+    int ieta;
+    int iphi;
+    if (!eta_phi_grid_cell(eta, grid.cell_eta, ieta) || !eta_phi_grid_cell(phi, grid.cell_phi, iphi)) return -1;
+    int match = -1;
+    for (int jeta = ieta - 1; jeta <= ieta + 1; jeta++) {
+        // The cells (jeta, iphi - 1) to (jeta, iphi + 1) are contiguous in the sorted points
+        EtaPhiGridPoint first;
+        first.ieta = jeta;
+        first.iphi = iphi - 1;
+        first.index = -1;
+        std::vector<EtaPhiGridPoint>::const_iterator point = std::lower_bound(grid.points.begin(), grid.points.end(), first);
+        for (; point != grid.points.end() && point->ieta == jeta && point->iphi <= iphi + 1; ++point) {
+            if (match >= 0 && point->index >= match) continue;
+            if (std::fabs(point->eta - eta) < grid.window_eta && std::fabs(point->phi - phi) < grid.window_phi) match = point->index;
+        }
+    }
+    return match;
+}
+
+#endif // ETAPHIGRID_H
@@ -0,0 +1,213 @@
+// Storage profiles for the HDF5 mixing pools written by to_hdf5.cc,
+// and chunk cache sizing for the programs reading them back
+//
+// archival:   chunks of HDF5_DEFAULT_CACHE bytes, shuffle + deflate.
+//             Smallest file, but every random single-event read
+//             decompresses a whole chunk
+// random:     one event per chunk, no filters. A random single-event
+//             read touches exactly one chunk and decodes nothing
+// contiguous: no chunking at all, fixed number of events. An event is
+//             a plain byte range, which is what mmap-style readers
+//             want. Requires the total number of events up front
+
+#ifndef HDF5STORAGE_H_
+#define HDF5STORAGE_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <H5Cpp.h>
+
+// This is chosen to be the CPU L2 cache size, which should exceed 512
+// kB for many years now
+#ifndef HDF5_DEFAULT_CACHE
+#define HDF5_DEFAULT_CACHE (512 * 1024)
+#endif // HDF5_DEFAULT_CACHE
+
+#ifndef HDF5_DEFLATE_LEVEL
+#define HDF5_DEFLATE_LEVEL 1
+#endif // HDF5_DEFLATE_LEVEL
+
+// Upper bound of the raw-data chunk cache a reader allocates per
+// dataset; smaller datasets get a cache that holds all of them
+#ifndef HDF5_READ_CACHE_MAX
+#define HDF5_READ_CACHE_MAX (256 * 1024 * 1024)
+#endif // HDF5_READ_CACHE_MAX
+
+// Upper bound of the hash slots of that cache, a prime: a cache of
+// many small chunks would otherwise get an index of tens of MB
+#ifndef HDF5_READ_CACHE_NSLOT_MAX
+#define HDF5_READ_CACHE_NSLOT_MAX 400009
+#endif // HDF5_READ_CACHE_NSLOT_MAX
+
+enum HDF5StorageProfile {HDF5_PROFILE_ARCHIVAL, HDF5_PROFILE_RANDOM, HDF5_PROFILE_CONTIGUOUS};
+
+inline const char *hdf5_profile_name(HDF5StorageProfile profile)
+{
+    if (profile == HDF5_PROFILE_RANDOM) return "random";
+    if (profile == HDF5_PROFILE_CONTIGUOUS) return "contiguous";
+    return "archival";
+}
+
+inline HDF5StorageProfile parse_hdf5_profile(const char *name)
+{
+    if (strcmp(name, "archival") == 0) return HDF5_PROFILE_ARCHIVAL;
+    if (strcmp(name, "random") == 0) return HDF5_PROFILE_RANDOM;
+    if (strcmp(name, "contiguous") == 0) return HDF5_PROFILE_CONTIGUOUS;
+    fprintf(stderr, "%s:%d: unknown storage profile \"%s\", must be "
+            "archival, random or contiguous\n", __FILE__, __LINE__, name);
+    exit(EXIT_FAILURE);
+}
+
+// The data space of a new dataset whose first dimension is the event
+// index. Chunked profiles start with dim_extend (one event) and are
+// extended per event; the contiguous profile is allocated for all
+// nevent_total events at once, since it cannot be extended
+inline H5::DataSpace hdf5_profile_dataspace(HDF5StorageProfile profile, int rank, const hsize_t *dim_extend, hsize_t nevent_total)
+{
+    std::vector<hsize_t> dim(dim_extend, dim_extend + rank);
+    std::vector<hsize_t> dim_max(dim_extend, dim_extend + rank);
+
+    if (profile == HDF5_PROFILE_CONTIGUOUS) {
+        dim[0] = nevent_total;
+        dim_max[0] = nevent_total;
+    }
+    else {
+        dim_max[0] = H5S_UNLIMITED;
+    }
+
+    return H5::DataSpace(rank, &dim[0], &dim_max[0]);
+}
+
+// The creation property list of a new dataset of floats for the
+// given profile, dim_extend being the dimension of one event
+inline H5::DSetCreatPropList hdf5_profile_property(HDF5StorageProfile profile, int rank, const hsize_t *dim_extend)
+{
+    H5::DSetCreatPropList property = H5::DSetCreatPropList();
+
+    if (profile == HDF5_PROFILE_CONTIGUOUS) {
+        property.setLayout(H5D_CONTIGUOUS);
+        // Allocate the whole byte range at creation, so every event
+        // has a fixed file offset from the start
+        H5Pset_alloc_time(property.getId(), H5D_ALLOC_TIME_EARLY);
+        return property;
+    }
+
+    hsize_t event_size = sizeof(float);
+    for (int i = 1; i < rank; i++) {
+        event_size *= dim_extend[i];
+    }
+
+    std::vector<hsize_t> dim_chunk(dim_extend, dim_extend + rank);
+
+    if (profile == HDF5_PROFILE_RANDOM) {
+        dim_chunk[0] = 1;
+    }
+    else {
+        // Activate chunking, while observing the HDF5_DEFAULT_CACHE
+        // being the CPU L2 cache size
+        dim_chunk[0] = std::max(static_cast<hsize_t>(1),
+                                HDF5_DEFAULT_CACHE / event_size);
+
+        // Check for zlib (deflate) availability and enable only if
+        // present. Shuffling the bytes of the floats before deflate
+        // groups the exponents together, which compresses much
+        // better, in particular the NAN padding
+        if (!H5Zfilter_avail(H5Z_FILTER_DEFLATE)) {
+            fprintf(stderr, "%s:%d: warning: deflate filter not "
+                    "available\n", __FILE__, __LINE__);
+        }
+        else {
+            unsigned int filter_info;
+
+            H5Zget_filter_info(H5Z_FILTER_DEFLATE, &filter_info);
+            if (!(filter_info & H5Z_FILTER_CONFIG_ENCODE_ENABLED)) {
+                fprintf(stderr, "%s:%d: warning: deflate filter not "
+                        "available for encoding\n", __FILE__, __LINE__);
+            }
+            else {
+                property.setShuffle();
+                property.setDeflate(HDF5_DEFLATE_LEVEL);
+            }
+        }
+    }
+
+    property.setChunk(rank, &dim_chunk[0]);
+
+    return property;
+}
+
+// Open a dataset with its raw-data chunk cache sized to the dataset:
+// large enough to hold all of it when it fits in HDF5_READ_CACHE_MAX,
+// and never smaller than one chunk (the HDF5 default of 1 MB is
+// smaller than an archival chunk of a track dataset, in which case
+// every single-event read decompresses the chunk again)
+inline H5::DataSet hdf5_open_dataset_cached(H5::H5File &file, const char *name)
+{
+    hid_t dataset_id = H5Dopen2(file.getId(), name, H5P_DEFAULT);
+
+    if (dataset_id < 0) {
+        fprintf(stderr, "%s:%d: cannot open dataset %s\n", __FILE__, __LINE__, name);
+        exit(EXIT_FAILURE);
+    }
+
+    hid_t create_property = H5Dget_create_plist(dataset_id);
+
+    if (H5Pget_layout(create_property) != H5D_CHUNKED) {
+        // Contiguous datasets do not go through the chunk cache
+        H5Pclose(create_property);
+        H5::DataSet dataset(dataset_id);
+        H5Dclose(dataset_id);
+        return dataset;
+    }
+
+    hid_t space = H5Dget_space(dataset_id);
+    hid_t type = H5Dget_type(dataset_id);
+    const int rank = H5Sget_simple_extent_ndims(space);
+    std::vector<hsize_t> dim(rank);
+    std::vector<hsize_t> dim_chunk(rank);
+
+    H5Sget_simple_extent_dims(space, &dim[0], NULL);
+    H5Pget_chunk(create_property, rank, &dim_chunk[0]);
+
+    const size_t element_size = H5Tget_size(type);
+    size_t chunk_size = element_size;
+    size_t nchunk = 1;
+
+    for (int i = 0; i < rank; i++) {
+        chunk_size *= dim_chunk[i];
+        nchunk *= (dim[i] + dim_chunk[i] - 1) / dim_chunk[i];
+    }
+
+    const size_t cache_size =
+        std::max(chunk_size, std::min(nchunk * chunk_size,
+                                      static_cast<size_t>(HDF5_READ_CACHE_MAX)));
+    const size_t cache_nchunk = std::max(static_cast<size_t>(1), cache_size / chunk_size);
+    // The HDF5 documentation recommends ~100 hash slots per cached
+    // chunk, and an odd (ideally prime) count
+    const size_t nslot =
+        std::min((100 * cache_nchunk) | 1,
+                 static_cast<size_t>(HDF5_READ_CACHE_NSLOT_MAX));
+
+    H5Tclose(type);
+    H5Sclose(space);
+    H5Pclose(create_property);
+    H5Dclose(dataset_id);
+
+    hid_t access_property = H5Pcreate(H5P_DATASET_ACCESS);
+
+    H5Pset_chunk_cache(access_property, nslot, cache_size, H5D_CHUNK_CACHE_W0_DEFAULT);
+    dataset_id = H5Dopen2(file.getId(), name, access_property);
+    H5Pclose(access_property);
+
+    H5::DataSet dataset(dataset_id);
+
+    H5Dclose(dataset_id);
+
+    return dataset;
+}
+
+#endif // HDF5STORAGE_H_
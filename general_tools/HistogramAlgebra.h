@@ -0,0 +1,165 @@
+// Bin-by-bin histogram algebra with error propagation, working directly on the contiguous content and sum-of-weights-squared
+// arrays (GetArray()/GetSumw2()) of TH1D, TH2D and TH3D, instead of per-bin GetBinContent/SetBinError calls
+// One implementation of the error formulas, shared by ratiofinder.C, rootresultcombiner.C, background_purity_subtraction.C
+// and the divide_histograms2D functions of the gamma-hadron, efficiency and pion-hadron programs
+// All operations run over every cell, under- and overflow included, so 1D, 2D and 3D histograms are handled alike
+// Errors are uncorrelated Gaussian propagation; a histogram without Sumw2 is taken to have Poisson errors (error^2 = content)
+// Author: Ivan Chernyshev
+
+#ifndef HISTOGRAMALGEBRA_H
+#define HISTOGRAMALGEBRA_H
+
+#include <TH1.h>
+#include <TArrayD.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+// The content array of a double-precision histogram (TH1D, TH2D, TH3D), or exit if the histogram is not one
+inline double* hist_content(TH1* hist){
+    TArrayD* array = dynamic_cast<TArrayD*>(hist);
+    if (array == NULL) {
+        fprintf(stderr, "%s:%d: %s is not a double-precision (TH1D, TH2D, TH3D) histogram\n", __FILE__, __LINE__, hist->GetName());
+        exit(EXIT_FAILURE);
+    }
+    return array->GetArray();
+}
+
+inline const double* hist_content(const TH1* hist){
+    return hist_content(const_cast<TH1*>(hist));
+}
+
+// The sum-of-weights-squared (error^2) array of an input histogram; NULL if it has none, meaning Poisson errors
+inline const double* hist_sumw2(const TH1* hist){
+    return hist->GetSumw2N() > 0 ? hist->GetSumw2()->GetArray() : NULL;
+}
+
+// The sum-of-weights-squared array of a result histogram, allocated with Sumw2() if needed
+inline double* hist_sumw2_result(TH1* hist){
+    if (hist->GetSumw2N() == 0) hist->Sumw2();
+    return hist->GetSumw2()->GetArray();
+}
+
+// Exit unless the two histograms have the same dimension and number of cells, i.e. their arrays line up bin by bin
+inline void hist_check_compatible(const TH1* hist1, const TH1* hist2){
+    if (hist1->GetDimension() != hist2->GetDimension() || hist1->GetNcells() != hist2->GetNcells()) {
+        fprintf(stderr, "%s:%d: histograms %s and %s have different binning\n", __FILE__, __LINE__, hist1->GetName(), hist2->GetName());
+        exit(EXIT_FAILURE);
+    }
+}
+
+// The raw arrays were modified behind ROOT's back: recompute the statistics from the bins, keeping the number of entries
+inline void hist_reset_stats(TH1* hist, double entries){
+    hist->ResetStats();
+    hist->SetEntries(entries);
+}
+
+// hist *= scalar, the scalar being exact
+inline void hist_scale(TH1* hist, double scalar){
+    const int ncells = hist->GetNcells();
+    const double entries = hist->GetEntries();
+    double* content = hist_content(hist);
+    const bool poisson = hist->GetSumw2N() == 0;
+    double* error2 = hist_sumw2_result(hist);
+    const double scalar2 = scalar*scalar;
+
+    for (int i = 0; i < ncells; i++) {
+        error2[i] = (poisson ? content[i] : error2[i])*scalar2;
+        content[i] *= scalar;
+    }
+    hist_reset_stats(hist, entries);
+}
+
+// result += scalar*hist, the scalar being exact. result and hist are independent
+inline void hist_add(TH1* result, const TH1* hist, double scalar = 1){
+    hist_check_compatible(result, hist);
+    const int ncells = result->GetNcells();
+    const double entries = result->GetEntries() + hist->GetEntries();
+    double* content = hist_content(result);
+    const bool poisson = result->GetSumw2N() == 0;
+    double* error2 = hist_sumw2_result(result);
+    const double* content_add = hist_content(hist);
+    const double* error2_add = hist_sumw2(hist);
+    const double scalar2 = scalar*scalar;
+
+    for (int i = 0; i < ncells; i++) {
+        const double e2_add = error2_add != NULL ? error2_add[i] : content_add[i];
+        error2[i] = (poisson ? content[i] : error2[i]) + scalar2*e2_add;
+        content[i] += scalar*content_add[i];
+    }
+    hist_reset_stats(result, entries);
+}
+
+// result = numerator/denominator bin by bin; bins with a zero denominator are set to 0 with 0 error
+// Uncorrelated: error^2 = (e_num^2 + q^2 e_den^2)/den^2
+// Binomial (numerator a subset of the denominator, e.g. an efficiency): error^2 = ((1 - 2q) e_num^2 + q^2 e_den^2)/den^2
+// result may be numerator or denominator itself
+inline void hist_divide(TH1* result, const TH1* numerator, const TH1* denominator, bool binomial = false){
+    hist_check_compatible(numerator, denominator);
+    hist_check_compatible(result, numerator);
+    const int ncells = result->GetNcells();
+    const double entries = numerator->GetEntries();
+    const double* num = hist_content(numerator);
+    const double* den = hist_content(denominator);
+    const double* num_error2 = hist_sumw2(numerator);
+    const double* den_error2 = hist_sumw2(denominator);
+    double* content = hist_content(result);
+    double* error2 = hist_sumw2_result(result);
+
+    for (int i = 0; i < ncells; i++) {
+        const double n = num[i];
+        const double d = den[i];
+        const double en2 = num_error2 != NULL ? num_error2[i] : n;
+        const double ed2 = den_error2 != NULL ? den_error2[i] : d;
+        const double q = d != 0 ? n/d : 0;
+        const double e2 = binomial ? (1 - 2*q)*en2 + q*q*ed2 : en2 + q*q*ed2;
+        content[i] = q;
+        error2[i] = d != 0 ? (e2 > 0 ? e2 : 0)/(d*d) : 0;
+    }
+    hist_reset_stats(result, entries);
+}
+
+// result = (signal - (1 - purity)*background)/purity, with purity +- deltapurity uncorrelated with the histograms:
+// error^2 = (e_sig^2 + (1 - p)^2 e_bkg^2)/p^2 + ((bkg - sig)/p^2)^2 dp^2
+// result may be signal or background itself
+inline void hist_purity_subtract(TH1* result, const TH1* signal, const TH1* background, double purity, double deltapurity){
+    hist_check_compatible(signal, background);
+    hist_check_compatible(result, signal);
+    if (purity == 0) {
+        fprintf(stderr, "%s:%d: purity of 0 for %s\n", __FILE__, __LINE__, signal->GetName());
+        exit(EXIT_FAILURE);
+    }
+    const int ncells = result->GetNcells();
+    const double entries = signal->GetEntries();
+    const double* sig = hist_content(signal);
+    const double* bkg = hist_content(background);
+    const double* sig_error2 = hist_sumw2(signal);
+    const double* bkg_error2 = hist_sumw2(background);
+    double* content = hist_content(result);
+    double* error2 = hist_sumw2_result(result);
+    const double impurity = 1 - purity;
+    const double purity2 = purity*purity;
+    const double deltapurity2 = deltapurity*deltapurity;
+
+    for (int i = 0; i < ncells; i++) {
+        const double s = sig[i];
+        const double b = bkg[i];
+        const double es2 = sig_error2 != NULL ? sig_error2[i] : s;
+        const double eb2 = bkg_error2 != NULL ? bkg_error2[i] : b;
+        const double dpurity = (b - s)/purity2;
+        content[i] = (s - impurity*b)/purity;
+        error2[i] = (es2 + impurity*impurity*eb2)/purity2 + dpurity*dpurity*deltapurity2;
+    }
+    hist_reset_stats(result, entries);
+}
+
+// A new histogram (a copy of numerator, renamed) holding numerator/denominator; see hist_divide
+template <typename Histogram>
+Histogram* hist_ratio(const Histogram* numerator, const Histogram* denominator, const char* name, const char* title, bool binomial = false){
+    Histogram* ratio = new Histogram(*numerator);
+    ratio->SetNameTitle(name, title);
+    hist_divide(ratio, numerator, denominator, binomial);
+    return ratio;
+}
+
+#endif // HISTOGRAMALGEBRA_H
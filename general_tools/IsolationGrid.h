@@ -0,0 +1,224 @@
+// Track isolation of clusters recomputed from the tracks of an event, for any cone radius and track selection: the sum of the pT
+// of the tracks with (track_quality & mask) != 0 and pT > pt_min within delta eta^2 + delta phi^2 < R^2 of the cluster
+// The tracks of the event are sorted once into eta rows, and by phi (wrapping around) within each row, with the cumulative pT
+// sums of each mask along that order. A cone is then summed row by row: the tracks of the row in the phi range wholly inside the
+// cone are one difference of cumulative sums, found by binary search, and only those in the phi ranges the cone edge crosses are
+// tested one by one. A query costs a few binary searches per row and the tracks along the edge of the cone, rather than a loop over
+// every track, and gives the same tracks as that loop; building costs a counting sort of the tracks into rows, so nothing is
+// cleared cell by cell. Tracks outside the eta range of the rows are kept aside and always tested
+// Author: Ivan Chernyshev
+
+#ifndef ISOLATIONGRID_H
+#define ISOLATIONGRID_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+// Radii of one isolation_grid_cones call, whose squares it keeps on the stack
+const int ISOLATION_GRID_NRADIUS_MAX = 16;
+
+struct IsolationGridTrack {
+    double phi;                         // in [0, 2 pi)
+    float eta;
+    float pt;
+    unsigned int quality;
+};
+
+struct IsolationGrid {
+    double eta_low;
+    int neta;
+    double cell_eta;
+    double pt_min;
+    std::vector<unsigned int> masks;
+    std::vector<int> first;             // [row], and the end; the row neta holds the tracks outside the rows
+    std::vector<IsolationGridTrack> tracks; // sorted by row, then phi
+    std::vector<double> phi;            // of the sorted tracks, for the binary searches
+    std::vector<double> prefix;         // [mask*(ntrack + 1) + k], pT of the tracks of the mask before track k
+    std::vector<int> bin;               // scratch: per input track, and counts per bin
+    std::vector<int> count;
+};
+
+inline double isolation_grid_wrap(double phi){
+    const double two_pi = 2*M_PI;
+    if (phi >= 0 && phi < two_pi) return phi;
+    phi -= two_pi*std::floor(phi/two_pi);
+    return phi < two_pi ? phi : 0;
+}
+
+// Rows of about cell_eta over |eta| < eta_max, summing the tracks above pt_min separately for each of the nmask masks
+inline IsolationGrid isolation_grid(double eta_max, double cell_eta, double pt_min, const unsigned int* masks, int nmask){
+    if (!(eta_max > 0) || !(cell_eta > 0) || nmask < 1) {
+        fprintf(stderr, "%s:%d: bad isolation grid |eta| < %g, rows of %g, %d masks\n", __FILE__, __LINE__, eta_max, cell_eta, nmask);
+        exit(EXIT_FAILURE);
+    }
+    IsolationGrid grid;
+    grid.eta_low = -eta_max;
+    grid.neta = std::max(1, (int)std::ceil(2*eta_max/cell_eta));
+    grid.cell_eta = 2*eta_max/grid.neta;
+    grid.pt_min = pt_min;
+    grid.masks.assign(masks, masks + nmask);
+    grid.first.resize(grid.neta + 2);
+    return grid;
+}
+
+// Sort the ntrack tracks of the event into the rows; the memory is reused from one event to the next
+inline void isolation_grid_build(IsolationGrid& grid, unsigned int ntrack, const float* track_pt, const float* track_eta,
+                                 const float* track_phi, const unsigned char* track_quality){
+    // Counting sort by row and phi bin, with about one track per bin, so that the sort by phi within the rows that follows
+    // hardly moves anything
+    int nsub = 1;
+    while (nsub < 256 && nsub*grid.neta < (int)ntrack) nsub *= 2;
+    const int nbin = (grid.neta + 1)*nsub;
+    const double sub_scale = nsub/(2*M_PI);
+    grid.count.assign(nbin + 1, 0);
+    grid.bin.resize(ntrack);
+    for (unsigned int i = 0; i < ntrack; i++) {
+        grid.bin[i] = -1;
+        if (!(track_pt[i] > grid.pt_min)) continue;
+        const double row = std::floor((track_eta[i] - grid.eta_low)/grid.cell_eta);
+        const int ieta = row >= 0 && row < grid.neta ? (int)row : grid.neta;
+        grid.bin[i] = ieta*nsub + std::min((int)(isolation_grid_wrap(track_phi[i])*sub_scale), nsub - 1);
+        grid.count[grid.bin[i] + 1]++;
+    }
+    for (int b = 0; b < nbin; b++) grid.count[b + 1] += grid.count[b];
+    for (int r = 0; r <= grid.neta + 1; r++) grid.first[r] = grid.count[std::min(r*nsub, nbin)];
+    const int nkept = grid.count[nbin];
+    grid.tracks.resize(nkept);
+    for (unsigned int i = 0; i < ntrack; i++) {
+        if (grid.bin[i] < 0) continue;
+        IsolationGridTrack& track = grid.tracks[grid.count[grid.bin[i]]++];
+        track.phi = isolation_grid_wrap(track_phi[i]);
+        track.eta = track_eta[i];
+        track.pt = track_pt[i];
+        track.quality = track_quality[i];
+    }
+    for (int r = 0; r < grid.neta; r++) {
+        for (int k = grid.first[r] + 1; k < grid.first[r + 1]; k++) {
+            if (!(grid.tracks[k - 1].phi > grid.tracks[k].phi)) continue;
+            const IsolationGridTrack track = grid.tracks[k];
+            int j = k;
+            for (; j > grid.first[r] && grid.tracks[j - 1].phi > track.phi; j--) grid.tracks[j] = grid.tracks[j - 1];
+            grid.tracks[j] = track;
+        }
+    }
+    grid.phi.resize(nkept);
+    for (int k = 0; k < nkept; k++) grid.phi[k] = grid.tracks[k].phi;
+    grid.prefix.resize(grid.masks.size()*(nkept + 1));
+    for (size_t m = 0; m < grid.masks.size(); m++) {
+        double* prefix = &grid.prefix[m*(nkept + 1)];
+        prefix[0] = 0;
+        for (int k = 0; k < nkept; k++) prefix[k + 1] = prefix[k] + ((grid.tracks[k].quality & grid.masks[m]) != 0 ? grid.tracks[k].pt : 0);
+    }
+}
+
+// Add the pT of the tracks [begin, end) that pass the mask and lie in each of the nradius cones to sums[]
+inline void isolation_grid_test(const IsolationGrid& grid, int imask, int begin, int end, double eta, double phi, const double* radius2,
+                                int nradius, double* sums){
+    const unsigned int mask = grid.masks[imask];
+    for (int k = begin; k < end; k++) {
+        const IsolationGridTrack& track = grid.tracks[k];
+        if ((track.quality & mask) == 0) continue;
+        const double deta = track.eta - eta;
+        double dphi = std::fabs(track.phi - phi);
+        if (dphi > M_PI) dphi = 2*M_PI - dphi;
+        const double distance2 = deta*deta + dphi*dphi;
+        for (int r = 0; r < nradius; r++) {
+            if (distance2 < radius2[r]) sums[r] += track.pt;
+        }
+    }
+}
+
+// The tracks of a row up to phi (phi in [0, 4 pi), the row going round twice): its position among them, counting those of the
+// first turn again after the end of the row
+inline int isolation_grid_position(const IsolationGrid& grid, int ieta, double phi){
+    const double* row_begin = &grid.phi[grid.first[ieta]];
+    const double* row_end = &grid.phi[0] + grid.first[ieta + 1];
+    if (phi < 2*M_PI) return std::lower_bound(row_begin, row_end, phi) - row_begin;
+    return (row_end - row_begin) + (std::lower_bound(row_begin, row_end, phi - 2*M_PI) - row_begin);
+}
+
+// Add the part of the cone of radius^2 radius2 in row ieta to sum
+inline void isolation_grid_row(const IsolationGrid& grid, int imask, int ieta, double eta, double phi, double radius2, double& sum){
+    // Row edges and phi ranges padded by a hair, so that a track rounded onto an edge is never taken as wholly inside the cone
+    const double pad = 1e-6;
+    const double radius = std::sqrt(radius2);
+    const double eta0 = grid.eta_low + ieta*grid.cell_eta - pad;
+    const double eta1 = grid.eta_low + (ieta + 1)*grid.cell_eta + pad;
+    const double near = eta < eta0 ? eta0 - eta : eta > eta1 ? eta - eta1 : 0;
+    if (!(near < radius)) return;
+    const double far = std::max(std::fabs(eta - eta0), std::fabs(eta - eta1));
+    // The cone reaches |delta phi| < reach in this row, and covers |delta phi| < cover; the 4 edges, from phi - reach taken in
+    // [0, 2 pi), as positions in the row going round twice
+    const double reach = std::min(std::sqrt(radius2 - near*near) + pad, M_PI);
+    const double cover = far < radius ? std::max(std::sqrt(radius2 - far*far) - pad, 0.0) : 0;
+    const double low = isolation_grid_wrap(phi - reach);
+    int edge[4];
+    edge[0] = isolation_grid_position(grid, ieta, low);
+    edge[1] = isolation_grid_position(grid, ieta, low + (reach - cover));
+    edge[2] = isolation_grid_position(grid, ieta, low + (reach + cover));
+    edge[3] = isolation_grid_position(grid, ieta, low + 2*reach);
+    const int first = grid.first[ieta];
+    const int n = grid.first[ieta + 1] - first;
+    const double* prefix = &grid.prefix[imask*(grid.tracks.size() + 1)];
+    if (edge[2] > edge[1]) {
+        sum += edge[2] <= n ? prefix[first + edge[2]] - prefix[first + edge[1]] :
+            edge[1] >= n ? prefix[first + edge[2] - n] - prefix[first + edge[1] - n] :
+            prefix[first + n] - prefix[first + edge[1]] + prefix[first + edge[2] - n] - prefix[first];
+    }
+    for (int side = 0; side < 2; side++) {
+        const int begin = edge[2*side];
+        const int end = edge[2*side + 1];
+        if (end <= n || begin >= n) {
+            const int shift = begin >= n ? n : 0;
+            isolation_grid_test(grid, imask, first + begin - shift, first + end - shift, eta, phi, &radius2, 1, &sum);
+        }
+        else {
+            isolation_grid_test(grid, imask, first + begin, first + n, eta, phi, &radius2, 1, &sum);
+            isolation_grid_test(grid, imask, first, first + end - n, eta, phi, &radius2, 1, &sum);
+        }
+    }
+}
+
+// The cone sums of pT around (eta, phi) with the tracks of mask imask, for the nradius radii at once, into sums[]
+inline void isolation_grid_cones(const IsolationGrid& grid, int imask, double eta, double phi, const double* radii, int nradius,
+                                 double* sums){
+    if (nradius > ISOLATION_GRID_NRADIUS_MAX) {
+        fprintf(stderr, "%s:%d: %d isolation cones, at most %d at once\n", __FILE__, __LINE__, nradius, ISOLATION_GRID_NRADIUS_MAX);
+        exit(EXIT_FAILURE);
+    }
+    double radius_max = 0;
+    double radius2[ISOLATION_GRID_NRADIUS_MAX];
+    for (int r = 0; r < nradius; r++) {
+        if (!(radii[r] > 0 && radii[r] < M_PI) || imask < 0 || imask >= (int)grid.masks.size()) {
+            fprintf(stderr, "%s:%d: bad isolation cone R = %g, mask %d of %lu\n", __FILE__, __LINE__, radii[r], imask,
+                    (unsigned long)grid.masks.size());
+            exit(EXIT_FAILURE);
+        }
+        radius_max = std::max(radius_max, radii[r]);
+        radius2[r] = radii[r]*radii[r];
+        sums[r] = 0;
+    }
+    if (nradius < 1) return;
+    phi = isolation_grid_wrap(phi);
+    isolation_grid_test(grid, imask, grid.first[grid.neta], grid.first[grid.neta + 1], eta, phi, radius2, nradius, sums);
+    const int row_begin = std::max(0, (int)std::floor((eta - radius_max - grid.eta_low)/grid.cell_eta));
+    const int row_end = std::min(grid.neta, (int)std::floor((eta + radius_max - grid.eta_low)/grid.cell_eta) + 1);
+    for (int ieta = row_begin; ieta < row_end; ieta++) {
+        const int n = grid.first[ieta + 1] - grid.first[ieta];
+        // A few tracks are tested faster than searched, and for all the radii at once
+        if (n <= 8) isolation_grid_test(grid, imask, grid.first[ieta], grid.first[ieta + 1], eta, phi, radius2, nradius, sums);
+        else for (int r = 0; r < nradius; r++) isolation_grid_row(grid, imask, ieta, eta, phi, radius2[r], sums[r]);
+    }
+}
+
+// The cone sum of pT around (eta, phi) with the tracks of mask imask
+inline double isolation_grid_cone(const IsolationGrid& grid, int imask, double eta, double phi, double radius){
+    double sum;
+    isolation_grid_cones(grid, imask, eta, phi, &radius, 1, &sum);
+    return sum;
+}
+
+#endif // ISOLATIONGRID_H
@@ -0,0 +1,277 @@
+// Fit driver for the pi0 invariant-mass peaks of a pT scan (old/pi_0/my_code.C, old/pion_hadron/My_Code/mass_pion_modeller.C)
+// The model is the gaussian_model of those macros, a normalized Gaussian on a quadratic background, with the same parameters:
+//   par[0]*exp(-0.5*((x - par[1])/par[2])^2)/sqrt(2 pi par[2]^2) + par[3]*x^2 + par[4]*x + par[5]
+// Each interval's histogram is copied once (on the calling thread) into plain arrays, and the chi-square fits then run on
+// those copies, concurrently, with a Levenberg-Marquardt minimizer using the analytic derivatives of the model, so nothing of
+// ROOT (TF1, TH1, the global fitter) is shared between the threads
+// The fits are done twice: first all from the starting parameters, then each again from the results of its two neighbouring
+// intervals, keeping the lowest chi-square; this replaces the sequential carrying-over (and repeated fits) of the macros' loops
+// As TH1::Fit without options, the fit uses every bin of the axis range with a non-zero error, at the bin centers, and the
+// parameter limits of the TF1 (SetParLimits; equal non-zero limits fix the parameter). Errors are from the inverse of the
+// Gauss-Newton curvature at the minimum
+// Author: Ivan Chernyshev
+
+#ifndef MASSPEAKFIT_H
+#define MASSPEAKFIT_H
+
+#include <TH1.h>
+#include <TF1.h>
+#include <TList.h>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#define MASSPEAKFIT_NPAR 6
+
+struct MassPeakFit {
+    std::vector<double> x;          // bin centers, contents and 1/error^2 of the fitted bins
+    std::vector<double> y;
+    std::vector<double> weight;
+    double start[MASSPEAKFIT_NPAR];
+    double low[MASSPEAKFIT_NPAR];
+    double high[MASSPEAKFIT_NPAR];
+    bool limited[MASSPEAKFIT_NPAR];
+    bool fixed[MASSPEAKFIT_NPAR];
+    double parameters[MASSPEAKFIT_NPAR];
+    double errors[MASSPEAKFIT_NPAR];
+    double chisquare;
+    int ndf;
+    int iterations;
+};
+
+// The model and its derivatives with respect to the parameters
+inline double mass_peak_model(double x, const double* par, double* gradient){
+    const double u = (x - par[1])/par[2];
+    const double gaussian = std::exp(-0.5*u*u)/(std::sqrt(2*M_PI)*std::fabs(par[2]));
+    if (gradient != NULL) {
+        gradient[0] = gaussian;
+        gradient[1] = par[0]*gaussian*u/par[2];
+        gradient[2] = par[0]*gaussian*(u*u - 1)/par[2];
+        gradient[3] = x*x;
+        gradient[4] = x;
+        gradient[5] = 1;
+    }
+    return par[0]*gaussian + par[3]*x*x + par[4]*x + par[5];
+}
+
+// Copy the bins of hist and the current parameters and limits of func (which must have the 6 parameters of the model)
+inline MassPeakFit mass_peak_fit_setup(const TH1* hist, const TF1* func){
+    MassPeakFit fit;
+    const TAxis* axis = hist->GetXaxis();
+    for (int i = axis->GetFirst(); i <= axis->GetLast(); i++) {
+        const double error = hist->GetBinError(i);
+        if (error == 0) continue;
+        fit.x.push_back(axis->GetBinCenter(i));
+        fit.y.push_back(hist->GetBinContent(i));
+        fit.weight.push_back(1/(error*error));
+    }
+    int nfree = 0;
+    for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+        fit.start[p] = func->GetParameter(p);
+        func->GetParLimits(p, fit.low[p], fit.high[p]);
+        // As TH1::Fit: equal limits fix the parameter, unless both are zero (no limits)
+        fit.fixed[p] = fit.low[p]*fit.high[p] != 0 && fit.low[p] >= fit.high[p];
+        fit.limited[p] = !fit.fixed[p] && fit.low[p] < fit.high[p];
+        if (fit.limited[p]) fit.start[p] = std::min(std::max(fit.start[p], fit.low[p]), fit.high[p]);
+        if (!fit.fixed[p]) nfree++;
+        fit.parameters[p] = fit.start[p];
+        fit.errors[p] = 0;
+    }
+    fit.ndf = (int)fit.x.size() - nfree;
+    fit.chisquare = 0;
+    fit.iterations = 0;
+    return fit;
+}
+
+inline double mass_peak_fit_chisquare(const MassPeakFit& fit, const double* par){
+    double chisquare = 0;
+    for (size_t i = 0; i < fit.x.size(); i++) {
+        const double residual = fit.y[i] - mass_peak_model(fit.x[i], par, NULL);
+        chisquare += residual*residual*fit.weight[i];
+    }
+    return chisquare;
+}
+
+// Gradient (J^T W r) and Gauss-Newton curvature (J^T W J) of the chi-square at par, over the free parameters
+inline void mass_peak_fit_curvature(const MassPeakFit& fit, const double* par, double* gradient, double curvature[][MASSPEAKFIT_NPAR]){
+    std::fill(gradient, gradient + MASSPEAKFIT_NPAR, 0.0);
+    for (int p = 0; p < MASSPEAKFIT_NPAR; p++) std::fill(curvature[p], curvature[p] + MASSPEAKFIT_NPAR, 0.0);
+    double derivative[MASSPEAKFIT_NPAR];
+    for (size_t i = 0; i < fit.x.size(); i++) {
+        const double residual = fit.y[i] - mass_peak_model(fit.x[i], par, derivative);
+        for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+            if (fit.fixed[p]) derivative[p] = 0;
+        }
+        for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+            gradient[p] += derivative[p]*fit.weight[i]*residual;
+            for (int q = 0; q <= p; q++) curvature[p][q] += derivative[p]*fit.weight[i]*derivative[q];
+        }
+    }
+    for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+        for (int q = p + 1; q < MASSPEAKFIT_NPAR; q++) curvature[p][q] = curvature[q][p];
+    }
+}
+
+// Solve matrix*solution = vector (or invert, if inverse is not NULL) by Gauss-Jordan elimination with partial pivoting,
+// on the matrix scaled to a unit diagonal, since the parameters differ by orders of magnitude; false if singular
+inline bool mass_peak_fit_solve(double matrix[][MASSPEAKFIT_NPAR], const double* vector, double* solution, double inverse[][MASSPEAKFIT_NPAR]){
+    const int n = MASSPEAKFIT_NPAR;
+    double scale[MASSPEAKFIT_NPAR];
+    double a[MASSPEAKFIT_NPAR][2*MASSPEAKFIT_NPAR + 1];
+    for (int p = 0; p < n; p++) scale[p] = matrix[p][p] > 0 ? 1/std::sqrt(matrix[p][p]) : 1;
+    for (int p = 0; p < n; p++) {
+        for (int q = 0; q < n; q++) {
+            a[p][q] = matrix[p][q]*scale[p]*scale[q];
+            a[p][n + q] = p == q;
+        }
+        a[p][2*n] = vector != NULL ? vector[p]*scale[p] : 0;
+    }
+    for (int c = 0; c < n; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < n; r++) {
+            if (std::fabs(a[r][c]) > std::fabs(a[pivot][c])) pivot = r;
+        }
+        if (std::fabs(a[pivot][c]) < 1e-14) return false;
+        for (int k = 0; k <= 2*n; k++) std::swap(a[c][k], a[pivot][k]);
+        const double diagonal = a[c][c];
+        for (int k = 0; k <= 2*n; k++) a[c][k] /= diagonal;
+        for (int r = 0; r < n; r++) {
+            if (r == c || a[r][c] == 0) continue;
+            const double factor = a[r][c];
+            for (int k = 0; k <= 2*n; k++) a[r][k] -= factor*a[c][k];
+        }
+    }
+    for (int p = 0; p < n; p++) {
+        if (solution != NULL) solution[p] = a[p][2*n]*scale[p];
+        if (inverse == NULL) continue;
+        for (int q = 0; q < n; q++) inverse[p][q] = a[p][n + q]*scale[p]*scale[q];
+    }
+    return true;
+}
+
+// Levenberg-Marquardt minimization of the chi-square from par (kept within the limits), leaving the result in fit
+inline void mass_peak_fit_minimize(MassPeakFit& fit, const double* start){
+    double par[MASSPEAKFIT_NPAR];
+    std::copy(start, start + MASSPEAKFIT_NPAR, par);
+    double chisquare = mass_peak_fit_chisquare(fit, par);
+    double gradient[MASSPEAKFIT_NPAR];
+    double curvature[MASSPEAKFIT_NPAR][MASSPEAKFIT_NPAR];
+    double damped[MASSPEAKFIT_NPAR][MASSPEAKFIT_NPAR];
+    double lambda = 1e-3;
+    int iteration = 0;
+    mass_peak_fit_curvature(fit, par, gradient, curvature);
+    for (; iteration < 1000 && lambda < 1e12; iteration++) {
+        // Fixed parameters, and those at a limit that the chi-square pushes beyond it, get a unit diagonal and a zero step
+        bool frozen[MASSPEAKFIT_NPAR];
+        double pull[MASSPEAKFIT_NPAR];
+        for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+            frozen[p] = fit.fixed[p] || (fit.limited[p] && ((par[p] <= fit.low[p] && gradient[p] < 0) ||
+                                                            (par[p] >= fit.high[p] && gradient[p] > 0)));
+            pull[p] = frozen[p] ? 0 : gradient[p];
+        }
+        for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+            for (int q = 0; q < MASSPEAKFIT_NPAR; q++) damped[p][q] = frozen[p] || frozen[q] ? 0 : curvature[p][q];
+            damped[p][p] = frozen[p] ? 1 : curvature[p][p]*(1 + lambda) + 1e-300;
+        }
+        double step[MASSPEAKFIT_NPAR];
+        if (!mass_peak_fit_solve(damped, pull, step, NULL)) {
+            lambda *= 10;
+            continue;
+        }
+        double trial[MASSPEAKFIT_NPAR];
+        for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+            trial[p] = frozen[p] ? par[p] : par[p] + step[p];
+            if (fit.limited[p]) trial[p] = std::min(std::max(trial[p], fit.low[p]), fit.high[p]);
+        }
+        const double trial_chisquare = mass_peak_fit_chisquare(fit, trial);
+        if (!(trial_chisquare < chisquare)) {
+            lambda *= 10;
+            continue;
+        }
+        const bool converged = chisquare - trial_chisquare < 1e-10*chisquare + 1e-12;
+        std::copy(trial, trial + MASSPEAKFIT_NPAR, par);
+        chisquare = trial_chisquare;
+        lambda = std::max(lambda/10, 1e-12);
+        mass_peak_fit_curvature(fit, par, gradient, curvature);
+        if (converged) break;
+    }
+    std::copy(par, par + MASSPEAKFIT_NPAR, fit.parameters);
+    fit.chisquare = chisquare;
+    fit.iterations = iteration;
+    // Errors: square roots of the diagonal of the inverse curvature
+    double covariance[MASSPEAKFIT_NPAR][MASSPEAKFIT_NPAR];
+    for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+        if (fit.fixed[p]) {
+            for (int q = 0; q < MASSPEAKFIT_NPAR; q++) curvature[p][q] = curvature[q][p] = p == q;
+        }
+    }
+    const bool invertible = mass_peak_fit_solve(curvature, NULL, NULL, covariance);
+    for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+        fit.errors[p] = invertible && !fit.fixed[p] && covariance[p][p] > 0 ? std::sqrt(covariance[p][p]) : 0;
+    }
+}
+
+// Run body(i) for i = 0, ..., n - 1 over up to nthread threads (0: one per core)
+template <typename Body>
+inline void mass_peak_fit_parallel(size_t n, unsigned int nthread, Body body){
+    if (nthread == 0) nthread = std::max(1U, std::thread::hardware_concurrency());
+    nthread = std::min<size_t>(nthread, n);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < nthread; t++) {
+        threads.push_back(std::thread([&]() {
+            for (size_t i = next++; i < n; i = next++) body(i);
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+}
+
+// Fit all the intervals of a scan, in order of pT, concurrently, then again from each one's neighbours' results
+inline void mass_peak_fit_scan(std::vector<MassPeakFit>& fits, unsigned int nthread = 0){
+    mass_peak_fit_parallel(fits.size(), nthread, [&](size_t i) {
+        mass_peak_fit_minimize(fits[i], fits[i].start);
+    });
+    const std::vector<MassPeakFit> first_pass = fits;
+    mass_peak_fit_parallel(fits.size(), nthread, [&](size_t i) {
+        for (int side = -1; side <= 1; side += 2) {
+            if ((side < 0 && i == 0) || (side > 0 && i + 1 >= fits.size())) continue;
+            MassPeakFit neighbour_start = first_pass[i];
+            double start[MASSPEAKFIT_NPAR];
+            for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+                start[p] = neighbour_start.fixed[p] ? neighbour_start.start[p] : first_pass[i + side].parameters[p];
+                if (neighbour_start.limited[p]) start[p] = std::min(std::max(start[p], neighbour_start.low[p]), neighbour_start.high[p]);
+            }
+            mass_peak_fit_minimize(neighbour_start, start);
+            if (neighbour_start.chisquare < fits[i].chisquare) fits[i] = neighbour_start;
+        }
+    });
+}
+
+// Put a fit result into func, as TH1::Fit would (parameters, errors, chi-square, NDF), attach a copy of func to hist (if any)
+// like TH1::Fit does, and print the result
+inline void mass_peak_fit_result(const MassPeakFit& fit, TF1* func, TH1* hist){
+    func->SetParameters(fit.parameters);
+    func->SetParErrors(fit.errors);
+    func->SetChisquare(fit.chisquare);
+    func->SetNDF(fit.ndf);
+    func->SetNumberFitPoints(fit.x.size());
+    if (hist != NULL) {
+        TF1* attached = (TF1*)hist->GetListOfFunctions()->FindObject(func->GetName());
+        if (attached != NULL) {
+            hist->GetListOfFunctions()->Remove(attached);
+            delete attached;
+        }
+        hist->GetListOfFunctions()->Add(func->Clone());
+    }
+    printf("%s: chi2/ndf = %g/%d after %d iterations\n", hist != NULL ? hist->GetName() : func->GetName(), fit.chisquare, fit.ndf,
+           fit.iterations);
+    for (int p = 0; p < MASSPEAKFIT_NPAR; p++) {
+        printf("  %-16s %14.6g +/- %.6g%s\n", func->GetParName(p), fit.parameters[p], fit.errors[p], fit.fixed[p] ? " (fixed)" : "");
+    }
+}
+
+#endif // MASSPEAKFIT_H
@@ -0,0 +1,139 @@
+// Helpers shared by the programs that merge ROOT outputs object by object in forked worker processes (general_tools/combine_results.cc
+// and gamma_jet_correlations/merge_outputs.cc): opening the inputs, reading an object detached from its file, running the workers,
+// each writing the objects w, w + nworker, ... of the output to a part file <output>.part<w>, and merging the part files into the
+// output in object order
+// Author: Ivan Chernyshev
+
+#ifndef PARALLELMERGE_H
+#define PARALLELMERGE_H
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TH1.h>
+#include <TROOT.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Open every input, or return an empty vector
+inline std::vector<TFile*> open_inputs(const std::vector<std::string>& inputs){
+    std::vector<TFile*> files;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        TFile* file = TFile::Open(inputs[i].c_str(), "READ");
+        if (file == NULL || file->IsZombie()) {
+            fprintf(stderr, "%s:%d: cannot open %s\n", __FILE__, __LINE__, inputs[i].c_str());
+            for (size_t j = 0; j < files.size(); j++) delete files[j];
+            return std::vector<TFile*>();
+        }
+        files.push_back(file);
+    }
+    return files;
+}
+
+inline void close_inputs(std::vector<TFile*>& files){
+    for (size_t i = 0; i < files.size(); i++) {
+        files[i]->Close();
+        delete files[i];
+    }
+    files.clear();
+}
+
+// Read one object of a file, detached from it; NULL if there is none
+inline TObject* read_object(TFile* file, const std::string& name){
+    TKey* key = file->GetKey(name.c_str());
+    if (key == NULL) return NULL;
+    TObject* object = key->ReadObj();
+    TH1* hist = dynamic_cast<TH1*>(object);
+    if (hist != NULL) hist->SetDirectory(0);
+    return object;
+}
+
+// The part file of worker w
+inline std::string merge_part(const std::string& output, long w){
+    return output + Form(".part%ld", w);
+}
+
+// Remove the part files, e.g. when they cannot all be merged
+inline void merge_remove_parts(const std::vector<std::string>& parts){
+    for (size_t w = 0; w < parts.size(); w++) remove(parts[w].c_str());
+}
+
+// Run work(w, part file) for w = 0, ..., nworker - 1 in forked processes, a worker failing when work returns nonzero; returns the
+// number of failed workers
+template <typename Work>
+int merge_run_workers(long nworker, const std::string& output, Work work){
+    std::map<pid_t, long> running;
+    for (long w = 0; w < nworker; w++) {
+        const pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            _exit(work(w, merge_part(output, w)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        running[pid] = w;
+    }
+    int nfailed_worker = 0;
+    while (!running.empty()) {
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0) {
+            perror("wait");
+            exit(EXIT_FAILURE);
+        }
+        if (running.count(pid) == 0) continue;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "%s:%d: worker %ld failed\n", __FILE__, __LINE__, running[pid]);
+            nfailed_worker++;
+        }
+        running.erase(pid);
+    }
+    return nfailed_worker;
+}
+
+// Merge the part files of nworker workers into output, one object at a time, names[k] coming from the part of worker k % nworker,
+// and remove them; returns the number of objects merged
+inline size_t merge_parts(long nworker, const std::vector<std::string>& names, const std::string& output){
+    std::vector<std::string> parts;
+    for (long w = 0; w < nworker; w++) parts.push_back(merge_part(output, w));
+    std::vector<TFile*> part_files = open_inputs(parts);
+    if (part_files.empty()) {
+        // The objects of a missing part cannot be recovered from the others, which are removed with it
+        for (long w = 0; w < nworker; w++) {
+            if (access(parts[w].c_str(), F_OK) != 0) fprintf(stderr, "%s:%d: worker %ld left no part file %s\n", __FILE__, __LINE__, w, parts[w].c_str());
+        }
+        fprintf(stderr, "%s:%d: cannot merge %s, removing its part files\n", __FILE__, __LINE__, output.c_str());
+        merge_remove_parts(parts);
+        exit(EXIT_FAILURE);
+    }
+    TFile* fout = TFile::Open(output.c_str(), "RECREATE");
+    if (fout == NULL || fout->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, output.c_str());
+        close_inputs(part_files);
+        merge_remove_parts(parts);
+        exit(EXIT_FAILURE);
+    }
+    size_t nmerged = 0;
+    for (size_t k = 0; k < names.size(); k++) {
+        TObject* object = read_object(part_files[k % nworker], names[k]);
+        if (object == NULL) continue;
+        fout->cd();
+        object->Write(names[k].c_str());
+        delete object;
+        nmerged++;
+    }
+    fout->Close();
+    delete fout;
+    close_inputs(part_files);
+    merge_remove_parts(parts);
+    return nmerged;
+}
+
+#endif // PARALLELMERGE_H
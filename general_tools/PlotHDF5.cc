@@ -17,6 +17,7 @@
 #include <iostream>
 #include <fstream>
 #include "H5Cpp.h"
+#include "HDF5Storage.h" // chunk cache sizing for the mixing pool
 
 #define NTRACK_MAX (1U << 14)
 
@@ -72,7 +73,7 @@ int main(int argc, char *argv[])
   //open hdf5: Define size of data from file, explicitly allocate memory in hdf5 space and array size
   const H5std_string event_ds_name( "event" );
   H5File h5_file( hdf5_file_name, H5F_ACC_RDONLY ); //hdf5_file_name from argv[2]
-  DataSet event_dataset = h5_file.openDataSet( event_ds_name );
+  DataSet event_dataset = hdf5_open_dataset_cached( h5_file, event_ds_name.c_str() ); //chunk cache sized to the dataset
   DataSpace event_dataspace = event_dataset.getSpace();
   //Load the dimensions of dataset from file, to be used in array/hyperslab
   const int event_ndims = event_dataspace.getSimpleExtentNdims();
@@ -119,7 +120,7 @@ int main(int argc, char *argv[])
   // Get jet
   const H5std_string jet_ds_name( "jet" );
   H5File h5_file_jet( hdf5_file_name, H5F_ACC_RDONLY ); //hdf5_file_name from argv[2]
-  DataSet jet_dataset = h5_file_jet.openDataSet( jet_ds_name );
+  DataSet jet_dataset = hdf5_open_dataset_cached( h5_file_jet, jet_ds_name.c_str() ); //chunk cache sized to the dataset
   DataSpace jet_dataspace = jet_dataset.getSpace();
     
   //Load the dimensions of dataset from file, to be used in array/hyperslab
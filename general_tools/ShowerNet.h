@@ -0,0 +1,276 @@
+// Feed-forward neural-network photon identification from the cell energies around each cluster's maximum cell, to recompute a
+// shower-shape score like cluster_s_nphoton from the cell_e array of the ntuples with a network of our own
+// The network is read from a text file of whitespace-separated tokens ('#' starts a comment to the end of the line):
+//   window W                   (W x W cells around cluster_cell_id_max, W odd; input (deta + W/2)*W + (dphi + W/2))
+//   normalization cluster_e    (inputs divided by cluster_e; "none" leaves them in GeV)
+//   output K                   (the score is output K of the last layer)
+//   layer NIN NOUT ACTIVATION  (relu, sigmoid, tanh, linear or softmax), then NOUT x NIN weights, output by output, and NOUT biases
+// as many layers as needed, the first with NIN = W*W. Cells outside the supermodule of the maximum cell count as empty
+// Clusters are evaluated 32 at a time, the activations stored feature by feature for the 32 clusters, so every weight is applied to
+// whole vectors of clusters with the vector types of GCC and Clang (AVX when the compiler targets it, SSE otherwise)
+// Author: Ivan Chernyshev
+
+#ifndef SHOWERNET_H
+#define SHOWERNET_H
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "EMCalGeometry.h"
+
+// 32 clusters per batch, as 4 AVX or 8 SSE vectors
+#ifdef __AVX__
+#define SHOWERNET_LANES 8
+#else
+#define SHOWERNET_LANES 4
+#endif
+#define SHOWERNET_BATCH 32
+#define SHOWERNET_VECTORS (SHOWERNET_BATCH/SHOWERNET_LANES)
+
+typedef float ShowerNetVector __attribute__((vector_size(SHOWERNET_LANES*sizeof(float))));
+
+enum ShowerNetActivation {SHOWERNET_RELU, SHOWERNET_SIGMOID, SHOWERNET_TANH, SHOWERNET_LINEAR, SHOWERNET_SOFTMAX};
+
+struct ShowerNetLayer {
+    int nin;
+    int nout;
+    ShowerNetActivation activation;
+    std::vector<float> weight;      // [nout][nin]
+    std::vector<float> bias;
+};
+
+struct ShowerNet {
+    int window;
+    bool normalize;
+    int output;
+    int max_width;                  // widest layer, inputs included
+    std::vector<ShowerNetLayer> layers;
+};
+
+// Activations of a batch, [feature][SHOWERNET_BATCH]
+struct ShowerNetWork {
+    std::vector<float> buffer[2];
+};
+
+// Next token of the file, comments skipped; false at the end
+inline bool shower_net_token(FILE* file, std::string& token){
+    token.clear();
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        if (c == '#') {
+            while ((c = fgetc(file)) != EOF && c != '\n') {}
+            if (!token.empty()) return true;
+        }
+        else if (isspace(c)) {
+            if (!token.empty()) return true;
+        }
+        else token += (char)c;
+    }
+    return !token.empty();
+}
+
+inline double shower_net_number(FILE* file, const char* filename, const char* what){
+    std::string token;
+    char* end = NULL;
+    const double value = shower_net_token(file, token) ? strtod(token.c_str(), &end) : 0;
+    if (end == NULL || *end != '\0' || token.empty()) {
+        fprintf(stderr, "%s:%d: %s: expected %s, found \"%s\"\n", __FILE__, __LINE__, filename, what, token.c_str());
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+inline ShowerNet shower_net_read(const char* filename){
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "%s:%d: cannot open the network file %s\n", __FILE__, __LINE__, filename);
+        exit(EXIT_FAILURE);
+    }
+    ShowerNet net;
+    net.window = 0;
+    net.normalize = true;
+    net.output = 0;
+    std::string key;
+    while (shower_net_token(file, key)) {
+        if (key == "window") {
+            net.window = (int)shower_net_number(file, filename, "the window size");
+        }
+        else if (key == "normalization") {
+            std::string value;
+            shower_net_token(file, value);
+            if (value != "cluster_e" && value != "none") {
+                fprintf(stderr, "%s:%d: %s: normalization must be cluster_e or none, not \"%s\"\n", __FILE__, __LINE__, filename, value.c_str());
+                exit(EXIT_FAILURE);
+            }
+            net.normalize = value == "cluster_e";
+        }
+        else if (key == "output") {
+            net.output = (int)shower_net_number(file, filename, "the output index");
+        }
+        else if (key == "layer") {
+            ShowerNetLayer layer;
+            layer.nin = (int)shower_net_number(file, filename, "the number of layer inputs");
+            layer.nout = (int)shower_net_number(file, filename, "the number of layer outputs");
+            std::string activation;
+            shower_net_token(file, activation);
+            if (activation == "relu") layer.activation = SHOWERNET_RELU;
+            else if (activation == "sigmoid") layer.activation = SHOWERNET_SIGMOID;
+            else if (activation == "tanh") layer.activation = SHOWERNET_TANH;
+            else if (activation == "linear") layer.activation = SHOWERNET_LINEAR;
+            else if (activation == "softmax") layer.activation = SHOWERNET_SOFTMAX;
+            else {
+                fprintf(stderr, "%s:%d: %s: unknown activation \"%s\"\n", __FILE__, __LINE__, filename, activation.c_str());
+                exit(EXIT_FAILURE);
+            }
+            if (layer.nin < 1 || layer.nout < 1) {
+                fprintf(stderr, "%s:%d: %s: layer %lu has %d inputs and %d outputs\n", __FILE__, __LINE__, filename,
+                        (unsigned long)net.layers.size(), layer.nin, layer.nout);
+                exit(EXIT_FAILURE);
+            }
+            layer.weight.resize((size_t)layer.nin*layer.nout);
+            for (size_t i = 0; i < layer.weight.size(); i++) layer.weight[i] = shower_net_number(file, filename, "a weight");
+            layer.bias.resize(layer.nout);
+            for (int o = 0; o < layer.nout; o++) layer.bias[o] = shower_net_number(file, filename, "a bias");
+            net.layers.push_back(layer);
+        }
+        else {
+            fprintf(stderr, "%s:%d: %s: unknown keyword \"%s\"\n", __FILE__, __LINE__, filename, key.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(file);
+    // The layers must chain from the window to an output that exists
+    int width = net.window*net.window;
+    net.max_width = width;
+    for (size_t l = 0; l < net.layers.size(); l++) {
+        if (net.layers[l].nin != width) {
+            fprintf(stderr, "%s:%d: %s: layer %lu takes %d inputs, but gets %d\n", __FILE__, __LINE__, filename, (unsigned long)l,
+                    net.layers[l].nin, width);
+            exit(EXIT_FAILURE);
+        }
+        width = net.layers[l].nout;
+        net.max_width = std::max(net.max_width, width);
+    }
+    if (net.window < 1 || net.window % 2 == 0 || net.layers.empty() || net.output < 0 || net.output >= width) {
+        fprintf(stderr, "%s:%d: %s: needs an odd window, at least one layer, and an output below %d (window %d, %lu layers, output %d)\n",
+                __FILE__, __LINE__, filename, width, net.window, (unsigned long)net.layers.size(), net.output);
+        exit(EXIT_FAILURE);
+    }
+    return net;
+}
+
+// The window x window cell energies around cell_id_max, times scale, into input[i*stride]
+inline void shower_net_window(const EMCalGeometry& geometry, int window, const float* cell_e, int cell_id_max, float scale, float* input,
+                              size_t stride){
+    const int half = window/2;
+    const int sm = geometry.sm[cell_id_max];
+    const int ieta = geometry.ieta[cell_id_max];
+    const int iphi = geometry.iphi[cell_id_max];
+    const int nphi = geometry.sm_nphi[sm];
+    for (int i = 0; i < window*window; i++) input[i*stride] = 0;
+    // Only the part of the window inside the supermodule is looked up
+    const int deta_begin = std::max(-half, -ieta);
+    const int deta_end = std::min(half, geometry.sm_neta[sm] - 1 - ieta);
+    const int dphi_begin = std::max(-half, -iphi);
+    const int dphi_end = std::min(half, nphi - 1 - iphi);
+    for (int deta = deta_begin; deta <= deta_end; deta++) {
+        const int eta = ieta + deta;
+        const float* row = cell_e + geometry.sm_offset[sm] + 2*(eta/2)*nphi + 1 - eta % 2;
+        float* out = input + (deta + half)*window*stride;
+        for (int dphi = dphi_begin; dphi <= dphi_end; dphi++) out[(dphi + half)*stride] = row[2*(iphi + dphi)]*scale;
+    }
+}
+
+// One layer on a batch: output[o][b] = activation(bias[o] + sum_i weight[o][i]*input[i][b])
+inline void shower_net_layer(const ShowerNetLayer& layer, const float* input, float* output){
+    // Two outputs at a time, for twice the independent sums
+    for (int o = 0; o < layer.nout; o += 2) {
+        const int o1 = std::min(o + 1, layer.nout - 1);
+        const float* weight0 = &layer.weight[(size_t)o*layer.nin];
+        const float* weight1 = &layer.weight[(size_t)o1*layer.nin];
+        ShowerNetVector sum0[SHOWERNET_VECTORS];
+        ShowerNetVector sum1[SHOWERNET_VECTORS];
+        for (int v = 0; v < SHOWERNET_VECTORS; v++) {
+            sum0[v] = ShowerNetVector{} + layer.bias[o];
+            sum1[v] = ShowerNetVector{} + layer.bias[o1];
+        }
+        for (int i = 0; i < layer.nin; i++) {
+            // memcpy, as the buffers are only float-aligned
+            ShowerNetVector x[SHOWERNET_VECTORS];
+            memcpy(x, input + (size_t)i*SHOWERNET_BATCH, sizeof(x));
+            for (int v = 0; v < SHOWERNET_VECTORS; v++) {
+                sum0[v] += weight0[i]*x[v];
+                sum1[v] += weight1[i]*x[v];
+            }
+        }
+        memcpy(output + (size_t)o*SHOWERNET_BATCH, sum0, sizeof(sum0));
+        memcpy(output + (size_t)o1*SHOWERNET_BATCH, sum1, sizeof(sum1));
+    }
+    float* y = output;
+    const size_t n = (size_t)layer.nout*SHOWERNET_BATCH;
+    switch (layer.activation) {
+    case SHOWERNET_RELU:
+        for (size_t k = 0; k < n; k++) y[k] = std::max(y[k], 0.0f);
+        break;
+    case SHOWERNET_SIGMOID:
+        for (size_t k = 0; k < n; k++) y[k] = 1/(1 + std::exp(-y[k]));
+        break;
+    case SHOWERNET_TANH:
+        for (size_t k = 0; k < n; k++) y[k] = std::tanh(y[k]);
+        break;
+    case SHOWERNET_LINEAR:
+        break;
+    case SHOWERNET_SOFTMAX:
+        for (int b = 0; b < SHOWERNET_BATCH; b++) {
+            float max = y[b];
+            for (int o = 1; o < layer.nout; o++) max = std::max(max, y[o*SHOWERNET_BATCH + b]);
+            float sum = 0;
+            for (int o = 0; o < layer.nout; o++) sum += (y[o*SHOWERNET_BATCH + b] = std::exp(y[o*SHOWERNET_BATCH + b] - max));
+            for (int o = 0; o < layer.nout; o++) y[o*SHOWERNET_BATCH + b] /= sum;
+        }
+        break;
+    }
+}
+
+// The scores of the ncluster clusters of an event, batch by batch
+inline void shower_net_event(const ShowerNet& net, const EMCalGeometry& geometry, unsigned int ncluster, const float* cell_e,
+                             const unsigned short* cluster_cell_id_max, const float* cluster_e, float* scores, ShowerNetWork& work){
+    const size_t size = (size_t)net.max_width*SHOWERNET_BATCH;
+    if (work.buffer[0].size() < size) {
+        work.buffer[0].resize(size);
+        work.buffer[1].resize(size);
+    }
+    const int ninput = net.window*net.window;
+    for (unsigned int first = 0; first < ncluster; first += SHOWERNET_BATCH) {
+        const int nbatch = std::min<unsigned int>(SHOWERNET_BATCH, ncluster - first);
+        float* input = &work.buffer[0][0];
+        for (int b = 0; b < nbatch; b++) {
+            const unsigned int n = first + b;
+            const int cell = cluster_cell_id_max[n];
+            if (cell >= EMCAL_NCELL) {
+                for (int i = 0; i < ninput; i++) input[(size_t)i*SHOWERNET_BATCH + b] = 0;
+                continue;
+            }
+            const float scale = !net.normalize ? 1 : cluster_e[n] > 0 ? 1/cluster_e[n] : 0;
+            shower_net_window(geometry, net.window, cell_e, cell, scale, input + b, SHOWERNET_BATCH);
+        }
+        // The lanes past the last cluster are evaluated on zeros and dropped
+        for (int b = nbatch; b < SHOWERNET_BATCH; b++) {
+            for (int i = 0; i < ninput; i++) input[(size_t)i*SHOWERNET_BATCH + b] = 0;
+        }
+        int current = 0;
+        for (size_t l = 0; l < net.layers.size(); l++) {
+            shower_net_layer(net.layers[l], &work.buffer[current][0], &work.buffer[1 - current][0]);
+            current = 1 - current;
+        }
+        for (int b = 0; b < nbatch; b++) scores[first + b] = work.buffer[current][(size_t)net.output*SHOWERNET_BATCH + b];
+    }
+}
+
+#endif // SHOWERNET_H
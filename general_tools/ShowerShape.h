@@ -0,0 +1,168 @@
+// Shower-shape variables of EMCal clusters recomputed from the cell energies of the ntuples (cell_e, cluster_cell_id_max,
+// cluster_ncell), to try other definitions of lambda0^2, Emax and Ecross than the stored cluster_lambda_square, cluster_e_max and
+// cluster_e_cross in the same pass as the correlations
+// The ntuples do not keep which cells make up a cluster, so each one is grown again from its maximum cell, as the V1 clusterizer
+// does: breadth first over the cells sharing a side (across supermodules, see EMCalGeometry.h) with more than cell_e_min, nearest
+// first, and at most cluster_ncell of them. Then the cells of all the clusters of the event are laid out in flat arrays, so that
+// the log weights w = max(0, w0 + ln(E_cell/E)), which cost the most, are one branch-free loop over all of them (vectorized with
+// -O3 -ffast-math and a vector math library), and the weighted moments in global (column, row) cell units, as in AliEMCALRecPoint,
+// short loops over the cells of each cluster
+// Author: Ivan Chernyshev
+
+#ifndef SHOWERSHAPE_H
+#define SHOWERSHAPE_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "EMCalGeometry.h"
+
+struct ShowerShapeParameters {
+    float cell_e_min;           // GeV, for a cell to join a cluster
+    float w0;                   // of the log weights
+};
+
+struct ShowerShape {
+    int ncell;                  // cells found
+    float e;                    // sum of their energies
+    float e_max;                // energy of the maximum cell
+    float e_cross;              // of its 4 neighbours sharing a side
+    float lambda0_square;       // long and short axes of the shower, in cells^2
+    float lambda1_square;
+};
+
+// Cells of the clusters of an event, cluster after cluster, and scratch arrays, reused from event to event
+struct ShowerShapeWork {
+    std::vector<int> cell;
+    std::vector<size_t> first;  // [cluster], and the end
+    std::vector<float> sum;     // [cluster], of the cell energies
+    std::vector<float> e;       // per cell, gathered from cell
+    std::vector<float> x;       // column and row from the maximum cell of the cluster
+    std::vector<float> z;
+    std::vector<float> inverse; // 1/E of the cluster
+    std::vector<float> w;
+    std::vector<unsigned int> mark;
+    unsigned int stamp;
+};
+
+inline ShowerShapeParameters shower_shape_parameters(float cell_e_min = 0.1, float w0 = 4.5){
+    ShowerShapeParameters parameters;
+    parameters.cell_e_min = cell_e_min;
+    parameters.w0 = w0;
+    return parameters;
+}
+
+inline ShowerShapeWork shower_shape_work(){
+    ShowerShapeWork work;
+    work.mark.assign(EMCAL_NCELL, 0);
+    work.stamp = 0;
+    return work;
+}
+
+// Append the cells of the cluster around cell_id_max to work.cell, breadth first
+inline void shower_shape_grow(const EMCalGeometry& geometry, const ShowerShapeParameters& parameters, const float* cell_e, int cell_id_max,
+                              int ncell_max, ShowerShapeWork& work){
+    if (++work.stamp == 0) {
+        std::fill(work.mark.begin(), work.mark.end(), 0);
+        work.stamp = 1;
+    }
+    const size_t begin = work.cell.size();
+    work.cell.push_back(cell_id_max);
+    work.mark[cell_id_max] = work.stamp;
+    for (size_t head = begin; head < work.cell.size(); head++) {
+        const short* neighbour = &geometry.neighbour[4*work.cell[head]];
+        for (int k = 0; k < 4; k++) {
+            if ((int)(work.cell.size() - begin) >= ncell_max) return;
+            const int cell = neighbour[k];
+            if (cell < 0 || work.mark[cell] == work.stamp || !(cell_e[cell] > parameters.cell_e_min)) continue;
+            work.mark[cell] = work.stamp;
+            work.cell.push_back(cell);
+        }
+    }
+}
+
+// The shapes of the n clusters index[0 .. n - 1] (all of 0 .. n - 1 if index is NULL), into shapes[cluster]; a cluster without a
+// valid maximum cell gets zeros
+inline void shower_shape_event(const EMCalGeometry& geometry, const ShowerShapeParameters& parameters, const float* cell_e, size_t n,
+                               const int* index, const unsigned short* cluster_cell_id_max, const int* cluster_ncell, ShowerShape* shapes,
+                               ShowerShapeWork& work){
+    if (work.mark.size() != EMCAL_NCELL) work = shower_shape_work();
+    work.cell.clear();
+    work.first.resize(n + 1);
+    work.sum.assign(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        const int cluster = index != NULL ? index[i] : i;
+        work.first[i] = work.cell.size();
+        if (cluster_cell_id_max[cluster] < EMCAL_NCELL) {
+            shower_shape_grow(geometry, parameters, cell_e, cluster_cell_id_max[cluster], std::max(cluster_ncell[cluster], 1), work);
+        }
+    }
+    work.first[n] = work.cell.size();
+    // Flat arrays of all the cells
+    const size_t ncell = work.cell.size();
+    work.e.resize(ncell);
+    work.x.resize(ncell);
+    work.z.resize(ncell);
+    work.inverse.resize(ncell);
+    work.w.resize(ncell);
+    for (size_t i = 0; i < n; i++) {
+        const size_t begin = work.first[i];
+        const size_t end = work.first[i + 1];
+        if (begin == end) continue;
+        const int column_max = geometry.column[work.cell[begin]];
+        const int row_max = geometry.row[work.cell[begin]];
+        for (size_t k = begin; k < end; k++) {
+            const int cell = work.cell[k];
+            work.e[k] = cell_e[cell];
+            work.x[k] = geometry.column[cell] - column_max;
+            work.z[k] = geometry.row[cell] - row_max;
+            work.sum[i] += work.e[k];
+        }
+        std::fill(work.inverse.begin() + begin, work.inverse.begin() + end, work.sum[i] > 0 ? 1/work.sum[i] : 0.0f);
+    }
+    const float w0 = parameters.w0;
+    for (size_t k = 0; k < ncell; k++) work.w[k] = std::max(0.0f, w0 + std::log(std::max(work.e[k]*work.inverse[k], 1e-30f)));
+    for (size_t i = 0; i < n; i++) {
+        const int cluster = index != NULL ? index[i] : i;
+        ShowerShape& shape = shapes[cluster];
+        const size_t begin = work.first[i];
+        const size_t end = work.first[i + 1];
+        shape.ncell = end - begin;
+        shape.e = shape.e_max = shape.e_cross = shape.lambda0_square = shape.lambda1_square = 0;
+        if (begin == end) continue;
+        const int cell_max = work.cell[begin];
+        shape.e_max = cell_e[cell_max];
+        for (int k = 0; k < 4; k++) {
+            const int cell = geometry.neighbour[4*cell_max + k];
+            if (cell >= 0) shape.e_cross += cell_e[cell];
+        }
+        shape.e = work.sum[i];
+        float sw = 0;
+        float sx = 0;
+        float sz = 0;
+        float sxx = 0;
+        float szz = 0;
+        float sxz = 0;
+        for (size_t k = begin; k < end; k++) {
+            const float w = work.w[k];
+            sw += w;
+            sx += w*work.x[k];
+            sz += w*work.z[k];
+            sxx += w*work.x[k]*work.x[k];
+            szz += w*work.z[k]*work.z[k];
+            sxz += w*work.x[k]*work.z[k];
+        }
+        if (!(sw > 0)) continue;
+        const float mx = sx/sw;
+        const float mz = sz/sw;
+        const float dxx = sxx/sw - mx*mx;
+        const float dzz = szz/sw - mz*mz;
+        const float dxz = sxz/sw - mx*mz;
+        const float root = std::sqrt(0.25f*(dxx - dzz)*(dxx - dzz) + dxz*dxz);
+        shape.lambda0_square = std::max(0.0f, 0.5f*(dxx + dzz) + root);
+        shape.lambda1_square = std::max(0.0f, 0.5f*(dxx + dzz) - root);
+    }
+}
+
+#endif // SHOWERSHAPE_H
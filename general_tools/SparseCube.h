@@ -0,0 +1,263 @@
+// Dense cube of a THnSparse, for sweeps of range projections over the same sparse histogram (pion_hadron_corr.C, mass_pion_modeller.C)
+// A THnSparse projection rescans every filled bin each time, whatever the ranges; the cube is filled in one scan, over the "cut"
+// axes whose ranges the sweep changes and the "kept" axes that are projected on, and holds the cumulative sums along the cut axes,
+// so a projection for any ranges of the cut axes is the inclusion-exclusion of 2^ncut blocks of the kept cells
+// Ranges set on the other axes when the cube is built are applied once, as THnSparse::Projection would, and so are the ranges of the
+// kept and cut axes: the cube only spans them (under- and overflow included for an axis without a range), which also bounds its size
+// The projections are what THnSparse::Projection gives for the same ranges: the kept axes cover their range, out-of-range contents
+// of an axis without range land in the under- and overflow, and the errors are those of the THnSparse if it has them
+// (GetCalculateErrors), Poisson if the projection has Sumw2 anyway (TH1::SetDefaultSumw2), none otherwise
+// Author: Ivan Chernyshev
+
+#ifndef SPARSECUBE_H
+#define SPARSECUBE_H
+
+#include <THnSparse.h>
+#include <TAxis.h>
+#include <TH1D.h>
+#include <TH2D.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "HistogramAlgebra.h"
+
+#define SPARSECUBE_MAX_CUT 4
+#define SPARSECUBE_MAX_KEEP 2
+// Cells per array (content, and errors^2 if any) before refusing to build the cube: narrow the ranges of its axes instead
+#define SPARSECUBE_MAX_CELLS (1LL << 27)
+
+struct SparseCube {
+    THnSparse* source;
+    int ncut;
+    int nkeep;
+    int axis[SPARSECUBE_MAX_CUT + SPARSECUBE_MAX_KEEP];     // THnSparse axes: the cut axes, then the kept axes
+    int first[SPARSECUBE_MAX_CUT + SPARSECUBE_MAX_KEEP];    // first THnSparse bin spanned
+    int nbins[SPARSECUBE_MAX_CUT + SPARSECUBE_MAX_KEEP];    // THnSparse bins spanned
+    long long stride[SPARSECUBE_MAX_CUT + SPARSECUBE_MAX_KEEP];
+    long long nkept_cells;
+    bool errors;
+    std::vector<double> sum;    // cumulative sums; along cut axis k, index i + 1 holds the bins first[k] to first[k] + i
+    std::vector<double> sum2;   // the same for the errors^2
+    int cut_low[SPARSECUBE_MAX_CUT];    // current range of each cut axis, in cube bins (both included)
+    int cut_high[SPARSECUBE_MAX_CUT];
+};
+
+// The bins of an axis that THnSparse::Projection takes: its range if one is set, every bin with under- and overflow otherwise
+inline void sparse_cube_axis_span(TAxis* axis, int& first, int& nbins){
+    if (axis->TestBit(TAxis::kAxisRange)) {
+        first = axis->GetFirst();
+        nbins = axis->GetLast() - first + 1;
+    }
+    else {
+        first = 0;
+        nbins = axis->GetNbins() + 2;
+    }
+}
+
+// Build the cube of h over the cut axes (whose ranges are then set with sparse_cube_cut) and the kept axes (1 or 2, x then y)
+inline SparseCube sparse_cube(THnSparse* h, int ncut, const int* cut_axes, int nkeep, const int* keep_axes){
+    if (ncut < 1 || ncut > SPARSECUBE_MAX_CUT || nkeep < 1 || nkeep > SPARSECUBE_MAX_KEEP) {
+        fprintf(stderr, "%s:%d: a sparse cube needs 1 to %d cut axes and 1 to %d kept axes, not %d and %d\n", __FILE__, __LINE__,
+                SPARSECUBE_MAX_CUT, SPARSECUBE_MAX_KEEP, ncut, nkeep);
+        exit(EXIT_FAILURE);
+    }
+    SparseCube cube;
+    cube.source = h;
+    cube.ncut = ncut;
+    cube.nkeep = nkeep;
+    cube.errors = h->GetCalculateErrors();
+    const int ndim = ncut + nkeep;
+    for (int k = 0; k < ndim; k++) {
+        cube.axis[k] = k < ncut ? cut_axes[k] : keep_axes[k - ncut];
+        if (cube.axis[k] < 0 || cube.axis[k] >= h->GetNdimensions()) {
+            fprintf(stderr, "%s:%d: %s has no axis %d\n", __FILE__, __LINE__, h->GetName(), cube.axis[k]);
+            exit(EXIT_FAILURE);
+        }
+        for (int l = 0; l < k; l++) {
+            if (cube.axis[l] == cube.axis[k]) {
+                fprintf(stderr, "%s:%d: axis %d is given twice to the sparse cube\n", __FILE__, __LINE__, cube.axis[k]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        sparse_cube_axis_span(h->GetAxis(cube.axis[k]), cube.first[k], cube.nbins[k]);
+    }
+    // Kept axes innermost, so that each corner of a projection is one contiguous block; cut axes have one more (zero) index
+    long long ncells = 1;
+    for (int k = ndim - 1; k >= 0; k--) {
+        cube.stride[k] = ncells;
+        ncells *= k < ncut ? cube.nbins[k] + 1 : cube.nbins[k];
+        if (k == ncut) cube.nkept_cells = ncells;
+    }
+    if (ncells > SPARSECUBE_MAX_CELLS) {
+        fprintf(stderr, "%s:%d: the sparse cube of %s would have %lld cells, more than %lld; set narrower ranges on its axes\n",
+                __FILE__, __LINE__, h->GetName(), ncells, SPARSECUBE_MAX_CELLS);
+        exit(EXIT_FAILURE);
+    }
+    cube.sum.assign(ncells, 0);
+    if (cube.errors) cube.sum2.assign(ncells, 0);
+
+    // The one scan of the filled bins: ranges of the other axes as in THnSparse::Projection
+    std::vector<int> other_first;
+    std::vector<int> other_last;
+    std::vector<int> other_axis;
+    for (int d = 0; d < h->GetNdimensions(); d++) {
+        bool in_cube = false;
+        for (int k = 0; k < ndim; k++) in_cube = in_cube || cube.axis[k] == d;
+        if (in_cube || !h->GetAxis(d)->TestBit(TAxis::kAxisRange)) continue;
+        other_axis.push_back(d);
+        other_first.push_back(h->GetAxis(d)->GetFirst());
+        other_last.push_back(h->GetAxis(d)->GetLast());
+    }
+    std::vector<Int_t> coord(h->GetNdimensions());
+    for (Long64_t ibin = 0; ibin < h->GetNbins(); ibin++) {
+        const double content = h->GetBinContent(ibin, &coord[0]);
+        bool in_range = true;
+        for (size_t o = 0; o < other_axis.size() && in_range; o++) {
+            in_range = coord[other_axis[o]] >= other_first[o] && coord[other_axis[o]] <= other_last[o];
+        }
+        long long cell = 0;
+        for (int k = 0; k < ndim && in_range; k++) {
+            const int i = coord[cube.axis[k]] - cube.first[k];
+            in_range = i >= 0 && i < cube.nbins[k];
+            cell += (k < ncut ? i + 1 : i)*cube.stride[k];
+        }
+        if (!in_range) continue;
+        cube.sum[cell] += content;
+        if (cube.errors) cube.sum2[cell] += h->GetBinError2(ibin);
+    }
+
+    // Cumulative sums along each cut axis
+    for (int k = 0; k < ncut; k++) {
+        const long long step = cube.stride[k];
+        const long long block = step*(cube.nbins[k] + 1);
+        for (long long start = 0; start < ncells; start += block) {
+            for (long long cell = start + 2*step; cell < start + block; cell++) {
+                cube.sum[cell] += cube.sum[cell - step];
+                if (cube.errors) cube.sum2[cell] += cube.sum2[cell - step];
+            }
+        }
+        cube.cut_low[k] = 0;
+        cube.cut_high[k] = cube.nbins[k] - 1;
+    }
+    return cube;
+}
+
+// Set the range of a cut axis of the cube to the bins of [min, max), as SetCut does with the THnSparse axis; like TAxis::SetRange,
+// an empty range means the whole axis (as far as the cube spans it)
+inline void sparse_cube_cut(SparseCube& cube, int axis, double min, double max){
+    for (int k = 0; k < cube.ncut; k++) {
+        if (cube.axis[k] != axis) continue;
+        TAxis* source_axis = cube.source->GetAxis(axis);
+        cube.cut_low[k] = source_axis->FindBin(min) - cube.first[k];
+        cube.cut_high[k] = source_axis->FindBin(max) - 1 - cube.first[k];
+        if (cube.cut_high[k] < cube.cut_low[k]) {
+            cube.cut_low[k] = 0;
+            cube.cut_high[k] = cube.nbins[k] - 1;
+        }
+        return;
+    }
+    fprintf(stderr, "%s:%d: axis %d of %s is not a cut axis of the sparse cube\n", __FILE__, __LINE__, axis, cube.source->GetName());
+    exit(EXIT_FAILURE);
+}
+
+// Sum the kept cells over the current ranges of the cut axes, into content (and errors2 if the cube has errors)
+inline void sparse_cube_sum(const SparseCube& cube, std::vector<double>& content, std::vector<double>& errors2){
+    content.assign(cube.nkept_cells, 0);
+    errors2.assign(cube.errors ? cube.nkept_cells : 0, 0);
+    long long low[SPARSECUBE_MAX_CUT];
+    long long high[SPARSECUBE_MAX_CUT];
+    for (int k = 0; k < cube.ncut; k++) {
+        // Cumulative-sum indices: high[k] holds the bins up to cut_high, low[k] those below cut_low; both clipped to the cube
+        low[k] = std::max(cube.cut_low[k], 0);
+        high[k] = std::min(cube.cut_high[k], cube.nbins[k] - 1) + 1;
+        if (high[k] <= low[k]) return;
+    }
+    for (int corner = 0; corner < (1 << cube.ncut); corner++) {
+        long long offset = 0;
+        double sign = 1;
+        bool empty = false;
+        for (int k = 0; k < cube.ncut; k++) {
+            const bool lower = (corner >> k) & 1;
+            if (lower && low[k] == 0) empty = true;
+            offset += (lower ? low[k] : high[k])*cube.stride[k];
+            if (lower) sign = -sign;
+        }
+        if (empty) continue;
+        const double* block = &cube.sum[offset];
+        for (long long cell = 0; cell < cube.nkept_cells; cell++) content[cell] += sign*block[cell];
+        if (!cube.errors) continue;
+        const double* block2 = &cube.sum2[offset];
+        for (long long cell = 0; cell < cube.nkept_cells; cell++) errors2[cell] += sign*block2[cell];
+    }
+}
+
+// Bin edges of the part of a THnSparse axis spanned by the cube, without under- and overflow
+inline std::vector<double> sparse_cube_edges(TAxis* axis, int first, int nbins){
+    const int low = std::max(first, 1);
+    const int high = std::min(first + nbins - 1, axis->GetNbins());
+    std::vector<double> edges;
+    for (int i = low; i <= high; i++) edges.push_back(axis->GetBinLowEdge(i));
+    edges.push_back(axis->GetBinUpEdge(high));
+    return edges;
+}
+
+// Copy the summed kept cells into a histogram made by sparse_cube_projection or sparse_cube_projection_2D
+inline void sparse_cube_fill(const SparseCube& cube, TH1* projection){
+    std::vector<double> content;
+    std::vector<double> errors2;
+    sparse_cube_sum(cube, content, errors2);
+    double* hist = hist_content(projection);
+    double* hist2 = cube.errors || projection->GetSumw2N() > 0 ? hist_sumw2_result(projection) : NULL;
+    const int kx = cube.ncut;
+    const int ky = cube.ncut + 1;
+    double entries = 0;
+    for (long long cell = 0; cell < cube.nkept_cells; cell++) {
+        // Histogram bin 1 is the first bin of the range, so that the underflow of an axis spanned from bin 0 stays the underflow
+        const int ix = cube.first[kx] + (cube.nkeep == 2 ? cell/cube.stride[kx] : cell) - std::max(cube.first[kx], 1) + 1;
+        const int iy = cube.nkeep == 2 ? cube.first[ky] + cell%cube.stride[kx] - std::max(cube.first[ky], 1) + 1 : 0;
+        const int bin = projection->GetBin(ix, iy);
+        hist[bin] = content[cell];
+        if (hist2 != NULL) hist2[bin] = cube.errors ? errors2[cell] : content[cell];
+        entries += content[cell];
+    }
+    projection->SetEntries(entries);
+}
+
+// Projection on the one kept axis, for the current ranges of the cut axes (THnSparse::Projection(axis))
+inline TH1D* sparse_cube_projection(const SparseCube& cube){
+    if (cube.nkeep != 1) {
+        fprintf(stderr, "%s:%d: the sparse cube of %s keeps %d axes, not 1\n", __FILE__, __LINE__, cube.source->GetName(), cube.nkeep);
+        exit(EXIT_FAILURE);
+    }
+    TAxis* x = cube.source->GetAxis(cube.axis[cube.ncut]);
+    const std::vector<double> x_edges = sparse_cube_edges(x, cube.first[cube.ncut], cube.nbins[cube.ncut]);
+    TH1D* projection = new TH1D(Form("%s_proj_%d", cube.source->GetName(), cube.axis[cube.ncut]), cube.source->GetTitle(),
+                                x_edges.size() - 1, &x_edges[0]);
+    projection->GetXaxis()->SetTitle(x->GetTitle());
+    sparse_cube_fill(cube, projection);
+    return projection;
+}
+
+// Projection on the two kept axes, the first on x and the second on y, for the current ranges of the cut axes
+// (THnSparse::Projection(y, x), which takes y first)
+inline TH2D* sparse_cube_projection_2D(const SparseCube& cube){
+    if (cube.nkeep != 2) {
+        fprintf(stderr, "%s:%d: the sparse cube of %s keeps %d axes, not 2\n", __FILE__, __LINE__, cube.source->GetName(), cube.nkeep);
+        exit(EXIT_FAILURE);
+    }
+    TAxis* x = cube.source->GetAxis(cube.axis[cube.ncut]);
+    TAxis* y = cube.source->GetAxis(cube.axis[cube.ncut + 1]);
+    const std::vector<double> x_edges = sparse_cube_edges(x, cube.first[cube.ncut], cube.nbins[cube.ncut]);
+    const std::vector<double> y_edges = sparse_cube_edges(y, cube.first[cube.ncut + 1], cube.nbins[cube.ncut + 1]);
+    TH2D* projection = new TH2D(Form("%s_proj_%d_%d", cube.source->GetName(), cube.axis[cube.ncut], cube.axis[cube.ncut + 1]),
+                                cube.source->GetTitle(), x_edges.size() - 1, &x_edges[0], y_edges.size() - 1, &y_edges[0]);
+    projection->GetXaxis()->SetTitle(x->GetTitle());
+    projection->GetYaxis()->SetTitle(y->GetTitle());
+    sparse_cube_fill(cube, projection);
+    return projection;
+}
+
+#endif // SPARSECUBE_H
@@ -0,0 +1,128 @@
+// Per-event index of the Monte-Carlo truth particles of an ntuple, for the truth matching of the MC programs (GammaJet.cc,
+// PhotonEfficiency.cc, EnergyResponse.cc, DeepPionEfficiency.cc), and the one definition of their truth classes
+// One pass over the nmc_truth particles sets a bit per class and particle, so matching a cluster is a test of a bit for each of its
+// cluster_mc_truth_index entries, instead of three array lookups; the first entry of a class is kept per cluster, as the loops did
+// All the arrays are allocated once, for the NTRACK_MAX particles, clusters and jets of the caller, and only the part used by the previous event is
+// cleared, so nothing is allocated per event; the truth jets matched by reco jets are counted once each with an event stamp, in
+// place of a std::set
+// Author: Ivan Chernyshev
+
+#ifndef TRUTHINDEX_H
+#define TRUTHINDEX_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#define TRUTHINDEX_NONE 65535       // unused entries of cluster_mc_truth_index
+
+enum TruthClass {
+    TRUTH_PHOTON,               // any photon
+    TRUTH_PROMPT_PHOTON,        // photon whose first parent is a photon (prompt) and status > 0
+    TRUTH_PI0_PHOTON,           // photon from a pi0
+    TRUTH_ETA_PHOTON,           // photon from an eta
+    TRUTH_CONVERSION_ELECTRON,  // electron from a photon
+    TRUTH_SELECTED,             // the pdg code and first parent pdg code given to truth_index(), status > 0
+    TRUTH_NCLASS
+};
+
+struct TruthIndex {
+    int selected_pdg_code;
+    int selected_parent_pdg_code;
+    unsigned int max;                                   // particles, clusters and jets the arrays hold
+    unsigned int ntruth;
+    size_t nword;                                       // 64-bit words of the bits in use
+    std::vector<unsigned long long> bits[TRUTH_NCLASS];
+    unsigned int ncluster;
+    std::vector<int> cluster_truth;                     // first truth particle of the matched class per cluster, -1 if none
+    unsigned int event;
+    std::vector<unsigned int> jet_event;                // event in which each truth jet was last counted
+};
+
+// An index for up to max truth particles, clusters and jets per event, the NTRACK_MAX the caller's branch arrays are sized with
+inline TruthIndex truth_index(unsigned int max, int selected_pdg_code = 22, int selected_parent_pdg_code = 22){
+    TruthIndex index;
+    index.selected_pdg_code = selected_pdg_code;
+    index.selected_parent_pdg_code = selected_parent_pdg_code;
+    index.max = max;
+    index.ntruth = 0;
+    index.nword = 0;
+    for (int c = 0; c < TRUTH_NCLASS; c++) index.bits[c].assign((max + 63)/64, 0);
+    index.ncluster = 0;
+    index.cluster_truth.assign(max, -1);
+    index.event = 1;
+    index.jet_event.assign(max, 0);
+    return index;
+}
+
+// Classify the nmc_truth particles of the event just read
+inline void truth_index_build(TruthIndex& index, unsigned int nmc_truth, const short* pdg_code, const short* first_parent_pdg_code,
+                              const unsigned char* status){
+    if (nmc_truth > index.max) {
+        fprintf(stderr, "%s:%d: %u truth particles, more than the %u of the index\n", __FILE__, __LINE__, nmc_truth, index.max);
+        exit(EXIT_FAILURE);
+    }
+    for (int c = 0; c < TRUTH_NCLASS; c++) std::fill(index.bits[c].begin(), index.bits[c].begin() + index.nword, 0ULL);
+    for (unsigned int i = 0; i < nmc_truth; i++) {
+        const int pdg = pdg_code[i];
+        const int parent = first_parent_pdg_code[i];
+        const bool alive = status[i] > 0;
+        const unsigned long long bit = 1ULL << (i % 64);
+        const size_t word = i/64;
+        if (pdg == 22) index.bits[TRUTH_PHOTON][word] |= bit;
+        if (pdg == 22 && parent == 22 && alive) index.bits[TRUTH_PROMPT_PHOTON][word] |= bit;
+        if (pdg == 22 && parent == 111) index.bits[TRUTH_PI0_PHOTON][word] |= bit;
+        if (pdg == 22 && parent == 221) index.bits[TRUTH_ETA_PHOTON][word] |= bit;
+        if (pdg == 11 && parent == 22) index.bits[TRUTH_CONVERSION_ELECTRON][word] |= bit;
+        if (pdg == index.selected_pdg_code && parent == index.selected_parent_pdg_code && alive) index.bits[TRUTH_SELECTED][word] |= bit;
+    }
+    index.ntruth = nmc_truth;
+    index.nword = (nmc_truth + 63)/64;
+    index.ncluster = 0;
+    index.event++;
+}
+
+// Whether truth particle i (e.g. an entry of cluster_mc_truth_index, TRUTHINDEX_NONE included) is of the class
+inline bool truth_index_is(const TruthIndex& index, TruthClass truth_class, unsigned int i){
+    return i < index.ntruth && ((index.bits[truth_class][i/64] >> (i % 64)) & 1ULL) != 0;
+}
+
+// The first of the 32 truth particles of a cluster that is of the class; -1 if none is
+inline int truth_index_first(const TruthIndex& index, TruthClass truth_class, const unsigned short* cluster_truth){
+    for (int counter = 0; counter < 32; counter++) {
+        if (truth_index_is(index, truth_class, cluster_truth[counter])) return cluster_truth[counter];
+    }
+    return -1;
+}
+
+// The number of the 32 truth particles of a cluster that are of the class, an entry repeating the last one counted not counting again
+inline int truth_index_count(const TruthIndex& index, TruthClass truth_class, const unsigned short* cluster_truth){
+    int count = 0;
+    int last = -1;
+    for (int counter = 0; counter < 32; counter++) {
+        if (!truth_index_is(index, truth_class, cluster_truth[counter]) || cluster_truth[counter] == last) continue;
+        last = cluster_truth[counter];
+        count++;
+    }
+    return count;
+}
+
+// Match every cluster of the event to its first truth particle of the class, in index.cluster_truth
+inline void truth_index_match_clusters(TruthIndex& index, TruthClass truth_class, unsigned int ncluster, const unsigned short (*cluster_mc_truth_index)[32]){
+    if (ncluster > index.max) {
+        fprintf(stderr, "%s:%d: %u clusters, more than the %u of the index\n", __FILE__, __LINE__, ncluster, index.max);
+        exit(EXIT_FAILURE);
+    }
+    index.ncluster = ncluster;
+    for (unsigned int n = 0; n < index.ncluster; n++) index.cluster_truth[n] = truth_index_first(index, truth_class, cluster_mc_truth_index[n]);
+}
+
+// True the first time truth jet ijet is seen in the event (a jet index outside the arrays never is)
+inline bool truth_index_first_jet(TruthIndex& index, int ijet){
+    if (ijet < 0 || ijet >= (int)index.max || index.jet_event[ijet] == index.event) return false;
+    index.jet_event[ijet] = index.event;
+    return true;
+}
+
+#endif // TRUTHINDEX_H
@@ -0,0 +1,141 @@
+// Benchmark of the zT bin search of the gamma-hadron correlation fills
+// (old/gamma_hadron/modified_code), per cluster-track pair: the loop
+// over all bins of the programs, a binary search, and the lookup of
+// BinLookup.h
+//
+// Synthetic events have a few clusters of 10 to 16 GeV (the pT_min
+// and pT_max of Corr_config.yaml) and a Poisson number of tracks with
+// a falling pT spectrum, and each pair adds one to the counter of its
+// zT bin, in place of the histogram fills. The three methods must
+// give the same counters
+//
+// Built by the Makefile: make bin_lookup_benchmark
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Benchmark.h"
+#include "BinLookup.h"
+
+namespace {
+
+    // The zT of every cluster-track pair, event after event
+    std::vector<double> pair_zt(size_t nevent, double ntrack_mean)
+    {
+        std::mt19937_64 generator(1);
+        std::uniform_int_distribution<int> ncluster_distribution(1, 3);
+        std::uniform_real_distribution<double> cluster_pt_distribution(10, 16);
+        std::poisson_distribution<int> ntrack_distribution(ntrack_mean);
+        // pT^-5 above 0.5 GeV
+        std::uniform_real_distribution<double> uniform(0, 1);
+        std::vector<double> zt;
+        std::vector<double> track_pt;
+
+        for (size_t ievent = 0; ievent < nevent; ievent++) {
+            const int ntrack = ntrack_distribution(generator);
+
+            track_pt.resize(ntrack);
+            for (int itrack = 0; itrack < ntrack; itrack++) {
+                track_pt[itrack] = 0.5 * std::pow(1 - uniform(generator), -1.0 / 4);
+            }
+
+            const int ncluster = ncluster_distribution(generator);
+
+            for (int icluster = 0; icluster < ncluster; icluster++) {
+                const double cluster_pt = cluster_pt_distribution(generator);
+
+                for (int itrack = 0; itrack < ntrack; itrack++) {
+                    zt.push_back(track_pt[itrack] / cluster_pt);
+                }
+            }
+        }
+
+        return zt;
+    }
+
+    double fill_loop(const std::vector<double> &zt, const float *ztbins, int nztbins, std::vector<long> &count)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < zt.size(); i++) {
+            for (int izt = 0; izt < nztbins; izt++) {
+                if (zt[i] > ztbins[izt] and zt[i] < ztbins[izt + 1]) {
+                    count[izt]++;
+                }
+            }
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+    double fill_binary_search(const std::vector<double> &zt, const float *ztbins, int nztbins, std::vector<long> &count)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < zt.size(); i++) {
+            // First edge >= zt, so that zt == edge falls out as in the loop
+            const int izt = std::lower_bound(ztbins, ztbins + nztbins + 1, zt[i]) - ztbins - 1;
+
+            if (izt >= 0 && izt < nztbins && zt[i] > ztbins[izt]) {
+                count[izt]++;
+            }
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+    double fill_lookup(const std::vector<double> &zt, const BinLookup &lookup, std::vector<long> &count)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < zt.size(); i++) {
+            const int izt = bin_lookup_find(lookup, zt[i]);
+
+            if (izt >= 0) {
+                count[izt]++;
+            }
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t nevent = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+    // Mean number of tracks per event; ntrack_max of the HDF5 pools is a few hundred
+    const double ntrack_mean = argc > 2 ? atof(argv[2]) : 60;
+    // Zt_bins of Corr_config.yaml
+    const float ztbins[] = { 0.0, 0.1, 0.2, 0.4, 0.6, 0.8, 1.0, 1.2 };
+    const int nztbins = sizeof(ztbins) / sizeof(*ztbins) - 1;
+
+    const std::vector<double> zt = pair_zt(nevent, ntrack_mean);
+    const BinLookup lookup = bin_lookup(ztbins, nztbins);
+    std::vector<long> count_loop(nztbins, 0);
+    std::vector<long> count_binary_search(nztbins, 0);
+    std::vector<long> count_lookup(nztbins, 0);
+
+    const double loop_time = fill_loop(zt, ztbins, nztbins, count_loop);
+    const double binary_search_time = fill_binary_search(zt, ztbins, nztbins, count_binary_search);
+    const double lookup_time = fill_lookup(zt, lookup, count_lookup);
+
+    fprintf(stdout, "%lu events, %.0f tracks per event on average, %lu pairs, %d zT bins\n",
+            nevent, ntrack_mean, zt.size(), nztbins);
+    benchmark_table_header("pairs (/s)");
+    benchmark_table_row("loop", loop_time, zt.size() / loop_time);
+    benchmark_table_row("binary search", binary_search_time, zt.size() / binary_search_time);
+    benchmark_table_row("lookup", lookup_time, zt.size() / lookup_time);
+
+    if (count_binary_search != count_loop || count_lookup != count_loop) {
+        fprintf(stderr, "%s:%d: the zT bins differ from those of the loop\n", __FILE__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
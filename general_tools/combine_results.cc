@@ -0,0 +1,199 @@
+// This program fuses the results of any number of data samples (e.g. the GammaJet outputs of several run periods), generalizing
+// rootresultcombiner.C: every histogram the input files share is combined, with the weights taken from the trigger counts each
+// file stores in h_weights (bin 1: number of clusters in the signal region N_SR, bin 2: in the background region N_BR)
+// - sig_* and hadj_* histograms (normalized per signal-region trigger) are averaged with the weights N_SR
+// - bkg_* histograms (normalized per background-region trigger) are averaged with the weights N_BR
+// - ratios (names containing "ratio" or "efficiency") and the truth distributions normalized per truth photon
+//   (h_dPhi_truth, h_Xj_truth, h_XobsPb_truth, h_pTD_truth, h_Multiplicity_truth) are averaged with the weights N_SR
+// - every other histogram (counts: h_weights, cut flows, TOT_*, zvertex, ...) is summed, so outputs can be combined again
+// Objects that are not histograms are copied from the first input
+//
+// Histograms are streamed one at a time (one accumulator and the histogram being added in memory, whatever the number of inputs)
+// and the histogram names are spread over forked worker processes, each writing a part file that is merged into the output at the end
+// Author: Ivan Chernyshev
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TH1.h>
+#include <TROOT.h>
+#include <TArrayD.h>
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "HistogramAlgebra.h"
+#include "ParallelMerge.h"
+
+enum CombineRule {SUM, AVERAGE_SR, AVERAGE_BR};
+
+bool starts_with(const std::string& s, const char* prefix){
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// How a histogram of the given name is combined (see the program description)
+CombineRule combine_rule(const std::string& name){
+    static const char* truth_normalized[] = {"h_dPhi_truth", "h_Xj_truth", "h_XobsPb_truth", "h_pTD_truth", "h_Multiplicity_truth"};
+    if (starts_with(name, "sig_") || starts_with(name, "hadj_")) return AVERAGE_SR;
+    if (starts_with(name, "bkg_")) return AVERAGE_BR;
+    if (name.find("ratio") != std::string::npos || name.find("efficiency") != std::string::npos) return AVERAGE_SR;
+    for (size_t i = 0; i < sizeof(truth_normalized)/sizeof(truth_normalized[0]); i++) {
+        if (name == truth_normalized[i]) return AVERAGE_SR;
+    }
+    return SUM;
+}
+
+// hist *= scalar and result += scalar*hist, with HistogramAlgebra.h for double-precision histograms and ROOT otherwise (TH1F, ...)
+void combine_scale(TH1* hist, double scalar){
+    if (dynamic_cast<TArrayD*>(hist) != NULL) hist_scale(hist, scalar);
+    else hist->Scale(scalar);
+}
+
+void combine_add(TH1* result, const TH1* hist, double scalar){
+    if (dynamic_cast<TArrayD*>(result) != NULL && dynamic_cast<const TArrayD*>(hist) != NULL) hist_add(result, hist, scalar);
+    else result->Add(hist, scalar);
+}
+
+// The latest cycle of every object name of a file, in file order
+std::vector<std::string> object_names(TFile* file){
+    std::vector<std::string> names;
+    std::set<std::string> seen;
+    TIter next(file->GetListOfKeys());
+    while (TKey* key = dynamic_cast<TKey*>(next())) {
+        if (seen.insert(key->GetName()).second) names.push_back(key->GetName());
+    }
+    return names;
+}
+
+// Combine the given histograms of all inputs into output; returns the number of failed histograms
+int combine_names(const std::vector<std::string>& inputs, const std::vector<std::string>& names, const std::string& output){
+    std::vector<TFile*> files = open_inputs(inputs);
+    if (files.empty()) return 1;
+    
+    // Trigger counts of every input
+    std::vector<double> n_sr(files.size());
+    std::vector<double> n_br(files.size());
+    double total_sr = 0;
+    double total_br = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        TH1* weights = dynamic_cast<TH1*>(read_object(files[i], "h_weights"));
+        if (weights == NULL) {
+            fprintf(stderr, "%s:%d: %s has no h_weights histogram\n", __FILE__, __LINE__, inputs[i].c_str());
+            return 1;
+        }
+        n_sr[i] = weights->GetBinContent(1);
+        n_br[i] = weights->GetBinContent(2);
+        total_sr += n_sr[i];
+        total_br += n_br[i];
+        delete weights;
+    }
+    
+    TFile* fout = TFile::Open(output.c_str(), "RECREATE");
+    if (fout == NULL || fout->IsZombie()) {
+        fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, output.c_str());
+        return 1;
+    }
+    int nfailed = 0;
+    for (size_t k = 0; k < names.size(); k++) {
+        TObject* first = read_object(files[0], names[k]);
+        TH1* result = dynamic_cast<TH1*>(first);
+        if (result == NULL) {
+            // Not a histogram: copied from the first input
+            fout->cd();
+            if (first != NULL) first->Write(names[k].c_str());
+            delete first;
+            continue;
+        }
+        const CombineRule rule = combine_rule(names[k]);
+        const std::vector<double>& n = rule == AVERAGE_BR ? n_br : n_sr;
+        const double total = rule == AVERAGE_BR ? total_br : total_sr;
+        if (rule != SUM && total <= 0) {
+            fprintf(stderr, "%s:%d: %s: the inputs have no %s clusters to weight with\n", __FILE__, __LINE__, names[k].c_str(), rule == AVERAGE_BR ? "background-region" : "signal-region");
+            delete result;
+            nfailed++;
+            continue;
+        }
+        if (rule != SUM) combine_scale(result, n[0]/total);
+        bool ok = true;
+        for (size_t i = 1; i < files.size() && ok; i++) {
+            TH1* hist = dynamic_cast<TH1*>(read_object(files[i], names[k]));
+            if (hist == NULL || hist->GetNcells() != result->GetNcells() || hist->GetDimension() != result->GetDimension()) {
+                fprintf(stderr, "%s:%d: %s: histogram %s is missing or has another binning\n", __FILE__, __LINE__, inputs[i].c_str(), names[k].c_str());
+                ok = false;
+            }
+            else {
+                combine_add(result, hist, rule == SUM ? 1 : n[i]/total);
+            }
+            delete hist;
+        }
+        fout->cd();
+        if (ok) result->Write(names[k].c_str());
+        else nfailed++;
+        delete result;
+    }
+    fout->Close();
+    delete fout;
+    close_inputs(files);
+    
+    return nfailed;
+}
+
+int main(int argc, char *argv[]) {
+    long nworker = sysconf(_SC_NPROCESSORS_ONLN);
+    int first_arg = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        nworker = atol(argv[2]);
+        first_arg = 3;
+    }
+    if (argc - first_arg < 3) {
+        fprintf(stderr, "Syntax is [-j number of parallel workers (default: number of CPUs)] [output ROOT file] [input ROOT file] [input ROOT file] ...\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nworker < 1) nworker = 1;
+    const std::string output = argv[first_arg];
+    const std::vector<std::string> inputs(argv + first_arg + 1, argv + argc);
+    
+    // Histograms must not attach to whatever file is open
+    TH1::AddDirectory(kFALSE);
+    
+    // The names every input shares, in the order of the first input
+    std::vector<std::string> names;
+    {
+        std::vector<TFile*> files = open_inputs(inputs);
+        if (files.empty()) exit(EXIT_FAILURE);
+        std::map<std::string, size_t> count;
+        for (size_t i = 0; i < files.size(); i++) {
+            const std::vector<std::string> file_names = object_names(files[i]);
+            for (size_t j = 0; j < file_names.size(); j++) count[file_names[j]]++;
+        }
+        const std::vector<std::string> first_names = object_names(files[0]);
+        for (size_t j = 0; j < first_names.size(); j++) {
+            if (count[first_names[j]] == files.size()) names.push_back(first_names[j]);
+            else std::cout << "Skipping " << first_names[j] << ", which only " << count[first_names[j]] << " of " << files.size() << " inputs have" << std::endl;
+        }
+        close_inputs(files);
+    }
+    if ((long)names.size() < nworker) nworker = names.size() > 0 ? names.size() : 1;
+    
+    if (nworker == 1) {
+        const int nfailed = combine_names(inputs, names, output);
+        std::cout << names.size() - nfailed << " of " << names.size() << " objects combined from " << inputs.size() << " inputs into " << output << std::endl;
+        return nfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    // Worker w combines the names w, w + nworker, ... into <output>.part<w>, merged into the output in the order of the first input
+    const int nfailed_worker = merge_run_workers(nworker, output, [&](long w, const std::string& part) {
+        std::vector<std::string> worker_names;
+        for (size_t k = w; k < names.size(); k += nworker) worker_names.push_back(names[k]);
+        return combine_names(inputs, worker_names, part);
+    });
+    const size_t ncombined = merge_parts(nworker, names, output);
+    std::cout << ncombined << " of " << names.size() << " objects combined from " << inputs.size() << " inputs into " << output << std::endl;
+    
+    return nfailed_worker == 0 && ncombined == names.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
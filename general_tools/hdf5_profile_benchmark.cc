@@ -0,0 +1,162 @@
+// Benchmark of random single-event reads for each storage profile of
+// HDF5Storage.h, i.e. the access pattern of the event mixing in
+// mixed_cluster_jet.cc (one hyperslab per mixed event, in the random
+// order given by mixed_events)
+//
+// A synthetic track tensor (index_event, index_track,
+// index_properties), NAN padded like the to_hdf5.cc output, is written
+// once per profile, then read back one random event at a time, both
+// with the HDF5 default chunk cache and with the cache sized by
+// hdf5_open_dataset_cached()
+//
+// Built by the Makefile: make hdf5_profile_benchmark
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sys/stat.h>
+
+#include <H5Cpp.h>
+
+#include "Benchmark.h"
+#include "HDF5Storage.h"
+
+#define RANK 3
+
+namespace {
+
+    // Write nevent synthetic events, each with a random number of
+    // tracks below ntrack_max and NAN padding after them
+    double write_profile(const char *filename, HDF5StorageProfile profile, hsize_t nevent, hsize_t ntrack_max, hsize_t row_size)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        H5::H5File file(filename, H5F_ACC_TRUNC);
+        const hsize_t dim_extend[RANK] = { 1, ntrack_max, row_size };
+        H5::DataSpace data_space = hdf5_profile_dataspace(profile, RANK, dim_extend, nevent);
+        H5::DSetCreatPropList property = hdf5_profile_property(profile, RANK, dim_extend);
+        H5::DataSet data_set = file.createDataSet("track", H5::PredType::NATIVE_FLOAT, data_space, property);
+
+        if (profile != HDF5_PROFILE_CONTIGUOUS) {
+            const hsize_t dim_extended[RANK] = { nevent, ntrack_max, row_size };
+
+            data_set.extend(dim_extended);
+        }
+
+        // Write in blocks of events, so the benchmark measures the
+        // reading rather than the writing
+        const hsize_t nevent_block = 1024;
+        std::vector<float> data(nevent_block * ntrack_max * row_size);
+        std::mt19937_64 generator(1);
+        std::uniform_int_distribution<hsize_t> ntrack_distribution(0, ntrack_max / 4);
+        std::normal_distribution<float> value_distribution(0, 1);
+
+        for (hsize_t offset_event = 0; offset_event < nevent; offset_event += nevent_block) {
+            const hsize_t nevent_write = std::min(nevent_block, nevent - offset_event);
+
+            for (hsize_t i = 0; i < nevent_write; i++) {
+                const hsize_t ntrack = ntrack_distribution(generator);
+
+                for (hsize_t j = 0; j < ntrack_max; j++) {
+                    for (hsize_t k = 0; k < row_size; k++) {
+                        data[(i * ntrack_max + j) * row_size + k] = j < ntrack ? value_distribution(generator) : NAN;
+                    }
+                }
+            }
+
+            const hsize_t offset[RANK] = { offset_event, 0, 0 };
+            const hsize_t count[RANK] = { nevent_write, ntrack_max, row_size };
+            H5::DataSpace file_space = data_set.getSpace();
+
+            file_space.selectHyperslab(H5S_SELECT_SET, count, offset);
+
+            H5::DataSpace memory_space(RANK, count, NULL);
+
+            data_set.write(&data[0], H5::PredType::NATIVE_FLOAT, memory_space, file_space);
+        }
+
+        file.close();
+
+        return benchmark_seconds_since(start);
+    }
+
+    // Read nread random single events, returning the time taken
+    double read_random(const char *filename, bool cached, hsize_t nread)
+    {
+        H5::H5File file(filename, H5F_ACC_RDONLY);
+        H5::DataSet data_set = cached ?
+            hdf5_open_dataset_cached(file, "track") : file.openDataSet("track");
+        H5::DataSpace file_space = data_set.getSpace();
+        hsize_t dim[RANK];
+
+        file_space.getSimpleExtentDims(dim, NULL);
+
+        const hsize_t count[RANK] = { 1, dim[1], dim[2] };
+        H5::DataSpace memory_space(RANK, count, NULL);
+        std::vector<float> data(dim[1] * dim[2]);
+        std::mt19937_64 generator(2);
+        std::uniform_int_distribution<hsize_t> event_distribution(0, dim[0] - 1);
+        double checksum = 0;
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (hsize_t i = 0; i < nread; i++) {
+            const hsize_t offset[RANK] = { event_distribution(generator), 0, 0 };
+
+            file_space.selectHyperslab(H5S_SELECT_SET, count, offset);
+            data_set.read(&data[0], H5::PredType::NATIVE_FLOAT, memory_space, file_space);
+            checksum += std::isnan(data[0]) ? 0 : data[0];
+        }
+
+        const double elapsed = benchmark_seconds_since(start);
+
+        // Keep the reads from being optimized away
+        if (checksum == 1e300) {
+            fprintf(stderr, "%f\n", checksum);
+        }
+
+        return elapsed;
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "%s", "Syntax is [scratch directory] [number of events (default 100000)] [number of random reads (default 100000)] [ntrack_max (default 432)]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const hsize_t nevent = argc > 2 ? strtoull(argv[2], NULL, 10) : 100000;
+    const hsize_t nread = argc > 3 ? strtoull(argv[3], NULL, 10) : 100000;
+    // 432 tracks of 10 properties, as in 13d_minbias_0GeVTracks.root
+    const hsize_t ntrack_max = argc > 4 ? strtoull(argv[4], NULL, 10) : 432;
+    const hsize_t row_size = 10;
+
+    const HDF5StorageProfile profiles[] = {
+        HDF5_PROFILE_ARCHIVAL, HDF5_PROFILE_RANDOM, HDF5_PROFILE_CONTIGUOUS
+    };
+
+    fprintf(stdout, "%llu events, %llu tracks x %llu properties, %llu random single-event reads\n",
+            nevent, ntrack_max, row_size, nread);
+    fprintf(stdout, "%-12s %12s %10s %18s %18s\n", "profile", "size (MB)", "write (s)",
+            "default cache (/s)", "sized cache (/s)");
+
+    for (size_t i = 0; i < sizeof(profiles) / sizeof(*profiles); i++) {
+        const std::string filename = std::string(argv[1]) + "/hdf5_profile_benchmark_" +
+            hdf5_profile_name(profiles[i]) + ".hdf5";
+        const double write_time = write_profile(filename.c_str(), profiles[i], nevent, ntrack_max, row_size);
+        struct stat file_stat;
+
+        stat(filename.c_str(), &file_stat);
+
+        const double default_time = read_random(filename.c_str(), false, nread);
+        const double cached_time = read_random(filename.c_str(), true, nread);
+
+        fprintf(stdout, "%-12s %12.1f %10.2f %18.0f %18.0f\n", hdf5_profile_name(profiles[i]),
+                file_stat.st_size / (1024.0 * 1024.0), write_time,
+                nread / default_time, nread / cached_time);
+        remove(filename.c_str());
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+// Benchmark of the track isolation of IsolationGrid.h (the track_cone
+// isolation of GammaJet.cc), per cluster and cone: a loop over every
+// track of the event, as the cone sums would otherwise be taken,
+// against the grid, for cones of R = 0.2, 0.3 and 0.4
+//
+// Synthetic events have a Poisson number of tracks, uniform in
+// |eta| < 0.9 and phi, with a falling pT spectrum and random
+// track_quality bits, and a Poisson number of clusters in the EMCal
+// acceptance (GammaJet.cc takes the isolation of every cluster). The
+// grid time includes building the grid of each event, so the grid
+// gains with the number of cones per event. Both methods must give
+// the same sums
+//
+// Built by the Makefile: make isolation_grid_benchmark
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Benchmark.h"
+#include "IsolationGrid.h"
+
+namespace {
+
+    struct Event {
+        std::vector<float> track_pt;
+        std::vector<float> track_eta;
+        std::vector<float> track_phi;
+        std::vector<unsigned char> track_quality;
+        std::vector<float> cluster_eta;
+        std::vector<float> cluster_phi;
+    };
+
+    std::vector<Event> make_events(size_t nevent, double ntrack_mean, double ncluster_mean)
+    {
+        std::mt19937_64 generator(1);
+        std::poisson_distribution<int> ntrack_distribution(ntrack_mean);
+        std::poisson_distribution<int> ncluster_distribution(ncluster_mean);
+        std::uniform_real_distribution<float> eta_distribution(-0.9, 0.9);
+        std::uniform_real_distribution<float> phi_distribution(0, 2 * M_PI);
+        std::uniform_real_distribution<float> cluster_eta_distribution(-0.67, 0.67);
+        std::uniform_real_distribution<float> cluster_phi_distribution(1.4, 3.3);
+        std::uniform_int_distribution<int> quality_distribution(0, 255);
+        // pT^-5 above 0.15 GeV
+        std::uniform_real_distribution<double> uniform(0, 1);
+        std::vector<Event> events(nevent);
+
+        for (size_t ievent = 0; ievent < nevent; ievent++) {
+            Event &event = events[ievent];
+            const int ntrack = ntrack_distribution(generator);
+            const int ncluster = ncluster_distribution(generator);
+
+            for (int itrack = 0; itrack < ntrack; itrack++) {
+                event.track_pt.push_back(0.15 * std::pow(1 - uniform(generator), -1.0 / 4));
+                event.track_eta.push_back(eta_distribution(generator));
+                event.track_phi.push_back(phi_distribution(generator));
+                event.track_quality.push_back(quality_distribution(generator));
+            }
+            for (int icluster = 0; icluster < ncluster; icluster++) {
+                event.cluster_eta.push_back(cluster_eta_distribution(generator));
+                event.cluster_phi.push_back(cluster_phi_distribution(generator));
+            }
+        }
+
+        return events;
+    }
+
+    double isolate_loop(const std::vector<Event> &events, unsigned int mask, double pt_min, const double *radii, int nradius,
+                        std::vector<double> &sums)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t ievent = 0; ievent < events.size(); ievent++) {
+            const Event &event = events[ievent];
+
+            for (size_t icluster = 0; icluster < event.cluster_eta.size(); icluster++) {
+                const double phi = isolation_grid_wrap(event.cluster_phi[icluster]);
+
+                for (int r = 0; r < nradius; r++) {
+                    double sum = 0;
+
+                    for (size_t itrack = 0; itrack < event.track_pt.size(); itrack++) {
+                        if (!(event.track_pt[itrack] > pt_min) || (event.track_quality[itrack] & mask) == 0) {
+                            continue;
+                        }
+
+                        const double deta = event.track_eta[itrack] - event.cluster_eta[icluster];
+                        double dphi = std::fabs(isolation_grid_wrap(event.track_phi[itrack]) - phi);
+
+                        if (dphi > M_PI) {
+                            dphi = 2 * M_PI - dphi;
+                        }
+                        if (deta * deta + dphi * dphi < radii[r] * radii[r]) {
+                            sum += event.track_pt[itrack];
+                        }
+                    }
+                    sums.push_back(sum);
+                }
+            }
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+    double isolate_grid(const std::vector<Event> &events, unsigned int mask, double pt_min, const double *radii, int nradius,
+                        std::vector<double> &sums)
+    {
+        IsolationGrid grid = isolation_grid(0.9, 0.05, pt_min, &mask, 1);
+        std::vector<double> cone(nradius);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (size_t ievent = 0; ievent < events.size(); ievent++) {
+            const Event &event = events[ievent];
+            const unsigned int ntrack = event.track_pt.size();
+
+            if (ntrack > 0) {
+                isolation_grid_build(grid, ntrack, &event.track_pt[0], &event.track_eta[0], &event.track_phi[0],
+                                     &event.track_quality[0]);
+            }
+            else {
+                isolation_grid_build(grid, 0, NULL, NULL, NULL, NULL);
+            }
+            for (size_t icluster = 0; icluster < event.cluster_eta.size(); icluster++) {
+                isolation_grid_cones(grid, 0, event.cluster_eta[icluster], event.cluster_phi[icluster], radii, nradius, &cone[0]);
+                sums.insert(sums.end(), cone.begin(), cone.end());
+            }
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t nevent = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+    // Mean number of tracks per event; a few hundred in central p-Pb collisions
+    const double ntrack_mean = argc > 2 ? atof(argv[2]) : 200;
+    const double ncluster_mean = argc > 3 ? atof(argv[3]) : 10;
+    // The TrackCutBit of GammaJet.cc
+    const unsigned int mask = 16;
+    const double pt_min = 0.15;
+    const double radii[] = { 0.2, 0.3, 0.4 };
+    const int nradius = sizeof(radii) / sizeof(*radii);
+
+    const std::vector<Event> events = make_events(nevent, ntrack_mean, ncluster_mean);
+    std::vector<double> sums_loop;
+    std::vector<double> sums_grid;
+
+    const double loop_time = isolate_loop(events, mask, pt_min, radii, nradius, sums_loop);
+    const double grid_time = isolate_grid(events, mask, pt_min, radii, nradius, sums_grid);
+
+    double max_difference = 0;
+
+    for (size_t i = 0; i < sums_loop.size() && i < sums_grid.size(); i++) {
+        max_difference = std::max(max_difference, std::fabs(sums_loop[i] - sums_grid[i]));
+    }
+
+    fprintf(stdout, "%lu events, %.0f tracks and %.0f clusters per event on average, %lu cones (R = 0.2, 0.3, 0.4)\n",
+            nevent, ntrack_mean, ncluster_mean, sums_loop.size());
+    benchmark_table_header("cones (/s)");
+    benchmark_table_row("loop", loop_time, sums_loop.size() / loop_time);
+    benchmark_table_row("grid", grid_time, sums_grid.size() / grid_time);
+
+    if (sums_grid.size() != sums_loop.size() || !(max_difference < 1e-9)) {
+        fprintf(stderr, "%s:%d: the grid cone sums differ from those of the loop\n", __FILE__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+// Benchmark of the shower-shape network of ShowerNet.h (the DNN_local
+// photon_idvar of GammaJet.cc), per cluster: the batched evaluation of
+// shower_net_event against a plain loop, one cluster and one weight at
+// a time, over the same windows
+//
+// A random network of the given window and hidden layer sizes, with a
+// softmax of 2 outputs, is written to a file and read back, so that
+// the reader is exercised too. Synthetic events have a Poisson number
+// of clusters at random cells of the 17664, over random cell
+// energies. The two evaluations must agree to float rounding
+//
+// Built by the Makefile: make shower_net_benchmark
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Benchmark.h"
+#include "ShowerNet.h"
+
+namespace {
+
+    void write_network(const char *filename, int window, int nhidden1, int nhidden2)
+    {
+        std::mt19937_64 generator(1);
+        FILE *file = fopen(filename, "w");
+
+        if (file == NULL) {
+            fprintf(stderr, "%s:%d: cannot write %s\n", __FILE__, __LINE__, filename);
+            exit(EXIT_FAILURE);
+        }
+
+        const int width[] = { window * window, nhidden1, nhidden2, 2 };
+        const char *activation[] = { "relu", "relu", "softmax" };
+
+        fprintf(file, "# Random network of shower_net_benchmark\nwindow %d\nnormalization cluster_e\noutput 1\n", window);
+        for (int l = 0; l < 3; l++) {
+            // Weights of the size that keeps the activations of order one
+            std::normal_distribution<double> weight_distribution(0, 1 / std::sqrt(double(width[l])));
+
+            fprintf(file, "layer %d %d %s\n", width[l], width[l + 1], activation[l]);
+            for (int k = 0; k < width[l] * width[l + 1] + width[l + 1]; k++) {
+                fprintf(file, "%.7g%c", weight_distribution(generator), k % 16 == 15 ? '\n' : ' ');
+            }
+            fprintf(file, "\n");
+        }
+        fclose(file);
+    }
+
+    double evaluate_batched(const ShowerNet &net, const EMCalGeometry &geometry, const std::vector<float> &cell_e,
+                            const std::vector<unsigned int> &ncluster, const std::vector<unsigned short> &cell_id_max,
+                            const std::vector<float> &cluster_e, std::vector<float> &scores)
+    {
+        ShowerNetWork work;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t first = 0;
+
+        for (size_t ievent = 0; ievent < ncluster.size(); ievent++) {
+            shower_net_event(net, geometry, ncluster[ievent], &cell_e[(ievent % 16) * EMCAL_NCELL],
+                             &cell_id_max[first], &cluster_e[first], &scores[first], work);
+            first += ncluster[ievent];
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+    double evaluate_loop(const ShowerNet &net, const EMCalGeometry &geometry, const std::vector<float> &cell_e,
+                         const std::vector<unsigned int> &ncluster, const std::vector<unsigned short> &cell_id_max,
+                         const std::vector<float> &cluster_e, std::vector<float> &scores)
+    {
+        std::vector<float> input(net.max_width);
+        std::vector<float> output(net.max_width);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t n = 0;
+
+        for (size_t ievent = 0; ievent < ncluster.size(); ievent++) {
+            for (unsigned int icluster = 0; icluster < ncluster[ievent]; icluster++, n++) {
+                shower_net_window(geometry, net.window, &cell_e[(ievent % 16) * EMCAL_NCELL], cell_id_max[n],
+                                  1 / cluster_e[n], &input[0], 1);
+                for (size_t l = 0; l < net.layers.size(); l++) {
+                    const ShowerNetLayer &layer = net.layers[l];
+
+                    for (int o = 0; o < layer.nout; o++) {
+                        float sum = layer.bias[o];
+
+                        for (int i = 0; i < layer.nin; i++) {
+                            sum += layer.weight[o * layer.nin + i] * input[i];
+                        }
+                        output[o] = layer.activation == SHOWERNET_RELU ? std::max(sum, 0.0f) : sum;
+                    }
+                    if (layer.activation == SHOWERNET_SOFTMAX) {
+                        const float max = *std::max_element(output.begin(), output.begin() + layer.nout);
+                        float total = 0;
+
+                        for (int o = 0; o < layer.nout; o++) {
+                            total += (output[o] = std::exp(output[o] - max));
+                        }
+                        for (int o = 0; o < layer.nout; o++) {
+                            output[o] /= total;
+                        }
+                    }
+                    std::swap(input, output);
+                }
+                scores[n] = input[net.output];
+            }
+        }
+
+        return benchmark_seconds_since(start);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t nevent = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000;
+    const double ncluster_mean = argc > 2 ? atof(argv[2]) : 20;
+    const int window = argc > 3 ? atoi(argv[3]) : 7;
+    const int nhidden1 = argc > 4 ? atoi(argv[4]) : 64;
+    const int nhidden2 = argc > 5 ? atoi(argv[5]) : 32;
+    const char *filename = "shower_net_benchmark.txt";
+
+    write_network(filename, window, nhidden1, nhidden2);
+
+    const ShowerNet net = shower_net_read(filename);
+    const EMCalGeometry geometry = emcal_geometry();
+
+    // 16 sets of cell energies, reused round robin, with a falling spectrum
+    std::mt19937_64 generator(2);
+    std::exponential_distribution<float> cell_e_distribution(2);
+    std::vector<float> cell_e(16 * EMCAL_NCELL);
+
+    for (size_t k = 0; k < cell_e.size(); k++) {
+        cell_e[k] = cell_e_distribution(generator);
+    }
+
+    std::poisson_distribution<unsigned int> ncluster_distribution(ncluster_mean);
+    std::uniform_int_distribution<int> cell_distribution(0, EMCAL_NCELL - 1);
+    std::uniform_real_distribution<float> cluster_e_distribution(2, 20);
+    std::vector<unsigned int> ncluster(nevent);
+    std::vector<unsigned short> cell_id_max;
+    std::vector<float> cluster_e;
+
+    for (size_t ievent = 0; ievent < nevent; ievent++) {
+        ncluster[ievent] = ncluster_distribution(generator);
+        for (unsigned int icluster = 0; icluster < ncluster[ievent]; icluster++) {
+            cell_id_max.push_back(cell_distribution(generator));
+            cluster_e.push_back(cluster_e_distribution(generator));
+        }
+    }
+
+    const size_t nclusters = cluster_e.size();
+    std::vector<float> scores_batched(nclusters);
+    std::vector<float> scores_loop(nclusters);
+
+    const double batched_time = evaluate_batched(net, geometry, cell_e, ncluster, cell_id_max, cluster_e, scores_batched);
+    const double loop_time = evaluate_loop(net, geometry, cell_e, ncluster, cell_id_max, cluster_e, scores_loop);
+
+    double max_difference = 0;
+
+    for (size_t n = 0; n < nclusters; n++) {
+        max_difference = std::max(max_difference, double(std::fabs(scores_batched[n] - scores_loop[n])));
+    }
+
+    fprintf(stdout, "%lu events, %lu clusters, network %dx%d -> %d -> %d -> 2\n",
+            nevent, nclusters, window, window, nhidden1, nhidden2);
+    benchmark_table_header("clusters (/ms)");
+    benchmark_table_row("loop", loop_time, nclusters / loop_time / 1000);
+    benchmark_table_row("batched", batched_time, nclusters / batched_time / 1000);
+    fprintf(stdout, "largest score difference %.3g\n", max_difference);
+
+    remove(filename);
+
+    if (!(max_difference < 1e-4)) {
+        fprintf(stderr, "%s:%d: the batched scores differ from those of the loop\n", __FILE__, __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+// Combine per-run HDF5 mixing pools written by to_hdf5.cc (13d, 13e,
+// 13f, 17q, ...) into one pool, without copying any event data
+//
+// The output file holds HDF5 Virtual Datasets (VDS) named like the
+// inputs, "event", "track", "cluster" and "jet", that concatenate the
+// per-run datasets along the event index. mixed_cluster_jet.cc and
+// PlotHDF5.cc read them like any other pool. Runs with a smaller
+// ntrack_max (ncluster_max, njet_max) than the largest one read back
+// with the usual NAN padding, through the fill value of the VDS.
+//
+// The "event_index" dataset maps every global event index to (input
+// number, event index within that input), in the order the inputs
+// were given; the input file names are stored in the "source_file"
+// attribute.
+//
+// The inputs are referenced by the paths given on the command line, so
+// use absolute paths (or paths relative to where the readers will
+// run). Re-running with another list of inputs re-combines the pools
+// instantly. Requires HDF5 1.10 or later (Virtual Dataset support).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <H5Cpp.h>
+
+#if !H5_VERSION_GE(1, 10, 0)
+#error "stitch_hdf5 requires HDF5 1.10 or later (Virtual Dataset support)"
+#endif
+
+namespace {
+
+    // The dimensions of a dataset in an input pool, or an empty vector
+    // if the input does not have it
+    std::vector<hsize_t> source_dimension(const char *filename, const char *dataset_name)
+    {
+        std::vector<hsize_t> dim;
+        hid_t file = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+
+        if (file < 0) {
+            fprintf(stderr, "%s:%d: cannot open %s\n", __FILE__, __LINE__, filename);
+            exit(EXIT_FAILURE);
+        }
+        if (H5Lexists(file, dataset_name, H5P_DEFAULT) > 0) {
+            hid_t dataset = H5Dopen2(file, dataset_name, H5P_DEFAULT);
+            hid_t space = H5Dget_space(dataset);
+
+            dim.resize(H5Sget_simple_extent_ndims(space));
+            H5Sget_simple_extent_dims(space, &dim[0], NULL);
+            H5Sclose(space);
+            H5Dclose(dataset);
+        }
+        H5Fclose(file);
+
+        return dim;
+    }
+
+    // Create the virtual dataset dataset_name in file, concatenating
+    // dataset_name of all inputs along the first (event) dimension
+    void stitch_dataset(hid_t file, const char *dataset_name, const std::vector<std::string> &source_filename)
+    {
+        std::vector<std::vector<hsize_t> > source_dim;
+        std::vector<hsize_t> dim;
+
+        for (size_t i = 0; i < source_filename.size(); i++) {
+            source_dim.push_back(source_dimension(source_filename[i].c_str(), dataset_name));
+            if (source_dim.back().empty()) {
+                fprintf(stderr, "%s:%d: %s has no dataset %s, not stitching it\n",
+                        __FILE__, __LINE__, source_filename[i].c_str(), dataset_name);
+                return;
+            }
+            if (i > 0 && source_dim.back().size() != dim.size()) {
+                fprintf(stderr, "%s:%d: rank of %s in %s differs from the first input\n",
+                        __FILE__, __LINE__, dataset_name, source_filename[i].c_str());
+                exit(EXIT_FAILURE);
+            }
+            if (i == 0) {
+                dim = source_dim.back();
+                dim[0] = 0;
+            }
+            // Events are concatenated, the other dimensions are the
+            // largest over all inputs (e.g. ntrack_max)
+            dim[0] += source_dim.back()[0];
+            for (size_t j = 1; j < dim.size(); j++) {
+                dim[j] = std::max(dim[j], source_dim.back()[j]);
+            }
+        }
+
+        const int rank = dim.size();
+        hid_t space = H5Screate_simple(rank, &dim[0], NULL);
+        hid_t property = H5Pcreate(H5P_DATASET_CREATE);
+        // Regions not covered by an input (padding of inputs with a
+        // smaller ntrack_max, etc.) read as NAN, as in to_hdf5.cc
+        const float fill_value = NAN;
+
+        H5Pset_fill_value(property, H5T_NATIVE_FLOAT, &fill_value);
+
+        std::vector<hsize_t> offset(rank, 0);
+
+        for (size_t i = 0; i < source_filename.size(); i++) {
+            hid_t source_space = H5Screate_simple(rank, &source_dim[i][0], NULL);
+
+            H5Sselect_hyperslab(space, H5S_SELECT_SET, &offset[0], NULL, &source_dim[i][0], NULL);
+            H5Pset_virtual(property, space, source_filename[i].c_str(), dataset_name, source_space);
+            H5Sclose(source_space);
+            offset[0] += source_dim[i][0];
+        }
+        H5Sselect_all(space);
+
+        hid_t dataset = H5Dcreate2(file, dataset_name, H5T_NATIVE_FLOAT, space,
+                                   H5P_DEFAULT, property, H5P_DEFAULT);
+
+        if (dataset < 0) {
+            fprintf(stderr, "%s:%d: cannot create virtual dataset %s\n", __FILE__, __LINE__, dataset_name);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "%s:%d: %s: %llu events from %lu inputs\n", __FILE__, __LINE__,
+                dataset_name, dim[0], source_filename.size());
+
+        H5Dclose(dataset);
+        H5Pclose(property);
+        H5Sclose(space);
+    }
+
+    // Write the global event index: (input number, event index within
+    // the input) for every event of the stitched pool
+    void write_event_index(hid_t file, const std::vector<std::string> &source_filename)
+    {
+        std::vector<unsigned long long> event_index;
+
+        for (size_t i = 0; i < source_filename.size(); i++) {
+            const std::vector<hsize_t> dim = source_dimension(source_filename[i].c_str(), "event");
+
+            for (hsize_t j = 0; !dim.empty() && j < dim[0]; j++) {
+                event_index.push_back(i);
+                event_index.push_back(j);
+            }
+        }
+
+        const hsize_t dim[2] = { event_index.size() / 2, 2 };
+        hid_t space = H5Screate_simple(2, dim, NULL);
+        hid_t dataset = H5Dcreate2(file, "event_index", H5T_NATIVE_ULLONG, space,
+                                   H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+
+        if (!event_index.empty()) {
+            H5Dwrite(dataset, H5T_NATIVE_ULLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, &event_index[0]);
+        }
+
+        // The input file names, in input-number order
+        std::vector<const char *> name;
+
+        for (size_t i = 0; i < source_filename.size(); i++) {
+            name.push_back(source_filename[i].c_str());
+        }
+
+        const hsize_t nsource = name.size();
+        hid_t name_type = H5Tcopy(H5T_C_S1);
+
+        H5Tset_size(name_type, H5T_VARIABLE);
+
+        hid_t name_space = H5Screate_simple(1, &nsource, NULL);
+        hid_t attribute = H5Acreate2(dataset, "source_file", name_type, name_space,
+                                     H5P_DEFAULT, H5P_DEFAULT);
+
+        H5Awrite(attribute, name_type, &name[0]);
+        H5Aclose(attribute);
+        H5Sclose(name_space);
+        H5Tclose(name_type);
+        H5Dclose(dataset);
+        H5Sclose(space);
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "%s", "Syntax is [per-run hdf5 file] ... [new stitched hdf5 file name]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const std::vector<std::string> source_filename(argv + 1, argv + argc - 1);
+    hid_t file = H5Fcreate(argv[argc - 1], H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+
+    if (file < 0) {
+        fprintf(stderr, "%s:%d: cannot create %s\n", __FILE__, __LINE__, argv[argc - 1]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *dataset_name[] = { "event", "track", "cluster", "jet" };
+
+    for (size_t i = 0; i < sizeof(dataset_name) / sizeof(*dataset_name); i++) {
+        stitch_dataset(file, dataset_name[i], source_filename);
+    }
+    write_event_index(file, source_filename);
+
+    H5Fclose(file);
+
+    return EXIT_SUCCESS;
+}
@@ -4,15 +4,9 @@
 
 #include <H5Cpp.h>
 
-// This is chosen to be the CPU L2 cache size, which should exceed 512
-// kB for many years now
-#ifndef HDF5_DEFAULT_CACHE
-#define HDF5_DEFAULT_CACHE (512 * 1024)
-#endif // HDF5_DEFAULT_CACHE
-
-#ifndef HDF5_USE_DEFLATE
-#define HDF5_USE_DEFLATE
-#endif // HDF5_USE_DEFLATE
+// Storage profiles (archival, random, contiguous) and
+// HDF5_DEFAULT_CACHE
+#include "HDF5Storage.h"
 
 // Rank of the tensor written in HDF5, rank 3 being (index_event,
 // index_track, index_properties)
@@ -52,7 +46,9 @@ void find_ntrack_ncluster_max(char *argv_first[], char *argv_last[], UInt_t &nev
         UInt_t ntrack;
         UInt_t ncluster;
         UInt_t njet_ak04its;
-        nevent_max = UInt_t(hi_tree->GetEntries());
+        // Total over all files, needed up front by the contiguous
+        // profile
+        nevent_max += UInt_t(hi_tree->GetEntries());
 
         hi_tree->SetBranchAddress("ntrack", &ntrack);
         hi_tree->SetBranchAddress("ncluster", &ncluster);
@@ -82,7 +78,7 @@ void write_track_cluster(H5::DataSet &event_data_set, H5::DataSet &track_data_se
              hsize_t *event_offset, hsize_t *offset,
              const hsize_t *event_dim_extend, const hsize_t *track_dim_extend, const hsize_t *cluster_dim_extend, const hsize_t *jet_dim_extend,
              const UInt_t nevent_max, const UInt_t ntrack_max, const UInt_t ncluster_max, const UInt_t njet_max,
-             char *argv_first[], char *argv_last[])
+             const bool extend, char *argv_first[], char *argv_last[])
 {
     for (char **p = argv_first; p != argv_last; p++) {
         TFile *file = TFile::Open(*p);
@@ -224,8 +220,11 @@ void write_track_cluster(H5::DataSet &event_data_set, H5::DataSet &track_data_se
         event_offset[0] + event_dim_extend[0], event_dim_extend[1]
           };
         
-          //Extend to new Dimension
-          event_data_set.extend(event_dim_extended);
+          //Extend to new Dimension, unless the data set already
+          //has space for all events (contiguous profile)
+          if (extend) {
+            event_data_set.extend(event_dim_extended);
+          }
           H5::DataSpace event_file_space = event_data_set.getSpace();
           event_file_space.selectHyperslab(
           H5S_SELECT_SET, event_dim_extend, event_offset);
@@ -261,10 +260,14 @@ void write_track_cluster(H5::DataSet &event_data_set, H5::DataSet &track_data_se
                     jet_dim_extend[2]
                 };
 
-                // Extend to the new dimension
-                track_data_set.extend(track_dim_extended);
-                cluster_data_set.extend(cluster_dim_extended);
-                jet_data_set.extend(jet_dim_extended);
+                // Extend to the new dimension, unless the data sets
+                // already have space for all events (contiguous
+                // profile)
+                if (extend) {
+                    track_data_set.extend(track_dim_extended);
+                    cluster_data_set.extend(cluster_dim_extended);
+                    jet_data_set.extend(jet_dim_extended);
+                }
 
                 // Select the hyperslab that only encompass the
                 // difference from extending the data space (i.e. the
@@ -318,10 +321,25 @@ void write_track_cluster(H5::DataSet &event_data_set, H5::DataSet &track_data_se
 int main(int argc, char *argv[])
 {
     if (argc < 3) {
-      fprintf(stderr, "%s", "Syntax is [root_file] [new hdf5 file name]");
+      fprintf(stderr, "%s", "Syntax is [--profile archival|random|contiguous] [root_file] [new hdf5 file name]\n");
         exit(EXIT_FAILURE);
     }
 
+    // Storage profile, see HDF5Storage.h. The default, archival,
+    // matches the previous deflate-only files plus byte shuffling
+    HDF5StorageProfile profile = HDF5_PROFILE_ARCHIVAL;
+
+    if (strcmp(argv[1], "--profile") == 0) {
+        if (argc < 5) {
+            fprintf(stderr, "%s", "Syntax is [--profile archival|random|contiguous] [root_file] [new hdf5 file name]\n");
+            exit(EXIT_FAILURE);
+        }
+        profile = parse_hdf5_profile(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    fprintf(stderr, "%s:%d: storage profile %s\n", __FILE__, __LINE__, hdf5_profile_name(profile));
+
     //UInt_t ntrack_max = 1927 ;
     
     // hard-coded values for 13d_minbias_0GeVTracks.root
@@ -356,98 +374,20 @@ int main(int argc, char *argv[])
     hsize_t cluster_dim_extend[RANK] = { 1, ncluster_max, cluster_row_size };
     hsize_t jet_dim_extend[RANK] = { 1, njet_max, jet_row_size };
 
-    // The maximum tensor dimension, for unlimited number of events
-    hsize_t event_dim_max[Event_RANK] = {H5S_UNLIMITED, event_row_size};
-    hsize_t track_dim_max[RANK] = { H5S_UNLIMITED, ntrack_max, track_row_size };
-    hsize_t cluster_dim_max[RANK] = { H5S_UNLIMITED, ncluster_max, cluster_row_size };
-    hsize_t jet_dim_max[RANK] = { H5S_UNLIMITED, njet_max, jet_row_size };
-
-    // The extensible HDF5 data space
-    H5::DataSpace event_data_space(Event_RANK, event_dim_extend, event_dim_max);
-    H5::DataSpace track_data_space(RANK, track_dim_extend, track_dim_max);
-    H5::DataSpace cluster_data_space(RANK, cluster_dim_extend, cluster_dim_max);
-    H5::DataSpace jet_data_space(RANK, jet_dim_extend, jet_dim_max);
+    // The HDF5 data spaces: extensible for the chunked profiles,
+    // allocated for all nevent_max events for the contiguous profile
+    H5::DataSpace event_data_space = hdf5_profile_dataspace(profile, Event_RANK, event_dim_extend, nevent_max);
+    H5::DataSpace track_data_space = hdf5_profile_dataspace(profile, RANK, track_dim_extend, nevent_max);
+    H5::DataSpace cluster_data_space = hdf5_profile_dataspace(profile, RANK, cluster_dim_extend, nevent_max);
+    H5::DataSpace jet_data_space = hdf5_profile_dataspace(profile, RANK, jet_dim_extend, nevent_max);
     //might need two data_spaces: track_data_space & cluster_data_space
 
-
-    // To enable zlib compression (there will be many NANs) and
-    // efficient chunking (splitting of the tensor into contingous
-    // hyperslabs), a HDF5 property list is needed
-    H5::DSetCreatPropList event_property = H5::DSetCreatPropList();
-    H5::DSetCreatPropList track_property = H5::DSetCreatPropList();
-    H5::DSetCreatPropList cluster_property = H5::DSetCreatPropList();
-    H5::DSetCreatPropList jet_property = H5::DSetCreatPropList();
-
-#ifdef HDF5_USE_DEFLATE
-    // Check for zlib (deflate) availability and enable only if
-    // present
-    if (!H5Zfilter_avail(H5Z_FILTER_DEFLATE)) {
-        fprintf(stderr, "%s:%d: warning: deflate filter not "
-                "available\n", __FILE__, __LINE__);
-    }
-    else {
-        unsigned int filter_info;
-
-        H5Zget_filter_info(H5Z_FILTER_DEFLATE, &filter_info);
-        if (!(filter_info & H5Z_FILTER_CONFIG_ENCODE_ENABLED)) {
-            fprintf(stderr, "%s:%d: warning: deflate filter not "
-                    "available for encoding\n", __FILE__, __LINE__);
-        }
-        else {
-            event_property.setDeflate(1);
-            track_property.setDeflate(1);
-            cluster_property.setDeflate(1);
-            jet_property.setDeflate(1);
-        }
-    }
-#endif // HDF5_USE_DEFLATE
-
-    // Activate chunking, while observing the HDF5_DEFAULT_CACHE being
-    // the CPU L2 cache size
-    hsize_t event_dim_chunk[Event_RANK] = {
-        std::max(static_cast<unsigned long long>(1),
-                 HDF5_DEFAULT_CACHE /
-                 std::max(static_cast<unsigned long long>(1),
-                          event_dim_extend[0]*
-                          sizeof(float))),
-        event_dim_extend[1]
-    };
-    
-
-    hsize_t track_dim_chunk[RANK] = {
-        std::max(static_cast<unsigned long long>(1),
-                 HDF5_DEFAULT_CACHE /
-                 std::max(static_cast<unsigned long long>(1),
-                          track_dim_extend[1] * track_dim_extend[2] *
-                          sizeof(float))),
-        track_dim_extend[1],
-        track_dim_extend[2]
-    };
-
-    hsize_t cluster_dim_chunk[RANK] = {
-        std::max(static_cast<unsigned long long>(1),
-                 HDF5_DEFAULT_CACHE /
-                 std::max(static_cast<unsigned long long>(1),
-                          cluster_dim_extend[1] * cluster_dim_extend[2] *
-                          sizeof(float))),
-        cluster_dim_extend[1],
-        cluster_dim_extend[2]
-    };
-
-    hsize_t jet_dim_chunk[RANK] = {
-        std::max(static_cast<unsigned long long>(1),
-                 HDF5_DEFAULT_CACHE /
-                 std::max(static_cast<unsigned long long>(1),
-                          jet_dim_extend[1] * jet_dim_extend[2] *
-                          sizeof(float))),
-        jet_dim_extend[1],
-        jet_dim_extend[2]
-    };
-
-    event_property.setChunk(Event_RANK, event_dim_chunk);
-    track_property.setChunk(RANK, track_dim_chunk);
-    cluster_property.setChunk(RANK, cluster_dim_chunk);
-    jet_property.setChunk(RANK, jet_dim_chunk);
+    // Chunking and compression (there will be many NANs) are set by
+    // the profile through the HDF5 property list
+    H5::DSetCreatPropList event_property = hdf5_profile_property(profile, Event_RANK, event_dim_extend);
+    H5::DSetCreatPropList track_property = hdf5_profile_property(profile, RANK, track_dim_extend);
+    H5::DSetCreatPropList cluster_property = hdf5_profile_property(profile, RANK, cluster_dim_extend);
+    H5::DSetCreatPropList jet_property = hdf5_profile_property(profile, RANK, jet_dim_extend);
 
     // Create the data set, which will have space for the first event
     H5::DataSet event_data_set =
@@ -471,7 +411,8 @@ int main(int argc, char *argv[])
 
     write_track_cluster(event_data_set, track_data_set, cluster_data_set, jet_data_set,
             event_offset, offset, event_dim_extend, track_dim_extend, cluster_dim_extend, jet_dim_extend,
-            nevent_max, ntrack_max, ncluster_max, njet_max, argv + 1, argv + argc - 1);
+            nevent_max, ntrack_max, ncluster_max, njet_max,
+            profile != HDF5_PROFILE_CONTIGUOUS, argv + 1, argv + argc - 1);
 
     file.close();
 
@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <math.h>
+#include "../../../general_tools/TruthIndex.h"
 
 
 
@@ -174,6 +175,7 @@ int main(int argc, char *argv[])
     Float_t mc_truth_first_parent_eta[NTRACK_MAX];
     Float_t mc_truth_first_parent_phi[NTRACK_MAX];
     UChar_t mc_truth_status[NTRACK_MAX];
+    TruthIndex truth = truth_index(NTRACK_MAX);
  
     _tree_event->SetBranchAddress("primary_vertex", primary_vertex);
     _tree_event->SetBranchAddress("ntrack", &ntrack);
@@ -214,6 +216,7 @@ int main(int argc, char *argv[])
     for(Long64_t ievent = 0; ievent < _tree_event->GetEntries() ; ievent++){     
       // for(Long64_t ievent = 0; ievent < 1000 ; ievent++){
       _tree_event->GetEntry(ievent);
+      truth_index_build(truth, nmc_truth, mc_truth_pdg_code, mc_truth_first_parent_pdg_code, mc_truth_status);
       for (ULong64_t n = 0; n < ncluster; n++) {
 	//event selection
 	if(TMath::Abs(primary_vertex[2])>10) continue;
@@ -225,39 +228,10 @@ int main(int argc, char *argv[])
 	if(cluster_e_cross[n]/cluster_e[n]<0.05) continue;
               
 	//std::cout << " cluster pt " << cluster_pt[n] << " NN output " << cluster_s_nphoton[n][2] << std::endl;
-	int nphotons_pi0 = 0;
-	int nphotons_eta = 0;
-	int nelectrons_convertion = 0;
-	unsigned short index_temp = 65535;
-	unsigned short index_temp_e = 65535;
-
-	for(int counter = 0 ; counter<32; counter++)
-	  {
-	    unsigned short index = cluster_mc_truth_index[n][counter];
-	    if(index!=65535){
-	      //if (mc_truth_first_parent_pdg_code[index]==22) continue;
-	      // std::cout << "reco pt" << cluster_pt[n] << " true pt " << mc_truth_pt[index] << " pdgcode:" << mc_truth_pdg_code[index] << "  parent pdg:" << mc_truth_first_parent_pdg_code[index] << " first parent:" << mc_truth_first_parent_pt[index] << std::endl;
-                   
-
-
-	      if(mc_truth_pdg_code[index]==22){
-		if(mc_truth_first_parent_pdg_code[index]==111 && index!=index_temp){
-		  nphotons_pi0 += 1;
-		  index_temp = index; 
-		}
-		else if(mc_truth_first_parent_pdg_code[index]==221){
-		  nphotons_eta +=1;
-		}               
-	      }
-	      else if(mc_truth_pdg_code[index]==11){
-		if(mc_truth_first_parent_pdg_code[index]==22 && index!=index_temp_e){
-		  nelectrons_convertion +=1;
-		  index_temp_e = index;
-		}
-	      }
-               
-	    }
-	  }//end loop on indices
+	// truth particles of the cluster by class
+	const int nphotons_pi0 = truth_index_count(truth, TRUTH_PI0_PHOTON, cluster_mc_truth_index[n]);
+	const int nphotons_eta = truth_index_count(truth, TRUTH_ETA_PHOTON, cluster_mc_truth_index[n]);
+	const int nelectrons_convertion = truth_index_count(truth, TRUTH_CONVERSION_ELECTRON, cluster_mc_truth_index[n]);
 
 	//std::cout << " truth photons from pi0 " << nphotons_pi0 << "; from eta " << nphotons_eta << " electrons from conv" << nelectrons_convertion << std::endl;
 	//std::cout << std::endl;
@@ -322,7 +296,7 @@ int main(int argc, char *argv[])
          
       //loop over truth particles
       for (ULong64_t nmc = 0; nmc < nmc_truth; nmc++) {
-	if(mc_truth_pdg_code[nmc]==22 &&  mc_truth_first_parent_pdg_code[nmc]==111){
+	if(truth_index_is(truth, TRUTH_PI0_PHOTON, nmc)){
 	  //std::cout << " pdg " << mc_truth_pdg_code[nmc] <<  " eta " << mc_truth_eta[nmc] << " " << mc_truth_first_parent_pdg_code[nmc] << 
 	  //  " " << mc_truth_pt[nmc] << " parent " << mc_truth_first_parent_pt[nmc] << std::endl; 
 	  if(TMath::Abs(mc_truth_eta[nmc])>0.6) continue;
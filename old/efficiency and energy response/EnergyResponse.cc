@@ -20,6 +20,7 @@
 
 #include <vector>
 #include <math.h>
+#include "../../general_tools/TruthIndex.h"
 
 int main(int argc, char *argv[])
 {
@@ -101,6 +102,7 @@ int main(int argc, char *argv[])
         Float_t mc_truth_first_parent_eta[NTRACK_MAX];
         Float_t mc_truth_first_parent_phi[NTRACK_MAX];
         UChar_t mc_truth_status[NTRACK_MAX];
+        TruthIndex truth = truth_index(NTRACK_MAX);
         
         
         // Set the branch addresses of the branches in the TTrees
@@ -135,12 +137,15 @@ int main(int argc, char *argv[])
         _tree_event->SetBranchAddress("mc_truth_pt", mc_truth_pt);
         _tree_event->SetBranchAddress("mc_truth_phi", mc_truth_phi);
         _tree_event->SetBranchAddress("mc_truth_eta", mc_truth_eta);
+        _tree_event->SetBranchAddress("mc_truth_first_parent_pdg_code", mc_truth_first_parent_pdg_code);
+        _tree_event->SetBranchAddress("mc_truth_status", mc_truth_status);
         
         
         // Loop over events
         for(Long64_t ievent = 0; ievent < _tree_event->GetEntries() ; ievent++){
             //for(Long64_t ievent = 0; ievent < 1000 ; ievent++){
             _tree_event->GetEntry(ievent);
+            truth_index_build(truth, nmc_truth, mc_truth_pdg_code, mc_truth_first_parent_pdg_code, mc_truth_status);
             
             double n_generated = 0;
             double n_detected = 0;
@@ -162,14 +167,13 @@ int main(int argc, char *argv[])
                 for(int counter = 0 ; counter<32; counter++){
                     unsigned short index = cluster_mc_truth_index[n][counter];
                     
-                    if(index!=65535)
-                        if(mc_truth_pt[index]>10)
-                            if(mc_truth_pdg_code[index]==22){
-                                if (mc_truth_pt[index] > generatedpT)
-                                    generatedpT = mc_truth_pt[index];
-                                
-                                n_generated++;
-                            }
+                    if(truth_index_is(truth, TRUTH_PHOTON, index))
+                        if(mc_truth_pt[index]>10){
+                            if (mc_truth_pt[index] > generatedpT)
+                                generatedpT = mc_truth_pt[index];
+                            
+                            n_generated++;
+                        }
                 }
                 
             }//end loop on clusters
@@ -18,6 +18,8 @@
 
 #include <vector>
 #include <math.h>
+#include "../../general_tools/HistogramAlgebra.h"
+#include "../../general_tools/TruthIndex.h"
 
 const int MAX_INPUT_LENGTH = 200;
 
@@ -59,35 +61,9 @@ TH1D* divide_histograms1D(TH1D* graph1, TH1D* graph2){
 // 2D histogram dividing function
 // Precondition: the two histograms must have the same y- and x-dimensions
 TH2D* divide_histograms2D(TH2D* graph1, TH2D* graph2){
-    // Make the 2D histogram to contain the quotient and find minimum and maximum bins along both axes
+    // Make the 2D histogram to contain the quotient, then divide graph 1 by graph 2 with error propagation
     TH2D* quotient = new TH2D(*graph1);
-    double x_bin_min = quotient->GetXaxis()->FindBin(quotient->GetXaxis()->GetXmin());
-    double x_bin_max = quotient->GetXaxis()->FindBin(quotient->GetXaxis()->GetXmax());
-    double y_bin_min = quotient->GetYaxis()->FindBin(quotient->GetYaxis()->GetXmin());
-    double y_bin_max = quotient->GetYaxis()->FindBin(quotient->GetYaxis()->GetXmax());
-    
-    // Loop over all bins, divide the element from graph 1 by its counterpart on graph 2. Manually propogate the error
-    for(int i = x_bin_min; i <= x_bin_max; i++)
-        for(int j = y_bin_min; j <= y_bin_max; j++) {
-            if (graph2->GetBinContent(i, j) != 0)
-                quotient->SetBinContent(i, j, (graph1->GetBinContent(i, j))/(graph2->GetBinContent(i, j)));
-            // Failsafe
-            else
-                quotient->SetBinContent(i, j, 0);
-            
-            // Error propogation
-            if (graph2->GetBinContent(i, j) == 0) {
-                if (graph1->GetBinContent(i, j) == 0)
-                    quotient->SetBinError(i, j, 0);
-                else
-                    quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) * (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) ) )));
-            }
-            else if (graph1->GetBinContent(i, j) == 0)
-                quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) * (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) ) )));
-            else
-                quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) * (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) ) + ( (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) * (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) ) )));
-        }
-    
+    hist_divide(quotient, graph1, graph2);
     
     return quotient;
 }
@@ -179,6 +155,7 @@ int main(int argc, char *argv[])
         short mc_truth_first_parent_pdg_code[NTRACK_MAX];
         char mc_truth_charge[NTRACK_MAX];
         UChar_t mc_truth_status[NTRACK_MAX];
+        TruthIndex truth = truth_index(NTRACK_MAX);
         
         Float_t mc_truth_first_parent_e[NTRACK_MAX];
         Float_t mc_truth_first_parent_pt[NTRACK_MAX];
@@ -236,6 +213,7 @@ int main(int argc, char *argv[])
         for(Long64_t ievent = 0; ievent < _tree_event->GetEntries() ; ievent++){
             //for(Long64_t ievent = 0; ievent < 1000 ; ievent++){
             _tree_event->GetEntry(ievent);
+            truth_index_build(truth, nmc_truth, mc_truth_pdg_code, mc_truth_first_parent_pdg_code, mc_truth_status);
             
             // Weight the event by simulation pT bin
             double weight = 1.0;
@@ -259,27 +237,14 @@ int main(int argc, char *argv[])
                 if( not(cluster_lambda_square[n][0]<0.27)) continue;
                 
                 // Truth-matching cut
-                Bool_t isTruePhoton = false;
-                //Float_t truth_pt = -999.0;
-                for(int counter = 0 ; counter<32; counter++){
-                    unsigned short index = cluster_mc_truth_index[n][counter];
-                    
-                    if(isTruePhoton) break;
-                    if(index==65535) continue;
-                    //std::cout<<"truth, pt: " << mc_truth_pt[index] << "phi " << mc_truth_phi[index] << " eta " << mc_truth_eta[index] << " code: " << mc_truth_pdg_code[index] << " status " << int(mc_truth_status[index]) << " parentpdg " << mc_truth_first_parent_pdg_code[index] << std::endl;
-                    if(mc_truth_pdg_code[index]!=22) continue;
-                    if(mc_truth_first_parent_pdg_code[index]!=22) continue;
-                    if( not (mc_truth_status[index] >0)) continue;
-                    isTruePhoton = true;
-                    //truth_pt = mc_truth_pt[index];
-                }//end loop over indices
+                Bool_t isTruePhoton = truth_index_first(truth, TRUTH_PROMPT_PHOTON, cluster_mc_truth_index[n]) >= 0;
                 
                 // Fill the measured histogram bins
                 if(isTruePhoton){
                     double phi = cluster_phi[n]/(TMath::Pi());
                     while(phi < 1.2)
                         phi += 2;
-                    while (phi > 3.2)1
+                    while (phi > 3.2)
                         phi -= 2;
                     double eta = cluster_eta[n];
                     if(TMath::Abs(eta) > 0.7) continue;
@@ -297,7 +262,7 @@ int main(int argc, char *argv[])
                 // Apply cuts
                 
                 //std::cout << mc_truth_pt[m] << "phi " << mc_truth_phi[m] << " eta " << mc_truth_eta[m] << " code: " << mc_truth_pdg_code[m] << " status " << int(mc_truth_status[m]) << " parentpdg " << mc_truth_first_parent_pdg_code[m] << std::endl;
-                if( not(mc_truth_pdg_code[m]==22 && int(mc_truth_status[m])>0 &&  mc_truth_first_parent_pdg_code[m]==22))
+                if( not(truth_index_is(truth, TRUTH_PROMPT_PHOTON, m)))
                     {mctruths_rejected++;  continue; }
                 mctruths_accepted++;
                 
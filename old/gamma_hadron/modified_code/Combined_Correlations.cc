@@ -15,6 +15,9 @@
 #include <iostream>
 #include <fstream>
 #include "H5Cpp.h"
+#include "../../../general_tools/HistogramAlgebra.h"
+#include "../../../general_tools/EtaPhiGrid.h"
+#include "../../../general_tools/BinLookup.h"
 
 #define NTRACK_MAX (1U << 14)
 
@@ -27,40 +30,23 @@ enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_
 
 using namespace H5;
 
+// A track of a mixing partner that passed every cut not involving the trigger cluster (track quality, pT > 1 GeV, charged-particle
+// veto against the partner's clusters); the partners' tracks are read and cut once per triggered event, and the cache is paired
+// with every selected cluster of the event
+struct MixedTrack {
+    float pt;
+    float eta;
+    float phi;
+};
+
 // 2D histogram dividing function, fitted with parameters for constructing the quotient histogram
 // Precondition: the two histograms must have the same y- and x-dimensions, and so must the quotient
 TH2D* divide_histograms2D(TH2D* graph1, TH2D* graph2, const char *name, const char *title, Int_t nbinsx, Double_t xlow, Double_t xup, Int_t nbinsy, Double_t ylow, Double_t yup){
-    // Make the 2D histogram to contain the quotient and find minimum and maximum bins along both axes
+    // Make the 2D histogram to contain the quotient, then divide graph 1 by graph 2 with error propagation
     TH2D* quotient = new TH2D(name, title, nbinsx, xlow, xup, nbinsy, ylow, yup);
     quotient->Sumw2();
     quotient->SetMinimum(0.);
-    double x_bin_min = quotient->GetXaxis()->FindBin(quotient->GetXaxis()->GetXmin());
-    double x_bin_max = quotient->GetXaxis()->FindBin(quotient->GetXaxis()->GetXmax());
-    double y_bin_min = quotient->GetYaxis()->FindBin(quotient->GetYaxis()->GetXmin());
-    double y_bin_max = quotient->GetYaxis()->FindBin(quotient->GetYaxis()->GetXmax());
-    
-    // Loop over all bins, divide the element from graph 1 by its counterpart on graph 2. Manually propogate the error
-    for(int i = x_bin_min; i <= x_bin_max; i++)
-        for(int j = y_bin_min; j <= y_bin_max; j++) {
-            if (graph2->GetBinContent(i, j) != 0)
-                quotient->SetBinContent(i, j, (graph1->GetBinContent(i, j))/(graph2->GetBinContent(i, j)));
-            // Failsafe
-            else
-                quotient->SetBinContent(i, j, 0);
-            
-            // Error propogation
-            if (graph2->GetBinContent(i, j) == 0) {
-                if (graph1->GetBinContent(i, j) == 0)
-                    quotient->SetBinError(i, j, 0);
-                else
-                    quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) * (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) ) )));
-            }
-            else if (graph1->GetBinContent(i, j) == 0)
-                quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) * (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) ) )));
-            else
-                quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) * (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) ) + ( (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) * (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) ) )));
-        }
-    
+    hist_divide(quotient, graph1, graph2);
     
     return quotient;
 }
@@ -320,6 +306,8 @@ int main(int argc, char *argv[])
     for (int i = 0; i <= nztbins; i++){
         std::cout << "zt bound: " << ztbins[i] << std::endl;
     }
+    // zt bin of each cluster-track pair, looked up directly rather than by testing every bin
+    const BinLookup zt_lookup = bin_lookup(ztbins, nztbins);
     
     // Create the TCanvas and the histograms
     TCanvas canvas("canvas", "");
@@ -598,11 +586,20 @@ int main(int argc, char *argv[])
         
         Long64_t nentries = _tree_event->GetEntries();
         
+        // Tracks of the 50 mixing partners of the current event, in partner and track order
+        std::vector<MixedTrack> mixed_tracks;
+        mixed_tracks.reserve(50*ntrack_max);
+        // Clusters of the current partner, for the charged-particle veto of its tracks
+        EtaPhiGrid partner_clusters = eta_phi_grid(0.015, 0.015);
+        
         for(Long64_t ievent = 0; ievent < nentries ; ievent++){
             //for(Long64_t ievent = 0; ievent < 1000 ; ievent++){
             _tree_event->GetEntry(ievent);
             fprintf(stderr, "\r%s:%d: %llu / %llu", __FILE__, __LINE__, ievent, nentries);
             
+            // The partners are only read once a cluster of the event is selected, so events without a trigger cost no HDF5 reads
+            bool mixed_tracks_read = false;
+            
             for (ULong64_t n = 0; n < ncluster; n++) {
                 if( not(cluster_pt[n]>pT_min and cluster_pt[n]<pT_max)) continue; //select pt of photons
                 //if( not(cluster_s_nphoton[n][1]>DNN_min and cluster_s_nphoton[n][1]<DNN_max)) continue; //select deep-photons
@@ -631,83 +628,87 @@ int main(int argc, char *argv[])
                         h_ntrig.Fill(0.5);
                     }
                 }
-                // Mixed events
-                for (Long64_t imix = 0; imix < 50; imix++){
-                    Long64_t mix_event = Mix_Events[imix];
-                    if (mix_event == ievent) continue;
+                // Mixed events: read the partners' tracks, and apply the cuts that do not involve this cluster, once per event
+                if (!mixed_tracks_read) {
+                    mixed_tracks.clear();
+                    for (Long64_t imix = 0; imix < 50; imix++){
+                        Long64_t mix_event = Mix_Events[imix];
+                        if (mix_event == ievent) continue;
+                        
+                        //adjust offset for next mixed event
+                        track_offset[0]=mix_event;
+                        track_dataspace.selectHyperslab( H5S_SELECT_SET, track_count, track_offset );
+                        track_dataset.read( track_data_out, PredType::NATIVE_FLOAT, track_memspace, track_dataspace );
+                        
+                        cluster_offset[0]=mix_event;
+                        cluster_dataspace.selectHyperslab( H5S_SELECT_SET, cluster_count, cluster_offset );
+                        cluster_dataset.read( cluster_data_out, PredType::NATIVE_FLOAT, cluster_memspace, cluster_dataspace );
+                        size_t npartner_cluster = 0;
+                        while (npartner_cluster < ncluster_max && !std::isnan(cluster_data_out[0][npartner_cluster][0])) npartner_cluster++;
+                        eta_phi_grid_build(partner_clusters, &cluster_data_out[0][0][2], &cluster_data_out[0][0][3], 5, npartner_cluster);
+                        
+                        for (ULong64_t itrack = 0; itrack < ntrack_max; itrack++) {
+                            if (std::isnan(track_data_out[0][itrack][1])) break;
+                            // The quality bit is taken from the triggered event's track_quality, as it always was
+                            if((track_quality[itrack]&selection_number)==0) continue; //pass 3 cut
+                            //if (track_data_out[0][itrack][1] < 2) continue; //less than 2GeV
+                            if (track_data_out[0][itrack][1] < 1) continue; //less than 1GeV
+                            
+                            //veto charged particles from mixed event tracks: the track's EMCal projection within 0.015 of a cluster
+                            if (eta_phi_grid_match(partner_clusters, track_data_out[0][itrack][5], track_data_out[0][itrack][6]) >= 0) continue;
+                            
+                            MixedTrack track;
+                            track.pt = track_data_out[0][itrack][1];
+                            track.eta = track_data_out[0][itrack][2];
+                            track.phi = track_data_out[0][itrack][3];
+                            mixed_tracks.push_back(track);
+                        }
+                    }
+                    mixed_tracks_read = true;
+                }
+                
+                for (size_t itrack = 0; itrack < mixed_tracks.size(); itrack++) {
+                    const MixedTrack &track = mixed_tracks[itrack];
+                    Float_t DeltaPhi = cluster_phi[n] - track.phi;
+                    if (DeltaPhi < -M_PI/2){DeltaPhi += 2*M_PI;}  //if less then -pi/2 add 2pi
+                    if (DeltaPhi > 3*M_PI/2){DeltaPhi =DeltaPhi -2*M_PI;}
+                    Float_t DeltaEta = cluster_eta[n] - track.eta;
+                    if ((TMath::Abs(DeltaPhi) < 0.005) && (TMath::Abs(DeltaEta) < 0.005)) continue;
                     
-                    //adjust offset for next mixed event
-                    track_offset[0]=mix_event;
-                    track_dataspace.selectHyperslab( H5S_SELECT_SET, track_count, track_offset );
-                    track_dataset.read( track_data_out, PredType::NATIVE_FLOAT, track_memspace, track_dataspace );
+                    //Debugging peak at Deltaphi 2
+                    if(DeltaPhi > 1.8326 && DeltaPhi < 2.3562){
+                        PhiValues->Fill(cluster_phi[n],track.phi);
+                    }
                     
-                    cluster_offset[0]=mix_event;
-                    cluster_dataspace.selectHyperslab( H5S_SELECT_SET, cluster_count, cluster_offset );
-                    cluster_dataset.read( cluster_data_out, PredType::NATIVE_FLOAT, cluster_memspace, cluster_dataspace );
+                    Double_t zt = track.pt/cluster_pt[n];
+                    Float_t deta =  cluster_eta[n]-track.eta;;
+                    Float_t dphi =  TVector2::Phi_mpi_pi(cluster_phi[n]-track.phi);
+                    dphi = dphi/TMath::Pi();
+                    //if(!(TMath::Abs(deta)<0.6)) continue; //deta cut
+                    if(dphi<-0.5) dphi +=2;
                     
-                    const int TrackCutBit =16;
-                    for (ULong64_t itrack = 0; itrack < ntrack_max; itrack++) {
-                        if (std::isnan(track_data_out[0][itrack][1])) break;
-                        if((track_quality[itrack]&selection_number)==0) continue; //pass 3 cut
-                        //if (track_data_out[0][itrack][1] < 2) continue; //less than 2GeV
-                        if (track_data_out[0][itrack][1] < 1) continue; //less than 1GeV
-                        
-                        //veto charged particles from mixed event tracks
-                        bool MixTrack_HasMatch = false;
-                        for (unsigned int l = 0; l < ncluster_max; l++){
-                            if (std::isnan(cluster_data_out[0][l][0])) break;
-                            if (TMath::Abs(cluster_data_out[0][l][2] - track_data_out[0][itrack][5]) < 0.015  &&
-                                TMath::Abs(cluster_data_out[0][l][3] - track_data_out[0][itrack][6]) < 0.015) {
-                                MixTrack_HasMatch = true;
-                                break;
-                            }
+                    // zt bin of the pair
+                    const int izt = bin_lookup_find(zt_lookup, zt);
+                    if (izt < 0) continue;
+                    // Where the  h_dPhi_iso and h_dPhi_noniso bins are filled
+                    if(isolation< iso_max){
+                        if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
+                            h_dPhi_iso_mixed[izt]->Fill(DeltaPhi/M_PI);
+                            IsoMap_mixed[izt]->Fill(DeltaPhi,DeltaEta);
+                            mixed_clusters_passed_iso[izt] += 1;
                         }
-                        if (MixTrack_HasMatch) continue;
-                        //fprintf(stderr, "%s:%d: Mixed Event: %llu Track: %llu\n", __FILE__, __LINE__, mix_event, itrack);
-                        
-                        Float_t DeltaPhi = cluster_phi[n] - track_data_out[0][itrack][3];
-                        if (DeltaPhi < -M_PI/2){DeltaPhi += 2*M_PI;}  //if less then -pi/2 add 2pi
-                        if (DeltaPhi > 3*M_PI/2){DeltaPhi =DeltaPhi -2*M_PI;}
-                        Float_t DeltaEta = cluster_eta[n] - track_data_out[0][itrack][2];
-                        if ((TMath::Abs(DeltaPhi) < 0.005) && (TMath::Abs(DeltaEta) < 0.005)) continue;
-                        
-                        //Debugging peak at Deltaphi 2
-                        if(DeltaPhi > 1.8326 && DeltaPhi < 2.3562){
-                            PhiValues->Fill(cluster_phi[n],track_data_out[0][itrack][3]);
+                    }
+                    if(isolation<iso_max){
+                        if (cluster_s_nphoton[n][1] > 0.0 && cluster_s_nphoton[n][1] < 0.3){ //sel deep photons
+                            h_dPhi_noniso_mixed[izt]->Fill(DeltaPhi/M_PI);
+                            AntiIsoMap_mixed[izt]->Fill(DeltaPhi,DeltaEta);
+                            mixed_clusters_passed_Antiiso[izt] += 1;
                         }
-                        
-                        Double_t zt = track_data_out[0][itrack][1]/cluster_pt[n];
-                        Float_t deta =  cluster_eta[n]-track_data_out[0][itrack][2];;
-                        Float_t dphi =  TVector2::Phi_mpi_pi(cluster_phi[n]-track_data_out[0][itrack][3]);
-                        dphi = dphi/TMath::Pi();
-                        //if(!(TMath::Abs(deta)<0.6)) continue; //deta cut
-                        if(dphi<-0.5) dphi +=2;
-                        
-                        for(int izt = 0; izt<nztbins ; izt++){
-                            if(zt>ztbins[izt] and  zt<ztbins[izt+1])
-                            {
-                                // Where the  h_dPhi_iso and h_dPhi_noniso bins are filled
-                                if(isolation< iso_max){
-                                    if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
-                                        h_dPhi_iso_mixed[izt]->Fill(DeltaPhi/M_PI);
-                                        IsoMap_mixed[izt]->Fill(DeltaPhi,DeltaEta);
-                                        mixed_clusters_passed_iso[izt] += 1;
-                                    }
-                                }
-                                if(isolation<iso_max){
-                                    if (cluster_s_nphoton[n][1] > 0.0 && cluster_s_nphoton[n][1] < 0.3){ //sel deep photons
-                                        h_dPhi_noniso_mixed[izt]->Fill(DeltaPhi/M_PI);
-                                        AntiIsoMap_mixed[izt]->Fill(DeltaPhi,DeltaEta);
-                                        mixed_clusters_passed_Antiiso[izt] += 1;
-                                    }
-                                }
-                                Map_mixed[izt]->Fill(DeltaPhi,DeltaEta);
-                                h_dPhi_all_mixed[izt]->Fill(DeltaPhi/M_PI);
-                                mixed_clusters_passed[izt] += 1;
-                            }//if in zt bin
-                        } // end loop over zt bins
-                    }//end loop over tracks
-                }//end loop over mixed events
+                    }
+                    Map_mixed[izt]->Fill(DeltaPhi,DeltaEta);
+                    h_dPhi_all_mixed[izt]->Fill(DeltaPhi/M_PI);
+                    mixed_clusters_passed[izt] += 1;
+                }//end loop over the mixed tracks
                 
                 // Loop over tracks: for the same events
                 for (ULong64_t itrack = 0; itrack < ntrack; itrack++) {
@@ -727,29 +728,26 @@ int main(int argc, char *argv[])
                     //if(!(TMath::Abs(deta)<deta_max)) continue; // delta eta cut
                     if(dphi<-0.5) dphi +=2;
                     
-                    // Loop over zt bins
-                    for(int izt = 0; izt<nztbins ; izt++){
-                        if(zt>ztbins[izt] and  zt<ztbins[izt+1])
-                        {
-                            // Where the  h_dPhi_iso and h_dPhi_noniso bins are filled, along with all of the maps
-                            if(isolation< iso_max){
-                                if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
-                                    h_dPhi_iso_same[izt]->Fill(DeltaPhi/M_PI);
-                                    IsoMap_same[izt]->Fill(DeltaPhi,DeltaEta);
-                                    same_clusters_passed_iso[izt] += 1;
-                                }
-                            }
-                            if(isolation> noniso_min && isolation<noniso_max){
-                                if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
-                                    h_dPhi_noniso_same[izt]->Fill(DeltaPhi/M_PI);
-                                    AntiIsoMap_same[izt]->Fill(DeltaPhi,DeltaEta);
-                                    same_clusters_passed_Antiiso[izt] += 1;
-                                }
-                            }
-                            Map_same[izt]->Fill(DeltaPhi,DeltaEta);
-                            same_clusters_passed[izt] += 1;
+                    // zt bin of the pair
+                    const int izt = bin_lookup_find(zt_lookup, zt);
+                    if (izt < 0) continue;
+                    // Where the  h_dPhi_iso and h_dPhi_noniso bins are filled, along with all of the maps
+                    if(isolation< iso_max){
+                        if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
+                            h_dPhi_iso_same[izt]->Fill(DeltaPhi/M_PI);
+                            IsoMap_same[izt]->Fill(DeltaPhi,DeltaEta);
+                            same_clusters_passed_iso[izt] += 1;
+                        }
+                    }
+                    if(isolation> noniso_min && isolation<noniso_max){
+                        if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
+                            h_dPhi_noniso_same[izt]->Fill(DeltaPhi/M_PI);
+                            AntiIsoMap_same[izt]->Fill(DeltaPhi,DeltaEta);
+                            same_clusters_passed_Antiiso[izt] += 1;
                         }
-                    } // end loop over bins
+                    }
+                    Map_same[izt]->Fill(DeltaPhi,DeltaEta);
+                    same_clusters_passed[izt] += 1;
                 }//end loop over tracks (same events)
                 
             }//end loop on clusters.
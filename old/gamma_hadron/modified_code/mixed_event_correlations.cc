@@ -16,6 +16,7 @@
 #include <iostream>
 #include <fstream>
 #include "H5Cpp.h"
+#include "../../../general_tools/BinLookup.h"
 
 #define NTRACK_MAX (1U << 14)
 
@@ -215,6 +216,9 @@ int main(int argc, char *argv[])
     std::cout << "zt bound: " << ztbins[i] << std::endl;
   for (int i = 0; i <= nptbins; i++)
     std::cout << "pt bound: " << ptbins[i] << std::endl;
+  // Bins of each cluster and cluster-track pair, looked up directly rather than by testing every bin
+  const BinLookup pt_lookup = bin_lookup(ptbins, nptbins);
+  const BinLookup zt_lookup = bin_lookup(ztbins, nztbins);
 
 
   //HISTOGRAMS
@@ -450,6 +454,10 @@ int main(int argc, char *argv[])
 	else if (determiner == CLUSTER_ISO_ITS_04) isolation = cluster_iso_its_04[n];
 	else if (determiner == CLUSTER_FRIXIONE_TPC_04_02) isolation = cluster_frixione_tpc_04_02[n];
 	else isolation = cluster_frixione_its_04_02[n];
+
+	// Nothing is filled for clusters outside the pt bins, so their mixed events need not be read
+	const int ipt = bin_lookup_find(pt_lookup, cluster_pt[n]);
+	if (ipt < 0) continue;
         
 	for (Long64_t imix = 0; imix < 50; imix++){
 	  Long64_t mix_event = Mix_Events[imix];
@@ -500,26 +508,20 @@ int main(int argc, char *argv[])
 
  	    Double_t zt = track_data_out[0][itrack][1]/cluster_pt[n];
 
-	    for (int ipt = 0; ipt < nptbins; ipt++){
-	      if (cluster_pt[n] >ptbins[ipt] && cluster_pt[n] <ptbins[ipt+1]){
-		for(int izt = 0; izt<nztbins ; izt++){
-		  if(zt>ztbins[izt] and  zt<ztbins[izt+1]){
-
-		    if(isolation< iso_max){
-		      if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
-			IsoCorr[izt+ipt*nztbins]->Fill(DeltaPhi,DeltaEta);
-		      }
-		    }
-		    if(isolation<iso_max){
-		      if (cluster_s_nphoton[n][1] > 0.0 && cluster_s_nphoton[n][1] < 0.3){ //sel deep photons 
-			BKGD_IsoCorr[izt+ipt*nztbins]->Fill(DeltaPhi,DeltaEta);
-		      }
-		    }
-		    Corr[izt+ipt*nztbins]->Fill(DeltaPhi,DeltaEta);
-		  }//if in zt bin
-		} // end loop over zt bins
-	      }//end if in pt bin
-	    }//end pt loop bin
+	    const int izt = bin_lookup_find(zt_lookup, zt);
+	    if (izt < 0) continue;
+
+	    if(isolation< iso_max){
+	      if (cluster_s_nphoton[n][1] > DNN_min && cluster_s_nphoton[n][1] < DNN_max){
+		IsoCorr[izt+ipt*nztbins]->Fill(DeltaPhi,DeltaEta);
+	      }
+	    }
+	    if(isolation<iso_max){
+	      if (cluster_s_nphoton[n][1] > 0.0 && cluster_s_nphoton[n][1] < 0.3){ //sel deep photons 
+		BKGD_IsoCorr[izt+ipt*nztbins]->Fill(DeltaPhi,DeltaEta);
+	      }
+	    }
+	    Corr[izt+ipt*nztbins]->Fill(DeltaPhi,DeltaEta);
 	  }//end loop over tracks
 	}//end loop over mixed events
       }//end loop on clusters. 
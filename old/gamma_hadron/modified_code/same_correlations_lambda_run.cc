@@ -19,6 +19,8 @@
 
 #include <vector>
 #include <math.h>
+#include "../../../general_tools/HistogramAlgebra.h"
+#include "../../../general_tools/BinLookup.h"
 
 const int MAX_INPUT_LENGTH = 200;
 
@@ -27,37 +29,11 @@ enum isolationDet {CLUSTER_ISO_TPC_04, CLUSTER_ISO_ITS_04, CLUSTER_FRIXIONE_TPC_
 // 2D histogram dividing function, fitted with parameters for constructing the quotient histogram
 // Precondition: the two histograms must have the same y- and x-dimensions, and so must the quotient
 TH2D* divide_histograms2D(TH2D* graph1, TH2D* graph2, const char *name, const char *title, Int_t nbinsx, Double_t xlow, Double_t xup, Int_t nbinsy, Double_t ylow, Double_t yup){
-    // Make the 2D histogram to contain the quotient and find minimum and maximum bins along both axes
+    // Make the 2D histogram to contain the quotient, then divide graph 1 by graph 2 with error propagation
     TH2D* quotient = new TH2D(name, title, nbinsx, xlow, xup, nbinsy, ylow, yup);
     quotient->Sumw2();
     quotient->SetMinimum(0.);
-    double x_bin_min = quotient->GetXaxis()->FindBin(quotient->GetXaxis()->GetXmin());
-    double x_bin_max = quotient->GetXaxis()->FindBin(quotient->GetXaxis()->GetXmax());
-    double y_bin_min = quotient->GetYaxis()->FindBin(quotient->GetYaxis()->GetXmin());
-    double y_bin_max = quotient->GetYaxis()->FindBin(quotient->GetYaxis()->GetXmax());
-    
-    // Loop over all bins, divide the element from graph 1 by its counterpart on graph 2. Manually propogate the error
-    for(int i = x_bin_min; i <= x_bin_max; i++)
-        for(int j = y_bin_min; j <= y_bin_max; j++) {
-            if (graph2->GetBinContent(i, j) != 0)
-                quotient->SetBinContent(i, j, (graph1->GetBinContent(i, j))/(graph2->GetBinContent(i, j)));
-            // Failsafe
-            else
-                quotient->SetBinContent(i, j, 0);
-            
-            // Error propogation
-            if (graph2->GetBinContent(i, j) == 0) {
-                if (graph1->GetBinContent(i, j) == 0)
-                    quotient->SetBinError(i, j, 0);
-                else
-                    quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) * (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) ) )));
-            }
-            else if (graph1->GetBinContent(i, j) == 0)
-                quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) * (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) ) )));
-            else
-                quotient->SetBinError(i, j, (quotient->GetBinContent(i, j)*TMath::Sqrt(( (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) * (graph1->GetBinError(i, j)/graph1->GetBinContent(i, j)) ) + ( (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) * (graph2->GetBinError(i, j)/graph2->GetBinContent(i, j)) ) )));
-        }
-    
+    hist_divide(quotient, graph1, graph2);
     
     return quotient;
 }
@@ -355,6 +331,8 @@ int main(int argc, char *argv[])
         // Zt bins
         //const int nztbins = 7;
         //const float ztbins[nztbins+1] = {0.0, 0.1, 0.2, 0.4, 0.6, 0.8, 1.0, 1.2};
+        // zt bin of each cluster-track pair, looked up directly rather than by testing every bin
+        const BinLookup zt_lookup = bin_lookup(ztbins, nztbins);
         
         // Function declarations of the correlation functions
         TH1F* h_dPhi_signal[nztbins];
@@ -553,22 +531,19 @@ int main(int argc, char *argv[])
                     Float_t DeltaEta = cluster_eta[n] - track_eta[itrack];
                     if ((TMath::Abs(DeltaPhi) < 0.005) && (TMath::Abs(DeltaEta) < 0.005)) continue; //Match Mixing Cut
                     
-                    // Loop over zt bins
-                    for(int izt = 0; izt<nztbins ; izt++){
-                        if(zt>ztbins[izt] and  zt<ztbins[izt+1])
-                        {
-                            // Where the  h_dPhi_iso and h_dPhi_noniso bins are filled
-                            //if(isolation< iso_max)
-                            h_dPhi_signal[izt]->Fill(dphi);
-                            Map_signal[izt]->Fill(dphi, deta);
-                            signal_numofphotons[izt] += 1;
-                            //if(isolation> noniso_min && isolation<noniso_max) {
-                            //h_dPhi_background[izt]->Fill(dphi);
-                            //Map_background[izt]->Fill(dphi, deta);
-                            //background_numofphotons[izt] += 1;
-                            //}
-                        }
-                    } // end loop over bins
+                    // zt bin of the pair
+                    const int izt = bin_lookup_find(zt_lookup, zt);
+                    if (izt < 0) continue;
+                    // Where the  h_dPhi_iso and h_dPhi_noniso bins are filled
+                    //if(isolation< iso_max)
+                    h_dPhi_signal[izt]->Fill(dphi);
+                    Map_signal[izt]->Fill(dphi, deta);
+                    signal_numofphotons[izt] += 1;
+                    //if(isolation> noniso_min && isolation<noniso_max) {
+                    //h_dPhi_background[izt]->Fill(dphi);
+                    //Map_background[izt]->Fill(dphi, deta);
+                    //background_numofphotons[izt] += 1;
+                    //}
                 }//end loop over tracks
                 
             }//end loop on clusters.